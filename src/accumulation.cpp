@@ -0,0 +1,152 @@
+#include "accumulation.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cassert>
+
+using namespace agl;
+using namespace std;
+
+// rows per task of the parallel loops
+static const int kRowGrain = 32;
+
+// the radical inverse of i in the given base, in [0, 1)
+static float radical_inverse(int i, int base)
+{
+   float result = 0.0f;
+   float digit = 1.0f / base;
+   for (; i > 0; i /= base, digit /= base)
+   {
+      result += (i % base) * digit;
+   }
+   return result;
+}
+
+accumulation_buffer::accumulation_buffer(int width, int height) : _sums(width, height), _weight(0), _passes(0)
+{
+}
+
+int accumulation_buffer::width() const
+{
+   return _sums.width();
+}
+
+int accumulation_buffer::height() const
+{
+   return _sums.height();
+}
+
+void accumulation_buffer::clear()
+{
+   fill(_sums.data(), _sums.data() + static_cast<size_t>(width()) * height() * 3, 0.0f);
+   _weight = 0;
+   _passes = 0;
+}
+
+void accumulation_buffer::add(const ppm_image& image, float weight)
+{
+   assert((image.width() == width() && image.height() == height()) && "The pass has to be the size of the buffer!");
+   size_t stride = static_cast<size_t>(width()) * 3;
+   float scale = weight / 255.0f;
+   const int* src = image.data();
+   float* sums = _sums.data();
+   parallel_for(0, height(), kRowGrain, [&](int first, int last) {
+      for (size_t x = first * stride; x < last * stride; x++)
+      {
+         sums[x] += static_cast<float>(src[x]) * scale;
+      }
+   });
+   _weight += weight;
+   _passes++;
+}
+
+void accumulation_buffer::blend(const ppm_image& image, float alpha)
+{
+   assert((image.width() == width() && image.height() == height()) && "The layer has to be the size of the buffer!");
+   assert((alpha >= 0 && alpha <= 1) && "alpha has to be in [0, 1]!");
+   if (_weight == 0)
+   {
+      _weight = 1.0f;
+   }
+   // keep the sums a weighted total: the layer counts with the weight of everything under it
+   size_t stride = static_cast<size_t>(width()) * 3;
+   float keep = 1.0f - alpha;
+   float scale = alpha * _weight / 255.0f;
+   const int* src = image.data();
+   float* sums = _sums.data();
+   parallel_for(0, height(), kRowGrain, [&](int first, int last) {
+      for (size_t x = first * stride; x < last * stride; x++)
+      {
+         sums[x] = sums[x] * keep + static_cast<float>(src[x]) * scale;
+      }
+   });
+   _passes++;
+}
+
+int accumulation_buffer::passes() const
+{
+   return _passes;
+}
+
+float accumulation_buffer::weight() const
+{
+   return _weight;
+}
+
+ppm_image accumulation_buffer::resolve(float exposure, Tonemap tonemap) const
+{
+   ppm_image result(width(), height());
+   size_t stride = static_cast<size_t>(width()) * 3;
+   float scale = (_weight > 0) ? exposure / _weight : 0.0f;
+   const float* sums = _sums.data();
+   int* out = result.data();
+   parallel_for(0, height(), kRowGrain, [&](int first, int last) {
+      if (tonemap == TONEMAP_REINHARD)
+      {
+         for (size_t x = first * stride; x < last * stride; x++)
+         {
+            float v = max(0.0f, sums[x] * scale);
+            out[x] = static_cast<int>(v / (1.0f + v) * 255.0f + 0.5f);
+         }
+      }
+      else
+      {
+         for (size_t x = first * stride; x < last * stride; x++)
+         {
+            float v = min(255.0f, max(0.0f, sums[x] * scale * 255.0f + 0.5f));
+            out[x] = static_cast<int>(v);
+         }
+      }
+   });
+   return result;
+}
+
+bool accumulation_buffer::save(const std::string& filename, float exposure, Tonemap tonemap) const
+{
+   return resolve(exposure, tonemap).save(filename);
+}
+
+void accumulation_buffer::supersample(canvas& drawer, int passes, const std::function<void(canvas&)>& draw)
+{
+   assert((drawer.width() == width() && drawer.height() == height()) && "The canvas has to be the size of the buffer!");
+   for (int pass = 0; pass < passes; pass++)
+   {
+      float dx, dy;
+      jitter(pass, dx, dy);
+      drawer.sample_offset(dx, dy);
+      draw(drawer);
+      add(drawer.image());
+   }
+   drawer.sample_offset(0, 0);
+}
+
+void accumulation_buffer::jitter(int pass, float& dx, float& dy)
+{
+   // index 0 of the sequence is the corner; start at 1 so the first pass samples near the center
+   dx = radical_inverse(pass + 1, 2) - 0.5f;
+   dy = radical_inverse(pass + 1, 3) - 0.5f;
+}
+
+const rgbf32_image& accumulation_buffer::sums() const
+{
+   return _sums;
+}
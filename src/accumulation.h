@@ -0,0 +1,68 @@
+//----------------------------------------
+// Float accumulation buffer
+// Author: Jiajie(Jason) Ma
+//----------------------------------------
+
+#pragma once
+#include <functional>
+#include <string>
+#include "canvas.h"
+#include "pixel_image.h"
+
+namespace agl
+{
+  // How resolve maps the accumulated colors to 8 bits: clamp to [0, 255], or the Reinhard curve
+  // x / (1 + x), which compresses bright values instead of clipping them
+  enum Tonemap {TONEMAP_CLAMP, TONEMAP_REINHARD};
+
+  // Sums weighted passes of a render in float (rgbf32), so layering and averaging images rounds once,
+  // in resolve, instead of after every pass. Supersampling adds passes drawn with jittered sample
+  // offsets; motion blur adds the frames of a time step.
+  class accumulation_buffer
+  {
+  public:
+     accumulation_buffer(int width, int height);
+
+     // return the size of the buffer
+     int width() const;
+     int height() const;
+
+     // forget all the passes
+     void clear();
+
+     // Add image (the same size as the buffer) as a pass with the given weight
+     void add(const ppm_image& image, float weight = 1.0f);
+
+     // Composite image over the accumulated result with opacity alpha in [0, 1], without rounding
+     // (over black if nothing was added yet)
+     void blend(const ppm_image& image, float alpha);
+
+     // return the number of passes added and their total weight
+     int passes() const;
+     float weight() const;
+
+     // Return the weighted average of the passes times exposure, tonemapped and rounded to 8 bits.
+     // Rows are resolved in parallel
+     ppm_image resolve(float exposure = 1.0f, Tonemap tonemap = TONEMAP_CLAMP) const;
+
+     // save resolve() in png file format
+     // returns true if the save is successful; false otherwise
+     bool save(const std::string& filename, float exposure = 1.0f, Tonemap tonemap = TONEMAP_CLAMP) const;
+
+     // Supersample: call draw(drawer) passes times, each time with the next jitter offset as the sample
+     // offset of drawer (which has to be the size of the buffer), and add each result as a pass
+     void supersample(canvas& drawer, int passes, const std::function<void(canvas&)>& draw);
+
+     // the sample offset of the given pass: the (2, 3) Halton sequence, moved to [-0.5, 0.5)^2, which
+     // covers the pixel evenly for any number of passes
+     static void jitter(int pass, float& dx, float& dy);
+
+     // return the accumulated sums (1 for 255 times the weight)
+     const rgbf32_image& sums() const;
+
+  private:
+     rgbf32_image _sums;
+     float _weight;
+     int _passes;
+  };
+}
@@ -0,0 +1,252 @@
+#include "animation.h"
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+using namespace agl;
+using namespace std;
+
+typedef chrono::steady_clock timer;
+
+static double seconds_since(timer::time_point start)
+{
+   return chrono::duration<double>(timer::now() - start).count();
+}
+
+// find the rows of cur that differ from prev: scan down from the top and up from the bottom
+// to the first different row, so an unchanged frame costs one pass of memcmp
+static void changed_rows(const ppm_image& prev, const ppm_image& cur, frame_info& info)
+{
+   size_t stride = static_cast<size_t>(cur.width()) * 3;
+   const int* a = prev.data();
+   const int* b = cur.data();
+   int first = 0;
+   while (first < cur.height() && memcmp(a + first * stride, b + first * stride, stride * sizeof(int)) == 0)
+   {
+      first++;
+   }
+   int last = cur.height();
+   while (last > first && memcmp(a + (last - 1) * stride, b + (last - 1) * stride, stride * sizeof(int)) == 0)
+   {
+      last--;
+   }
+   info.changed = (first < last);
+   info.first_row = first;
+   info.last_row = last;
+}
+
+static bool copy_file(const string& from, const string& to)
+{
+   ifstream in(from.c_str(), ios::binary);
+   ofstream out(to.c_str(), ios::binary);
+   if (!in || !out)
+   {
+      return false;
+   }
+   out << in.rdbuf();
+   return static_cast<bool>(out);
+}
+
+animation::animation(int width, int height, int buffers) :
+   _w(width), _h(height), _detect(true), _draw_seconds(0), _encode_seconds(0), _total_seconds(0), _unchanged(0)
+{
+   assert((buffers >= 2) && "An animation needs at least two buffers!");
+   for (int i = 0; i < buffers; i++)
+   {
+      _buffers.push_back(unique_ptr<canvas>(new canvas(width, height)));
+   }
+}
+
+animation::~animation()
+{
+}
+
+int animation::width() const
+{
+   return _w;
+}
+
+int animation::height() const
+{
+   return _h;
+}
+
+void animation::detect_changes(bool enabled)
+{
+   _detect = enabled;
+}
+
+void animation::render(int count, const function<void(int, canvas&)>& draw,
+   const function<void(const frame_info&, const ppm_image&)>& encode)
+{
+   timer::time_point start = timer::now();
+   _draw_seconds = 0;
+   _encode_seconds = 0;
+   _unchanged = 0;
+
+   // buffers go round from the free list to the drawing thread, to the ready queue, to the encode
+   // thread and back; with change detection the encoder keeps the previous frame one frame longer
+   mutex lock;
+   condition_variable wake;
+   deque<int> free_buffers;
+   deque<int> ready;
+   for (int b = 0; b < static_cast<int>(_buffers.size()); b++)
+   {
+      free_buffers.push_back(b);
+   }
+   // set when draw or encode threw: both stages stop, and the first exception goes to the caller
+   bool stop = false;
+   exception_ptr failure;
+
+   thread encoder([&]() {
+      int previous = -1;
+      for (int index = 0; index < count; index++)
+      {
+         int b;
+         {
+            unique_lock<mutex> guard(lock);
+            wake.wait(guard, [&]() { return !ready.empty() || stop; });
+            if (stop)
+            {
+               return;
+            }
+            b = ready.front();
+            ready.pop_front();
+         }
+
+         try
+         {
+            timer::time_point begin = timer::now();
+            const ppm_image& image = _buffers[b]->image();
+            frame_info info = {index, true, 0, _h};
+            if (_detect && previous >= 0)
+            {
+               changed_rows(_buffers[previous]->image(), image, info);
+               _unchanged += info.changed ? 0 : 1;
+            }
+            encode(info, image);
+            _encode_seconds += seconds_since(begin);
+         }
+         catch (...)
+         {
+            unique_lock<mutex> guard(lock);
+            failure = current_exception();
+            stop = true;
+            wake.notify_all();
+            return;
+         }
+
+         unique_lock<mutex> guard(lock);
+         if (previous >= 0)
+         {
+            free_buffers.push_back(previous);
+         }
+         previous = b;
+         if (!_detect)
+         {
+            free_buffers.push_back(b);
+            previous = -1;
+         }
+         wake.notify_all();
+      }
+   });
+
+   for (int index = 0; index < count; index++)
+   {
+      int b;
+      {
+         unique_lock<mutex> guard(lock);
+         wake.wait(guard, [&]() { return !free_buffers.empty() || stop; });
+         if (stop)
+         {
+            break;
+         }
+         b = free_buffers.front();
+         free_buffers.pop_front();
+      }
+
+      try
+      {
+         timer::time_point begin = timer::now();
+         draw(index, *_buffers[b]);
+         _draw_seconds += seconds_since(begin);
+      }
+      catch (...)
+      {
+         // the encoder has to be joined before the exception leaves, or its thread terminates the program
+         {
+            unique_lock<mutex> guard(lock);
+            stop = true;
+            wake.notify_all();
+         }
+         encoder.join();
+         throw;
+      }
+
+      unique_lock<mutex> guard(lock);
+      ready.push_back(b);
+      wake.notify_all();
+   }
+
+   encoder.join();
+   _total_seconds = seconds_since(start);
+   if (failure)
+   {
+      rethrow_exception(failure);
+   }
+}
+
+bool animation::render(int count, const function<void(int, canvas&)>& draw, const string& pattern)
+{
+   bool ppm = pattern.size() >= 4 && pattern.compare(pattern.size() - 4, 4, ".ppm") == 0;
+   bool success = true;
+   string previous;
+   render(count, draw, [&](const frame_info& info, const ppm_image& image) {
+      char name[1024];
+      snprintf(name, sizeof(name), pattern.c_str(), info.index);
+      bool saved;
+      if (!info.changed)
+      {
+         saved = copy_file(previous, name);
+      }
+      else
+      {
+         saved = ppm ? image.save_ppm(name) : image.save(name);
+      }
+      if (!saved)
+      {
+         cout << "ERROR: Cannot write frame: " << name << endl << endl;
+         success = false;
+      }
+      previous = name;
+   });
+   return success;
+}
+
+double animation::draw_seconds() const
+{
+   return _draw_seconds;
+}
+
+double animation::encode_seconds() const
+{
+   return _encode_seconds;
+}
+
+double animation::total_seconds() const
+{
+   return _total_seconds;
+}
+
+int animation::unchanged_frames() const
+{
+   return _unchanged;
+}
@@ -0,0 +1,75 @@
+//----------------------------------------
+// Pipelined animation renderer
+// Author: Jiajie(Jason) Ma
+//----------------------------------------
+
+#pragma once
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "canvas.h"
+
+namespace agl
+{
+  // What changed in a frame since the frame before it
+  struct frame_info
+  {
+     int index; // frame number
+     bool changed; // false if the frame is identical to the previous one
+     int first_row; // all the changed pixels are in the rows [first_row, last_row)
+     int last_row;
+  };
+
+  // Renders a sequence of frames as a two-stage pipeline: while frame n is encoded on a dedicated
+  // thread, frame n + 1 is drawn on the calling thread, so a frame takes as long as the slower of
+  // the two stages instead of their sum. The frames are drawn into a fixed pool of canvases that
+  // are reused from frame to frame; drawing waits when all of them are in flight.
+  class animation
+  {
+  public:
+     // frames are width x height; buffers canvases (at least 2) are allocated once
+     animation(int width, int height, int buffers = 3);
+     virtual ~animation();
+
+     // return the size of the frames
+     int width() const;
+     int height() const;
+
+     // Compare every frame with the previous one on the encode thread and report the changed rows in
+     // frame_info (on by default). Otherwise every frame is reported as changed in all its rows
+     void detect_changes(bool enabled);
+
+     // Render the frames [0, count): draw(index, drawer) draws frame index (the canvas still holds an
+     // older frame, so it should start with background), then encode(info, image) is called with the
+     // pixels of the frame on the encode thread. Frames are encoded in order. If draw or encode throws,
+     // both stages stop and the exception is thrown to the caller once the encode thread is joined
+     void render(int count, const std::function<void(int, canvas&)>& draw,
+        const std::function<void(const frame_info&, const ppm_image&)>& encode);
+
+     // Render the frames [0, count) to files named after the printf pattern with the frame number,
+     // e.g. "frame-%04d.png" (png files, or ppm files if the pattern ends with ".ppm"). An unchanged
+     // frame is a copy of the previous file instead of being encoded again.
+     // returns true if all the files were written; false otherwise
+     bool render(int count, const std::function<void(int, canvas&)>& draw, const std::string& pattern);
+
+     // seconds spent in draw and in encode (including the comparison) during the last render,
+     // and the wall-clock time of the whole render
+     double draw_seconds() const;
+     double encode_seconds() const;
+     double total_seconds() const;
+
+     // number of frames of the last render that were identical to the previous one
+     int unchanged_frames() const;
+
+  private:
+     int _w;
+     int _h;
+     std::vector<std::unique_ptr<canvas> > _buffers;
+     bool _detect;
+     double _draw_seconds;
+     double _encode_seconds;
+     double _total_seconds;
+     int _unchanged;
+  };
+}
@@ -0,0 +1,94 @@
+#include "batch.h"
+#include "parallel.h"
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+
+using namespace agl;
+using namespace std;
+
+batch_runner::batch_runner(int threads, size_t memory_budget) : _threads(threads > 0 ? threads : worker_count()), _budget(memory_budget)
+{
+}
+
+int batch_runner::threads() const
+{
+   return _threads;
+}
+
+size_t batch_runner::canvas_bytes(int width, int height)
+{
+   return static_cast<size_t>(width) * height * 3 * sizeof(int);
+}
+
+vector<job_timing> batch_runner::run(const vector<render_job>& jobs)
+{
+   vector<job_timing> timings(jobs.size());
+   int workers = max(1, min(_threads, static_cast<int>(jobs.size())));
+
+   // jobs are handed out in order; used counts the bytes of the canvases held by the workers
+   mutex lock;
+   condition_variable room;
+   size_t next = 0;
+   size_t used = 0;
+
+   // the workers are pool threads, so parallel loops inside a job run inline instead of
+   // competing with the other jobs for the global pool. The pool joins them at the end of the block
+   {
+      thread_pool pool(workers);
+      for (int w = 0; w < workers; w++)
+      {
+         pool.submit([&, w]() {
+            unique_ptr<canvas> drawer;
+            size_t held = 0;
+            for (;;)
+            {
+               size_t j;
+               {
+                  unique_lock<mutex> guard(lock);
+                  if (next == jobs.size())
+                  {
+                     break;
+                  }
+                  j = next++;
+                  const render_job& job = jobs[j];
+                  if (!drawer || drawer->width() != job.width || drawer->height() != job.height)
+                  {
+                     // give back the old canvas before waiting, so that waiting workers never hold
+                     // memory the others are waiting for
+                     size_t bytes = canvas_bytes(job.width, job.height);
+                     drawer.reset();
+                     used -= held;
+                     held = 0;
+                     room.notify_all();
+                     room.wait(guard, [&]() { return _budget == 0 || used == 0 || used + bytes <= _budget; });
+                     used += bytes;
+                     held = bytes;
+                     guard.unlock();
+                     drawer.reset(new canvas(job.width, job.height));
+                  }
+               }
+
+               const render_job& job = jobs[j];
+               chrono::steady_clock::time_point start = chrono::steady_clock::now();
+               // a reused canvas must not pass on the colors, depth test or multisampling of the last job
+               drawer->reset();
+               job.draw(*drawer);
+               if (!job.output.empty())
+               {
+                  drawer->save(job.output);
+               }
+               timings[j].output = job.output;
+               timings[j].worker = w;
+               timings[j].seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            }
+
+            unique_lock<mutex> guard(lock);
+            used -= held;
+            room.notify_all();
+         });
+      }
+   }
+   return timings;
+}
@@ -0,0 +1,56 @@
+//----------------------------------------
+// Batch rendering
+// Author: Jiajie(Jason) Ma
+//----------------------------------------
+
+#pragma once
+#include <functional>
+#include <string>
+#include <vector>
+#include "canvas.h"
+
+namespace agl
+{
+  // An independent render: draw(drawer) draws on a width x height canvas, which is then saved to
+  // output (unless it is empty). The canvas starts in the state of a new canvas (see canvas::reset)
+  // but may hold the pixels of an earlier job, so draw should start with background
+  struct render_job
+  {
+     std::string output;
+     int width;
+     int height;
+     std::function<void(canvas&)> draw;
+  };
+
+  // How a job went
+  struct job_timing
+  {
+     std::string output;
+     int worker; // the worker that ran the job
+     double seconds; // time to draw and save the job
+  };
+
+  // Runs render jobs on a set of workers. Every worker keeps its canvas from one job to the next as
+  // long as the size does not change. The canvases held by the workers must fit in the memory
+  // budget: a worker waits until there is room for a new canvas (a job that does not fit at all
+  // still runs, alone)
+  class batch_runner
+  {
+  public:
+     // threads workers (worker_count() if 0) and a budget in bytes for the canvases (0: no limit)
+     batch_runner(int threads = 0, size_t memory_budget = 0);
+
+     // return the number of workers
+     int threads() const;
+
+     // Run the jobs and return their timings, in the order of the jobs. Jobs start in order
+     std::vector<job_timing> run(const std::vector<render_job>& jobs);
+
+     // bytes of pixels taken by a width x height canvas
+     static size_t canvas_bytes(int width, int height);
+
+  private:
+     int _threads;
+     size_t _budget;
+  };
+}
@@ -0,0 +1,150 @@
+#include "buffer_pool.h"
+#include <new>
+
+using namespace agl;
+using namespace std;
+
+// smallest block, and the first power of two whose blocks are not cached
+static const int kMinShift = 6;
+static const int kMaxShift = 40;
+static const int kClasses = (kMaxShift - kMinShift) * 4 + 1;
+
+// raise counter to at least value
+static void raise_to(atomic<size_t>& counter, size_t value)
+{
+   size_t seen = counter.load();
+   while (value > seen && !counter.compare_exchange_weak(seen, value))
+   {
+   }
+}
+
+buffer_pool::buffer_pool(size_t max_cached) :
+   _max_cached(max_cached), _classes(kClasses), _hits(0), _misses(0), _bytes(0), _peak_bytes(0), _cached_bytes(0)
+{
+}
+
+buffer_pool::~buffer_pool()
+{
+   trim();
+}
+
+int buffer_pool::class_of(size_t& bytes)
+{
+   if (bytes <= (static_cast<size_t>(1) << kMinShift))
+   {
+      bytes = static_cast<size_t>(1) << kMinShift;
+      return 0;
+   }
+
+   // 2^e < bytes <= 2^(e+1), split in four steps of 2^e / 4
+   int e = kMinShift;
+   while ((static_cast<size_t>(2) << e) < bytes)
+   {
+      e++;
+   }
+   if (e >= kMaxShift)
+   {
+      return -1;
+   }
+   size_t base = static_cast<size_t>(1) << e;
+   size_t step = base / 4;
+   size_t q = (bytes - base + step - 1) / step;
+   bytes = base + q * step;
+   return (e - kMinShift) * 4 + static_cast<int>(q);
+}
+
+// return the size of the blocks of class c
+static size_t class_size(int c)
+{
+   if (c == 0)
+   {
+      return static_cast<size_t>(1) << kMinShift;
+   }
+   size_t base = static_cast<size_t>(1) << ((c - 1) / 4 + kMinShift);
+   return base + ((c - 1) % 4 + 1) * (base / 4);
+}
+
+void* buffer_pool::acquire(size_t bytes)
+{
+   int c = class_of(bytes);
+   void* block = 0;
+   if (c >= 0)
+   {
+      size_class& free = _classes[c];
+      lock_guard<mutex> guard(free.lock);
+      if (!free.blocks.empty())
+      {
+         block = free.blocks.back();
+         free.blocks.pop_back();
+      }
+   }
+
+   if (block)
+   {
+      _hits++;
+      _cached_bytes -= bytes;
+   }
+   else
+   {
+      _misses++;
+      block = ::operator new(bytes);
+   }
+   raise_to(_peak_bytes, _bytes += bytes);
+   return block;
+}
+
+void buffer_pool::release(void* block, size_t bytes)
+{
+   if (!block)
+   {
+      return;
+   }
+   int c = class_of(bytes);
+   _bytes -= bytes;
+
+   // keep the block unless the cache is full
+   if (c >= 0 && _cached_bytes.fetch_add(bytes) + bytes <= _max_cached)
+   {
+      size_class& free = _classes[c];
+      lock_guard<mutex> guard(free.lock);
+      free.blocks.push_back(block);
+      return;
+   }
+   if (c >= 0)
+   {
+      _cached_bytes -= bytes;
+   }
+   ::operator delete(block);
+}
+
+void buffer_pool::trim()
+{
+   for (int c = 0; c < kClasses; c++)
+   {
+      size_class& free = _classes[c];
+      lock_guard<mutex> guard(free.lock);
+      for (size_t b = 0; b < free.blocks.size(); b++)
+      {
+         ::operator delete(free.blocks[b]);
+      }
+      _cached_bytes -= free.blocks.size() * class_size(c);
+      free.blocks.clear();
+   }
+}
+
+allocator_stats buffer_pool::stats() const
+{
+   allocator_stats result;
+   result.hits = _hits;
+   result.misses = _misses;
+   result.bytes = _bytes;
+   result.peak_bytes = _peak_bytes;
+   result.cached_bytes = _cached_bytes;
+   return result;
+}
+
+buffer_pool& buffer_pool::global()
+{
+   static buffer_pool* pool = new buffer_pool();
+   return *pool;
+}
@@ -0,0 +1,112 @@
+//----------------------------------------
+// Pooled pixel buffers
+// Author: Jiajie(Jason) Ma
+//----------------------------------------
+
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace agl
+{
+  // Counters of an allocator
+  struct allocator_stats
+  {
+     uint64_t hits; // requests served from memory the allocator already had
+     uint64_t misses; // requests that had to allocate new memory
+     size_t bytes; // bytes handed out and not returned yet
+     size_t peak_bytes; // maximum of bytes so far
+     size_t cached_bytes; // bytes kept for reuse
+  };
+
+  // A cache of memory blocks sorted in size classes (four per power of two, so at most 25% of a block
+  // is wasted). Released blocks are kept in the free list of their class, up to max_cached bytes in
+  // total, and handed out again to the next request of the same class. Every class has its own lock,
+  // so threads allocating different sizes do not wait on each other. Thread safe.
+  class buffer_pool
+  {
+  public:
+     explicit buffer_pool(size_t max_cached = 256 << 20);
+     virtual ~buffer_pool();
+
+     // return a block of at least bytes bytes (16-byte aligned, not initialized)
+     void* acquire(size_t bytes);
+
+     // give back a block returned by acquire(bytes)
+     void release(void* block, size_t bytes);
+
+     // free all the cached blocks
+     void trim();
+
+     // return the counters of the pool
+     allocator_stats stats() const;
+
+     // the pool used by ppm_image and the filters. It is never destroyed, so images in static
+     // storage can still release their pixels at exit
+     static buffer_pool& global();
+
+  private:
+     // the free blocks of one size class
+     struct size_class
+     {
+        std::mutex lock;
+        std::vector<void*> blocks;
+     };
+
+     // return the class of bytes and round bytes up to the size of the class
+     static int class_of(size_t& bytes);
+
+     size_t _max_cached;
+     std::vector<size_class> _classes;
+     std::atomic<uint64_t> _hits;
+     std::atomic<uint64_t> _misses;
+     std::atomic<size_t> _bytes;
+     std::atomic<size_t> _peak_bytes;
+     std::atomic<size_t> _cached_bytes;
+  };
+
+  // A fixed-size array of T (trivial types only) whose storage comes from a buffer_pool, for the
+  // temporaries of the filters
+  template <class T>
+  class pooled_array
+  {
+  public:
+     // n values, not initialized
+     explicit pooled_array(size_t n, buffer_pool& pool = buffer_pool::global()) :
+        _pool(pool), _size(n), _data(static_cast<T*>(pool.acquire(n * sizeof(T))))
+     {
+     }
+
+     // n copies of value
+     pooled_array(size_t n, const T& value, buffer_pool& pool = buffer_pool::global()) :
+        _pool(pool), _size(n), _data(static_cast<T*>(pool.acquire(n * sizeof(T))))
+     {
+        for (size_t i = 0; i < n; i++)
+        {
+           _data[i] = value;
+        }
+     }
+
+     ~pooled_array()
+     {
+        _pool.release(_data, _size * sizeof(T));
+     }
+
+     T* data() { return _data; }
+     const T* data() const { return _data; }
+     size_t size() const { return _size; }
+     T& operator[](size_t i) { return _data[i]; }
+     const T& operator[](size_t i) const { return _data[i]; }
+
+  private:
+     pooled_array(const pooled_array&);
+     pooled_array& operator=(const pooled_array&);
+
+     buffer_pool& _pool;
+     size_t _size;
+     T* _data;
+  };
+}
@@ -1,7 +1,10 @@
 #include "canvas.h"
+#include "image_writer.h"
+#include "spatial_index.h"
 #include <cassert>
 #include <cmath>
 #include <iostream>
+#include <utility>
 
 using namespace std;
 using namespace agl;
@@ -59,11 +62,29 @@ point clamp(point p, int w, int h)
    return p;
 }
 
-canvas::canvas(int w, int h) : _canvas(w, h)
+canvas::canvas(int w, int h) : _canvas(w, h), _id(-1),
+   _arena(), _vertices(arena_allocator<point>(_arena)), _centers(arena_allocator<point>(_arena)),
+   _orientations(arena_allocator<point>(_arena)), _radii(arena_allocator<int>(_arena)), _sides(arena_allocator<int>(_arena)),
+   _angles(arena_allocator<float>(_arena)),
+   _vertex_depths(arena_allocator<float>(_arena)), _center_depths(arena_allocator<float>(_arena)),
+   _point_size(1), _point_shape(SQUARE), _sample_dx(0), _sample_dy(0), _z(0)
 {
+   _triangle_z[0] = _triangle_z[1] = _triangle_z[2] = 0;
    // no need to check the legality of w, h as iit is handled by ppm_image class
 }
 
+canvas::canvas(int w, int h, int tile_size, size_t cache_bytes, const std::string& scratch) :
+   _canvas(1, 1), _tiles(new tiled_image(w, h, tile_size, cache_bytes, scratch)), _id(-1),
+   _arena(), _vertices(arena_allocator<point>(_arena)), _centers(arena_allocator<point>(_arena)),
+   _orientations(arena_allocator<point>(_arena)), _radii(arena_allocator<int>(_arena)), _sides(arena_allocator<int>(_arena)),
+   _angles(arena_allocator<float>(_arena)),
+   _vertex_depths(arena_allocator<float>(_arena)), _center_depths(arena_allocator<float>(_arena)),
+   _point_size(1), _point_shape(SQUARE), _sample_dx(0), _sample_dy(0), _z(0)
+{
+   _triangle_z[0] = _triangle_z[1] = _triangle_z[2] = 0;
+   // the 1x1 _canvas is unused; every pixel lives in _tiles
+}
+
 canvas::~canvas()
 {
    // nothing to free as it is handled by ppm_image class
@@ -71,7 +92,105 @@ canvas::~canvas()
 
 void canvas::save(const std::string& filename)
 {
-   _canvas.save_ppm(filename);
+   if (_tiles)
+   {
+      _tiles->save_ppm(filename);
+   }
+   else
+   {
+      _canvas.save_ppm(filename);
+   }
+}
+
+shared_future<bool> canvas::save_async(const std::string& filename)
+{
+   if (_tiles)
+   {
+      promise<bool> done;
+      done.set_value(_tiles->save_ppm(filename));
+      return done.get_future().share();
+   }
+   return image_writer::global().submit(_canvas, [filename](const ppm_image& snapshot) {
+      return snapshot.save_ppm(filename);
+   });
+}
+
+int canvas::width() const
+{
+   return _tiles ? _tiles->width() : _canvas.width();
+}
+
+int canvas::height() const
+{
+   return _tiles ? _tiles->height() : _canvas.height();
+}
+
+const ppm_image& canvas::image() const
+{
+   assert(!_tiles && "An out-of-core canvas has no image in memory!");
+   return _canvas;
+}
+
+void canvas::plot(int row, int col, const ppm_pixel& c)
+{
+   mark(row, col);
+   if (_samples)
+   {
+      _samples->write(_canvas, row, col, _samples->full_mask(), c);
+   }
+   else if (_tiles)
+   {
+      _tiles->set(row, col, c);
+   }
+   else
+   {
+      _canvas.set(row, col, c);
+   }
+}
+
+void canvas::mark(int row, int col)
+{
+   if (_index)
+   {
+      _ids[static_cast<size_t>(row) * width() + col] = _id;
+   }
+}
+
+template <class F>
+void canvas::visit_box(int xmin, int ymin, int xmax, int ymax, F visit)
+{
+   // pixels off the canvas are never drawn, so only the visible part of the box is walked
+   xmin = max(xmin, 0);
+   ymin = max(ymin, 0);
+   xmax = min(xmax, width() - 1);
+   ymax = min(ymax, height() - 1);
+   if (!_tiles)
+   {
+      for (int i = ymin; i <= ymax; i++)
+      {
+         for (int j = xmin; j <= xmax; j++)
+         {
+            visit(i, j);
+         }
+      }
+      return;
+   }
+
+   // walk the box tile by tile
+   int tile = _tiles->tile_size();
+   for (int ty = ymin / tile; ymin <= ymax && ty <= ymax / tile; ty++)
+   {
+      for (int tx = xmin / tile; xmin <= xmax && tx <= xmax / tile; tx++)
+      {
+         for (int i = max(ymin, ty * tile); i <= min(ymax, ty * tile + tile - 1); i++)
+         {
+            for (int j = max(xmin, tx * tile); j <= min(xmax, tx * tile + tile - 1); j++)
+            {
+               visit(i, j);
+            }
+         }
+      }
+   }
 }
 
 void canvas::begin(PrimitiveType type)
@@ -86,14 +205,24 @@ void canvas::end()
    assert(_type != UNDEFINED && "The shape is not specified for the drawing!");
 
    // draw the shape specified by _type
-   if (_type == POINTS)
+   if (_type == POINTS && _depth)
    {
-      while(!_vertices.empty())
+      depth_points();
+   }
+   else if (_type == POINTS)
+   {
+      // hand the whole batch to the splat rasterizer instead of erasing the points one by one
+      frame_vector<splat> batch(_vertices.size(), splat(), arena_allocator<splat>(_arena));
+      for (size_t i = 0; i < _vertices.size(); i++)
       {
-         draw_point();
-         // remove the first point from _vertices
-         _vertices.erase (_vertices.begin(), _vertices.begin()+1);
+         batch[i].x = _vertices[i].x;
+         batch[i].y = _vertices[i].y;
+         batch[i].size = _point_size;
+         batch[i].r = _vertices[i].r;
+         batch[i].g = _vertices[i].g;
+         batch[i].b = _vertices[i].b;
       }
+      splats(batch.data(), static_cast<int>(batch.size()));
    }
    if (_type == LINES)
    {
@@ -102,6 +231,7 @@ void canvas::end()
          draw_line();
          // remove the first two points from _vertices
          _vertices.erase (_vertices.begin(), _vertices.begin()+2);
+         _vertex_depths.erase (_vertex_depths.begin(), _vertex_depths.begin()+2);
       }
    }
    else if (_type == TRIANGLES)
@@ -111,6 +241,7 @@ void canvas::end()
          draw_triangle(true);
          // remove the first three points from _vertices
          _vertices.erase (_vertices.begin(), _vertices.begin()+3);
+         _vertex_depths.erase (_vertex_depths.begin(), _vertex_depths.begin()+3);
       }
    }
    else if (_type == POLYGONS)
@@ -120,6 +251,7 @@ void canvas::end()
          draw_polygon(true);
          // remove the first point from _centers, first orientation vector from _orientations, and first # of sides from _sides
          _centers.erase (_centers.begin(), _centers.begin()+1);
+         _center_depths.erase (_center_depths.begin(), _center_depths.begin()+1);
          _orientations.erase (_orientations.begin(), _orientations.begin()+1);
          _sides.erase (_sides.begin(), _sides.begin()+1);
       }
@@ -131,6 +263,7 @@ void canvas::end()
          draw_circle(true);
          // remove the first point from _centers and first radius vector from _radii
          _centers.erase (_centers.begin(), _centers.begin()+1);
+         _center_depths.erase (_center_depths.begin(), _center_depths.begin()+1);
          _radii.erase(_radii.begin(), _radii.begin()+1);
       }
    }
@@ -141,6 +274,7 @@ void canvas::end()
          draw_sector();
          // remove the first point from _centers, first orientation vector from _orientations, and first angle from _angles
          _centers.erase (_centers.begin(), _centers.begin()+1);
+         _center_depths.erase (_center_depths.begin(), _center_depths.begin()+1);
          _orientations.erase (_orientations.begin(), _orientations.begin()+1);
          _angles.erase (_angles.begin(), _angles.begin()+1);
       }
@@ -152,6 +286,7 @@ void canvas::end()
          draw_triangle(false);
          // remove the first three points from _vertices
          _vertices.erase (_vertices.begin(), _vertices.begin()+3);
+         _vertex_depths.erase (_vertex_depths.begin(), _vertex_depths.begin()+3);
       }
    }
    else if (_type == OUTLINED_POLYGONS)
@@ -161,6 +296,7 @@ void canvas::end()
          draw_polygon(false);
          // remove the first point from _centers, first orientation vector from _orientations, and first # of sides from _sides
          _centers.erase (_centers.begin(), _centers.begin()+1);
+         _center_depths.erase (_center_depths.begin(), _center_depths.begin()+1);
          _orientations.erase (_orientations.begin(), _orientations.begin()+1);
          _sides.erase (_sides.begin(), _sides.begin()+1);
       }
@@ -172,20 +308,46 @@ void canvas::end()
          draw_circle(false);
          // remove the first point from _centers and first radius vector from _radii
          _centers.erase (_centers.begin(), _centers.begin()+1);
+         _center_depths.erase (_center_depths.begin(), _center_depths.begin()+1);
          _radii.erase(_radii.begin(), _radii.begin()+1);
       }
    }
 
    // clear the stored information for program security
-   _vertices.clear();
-   _radii.clear();
-   _orientations.clear();
-   _sides.clear();
-   _angles.clear();
-   _centers.clear();
+   cancel();
+}
+
+void canvas::cancel()
+{
+   // forget the stored information, and hand the memory back to the arena
+   _vertices = frame_vector<point>(arena_allocator<point>(_arena));
+   _radii = frame_vector<int>(arena_allocator<int>(_arena));
+   _orientations = frame_vector<point>(arena_allocator<point>(_arena));
+   _sides = frame_vector<int>(arena_allocator<int>(_arena));
+   _angles = frame_vector<float>(arena_allocator<float>(_arena));
+   _centers = frame_vector<point>(arena_allocator<point>(_arena));
+   _vertex_depths = frame_vector<float>(arena_allocator<float>(_arena));
+   _center_depths = frame_vector<float>(arena_allocator<float>(_arena));
+   _arena.reset();
    _type = UNDEFINED;
 }
 
+void canvas::reset()
+{
+   cancel();
+   // set the members directly, as the setters assert on what an out-of-core canvas cannot turn on
+   _samples.reset();
+   _depth.reset();
+   _index.reset();
+   _ids.clear();
+   _id = -1;
+   _color.r = _color.g = _color.b = 0;
+   depth(0);
+   sample_offset(0, 0);
+   _point_size = 1;
+   _point_shape = SQUARE;
+}
+
 void canvas::vertex(int x, int y)
 {
    // add a point with position (x,y) and color _color to _vertices
@@ -197,18 +359,21 @@ void canvas::vertex(int x, int y)
    pt.b = _color.b;
 
    _vertices.push_back(pt);
+   _vertex_depths.push_back(_z);
 }
 
 void canvas::vertex(point p)
 {
    // add a point p to _vertices
    _vertices.push_back(p);
+   _vertex_depths.push_back(_z);
 }
 
 void canvas::center(point p)
 {
    // add a point p to _centers
    _centers.push_back(p);
+   _center_depths.push_back(_z);
 }
 
 void canvas::center(int x, int y)
@@ -222,6 +387,7 @@ void canvas::center(int x, int y)
    pt.b = _color.b;
 
    _centers.push_back(pt);
+   _center_depths.push_back(_z);
 }
 
 void canvas::orientation(int x, int y)
@@ -252,6 +418,141 @@ void canvas::angle(float theta)
    _angles.push_back(theta);
 }
 
+void canvas::point_size(int size)
+{
+   // make sure size is positive
+   assert((size > 0) && "The size of a point has to be positive!");
+   _point_size = size;
+}
+
+void canvas::point_shape(SplatShape shape)
+{
+   _point_shape = shape;
+}
+
+void canvas::sample_offset(float dx, float dy)
+{
+   _sample_dx = dx;
+   _sample_dy = dy;
+}
+
+void canvas::multisample(int samples)
+{
+   assert(!(samples > 1 && _tiles) && "An out-of-core canvas cannot be multisampled!");
+   assert(!(samples > 1 && _depth) && "A depth tested canvas cannot be multisampled!");
+   if (samples <= 1)
+   {
+      _samples.reset();
+   }
+   else
+   {
+      _samples.reset(new multisample_buffer(width(), height(), samples));
+   }
+}
+
+int canvas::samples() const
+{
+   return _samples ? _samples->samples() : 1;
+}
+
+int canvas::edge_pixels() const
+{
+   return _samples ? _samples->edge_pixels() : 0;
+}
+
+void canvas::depth_test(bool enabled)
+{
+   assert(!(enabled && _tiles) && "An out-of-core canvas has no depth buffer!");
+   assert(!(enabled && _samples) && "A multisampled canvas has no depth buffer!");
+   if (!enabled)
+   {
+      _depth.reset();
+   }
+   else if (!_depth)
+   {
+      _depth.reset(new depth_buffer(width(), height()));
+   }
+}
+
+void canvas::depth(float z)
+{
+   _z = z;
+   _triangle_z[0] = _triangle_z[1] = _triangle_z[2] = z;
+}
+
+void canvas::clear_depth()
+{
+   if (_depth)
+   {
+      _depth->clear();
+   }
+}
+
+void canvas::picking(bool enabled)
+{
+   assert(!_tiles && "An out-of-core canvas cannot be picked!");
+   if (!enabled)
+   {
+      _index.reset();
+      _ids.clear();
+   }
+   else if (!_index)
+   {
+      _index.reset(new spatial_index(width(), height()));
+      _ids.assign(static_cast<size_t>(width()) * height(), -1);
+   }
+}
+
+void canvas::primitive_id(int id)
+{
+   _id = id;
+}
+
+int canvas::pick(int row, int col) const
+{
+   assert(_index && "Picking is off!");
+   if (row < 0 || row >= height() || col < 0 || col >= width())
+   {
+      return -1;
+   }
+   return _ids[static_cast<size_t>(row) * width() + col];
+}
+
+std::vector<int> canvas::pick(const std::vector<point>& points) const
+{
+   std::vector<int> ids(points.size());
+   for (size_t k = 0; k < points.size(); k++)
+   {
+      ids[k] = pick(points[k].y, points[k].x);
+   }
+   return ids;
+}
+
+const spatial_index& canvas::primitives() const
+{
+   assert(_index && "Picking is off!");
+   return *_index;
+}
+
+void canvas::clear_primitives()
+{
+   if (_index)
+   {
+      _index->clear();
+      fill(_ids.begin(), _ids.end(), -1);
+   }
+}
+
+depth_stats canvas::depth_statistics() const
+{
+   if (_depth)
+   {
+      return _depth->stats();
+   }
+   depth_stats none = {0, 0, 0};
+   return none;
+}
+
 void canvas::color(unsigned char r, unsigned char g, unsigned char b)
 {
    // set _color with the given RGB values
@@ -268,6 +569,13 @@ void canvas::background(unsigned char r, unsigned char g, unsigned char b)
    color.g = g;
    color.b = b;
 
+   // an out-of-core canvas just forgets its tiles
+   if (_tiles)
+   {
+      _tiles->fill(color);
+      return;
+   }
+
    // color the background of canvas pixel-wise
    for (int i = 0; i < _canvas.height(); i++)
    {
@@ -276,6 +584,12 @@ void canvas::background(unsigned char r, unsigned char g, unsigned char b)
          _canvas.set(i,j,color);
       }
    }
+   if (_samples)
+   {
+      _samples->clear();
+   }
+   clear_depth();
+   clear_primitives();
 }
 
 void canvas::background(ppm_pixel tl, ppm_pixel tr, ppm_pixel bl, ppm_pixel br)
@@ -292,26 +606,38 @@ void canvas::background(ppm_pixel tl, ppm_pixel tr, ppm_pixel bl, ppm_pixel br)
    p1.g = tl.g;
    p1.b = tl.b;
 
-   p2.x = _canvas.width()-1;
+   p2.x = width()-1;
    p2.y = 0;
    p2.r = tr.r;
    p2.g = tr.g;
    p2.b = tr.b;
 
    p3.x = 0;
-   p3.y = _canvas.height()-1;
+   p3.y = height()-1;
    p3.r = bl.r;
    p3.g = bl.g;
    p3.b = bl.b;
 
-   p4.x = _canvas.width()-1;
-   p4.y = _canvas.height()-1;
+   p4.x = width()-1;
+   p4.y = height()-1;
    p4.r = br.r;
    p4.g = br.g;
    p4.b = br.b;
 
+   // the background covers whole pixels, up to the border of the canvas, so it is not multisampled (nor
+   // depth tested)
+   std::unique_ptr<multisample_buffer> samples(std::move(_samples));
+   std::unique_ptr<depth_buffer> depths(std::move(_depth));
    draw_triangle(p1, p3, p4, true);
    draw_triangle(p1, p2, p4, true);
+   _samples = std::move(samples);
+   _depth = std::move(depths);
+   if (_samples)
+   {
+      _samples->clear();
+   }
+   clear_depth();
+   clear_primitives();
 }
 
 void canvas::draw_point()
@@ -327,49 +653,117 @@ void canvas::draw_point()
    color.b = p.b;
 
    // draw it!
-   if (p.y >=0 && p.y < _canvas.height() && p.x >= 0 && p.x < _canvas.width())
+   if (p.y >=0 && p.y < height() && p.x >= 0 && p.x < width() && depth_passes(p.y, p.x, _vertex_depths[0]))
    {
-      _canvas.set(p.y, p.x, color);
+      plot(p.y, p.x, color);
    }
 }
 
-void canvas::draw_line()
+void canvas::splats(const splat* s, int n)
 {
-   // First, check if there are (at least) two points given in _vertices. We will use the first two points in _vertices.
-   assert((_vertices.size() >= 2) && "At least two points are required to draw a line!");
-   point a = _vertices[0];
-   point b = _vertices[1];
-
-   // draw the line with different methods based on its slope
-   int W = b.x - a.x;
-   int H = b.y - a.y;
-   // throw a warning if a = b
-   if (W == 0 && H == 0)
+   // a point is indexed by the box of its footprint, but only the pixels it draws take its id
+   for (int k = 0; _index && k < n; k++)
    {
-      std::cout << "WARNING: Two same vertices are given to draw a line. The color of the vertex would be consistent with the latter." << std::endl;
-      drawLineLow(a, b);
-   }
-   else if (abs(W) > abs(H)){
-      if (a.x < b.x)
+      int before, after;
+      splat_extent(_point_shape, s[k].size, before, after);
+      bounds box = {s[k].x - before, s[k].y - before, s[k].x + after, s[k].y + after};
+      if (_id >= 0)
       {
-         drawLineLow(a,b);
+         _index->add_box(_id, box);
       }
-      else{
-         drawLineLow(b,a);
+      for (int i = max(0, box.ymin); i <= min(height() - 1, box.ymax); i++)
+      {
+         for (int j = max(0, box.xmin); j <= min(width() - 1, box.xmax); j++)
+         {
+            if (splat_covers(_point_shape, s[k].size, j - s[k].x, i - s[k].y))
+            {
+               mark(i, j);
+            }
+         }
       }
    }
-   else{
-      if (a.y < b.y)
+
+   if (!_tiles)
+   {
+      draw_splats(_canvas, s, n, _point_shape);
+      // the edge pixels the points drew on lost their samples
+      for (int k = 0; _samples && _samples->edge_pixels() > 0 && k < n; k++)
       {
-         drawLineHigh(a,b);
+         int before, after;
+         splat_extent(_point_shape, s[k].size, before, after);
+         for (int i = max(0, s[k].y - before); i <= min(height() - 1, s[k].y + after); i++)
+         {
+            for (int j = max(0, s[k].x - before); j <= min(width() - 1, s[k].x + after); j++)
+            {
+               if (splat_covers(_point_shape, s[k].size, j - s[k].x, i - s[k].y))
+               {
+                  _samples->forget(i, j);
+               }
+            }
+         }
       }
-      else{
-         drawLineHigh(b,a);
+      return;
+   }
+
+   // out-of-core: give every tile the splats that touch it (in tile coordinates), then draw the
+   // touched tiles one at a time. The bins are kept from call to call, so a batch of points only
+   // allocates when a tile gets more splats than ever before
+   int tile = _tiles->tile_size();
+   _splat_bins.resize(static_cast<size_t>(_tiles->tiles_x()) * _tiles->tiles_y());
+   _splat_tiles.clear();
+   for (int k = 0; k < n; k++)
+   {
+      int before, after;
+      splat_extent(_point_shape, s[k].size, before, after);
+      int left = max(0, s[k].x - before);
+      int top = max(0, s[k].y - before);
+      int right = min(width() - 1, s[k].x + after);
+      int bottom = min(height() - 1, s[k].y + after);
+      for (int ty = top / tile; top <= bottom && ty <= bottom / tile; ty++)
+      {
+         for (int tx = left / tile; left <= right && tx <= right / tile; tx++)
+         {
+            splat local = s[k];
+            local.x -= tx * tile;
+            local.y -= ty * tile;
+            size_t t = static_cast<size_t>(ty) * _tiles->tiles_x() + tx;
+            if (_splat_bins[t].empty())
+            {
+               _splat_tiles.push_back(t);
+            }
+            _splat_bins[t].push_back(local);
+         }
       }
    }
+
+   ppm_image pixels(tile, tile);
+   for (size_t k = 0; k < _splat_tiles.size(); k++)
+   {
+      size_t t = _splat_tiles[k];
+      int tx = static_cast<int>(t % _tiles->tiles_x());
+      int ty = static_cast<int>(t / _tiles->tiles_x());
+      _tiles->read_tile(tx, ty, pixels);
+      draw_splats(pixels, &_splat_bins[t][0], static_cast<int>(_splat_bins[t].size()), _point_shape);
+      _tiles->write_tile(tx, ty, pixels);
+      // clear keeps the capacity for the next call
+      _splat_bins[t].clear();
+   }
+}
+
+void canvas::draw_line()
+{
+   // First, check if there are (at least) two points given in _vertices. We will use the first two points in _vertices.
+   assert((_vertices.size() >= 2) && "At least two points are required to draw a line!");
+   point a = _vertices[0];
+   point b = _vertices[1];
+   if (_index && _id >= 0)
+   {
+      _index->add_line(_id, a, b);
+   }
+   draw_line(a, b, _vertex_depths[0], _vertex_depths[1]);
 }
 
-void canvas::draw_line(point p1, point p2)
+void canvas::draw_line(point p1, point p2, float z1, float z2)
 {
    point a = p1; // start point
    point b = p2; // end point
@@ -381,24 +775,24 @@ void canvas::draw_line(point p1, point p2)
    if (W == 0 && H == 0)
    {
       std::cout << "WARNING: Two same vertices are given to draw a line. The color of the vertex would be consistent with the latter." << std::endl;
-      drawLineLow(a, b);
+      drawLineLow(a, b, z1, z2);
    }
    else if (abs(W) > abs(H)){
       if (a.x < b.x)
       {
-         drawLineLow(a,b);
+         drawLineLow(a,b,z1,z2);
       }
       else{
-         drawLineLow(b,a);
+         drawLineLow(b,a,z2,z1);
       }
    }
    else{
       if (a.y < b.y)
       {
-         drawLineHigh(a,b);
+         drawLineHigh(a,b,z1,z2);
       }
       else{
-         drawLineHigh(b,a);
+         drawLineHigh(b,a,z2,z1);
       }
    }
 }
@@ -410,19 +804,34 @@ void canvas::draw_triangle(bool filled)
    point a =  _vertices[0]; 
    point b = _vertices[1]; 
    point c = _vertices[2];
+   for (int k = 0; k < 3 && _depth; k++)
+   {
+      _triangle_z[k] = _vertex_depths[k];
+   }
+   // an outline is picked on its edges, the pixels it draws
+   if (_index && _id >= 0 && filled)
+   {
+      _index->add_triangle(_id, a, b, c);
+   }
+   else if (_index && _id >= 0)
+   {
+      _index->add_line(_id, a, b);
+      _index->add_line(_id, a, c);
+      _index->add_line(_id, b, c);
+   }
 
    // if a,b,c are collinear, we draw the line that contains all three points (e.g. if b is between a and c, then the line segment ac is drawn)
    if ((b.x - a.x) * (c.y - a.y) == (c.x - a.x) * (b.y - a.y)){
       // throw a warning
       std::cout << "WARNING: Three colinear points are given to draw a triangle! The minimal line segment that contains the three points is drawn instead." << std::endl;
       if ((a.x <= b.x <= c.x || c.x <= b.x <= a.x) && (a.y <= b.y <= c.y || c.y <= b.y <= a.y)){
-         draw_line(a,c);
+         draw_line(a,c,_triangle_z[0],_triangle_z[2]);
       }
       else if ((b.x <= a.x <= c.x || c.x <= a.x <= b.x) && (b.y <= a.y <= c.y || c.y <= a.y <= b.y)){
-         draw_line(b,c);
+         draw_line(b,c,_triangle_z[1],_triangle_z[2]);
       }
       else{
-         draw_line(a,b);
+         draw_line(a,b,_triangle_z[0],_triangle_z[1]);
       }
    }
    // otherwise, apply barycentric_fill algorithm
@@ -432,53 +841,63 @@ void canvas::draw_triangle(bool filled)
       float f_beta = ydistance(b,a,c);
       float f_gamma = ydistance(c,a,b);
 
-      int ymin = min(a.y, min(b.y, c.y));
-      int ymax = max(a.y, max(b.y, c.y));
-      int xmin = min(a.x, min(b.x, c.x));
-      int xmax = max(a.x, max(b.x, c.x));
+      // a sample offset can move the samples of the pixels next to the box inside the triangle
+      int grow = (_sample_dx != 0 || _sample_dy != 0) ? 1 : 0;
+      int ymin = min(a.y, min(b.y, c.y)) - grow;
+      int ymax = max(a.y, max(b.y, c.y)) + grow;
+      int xmin = min(a.x, min(b.x, c.x)) - grow;
+      int xmax = max(a.x, max(b.x, c.x)) + grow;
+
+      if (filled && _depth)
+      {
+         depth_triangle(a, b, c);
+         return;
+      }
+      if (filled && _samples)
+      {
+         multisample_triangle(a, b, c);
+         return;
+      }
+
+      // an outline is drawn once, not once per pixel of its box
+      if (!filled)
+      {
+         draw_line(a,b,_triangle_z[0],_triangle_z[1]);
+         draw_line(a,c,_triangle_z[0],_triangle_z[2]);
+         draw_line(b,c,_triangle_z[1],_triangle_z[2]);
+         return;
+      }
 
       // visit each pixel in the bounding box
-      for (int i = ymin; i <= ymax; i++)
+      visit_box(xmin, ymin, xmax, ymax, [&](int i, int j)
       {
-         for (int j = xmin; j <= xmax; j++)
+         // computing barycentric coordinates of the pixel (sampled at its position plus the sample offset)
+         float x = static_cast<float>(j) + _sample_dx;
+         float y = static_cast<float>(i) + _sample_dy;
+         float alpha = ydistance(x,y,b,c)/f_alpha;
+         float beta = ydistance(x,y,a,c)/f_beta;
+         float gamma = ydistance(x,y,a,b)/f_gamma;
+
+         // check if the pixel is inside the triangle
+         if(alpha >= 0.0 && beta >= 0.0 && gamma >= 0.0)
          {
-            // computing barycentric coordinates of the pixel
-            point p;
-            p.x = j;
-            p.y = i;
-            float alpha = ydistance(p,b,c)/f_alpha;
-            float beta = ydistance(p,a,c)/f_beta;
-            float gamma = ydistance(p,a,b)/f_gamma;
-
-            if(filled){
-               // check if the pixel is inside the triangle
-               if(alpha >= 0.0 && beta >= 0.0 && gamma >= 0.0)
+            // decide the color of the pixel using linear interpolation of a.color, b.color and c.color
+            ppm_pixel color;
+            color.r = floor(alpha * static_cast<float>(a.r) + beta * static_cast<float>(b.r) + gamma * static_cast<float>(c.r));
+            color.g = floor(alpha * static_cast<float>(a.g) + beta * static_cast<float>(b.g) + gamma * static_cast<float>(c.g));
+            color.b = floor(alpha * static_cast<float>(a.b) + beta * static_cast<float>(b.b) + gamma * static_cast<float>(c.b));
+            // handle adjacent edges with a mysterious points
+            bool drawAlpha = (alpha > 0 || f_alpha * ydistance(-1, -1,b,c) > 0 || f_alpha * ydistance(-1.1, -1,b,c) > 0 );
+            bool drawBeta  = (beta  > 0 || f_beta * ydistance(-1, -1,a,c) > 0 || f_beta * ydistance(-1.1, -1,a,c) > 0);
+            bool drawGamma = (gamma > 0 || f_gamma * ydistance(-1, -1,a,b) > 0 || f_gamma * ydistance(-1.1, -1,a,b) > 0);
+            if (drawAlpha && drawBeta && drawGamma) {
+               if(i >= 0 && i < height() && j >= 0 && j < width())
                {
-                  // decide the color of the pixel using linear interpolation of a.color, b.color and c.color
-                  ppm_pixel color;
-                  color.r = floor(alpha * static_cast<float>(a.r) + beta * static_cast<float>(b.r) + gamma * static_cast<float>(c.r));
-                  color.g = floor(alpha * static_cast<float>(a.g) + beta * static_cast<float>(b.g) + gamma * static_cast<float>(c.g));
-                  color.b = floor(alpha * static_cast<float>(a.b) + beta * static_cast<float>(b.b) + gamma * static_cast<float>(c.b));
-                  // handle adjacent edges with a mysterious points
-                  bool drawAlpha = (alpha > 0 || f_alpha * ydistance(-1, -1,b,c) > 0 || f_alpha * ydistance(-1.1, -1,b,c) > 0 );
-                  bool drawBeta  = (beta  > 0 || f_beta * ydistance(-1, -1,a,c) > 0 || f_beta * ydistance(-1.1, -1,a,c) > 0);
-                  bool drawGamma = (gamma > 0 || f_gamma * ydistance(-1, -1,a,b) > 0 || f_gamma * ydistance(-1.1, -1,a,b) > 0);
-                  if (drawAlpha && drawBeta && drawGamma) {
-                     if(i >= 0 && i < _canvas.height() && j >= 0 && j < _canvas.width())
-                     {
-                        _canvas.set(i, j, color);
-                     }
-                  }
+                  plot(i, j, color);
                }
             }
-            else{
-               // draw the edges of the triangle
-               draw_line(a,b);
-               draw_line(a,c);
-               draw_line(b,c);
-            }
          }
-      }
+      });
    }
 }
 
@@ -487,19 +906,28 @@ void canvas::draw_triangle(point p1, point p2, point p3, bool filled)
    point a = p1;
    point b = p2;
    point c = p3;
+   // an outline piece only draws (and is picked on) its edge bc
+   if (_index && _id >= 0 && filled)
+   {
+      _index->add_triangle(_id, a, b, c);
+   }
+   else if (_index && _id >= 0)
+   {
+      _index->add_line(_id, b, c);
+   }
 
    // if a,b,c are collinear, we draw the line that contains all three points (e.g. if b is between a and c, then the line segment ac is drawn)
    if ((b.x - a.x) * (c.y - a.y) == (c.x - a.x) * (b.y - a.y)){
       // throw a warning
       std::cout << "WARNING: Three colinear points are given to draw a triangle! The minimal line segment that contains the three points is drawn instead." << std::endl;
       if ((a.x <= b.x <= c.x || c.x <= b.x <= a.x) && (a.y <= b.y <= c.y || c.y <= b.y <= a.y)){
-         draw_line(a,c);
+         draw_line(a,c,_triangle_z[0],_triangle_z[2]);
       }
       else if ((b.x <= a.x <= c.x || c.x <= a.x <= b.x) && (b.y <= a.y <= c.y || c.y <= a.y <= b.y)){
-         draw_line(b,c);
+         draw_line(b,c,_triangle_z[1],_triangle_z[2]);
       }
       else{
-         draw_line(a,b);
+         draw_line(a,b,_triangle_z[0],_triangle_z[1]);
       }
    }
    // otherwise, apply barycentric_fill algorithm
@@ -509,54 +937,283 @@ void canvas::draw_triangle(point p1, point p2, point p3, bool filled)
       float f_beta = ydistance(b,a,c);
       float f_gamma = ydistance(c,a,b);
 
-      int ymin = min(a.y, min(b.y, c.y));
-      int ymax = max(a.y, max(b.y, c.y));
-      int xmin = min(a.x, min(b.x, c.x));
-      int xmax = max(a.x, max(b.x, c.x));
+      // a sample offset can move the samples of the pixels next to the box inside the triangle
+      int grow = (_sample_dx != 0 || _sample_dy != 0) ? 1 : 0;
+      int ymin = min(a.y, min(b.y, c.y)) - grow;
+      int ymax = max(a.y, max(b.y, c.y)) + grow;
+      int xmin = min(a.x, min(b.x, c.x)) - grow;
+      int xmax = max(a.x, max(b.x, c.x)) + grow;
+
+      if (filled && _depth)
+      {
+         depth_triangle(a, b, c);
+         return;
+      }
+      if (filled && _samples)
+      {
+         multisample_triangle(a, b, c);
+         return;
+      }
+
+      // an outline is drawn once, not once per pixel of its box
+      if (!filled)
+      {
+         draw_line(b,c,_triangle_z[1],_triangle_z[2]);
+         return;
+      }
 
       // visit each pixel in the bounding box
-      for (int i = ymin; i <= ymax; i++)
+      visit_box(xmin, ymin, xmax, ymax, [&](int i, int j)
       {
-         for (int j = xmin; j <= xmax; j++)
+         // computing barycentric coordinates of the pixel (sampled at its position plus the sample offset)
+         float x = static_cast<float>(j) + _sample_dx;
+         float y = static_cast<float>(i) + _sample_dy;
+         float alpha = ydistance(x,y,b,c)/f_alpha;
+         float beta = ydistance(x,y,a,c)/f_beta;
+         float gamma = ydistance(x,y,a,b)/f_gamma;
+
+         // check if the pixel is inside the triangle
+         if(alpha >= 0.0 && beta >= 0.0 && gamma >= 0.0)
+         {
+            // decide the color of the pixel using linear interpolation of a.color, b.color and c.color
+            ppm_pixel color;
+            color.r = floor(alpha * static_cast<float>(a.r) + beta * static_cast<float>(b.r) + gamma * static_cast<float>(c.r));
+            color.g = floor(alpha * static_cast<float>(a.g) + beta * static_cast<float>(b.g) + gamma * static_cast<float>(c.g));
+            color.b = floor(alpha * static_cast<float>(a.b) + beta * static_cast<float>(b.b) + gamma * static_cast<float>(c.b));
+            // handle adjacent edges with a mysterious points
+            bool drawAlpha = (alpha > 0 || f_alpha * ydistance(-1, -1,b,c) > 0 || f_alpha * ydistance(-1.1, -1,b,c) > 0 );
+            bool drawBeta  = (beta  > 0 || f_beta * ydistance(-1, -1,a,c) > 0 || f_beta * ydistance(-1.1, -1,a,c) > 0);
+            bool drawGamma = (gamma > 0 || f_gamma * ydistance(-1, -1,a,b) > 0 || f_gamma * ydistance(-1.1, -1,a,b) > 0);
+            if (drawAlpha && drawBeta && drawGamma) {
+               if(i >= 0 && i < height() && j >= 0 && j < width())
+               {
+                  plot(i, j, color);
+               }
+            }
+         }
+      });
+   }
+}
+
+void canvas::multisample_triangle(point a, point b, point c)
+{
+   // plug points into line equations
+   float f_alpha = ydistance(a,b,c);
+   float f_beta = ydistance(b,a,c);
+   float f_gamma = ydistance(c,a,b);
+
+   // a sample exactly on an edge is drawn by the same one of the two triangles sharing it as in draw_triangle
+   bool ownAlpha = f_alpha * ydistance(-1, -1,b,c) > 0 || f_alpha * ydistance(-1.1, -1,b,c) > 0;
+   bool ownBeta = f_beta * ydistance(-1, -1,a,c) > 0 || f_beta * ydistance(-1.1, -1,a,c) > 0;
+   bool ownGamma = f_gamma * ydistance(-1, -1,a,b) > 0 || f_gamma * ydistance(-1.1, -1,a,b) > 0;
+
+   // distance (in pixels) to the edge opposite of a vertex per unit of its barycentric coordinate
+   float toAlpha = fabs(f_alpha) / magnitude(c.x - b.x, c.y - b.y);
+   float toBeta = fabs(f_beta) / magnitude(c.x - a.x, c.y - a.y);
+   float toGamma = fabs(f_gamma) / magnitude(b.x - a.x, b.y - a.y);
+
+   int n = _samples->samples();
+   float dx[16];
+   float dy[16];
+   for (int k = 0; k < n; k++)
+   {
+      multisample_buffer::sample_position(n, k, dx[k], dy[k]);
+   }
+   // no sample is farther than this from the sampled point of its pixel, so a pixel whose point is
+   // farther inside every edge is fully covered and one farther outside any edge is not covered
+   const float reach = 0.75f;
+
+   int ymin = max(0, min(a.y, min(b.y, c.y)) - 1);
+   int ymax = min(height() - 1, max(a.y, max(b.y, c.y)) + 1);
+   int xmin = max(0, min(a.x, min(b.x, c.x)) - 1);
+   int xmax = min(width() - 1, max(a.x, max(b.x, c.x)) + 1);
+   for (int i = ymin; i <= ymax; i++)
+   {
+      for (int j = xmin; j <= xmax; j++)
+      {
+         float x = static_cast<float>(j) + _sample_dx;
+         float y = static_cast<float>(i) + _sample_dy;
+         float alpha = ydistance(x,y,b,c)/f_alpha;
+         float beta = ydistance(x,y,a,c)/f_beta;
+         float gamma = ydistance(x,y,a,b)/f_gamma;
+         if (alpha * toAlpha < -reach || beta * toBeta < -reach || gamma * toGamma < -reach)
          {
-            // computing barycentric coordinates of the pixel
-            point p;
-            p.x = j;
-            p.y = i;
-            float alpha = ydistance(p,b,c)/f_alpha;
-            float beta = ydistance(p,a,c)/f_beta;
-            float gamma = ydistance(p,a,b)/f_gamma;
-
-            if(filled){
-               // check if the pixel is inside the triangle
-               if(alpha >= 0.0 && beta >= 0.0 && gamma >= 0.0)
+            continue;
+         }
+
+         // only the pixels near an edge test their samples
+         unsigned mask = _samples->full_mask();
+         if (alpha * toAlpha < reach || beta * toBeta < reach || gamma * toGamma < reach)
+         {
+            mask = 0;
+            for (int k = 0; k < n; k++)
+            {
+               float sAlpha = ydistance(x + dx[k], y + dy[k], b, c)/f_alpha;
+               float sBeta = ydistance(x + dx[k], y + dy[k], a, c)/f_beta;
+               float sGamma = ydistance(x + dx[k], y + dy[k], a, b)/f_gamma;
+               if ((sAlpha > 0 || (sAlpha == 0 && ownAlpha)) && (sBeta > 0 || (sBeta == 0 && ownBeta)) &&
+                  (sGamma > 0 || (sGamma == 0 && ownGamma)))
+               {
+                  mask |= 1u << k;
+               }
+            }
+            if (mask == 0)
+            {
+               continue;
+            }
+         }
+
+         // the color is computed once per pixel, at its sampled point moved inside the triangle
+         float wAlpha = max(alpha, 0.0f);
+         float wBeta = max(beta, 0.0f);
+         float wGamma = max(gamma, 0.0f);
+         float sum = wAlpha + wBeta + wGamma;
+         ppm_pixel color;
+         color.r = floor((wAlpha * static_cast<float>(a.r) + wBeta * static_cast<float>(b.r) + wGamma * static_cast<float>(c.r)) / sum);
+         color.g = floor((wAlpha * static_cast<float>(a.g) + wBeta * static_cast<float>(b.g) + wGamma * static_cast<float>(c.g)) / sum);
+         color.b = floor((wAlpha * static_cast<float>(a.b) + wBeta * static_cast<float>(b.b) + wGamma * static_cast<float>(c.b)) / sum);
+         _samples->write(_canvas, i, j, mask, color);
+         mark(i, j);
+      }
+   }
+}
+
+bool canvas::depth_passes(int row, int col, float z)
+{
+   return !_depth || _depth->test(row, col, z);
+}
+
+void canvas::depth_points()
+{
+   int before, after;
+   splat_extent(_point_shape, _point_size, before, after);
+   depth_stats& stats = _depth->stats();
+   for (size_t k = 0; k < _vertices.size(); k++)
+   {
+      const point& p = _vertices[k];
+      float z = _vertex_depths[k];
+      bounds box = {p.x - before, p.y - before, p.x + after, p.y + after};
+      if (_index && _id >= 0)
+      {
+         _index->add_box(_id, box);
+      }
+      for (int i = max(0, box.ymin); i <= min(height() - 1, box.ymax); i++)
+      {
+         for (int j = max(0, box.xmin); j <= min(width() - 1, box.xmax); j++)
+         {
+            int weight = splat_weight(_point_shape, _point_size, j - p.x, i - p.y);
+            if (weight == 0)
+            {
+               continue;
+            }
+            if (_point_shape != GAUSSIAN)
+            {
+               if (_depth->test(i, j, z))
                {
-                  // decide the color of the pixel using linear interpolation of a.color, b.color and c.color
                   ppm_pixel color;
-                  color.r = floor(alpha * static_cast<float>(a.r) + beta * static_cast<float>(b.r) + gamma * static_cast<float>(c.r));
-                  color.g = floor(alpha * static_cast<float>(a.g) + beta * static_cast<float>(b.g) + gamma * static_cast<float>(c.g));
-                  color.b = floor(alpha * static_cast<float>(a.b) + beta * static_cast<float>(b.b) + gamma * static_cast<float>(c.b));
-                  // handle adjacent edges with a mysterious points
-                  bool drawAlpha = (alpha > 0 || f_alpha * ydistance(-1, -1,b,c) > 0 || f_alpha * ydistance(-1.1, -1,b,c) > 0 );
-                  bool drawBeta  = (beta  > 0 || f_beta * ydistance(-1, -1,a,c) > 0 || f_beta * ydistance(-1.1, -1,a,c) > 0);
-                  bool drawGamma = (gamma > 0 || f_gamma * ydistance(-1, -1,a,b) > 0 || f_gamma * ydistance(-1.1, -1,a,b) > 0);
-                  if (drawAlpha && drawBeta && drawGamma) {
-                     if(i >= 0 && i < _canvas.height() && j >= 0 && j < _canvas.width())
-                     {
-                        _canvas.set(i, j, color);
-                     }
-                  }
+                  color.r = p.r;
+                  color.g = p.g;
+                  color.b = p.b;
+                  plot(i, j, color);
                }
+               continue;
             }
-            else{
-               // draw the edge of the triangle that is opposite of the circle's/polygon's center
-               draw_line(b,c);
+            // what is behind a blended point still shows through, so its depth is not stored
+            stats.pixels_tested++;
+            if (z < _depth->get(i, j))
+            {
+               stats.pixels_passed++;
+               ppm_pixel old = _canvas.get(i, j);
+               ppm_pixel color;
+               color.r = static_cast<unsigned char>(old.r + (((p.r - old.r) * weight) >> 8));
+               color.g = static_cast<unsigned char>(old.g + (((p.g - old.g) * weight) >> 8));
+               color.b = static_cast<unsigned char>(old.b + (((p.b - old.b) * weight) >> 8));
+               plot(i, j, color);
             }
          }
       }
    }
 }
 
+void canvas::depth_triangle(point a, point b, point c)
+{
+   // plug points into line equations
+   float f_alpha = ydistance(a,b,c);
+   float f_beta = ydistance(b,a,c);
+   float f_gamma = ydistance(c,a,b);
+
+   // handle adjacent edges as draw_triangle does
+   bool ownAlpha = f_alpha * ydistance(-1, -1,b,c) > 0 || f_alpha * ydistance(-1.1, -1,b,c) > 0;
+   bool ownBeta = f_beta * ydistance(-1, -1,a,c) > 0 || f_beta * ydistance(-1.1, -1,a,c) > 0;
+   bool ownGamma = f_gamma * ydistance(-1, -1,a,b) > 0 || f_gamma * ydistance(-1.1, -1,a,b) > 0;
+
+   float nearest = min(_triangle_z[0], min(_triangle_z[1], _triangle_z[2]));
+   float farthest = max(_triangle_z[0], max(_triangle_z[1], _triangle_z[2]));
+
+   int grow = (_sample_dx != 0 || _sample_dy != 0) ? 1 : 0;
+   int ymin = max(0, min(a.y, min(b.y, c.y)) - grow);
+   int ymax = min(height() - 1, max(a.y, max(b.y, c.y)) + grow);
+   int xmin = max(0, min(a.x, min(b.x, c.x)) - grow);
+   int xmax = min(width() - 1, max(a.x, max(b.x, c.x)) + grow);
+
+   // walk the bounding box tile by tile, so that the tiles in which the triangle is hidden are skipped
+   // before any pixel of them is visited
+   int tile = _depth->tile_size();
+   for (int ty = ymin / tile; ymin <= ymax && ty <= ymax / tile; ty++)
+   {
+      for (int tx = xmin / tile; xmin <= xmax && tx <= xmax / tile; tx++)
+      {
+         if (_depth->occluded(tx, ty, nearest))
+         {
+            _depth->stats().tiles_skipped++;
+            continue;
+         }
+         bool in_front = _depth->in_front(tx, ty, farthest);
+         bool drawn = false;
+         for (int i = max(ymin, ty * tile); i <= min(ymax, ty * tile + tile - 1); i++)
+         {
+            for (int j = max(xmin, tx * tile); j <= min(xmax, tx * tile + tile - 1); j++)
+            {
+               // computing barycentric coordinates of the pixel
+               float x = static_cast<float>(j) + _sample_dx;
+               float y = static_cast<float>(i) + _sample_dy;
+               float alpha = ydistance(x,y,b,c)/f_alpha;
+               float beta = ydistance(x,y,a,c)/f_beta;
+               float gamma = ydistance(x,y,a,b)/f_gamma;
+               if (!((alpha > 0 || (alpha == 0 && ownAlpha)) && (beta > 0 || (beta == 0 && ownBeta)) &&
+                  (gamma > 0 || (gamma == 0 && ownGamma))))
+               {
+                  continue;
+               }
+
+               // the pixel is shaded only if it is nearer than what is there
+               float z = alpha * _triangle_z[0] + beta * _triangle_z[1] + gamma * _triangle_z[2];
+               if (in_front)
+               {
+                  _depth->write(i, j, z);
+               }
+               else if (!_depth->test(i, j, z))
+               {
+                  continue;
+               }
+               drawn = true;
+
+               ppm_pixel color;
+               color.r = floor(alpha * static_cast<float>(a.r) + beta * static_cast<float>(b.r) + gamma * static_cast<float>(c.r));
+               color.g = floor(alpha * static_cast<float>(a.g) + beta * static_cast<float>(b.g) + gamma * static_cast<float>(c.g));
+               color.b = floor(alpha * static_cast<float>(a.b) + beta * static_cast<float>(b.b) + gamma * static_cast<float>(c.b));
+               _canvas.set(i, j, color);
+               mark(i, j);
+            }
+         }
+         if (drawn)
+         {
+            _depth->update_tile(tx, ty);
+         }
+      }
+   }
+}
+
 void canvas::draw_polygon(bool filled)
 {
    // First, check if there are (at least) one points given in _centers, one orientation vector in _orientations, and one # of sides given in _sides
@@ -564,6 +1221,8 @@ void canvas::draw_polygon(bool filled)
    assert((_orientations.size() >= 1) && "At least one orientation vector is required to draw a polygon!");
    assert((_sides.size() >= 1) && "At least one number of sides is required to draw a polygon!");
    point c = _centers[0]; 
+   // every slice has the depth of the center
+   _triangle_z[0] = _triangle_z[1] = _triangle_z[2] = _center_depths[0];
    point v = _orientations[0]; 
    int n = _sides[0];
 
@@ -611,6 +1270,8 @@ void canvas::draw_circle(bool filled)
    assert((_centers.size() >= 1) && "At least one center point is required to draw a circle!");
    assert((_radii.size() >= 1) && "At least one radius is required to draw a circle!");
    point c = _centers[0]; 
+   // every slice has the depth of the center
+   _triangle_z[0] = _triangle_z[1] = _triangle_z[2] = _center_depths[0];
    int r = _radii[0]; 
    
    // make sure r is positive
@@ -661,6 +1322,8 @@ void canvas::draw_sector()
    assert((_orientations.size() >= 1) && "At least one orientation vector is required to draw a sector!");
    assert((_angles.size() >= 1) && "At least one angle is required to draw a sector!");
    point c = _centers[0]; 
+   // every slice has the depth of the center
+   _triangle_z[0] = _triangle_z[1] = _triangle_z[2] = _center_depths[0];
    point v = _orientations[0]; 
    float angle = _angles[0]; 
    
@@ -702,7 +1365,7 @@ void canvas::draw_sector()
    }
 }
 
-void canvas::drawLineLow(point a, point b)
+void canvas::drawLineLow(point a, point b, float za, float zb)
 {
    int W = b.x - a.x;
    int H = b.y - a.y;
@@ -723,6 +1386,7 @@ void canvas::drawLineLow(point a, point b)
    {
       // decide the color of the pixel using linear interpolation of a.color and b.color
       ppm_pixel color;
+      float z = zb;
       if (b.x == a.x)
       {
          color.r = b.r;
@@ -735,11 +1399,12 @@ void canvas::drawLineLow(point a, point b)
          color.r = floor(static_cast<float>(a.r) * (1.0 - t) + static_cast<float>(b.r) * t);
          color.g = floor(static_cast<float>(a.g) * (1.0 - t) + static_cast<float>(b.g) * t);
          color.b = floor(static_cast<float>(a.b) * (1.0 - t) + static_cast<float>(b.b) * t);
+         z = za + (zb - za) * t;
       }
 
-      if(y >= 0 && y < _canvas.height() && x >= 0 && x < _canvas.width())
+      if(y >= 0 && y < height() && x >= 0 && x < width() && depth_passes(y, x, z))
       {
-         _canvas.set(y, x, color);
+         plot(y, x, color);
       }
 
       if (F > 0)
@@ -753,7 +1418,7 @@ void canvas::drawLineLow(point a, point b)
    }
 }
 
-void canvas::drawLineHigh(point a, point b)
+void canvas::drawLineHigh(point a, point b, float za, float zb)
 {
    int W = b.x - a.x;
    int H = b.y - a.y;
@@ -778,10 +1443,11 @@ void canvas::drawLineHigh(point a, point b)
       color.r = floor(static_cast<float>(a.r) * (1 - t) + static_cast<float>(b.r) * t);
       color.g = floor(static_cast<float>(a.g) * (1 - t) + static_cast<float>(b.g) * t);
       color.b = floor(static_cast<float>(a.b) * (1 - t) + static_cast<float>(b.b) * t);
+      float z = za + (zb - za) * t;
 
-      if(y >= 0 && y < _canvas.height() && x >= 0 && x < _canvas.width())
+      if(y >= 0 && y < height() && x >= 0 && x < width() && depth_passes(y, x, z))
       {
-         _canvas.set(y, x, color);
+         plot(y, x, color);
       }
 
       if (F > 0)
@@ -815,8 +1481,17 @@ std::vector<point> canvas::polygon_vertices() const
    return _polygon_vertices;
 }
 
+allocator_stats canvas::arena_stats() const
+{
+   return _arena.stats();
+}
+
 ppm_pixel canvas::pixel_color(int row, int col) const
 {
+   if (_tiles)
+   {
+      return _tiles->get(row, col);
+   }
    return _canvas.get(row, col);
 }
 
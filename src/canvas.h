@@ -1,9 +1,16 @@
 #ifndef canvas_H_
 #define canvas_H_
 
+#include <future>
+#include <memory>
 #include <string>
 #include <vector>
+#include "depth_buffer.h"
+#include "frame_arena.h"
+#include "multisample.h"
 #include "ppm_image.h"
+#include "splat.h"
+#include "tiled_image.h"
 
 namespace agl
 {
@@ -18,15 +25,36 @@ namespace agl
      unsigned char b;
   };
 
+   class spatial_index;
+
    class canvas
    {
    public:
       canvas(int w, int h);
+
+      // Out-of-core canvas: the pixels are kept in tile_size * tile_size tiles of which at most
+      // cache_bytes worth stay in memory; the others are paged to a scratch file (see tiled_image)
+      canvas(int w, int h, int tile_size, size_t cache_bytes, const std::string& scratch = "");
+
       virtual ~canvas();
 
-      // Save to file
+      // return the width of the canvas
+      int width() const;
+
+      // return the height of the canvas
+      int height() const;
+
+      // Save to file (in ppm file format). An out-of-core canvas streams its tiles to the file
       void save(const std::string& filename);
 
+      // Save to file like save, without waiting for the file to be written: the pixels are copied and
+      // written by image_writer::global() on its own thread (this blocks only while too many saves are
+      // queued). The future becomes true once the file is written. An out-of-core canvas is saved at once
+      std::shared_future<bool> save_async(const std::string& filename);
+
+      // return the pixels of the canvas (not available for an out-of-core canvas)
+      const ppm_image& image() const;
+
       // Draw primitives with a given type (either LINES or TRIANGLES)
       // For example, the following draws a red line followed by a green line
       // begin(LINES);
@@ -40,6 +68,14 @@ namespace agl
       void begin(PrimitiveType type);
       void end();
 
+      // Forget the vertices, centers and parameters given since the last end without drawing them
+      void cancel();
+
+      // Put the drawing state back to that of a new canvas, keeping the pixels: cancel, and turn off
+      // multisampling, the depth test and picking; black color, depth 0, primitive id -1, sample offset
+      // (0, 0) and 1 pixel SQUARE points. For reusing a canvas between independent drawings
+      void reset();
+
       // Specifiy a vertex at raster position (x,y)
       // x corresponds to the column; y to the row
       void vertex(int x, int y);
@@ -66,6 +102,71 @@ namespace agl
       // Specify the angle of a sector
       void angle(float theta);
 
+      // Specify the size of the points drawn by POINTS (1 by default)
+      void point_size(int size);
+
+      // Specify the footprint of the points drawn by POINTS (SQUARE by default)
+      void point_shape(SplatShape shape);
+
+      // Specify where filled triangles (and the polygons, circles and sectors made of them) sample each
+      // pixel: at (col + dx, row + dy) instead of (col, row). Jittering the offset between passes that are
+      // added up in an accumulation_buffer gives antialiased edges. (0, 0) by default
+      void sample_offset(float dx, float dy);
+
+      // Multisample filled triangles (and the polygons, circles and sectors made of them): coverage is
+      // tested at the given number of sample positions per pixel (2, 4, 8 or 16) while the color is
+      // computed once per pixel, and edge pixels get the average of their samples. Only edge pixels
+      // store samples (see multisample_buffer). 1 turns it off (the default). Not available for an
+      // out-of-core canvas
+      void multisample(int samples);
+
+      // return the number of samples per pixel (1 if multisampling is off)
+      int samples() const;
+
+      // return the number of pixels that currently hold samples
+      int edge_pixels() const;
+
+      // Turn the depth test on or off (off by default). With the depth test on, a pixel of any primitive
+      // is drawn only if it is nearer (smaller depth) than what was drawn there, so shapes can be drawn
+      // in any order and hidden pixels are never shaded. Lines and outlines take the depth interpolated
+      // between their ends; gaussian points are tested but, being blended, do not hide what is behind
+      // them. Drawing front to back skips the hidden parts of a filled shape tile by tile. Not available
+      // for an out-of-core or multisampled canvas
+      void depth_test(bool enabled);
+
+      // Specify the depth (or layer) of the following vertices and centers (0 by default). The depth of
+      // a triangle is interpolated between its vertices; polygons, circles and sectors have the depth of
+      // their center
+      void depth(float z);
+
+      // make every pixel of the depth buffer infinitely far (background does this too)
+      void clear_depth();
+
+      // return the counters of the depth test (all zero if it is off)
+      depth_stats depth_statistics() const;
+
+      // Turn picking on or off (off by default). With picking on, the canvas keeps the id of the primitive
+      // on top of every pixel and a spatial_index of the primitives drawn with an id. Not available for an
+      // out-of-core canvas
+      void picking(bool enabled);
+
+      // Specify the id of the following primitives, e.g. one id per bar of a chart (-1 by default: the
+      // primitives cannot be picked, but still hide what is under them)
+      void primitive_id(int id);
+
+      // return the id of the primitive on top of pixel (row, col), or -1
+      int pick(int row, int col) const;
+
+      // return the id of the primitive on top of every point (x is the column; y the row)
+      std::vector<int> pick(const std::vector<point>& points) const;
+
+      // return the index of the primitives drawn with an id since picking was turned on or the background
+      // was last filled, for the primitives under a point (not only the one on top) or in a rectangle
+      const spatial_index& primitives() const;
+
+      // forget the recorded primitives and ids (background does this too)
+      void clear_primitives();
+
       // Specify a color. Color components are in range [0,255]
       void color(unsigned char r, unsigned char g, unsigned char b);
 
@@ -78,11 +179,15 @@ namespace agl
       // Drawing a point
       void draw_point();
 
+      // Draw n splats from a contiguous array with the current point shape
+      void splats(const splat* s, int n);
+
       // Line interpolation using the Bresenham algorithm
       void draw_line();
 
-      // draw_line method that is called by other drawing methods
-      void draw_line(point p1, point p2);
+      // draw_line method that is called by other drawing methods: the line from p1 at depth z1 to p2
+      // at depth z2 (the depths only matter with the depth test on)
+      void draw_line(point p1, point p2, float z1, float z2);
 
       // Triangle interpolation using barycentric coordinates
       void draw_triangle(bool filled);
@@ -100,10 +205,10 @@ namespace agl
       void draw_sector();
 
       // Helper function for canvas::draw_line method that draws a line (between a and b) whose slope is between -1 and 1 (exclusive)
-      void drawLineLow(point a, point b);
+      void drawLineLow(point a, point b, float za, float zb);
 
       // Helper function for canvas::draw_line method that draws a line whose slope is  > 1 or < 1
-      void drawLineHigh(point a, point b);
+      void drawLineHigh(point a, point b, float za, float zb);
 
       // find the midpoint of a given line
       point mid_point(point a, point b) const;
@@ -111,6 +216,9 @@ namespace agl
       // return the recorded vertices for a polygon
       std::vector<point> polygon_vertices() const;
 
+      // return the counters of the arena that holds the commands between begin and end
+      allocator_stats arena_stats() const;
+
       // get the color of a pixel in canvas
       ppm_pixel pixel_color(int row, int col) const;
 
@@ -124,15 +232,56 @@ namespace agl
       void polygon(point c, point v, int n);
 
    private:
+      // set the pixel at (row, col) of whichever backing store the canvas uses
+      void plot(int row, int col, const ppm_pixel& c);
+
+      // call visit(row, col) for each pixel of the box [xmin, xmax] * [ymin, ymax] that is on the canvas.
+      // An out-of-core canvas walks the box tile by tile so that each tile is paged in at most once
+      template <class F>
+      void visit_box(int xmin, int ymin, int xmax, int ymax, F visit);
+
+      // fill the triangle abc into the samples of _samples
+      void multisample_triangle(point a, point b, point c);
+
+      // return true if pixel (row, col) at depth z passes the depth test (always without it), and store z
+      bool depth_passes(int row, int col, float z);
+
+      // draw the points of _vertices one by one where they pass the depth test: square and disc points
+      // store their depth, gaussian ones are blended and leave the depth alone
+      void depth_points();
+
+      // fill the triangle abc, whose vertices have the depths _triangle_z, where it passes the depth test
+      void depth_triangle(point a, point b, point c);
+
+      // record _id as the id of the primitive on top of pixel (row, col) if picking is on
+      void mark(int row, int col);
+
       ppm_image _canvas;
+      std::unique_ptr<tiled_image> _tiles; // out-of-core backing store (replaces _canvas if set)
+      std::vector<std::vector<splat> > _splat_bins; // splats of each tile of _tiles, reused between batches
+      std::vector<size_t> _splat_tiles; // tiles with splats in the current batch, in the order first touched
+      std::unique_ptr<multisample_buffer> _samples; // samples of the edge pixels (if multisampling)
+      std::unique_ptr<depth_buffer> _depth; // depth of the pixels (if depth testing)
+      std::unique_ptr<spatial_index> _index; // primitives drawn with an id (if picking)
+      std::vector<int> _ids; // id of the primitive on top of each pixel (if picking)
+      int _id; // current primitive id
       PrimitiveType _type; // current primitive to draw
       ppm_pixel _color; // current color for vertex
-      std::vector<point> _vertices; // current vertices to draw
-      std::vector<point> _centers; // current vertices/centers to draw
-      std::vector<point> _orientations; // current orientation vector to draw
-      std::vector<int> _radii; // current radius of circle to draw
-      std::vector<int> _sides; // current number of sides for a polygon to draw
-      std::vector<float> _angles; // current angle for a sector to draw
+      frame_arena _arena; // storage of the commands below, reset by end()
+      frame_vector<point> _vertices; // current vertices to draw
+      frame_vector<point> _centers; // current vertices/centers to draw
+      frame_vector<point> _orientations; // current orientation vector to draw
+      frame_vector<int> _radii; // current radius of circle to draw
+      frame_vector<int> _sides; // current number of sides for a polygon to draw
+      frame_vector<float> _angles; // current angle for a sector to draw
+      frame_vector<float> _vertex_depths; // depth of each of _vertices
+      frame_vector<float> _center_depths; // depth of each of _centers
+      int _point_size; // current size of a point
+      SplatShape _point_shape; // current footprint of a point
+      float _sample_dx; // sample offset of filled triangles
+      float _sample_dy;
+      float _z; // current depth for vertex and center
+      float _triangle_z[3]; // depths of the vertices of the triangle being filled
       std::vector<point> _polygon_vertices; // record the vertices of a polygon for artwork purpose
    };
 }
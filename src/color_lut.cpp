@@ -0,0 +1,481 @@
+#include "color_lut.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+using namespace agl;
+using namespace std;
+
+static int clamp_channel(int v)
+{
+   return min(255, max(0, v));
+}
+
+channel_lut::channel_lut()
+{
+   for (int k = 0; k < 3; k++)
+   {
+      for (int v = 0; v < 256; v++)
+      {
+         table[k][v] = v;
+      }
+   }
+}
+
+channel_lut channel_lut::gamma(float gamma)
+{
+   channel_lut lut;
+   for (int v = 0; v < 256; v++)
+   {
+      int out = 255;
+      if (gamma != 0)
+      {
+         out = min(255, static_cast<int>(floor(255.0 * pow(static_cast<double>(v) / 255.0, 1.0 / static_cast<double>(gamma)))));
+      }
+      for (int k = 0; k < 3; k++)
+      {
+         lut.table[k][v] = out;
+      }
+   }
+   return lut;
+}
+
+channel_lut channel_lut::invert(float alpha)
+{
+   channel_lut lut;
+   for (int v = 0; v < 256; v++)
+   {
+      int out = max(0, static_cast<int>(floor(255.0 - static_cast<double>(v) * alpha)));
+      for (int k = 0; k < 3; k++)
+      {
+         lut.table[k][v] = out;
+      }
+   }
+   return lut;
+}
+
+channel_lut channel_lut::levels(int in_black, int in_white, float gamma, int out_black, int out_white)
+{
+   assert((in_white > in_black) && "The white point has to be above the black point!");
+   assert((gamma > 0) && "The gamma of levels has to be positive!");
+
+   channel_lut lut;
+   for (int v = 0; v < 256; v++)
+   {
+      double t = static_cast<double>(min(in_white, max(in_black, v)) - in_black) / static_cast<double>(in_white - in_black);
+      t = pow(t, 1.0 / static_cast<double>(gamma));
+      int out = clamp_channel(static_cast<int>(floor(out_black + t * (out_white - out_black) + 0.5)));
+      for (int k = 0; k < 3; k++)
+      {
+         lut.table[k][v] = out;
+      }
+   }
+   return lut;
+}
+
+channel_lut channel_lut::curve(const std::vector<std::pair<int, int> >& points)
+{
+   channel_lut lut;
+   int n = static_cast<int>(points.size());
+   if (n == 0)
+   {
+      return lut;
+   }
+
+   // monotone cubic (Fritsch-Carlson) tangents, so the curve never overshoots the control points
+   vector<double> slope(max(0, n - 1));
+   for (int i = 0; i + 1 < n; i++)
+   {
+      assert((points[i + 1].first > points[i].first) && "The control points of a curve have to be sorted by x!");
+      slope[i] = static_cast<double>(points[i + 1].second - points[i].second) / static_cast<double>(points[i + 1].first - points[i].first);
+   }
+   vector<double> tangent(n, 0.0);
+   for (int i = 0; i < n; i++)
+   {
+      if (n == 1)
+      {
+         break;
+      }
+      if (i == 0)
+      {
+         tangent[i] = slope[0];
+      }
+      else if (i == n - 1)
+      {
+         tangent[i] = slope[n - 2];
+      }
+      else if (slope[i - 1] * slope[i] > 0)
+      {
+         tangent[i] = 2.0 / (1.0 / slope[i - 1] + 1.0 / slope[i]);
+      }
+   }
+
+   for (int v = 0; v < 256; v++)
+   {
+      double y;
+      if (v <= points[0].first)
+      {
+         y = points[0].second;
+      }
+      else if (v >= points[n - 1].first)
+      {
+         y = points[n - 1].second;
+      }
+      else
+      {
+         int i = 0;
+         while (v > points[i + 1].first)
+         {
+            i++;
+         }
+         double dx = points[i + 1].first - points[i].first;
+         double t = (v - points[i].first) / dx;
+         double t2 = t * t;
+         double t3 = t2 * t;
+         y = (2 * t3 - 3 * t2 + 1) * points[i].second + (t3 - 2 * t2 + t) * dx * tangent[i]
+           + (-2 * t3 + 3 * t2) * points[i + 1].second + (t3 - t2) * dx * tangent[i + 1];
+      }
+      int out = clamp_channel(static_cast<int>(floor(y + 0.5)));
+      for (int k = 0; k < 3; k++)
+      {
+         lut.table[k][v] = out;
+      }
+   }
+   return lut;
+}
+
+channel_lut channel_lut::channels(const channel_lut& r, const channel_lut& g, const channel_lut& b)
+{
+   channel_lut lut;
+   for (int v = 0; v < 256; v++)
+   {
+      lut.table[0][v] = r.table[0][v];
+      lut.table[1][v] = g.table[1][v];
+      lut.table[2][v] = b.table[2][v];
+   }
+   return lut;
+}
+
+channel_lut channel_lut::then(const channel_lut& next) const
+{
+   channel_lut lut;
+   for (int k = 0; k < 3; k++)
+   {
+      for (int v = 0; v < 256; v++)
+      {
+         lut.table[k][v] = next.table[k][table[k][v]];
+      }
+   }
+   return lut;
+}
+
+unsigned char channel_lut::map(int k, int v) const
+{
+   return table[k][clamp_channel(v)];
+}
+
+void channel_lut::apply(ppm_image& image) const
+{
+   color_grade grade;
+   grade.add(*this);
+   grade.apply(image);
+}
+
+cube_lut::cube_lut(int n)
+{
+   assert((n >= 2) && "A 3-D lut needs at least 2 entries per axis!");
+   _n = n;
+   for (int k = 0; k < 3; k++)
+   {
+      _lo[k] = 0.0f;
+      _hi[k] = 1.0f;
+   }
+   _rgb.resize(static_cast<size_t>(n) * n * n * 3);
+   for (int b = 0; b < n; b++)
+   {
+      for (int g = 0; g < n; g++)
+      {
+         for (int r = 0; r < n; r++)
+         {
+            float scale = 1.0f / static_cast<float>(n - 1);
+            set(r, g, b, r * scale, g * scale, b * scale);
+         }
+      }
+   }
+}
+
+bool cube_lut::load(const std::string& filename)
+{
+   ifstream file(filename.c_str());
+   if (!file)
+   {
+      cout << "ERROR: Cannot load file: " << filename << endl << std::endl;
+      return false;
+   }
+
+   int n = 0;
+   float lo[3] = {0.0f, 0.0f, 0.0f};
+   float hi[3] = {1.0f, 1.0f, 1.0f};
+   vector<float> values;
+   string line;
+   while (getline(file, line))
+   {
+      istringstream in(line);
+      string key;
+      if (!(in >> key) || key[0] == '#' || key == "TITLE")
+      {
+         continue;
+      }
+      bool keyword = key == "LUT_3D_SIZE" || key == "DOMAIN_MIN" || key == "DOMAIN_MAX";
+      if (keyword && !values.empty())
+      {
+         // the keywords describe the whole table, so they have to come before its data
+         cout << "ERROR: " << key << " after the table data in " << filename << endl << std::endl;
+         return false;
+      }
+      if (key == "LUT_3D_SIZE")
+      {
+         in >> n;
+      }
+      else if (key == "DOMAIN_MIN")
+      {
+         in >> lo[0] >> lo[1] >> lo[2];
+      }
+      else if (key == "DOMAIN_MAX")
+      {
+         in >> hi[0] >> hi[1] >> hi[2];
+      }
+      else if (key == "LUT_1D_SIZE")
+      {
+         cout << "ERROR: 1-D .cube files are not supported: " << filename << endl << std::endl;
+         return false;
+      }
+      else
+      {
+         // a data line: red green blue, output colors in [0, 1] whatever the domain of the input
+         istringstream data(line);
+         float v[3];
+         if (data >> v[0] >> v[1] >> v[2])
+         {
+            for (int k = 0; k < 3; k++)
+            {
+               values.push_back(v[k]);
+            }
+         }
+      }
+   }
+
+   if (n < 2 || values.size() != static_cast<size_t>(n) * n * n * 3 || !(hi[0] > lo[0] && hi[1] > lo[1] && hi[2] > lo[2]))
+   {
+      cout << "ERROR: " << filename << " is not a valid 3-D .cube file." << endl << std::endl;
+      return false;
+   }
+
+   // the red index changes fastest in the file, which is also the order of _rgb
+   _n = n;
+   for (int k = 0; k < 3; k++)
+   {
+      _lo[k] = lo[k];
+      _hi[k] = hi[k];
+   }
+   _rgb.resize(values.size());
+   for (size_t i = 0; i < values.size(); i++)
+   {
+      _rgb[i] = 255.0f * min(1.0f, max(0.0f, values[i]));
+   }
+   return true;
+}
+
+int cube_lut::size() const
+{
+   return _n;
+}
+
+void cube_lut::set(int r, int g, int b, float red, float green, float blue)
+{
+   float* entry = &_rgb[((static_cast<size_t>(b) * _n + g) * _n + r) * 3];
+   entry[0] = 255.0f * red;
+   entry[1] = 255.0f * green;
+   entry[2] = 255.0f * blue;
+}
+
+void cube_lut::axis_tables(int* cell, float* frac) const
+{
+   for (int k = 0; k < 3; k++)
+   {
+      for (int v = 0; v < 256; v++)
+      {
+         // the input is placed in the domain of its axis; values outside it use the nearest edge
+         float x = (static_cast<float>(v) - 255.0f * _lo[k]) * static_cast<float>(_n - 1) / (255.0f * (_hi[k] - _lo[k]));
+         x = min(static_cast<float>(_n - 1), max(0.0f, x));
+         cell[k * 256 + v] = min(_n - 2, static_cast<int>(x));
+         frac[k * 256 + v] = x - static_cast<float>(cell[k * 256 + v]);
+      }
+   }
+}
+
+void cube_lut::map(const int* cell, const float* frac, int r, int g, int b, LutInterpolation interpolation, float* out) const
+{
+   size_t dr = 3;
+   size_t dg = static_cast<size_t>(_n) * 3;
+   size_t db = static_cast<size_t>(_n) * _n * 3;
+   const float* c000 = &_rgb[cell[512 + b] * db + cell[256 + g] * dg + cell[r] * dr];
+   float fr = frac[r];
+   float fg = frac[256 + g];
+   float fb = frac[512 + b];
+
+   if (interpolation == TRILINEAR)
+   {
+      for (int k = 0; k < 3; k++)
+      {
+         float c00 = c000[k] + fr * (c000[dr + k] - c000[k]);
+         float c10 = c000[dg + k] + fr * (c000[dg + dr + k] - c000[dg + k]);
+         float c01 = c000[db + k] + fr * (c000[db + dr + k] - c000[db + k]);
+         float c11 = c000[db + dg + k] + fr * (c000[db + dg + dr + k] - c000[db + dg + k]);
+         float c0 = c00 + fg * (c10 - c00);
+         float c1 = c01 + fg * (c11 - c01);
+         out[k] = c0 + fb * (c1 - c0);
+      }
+      return;
+   }
+
+   // tetrahedral: pick the tetrahedron of the cell that contains the point and use its 4 corners
+   size_t first, second;
+   float f1, f2, f3;
+   if (fr > fg)
+   {
+      if (fg > fb)
+      {
+         first = dr; second = dr + dg; f1 = fr; f2 = fg; f3 = fb;
+      }
+      else if (fr > fb)
+      {
+         first = dr; second = dr + db; f1 = fr; f2 = fb; f3 = fg;
+      }
+      else
+      {
+         first = db; second = dr + db; f1 = fb; f2 = fr; f3 = fg;
+      }
+   }
+   else
+   {
+      if (fb > fg)
+      {
+         first = db; second = dg + db; f1 = fb; f2 = fg; f3 = fr;
+      }
+      else if (fb > fr)
+      {
+         first = dg; second = dg + db; f1 = fg; f2 = fb; f3 = fr;
+      }
+      else
+      {
+         first = dg; second = dg + dr; f1 = fg; f2 = fr; f3 = fb;
+      }
+   }
+   size_t last = dr + dg + db;
+   for (int k = 0; k < 3; k++)
+   {
+      out[k] = c000[k] + f1 * (c000[first + k] - c000[k]) + f2 * (c000[second + k] - c000[first + k])
+             + f3 * (c000[last + k] - c000[second + k]);
+   }
+}
+
+ppm_pixel cube_lut::map(const ppm_pixel& c, LutInterpolation interpolation) const
+{
+   int cell[3 * 256];
+   float frac[3 * 256];
+   axis_tables(cell, frac);
+   float out[3];
+   map(cell, frac, c.r, c.g, c.b, interpolation, out);
+   ppm_pixel result;
+   result.r = clamp_channel(static_cast<int>(out[0] + 0.5f));
+   result.g = clamp_channel(static_cast<int>(out[1] + 0.5f));
+   result.b = clamp_channel(static_cast<int>(out[2] + 0.5f));
+   return result;
+}
+
+void cube_lut::apply(ppm_image& image, LutInterpolation interpolation) const
+{
+   color_grade grade;
+   grade.add(*this, interpolation);
+   grade.apply(image);
+}
+
+color_grade& color_grade::add(const channel_lut& lut)
+{
+   if (_stages.empty() || _stages.back().has_cube)
+   {
+      stage s;
+      s.lut = lut;
+      s.has_cube = false;
+      s.interpolation = TETRAHEDRAL;
+      _stages.push_back(s);
+   }
+   else
+   {
+      // fuse with the previous per-channel lut
+      _stages.back().lut = _stages.back().lut.then(lut);
+   }
+   return *this;
+}
+
+color_grade& color_grade::add(const cube_lut& lut, LutInterpolation interpolation)
+{
+   if (_stages.empty() || _stages.back().has_cube)
+   {
+      stage s;
+      s.has_cube = false;
+      _stages.push_back(s);
+   }
+   _stages.back().has_cube = true;
+   _stages.back().cube = lut;
+   _stages.back().interpolation = interpolation;
+   return *this;
+}
+
+void color_grade::apply(ppm_image& image) const
+{
+   // grid positions of every 8-bit value for each 3-D lut, computed once per call
+   vector<int> cells(_stages.size() * 3 * 256);
+   vector<float> fracs(_stages.size() * 3 * 256);
+   for (size_t s = 0; s < _stages.size(); s++)
+   {
+      if (_stages[s].has_cube)
+      {
+         _stages[s].cube.axis_tables(&cells[s * 3 * 256], &fracs[s * 3 * 256]);
+      }
+   }
+
+   int n = image.width() * 3;
+   int* pixels = image.data();
+   parallel_for(0, image.height(), 32, [&](int first, int last) {
+      for (size_t x = static_cast<size_t>(first) * n; x < static_cast<size_t>(last) * n; x += 3)
+      {
+         int r = clamp_channel(pixels[x]);
+         int g = clamp_channel(pixels[x + 1]);
+         int b = clamp_channel(pixels[x + 2]);
+         for (size_t s = 0; s < _stages.size(); s++)
+         {
+            const stage& st = _stages[s];
+            r = st.lut.table[0][r];
+            g = st.lut.table[1][g];
+            b = st.lut.table[2][b];
+            if (st.has_cube)
+            {
+               float out[3];
+               st.cube.map(&cells[s * 3 * 256], &fracs[s * 3 * 256], r, g, b, st.interpolation, out);
+               r = clamp_channel(static_cast<int>(out[0] + 0.5f));
+               g = clamp_channel(static_cast<int>(out[1] + 0.5f));
+               b = clamp_channel(static_cast<int>(out[2] + 0.5f));
+            }
+         }
+         pixels[x] = r;
+         pixels[x + 1] = g;
+         pixels[x + 2] = b;
+      }
+   });
+}
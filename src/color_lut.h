@@ -0,0 +1,119 @@
+//----------------------------------------
+// Color lookup tables and color grading
+// Author: Jiajie(Jason) Ma
+//----------------------------------------
+
+#pragma once
+#include <string>
+#include <utility>
+#include <vector>
+#include "ppm_image.h"
+
+namespace agl
+{
+  // A per-channel mapping of 8-bit values, stored as one 256-entry table per channel.
+  // Any per-channel adjustment is compiled into such a table, and chains of them fuse into one.
+  class channel_lut
+  {
+  public:
+     // the identity mapping
+     channel_lut();
+
+     // raise v/255 to the power of 1/gamma (same values as ppm_image::gammaCorrect)
+     static channel_lut gamma(float gamma);
+
+     // 255 - v * alpha, clamped at 0 (same values as ppm_image::invert)
+     static channel_lut invert(float alpha);
+
+     // map [in_black, in_white] onto [out_black, out_white] with a midtone gamma (values outside are clipped)
+     static channel_lut levels(int in_black, int in_white, float gamma = 1.0f, int out_black = 0, int out_white = 255);
+
+     // smooth monotone curve through the control points (x, y), given with increasing x
+     static channel_lut curve(const std::vector<std::pair<int, int> >& points);
+
+     // use the red table of r, the green table of g and the blue table of b
+     static channel_lut channels(const channel_lut& r, const channel_lut& g, const channel_lut& b);
+
+     // return the lut that applies this one and then next
+     channel_lut then(const channel_lut& next) const;
+
+     // map the value v (clamped to [0, 255]) of channel k
+     unsigned char map(int k, int v) const;
+
+     // apply the mapping to every pixel of image
+     void apply(ppm_image& image) const;
+
+     unsigned char table[3][256];
+  };
+
+  // how a 3-D lut is interpolated between its entries
+  enum LutInterpolation {TRILINEAR, TETRAHEDRAL};
+
+  // A 3-D color lookup table of n * n * n rgb entries in [0, 1], e.g. loaded from a .cube file
+  class cube_lut
+  {
+  public:
+     // the identity mapping with n entries per axis
+     explicit cube_lut(int n = 2);
+
+     // load an Adobe/Resolve .cube file (LUT_3D_SIZE, optional DOMAIN_MIN/DOMAIN_MAX, all before the data).
+     // The domain is the range of input values the grid spans (inputs outside it use its edge); the
+     // entries are output colors in [0, 1] whatever the domain
+     // returns true if the load is successful; false otherwise
+     bool load(const std::string& filename);
+
+     // return the number of entries per axis
+     int size() const;
+
+     // set the entry at grid position (r, g, b)
+     void set(int r, int g, int b, float red, float green, float blue);
+
+     // map a color through the table
+     ppm_pixel map(const ppm_pixel& c, LutInterpolation interpolation) const;
+
+     // apply the mapping to every pixel of image
+     void apply(ppm_image& image, LutInterpolation interpolation) const;
+
+  private:
+     friend class color_grade;
+
+     // map the 8-bit color (r, g, b) into out (3 floats in [0, 255]) using the grid position of each
+     // 8-bit value (cell) and its position inside the cell (frac), see axis_tables
+     void map(const int* cell, const float* frac, int r, int g, int b, LutInterpolation interpolation, float* out) const;
+
+     // fill the grid position of every 8-bit value on the red, green and blue axis (3 * 256 entries each,
+     // red first), placing the value in the domain of the axis
+     void axis_tables(int* cell, float* frac) const;
+
+     int _n;
+     float _lo[3]; // domain of the input on each axis
+     float _hi[3];
+     std::vector<float> _rgb; // entry (r, g, b) is at ((b * n + g) * n + r) * 3, scaled to [0, 255]
+  };
+
+  // A color grading pipeline: per-channel luts and 3-D luts applied in order to every pixel in a
+  // single pass over the image. Consecutive per-channel luts are fused into one table as they are added.
+  class color_grade
+  {
+  public:
+     // append a per-channel mapping
+     color_grade& add(const channel_lut& lut);
+
+     // append a 3-D lut
+     color_grade& add(const cube_lut& lut, LutInterpolation interpolation = TETRAHEDRAL);
+
+     // apply the whole pipeline to every pixel of image
+     void apply(ppm_image& image) const;
+
+  private:
+     // a per-channel lut followed by an (optional) 3-D lut
+     struct stage
+     {
+        channel_lut lut;
+        bool has_cube;
+        cube_lut cube;
+        LutInterpolation interpolation;
+     };
+     std::vector<stage> _stages;
+  };
+}
@@ -0,0 +1,235 @@
+#include "compare.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+using namespace agl;
+using namespace std;
+
+// number of channel values hashed by one task
+static const size_t kHashBlock = 1 << 16;
+
+// size and spacing of the ssim windows
+static const int kSsimWindow = 8;
+static const int kSsimStep = 4;
+
+static const uint64_t kPrime1 = 11400714785074694791ULL;
+static const uint64_t kPrime2 = 14029467366897019727ULL;
+static const uint64_t kPrime3 = 1609587929392839161ULL;
+static const uint64_t kPrime4 = 9650029242287828579ULL;
+static const uint64_t kPrime5 = 2870177450012600261ULL;
+
+static uint64_t rotl(uint64_t x, int r)
+{
+   return (x << r) | (x >> (64 - r));
+}
+
+static uint64_t round64(uint64_t acc, uint64_t input)
+{
+   acc += input * kPrime2;
+   return rotl(acc, 31) * kPrime1;
+}
+
+static uint64_t avalanche(uint64_t h)
+{
+   h ^= h >> 33;
+   h *= kPrime2;
+   h ^= h >> 29;
+   h *= kPrime3;
+   h ^= h >> 32;
+   return h;
+}
+
+// two channel values as one 64-bit word (independent of the byte order)
+static uint64_t word(const int* v)
+{
+   return static_cast<uint64_t>(static_cast<uint32_t>(v[0])) | (static_cast<uint64_t>(static_cast<uint32_t>(v[1])) << 32);
+}
+
+// hash of n values: four independent accumulators, each taking every fourth word
+static uint64_t hash_block(const int* v, size_t n, uint64_t seed)
+{
+   uint64_t acc[4] = {seed + kPrime1 + kPrime2, seed + kPrime2, seed, seed - kPrime1};
+   size_t x = 0;
+   for (; x + 8 <= n; x += 8)
+   {
+      acc[0] = round64(acc[0], word(v + x));
+      acc[1] = round64(acc[1], word(v + x + 2));
+      acc[2] = round64(acc[2], word(v + x + 4));
+      acc[3] = round64(acc[3], word(v + x + 6));
+   }
+   uint64_t h = rotl(acc[0], 1) + rotl(acc[1], 7) + rotl(acc[2], 12) + rotl(acc[3], 18);
+   for (; x < n; x++)
+   {
+      h ^= static_cast<uint64_t>(static_cast<uint32_t>(v[x])) * kPrime5;
+      h = rotl(h, 23) * kPrime2 + kPrime4;
+   }
+   return avalanche(h + n);
+}
+
+bool agl::identical(const ppm_image& a, const ppm_image& b)
+{
+   if (a.width() != b.width() || a.height() != b.height())
+   {
+      return false;
+   }
+   size_t stride = static_cast<size_t>(a.width()) * 3;
+   for (int i = 0; i < a.height(); i++)
+   {
+      if (memcmp(a.data() + i * stride, b.data() + i * stride, stride * sizeof(int)) != 0)
+      {
+         return false;
+      }
+   }
+   return true;
+}
+
+uint64_t agl::content_hash(const ppm_image& image)
+{
+   size_t n = static_cast<size_t>(image.width()) * image.height() * 3;
+   int blocks = static_cast<int>((n + kHashBlock - 1) / kHashBlock);
+   vector<uint64_t> hashes(blocks);
+   const int* pixels = image.data();
+   parallel_for(0, blocks, 1, [&](int first, int last) {
+      for (int b = first; b < last; b++)
+      {
+         size_t begin = b * kHashBlock;
+         hashes[b] = hash_block(pixels + begin, min(n, begin + kHashBlock) - begin, b);
+      }
+   });
+
+   uint64_t h = kPrime5 + (static_cast<uint64_t>(image.width()) << 32) + static_cast<uint64_t>(image.height());
+   for (int b = 0; b < blocks; b++)
+   {
+      h = round64(h, hashes[b]);
+   }
+   return avalanche(h);
+}
+
+ppm_image agl::difference(const ppm_image& a, const ppm_image& b, int gain)
+{
+   assert((a.width() == b.width() && a.height() == b.height()) && "The images have to be the same size!");
+   int w = a.width();
+   ppm_image result(w, a.height());
+   const int* pa = a.data();
+   const int* pb = b.data();
+   int* out = result.data();
+   parallel_for(0, a.height(), 64, [&](int first, int last) {
+      for (size_t x = static_cast<size_t>(first) * w * 3; x < static_cast<size_t>(last) * w * 3; x++)
+      {
+         out[x] = min(255, abs(pa[x] - pb[x]) * gain);
+      }
+   });
+   return result;
+}
+
+double agl::psnr(const ppm_image& a, const ppm_image& b)
+{
+   assert((a.width() == b.width() && a.height() == b.height()) && "The images have to be the same size!");
+   int w = a.width();
+   int h = a.height();
+   int parts = max(1, min(h, worker_count()));
+   vector<long long> errors(parts, 0);
+   const int* pa = a.data();
+   const int* pb = b.data();
+   parallel_for(0, parts, 1, [&](int first, int last) {
+      for (int part = first; part < last; part++)
+      {
+         size_t begin = static_cast<size_t>(h) * part / parts * w * 3;
+         size_t end = static_cast<size_t>(h) * (part + 1) / parts * w * 3;
+         long long error = 0;
+         for (size_t x = begin; x < end; x++)
+         {
+            long long d = pa[x] - pb[x];
+            error += d * d;
+         }
+         errors[part] = error;
+      }
+   });
+
+   long long error = 0;
+   for (int part = 0; part < parts; part++)
+   {
+      error += errors[part];
+   }
+   if (error == 0)
+   {
+      return numeric_limits<double>::infinity();
+   }
+   double mse = static_cast<double>(error) / (static_cast<double>(w) * h * 3);
+   return 10.0 * log10(255.0 * 255.0 / mse);
+}
+
+double agl::ssim(const ppm_image& a, const ppm_image& b)
+{
+   assert((a.width() == b.width() && a.height() == b.height()) && "The images have to be the same size!");
+   int w = a.width();
+   int h = a.height();
+   if (w == 0 || h == 0)
+   {
+      return 1.0;
+   }
+   int ww = min(kSsimWindow, w);
+   int wh = min(kSsimWindow, h);
+   int columns = (w - ww) / kSsimStep + 1;
+   int rows = (h - wh) / kSsimStep + 1;
+   const double c1 = (0.01 * 255) * (0.01 * 255);
+   const double c2 = (0.03 * 255) * (0.03 * 255);
+   const double n = static_cast<double>(ww) * wh;
+
+   vector<double> totals(rows, 0.0);
+   const int* pa = a.data();
+   const int* pb = b.data();
+   parallel_for(0, rows, 1, [&](int first, int last) {
+      for (int r = first; r < last; r++)
+      {
+         double total = 0.0;
+         for (int c = 0; c < columns; c++)
+         {
+            // integer sums of the window for the three channels
+            long long sa[3] = {0, 0, 0}, sb[3] = {0, 0, 0}, saa[3] = {0, 0, 0}, sbb[3] = {0, 0, 0}, sab[3] = {0, 0, 0};
+            for (int i = r * kSsimStep; i < r * kSsimStep + wh; i++)
+            {
+               size_t start = (static_cast<size_t>(i) * w + c * kSsimStep) * 3;
+               const int* va = pa + start;
+               const int* vb = pb + start;
+               for (int x = 0; x < ww * 3; x += 3)
+               {
+                  for (int k = 0; k < 3; k++)
+                  {
+                     long long u = va[x + k];
+                     long long v = vb[x + k];
+                     sa[k] += u;
+                     sb[k] += v;
+                     saa[k] += u * u;
+                     sbb[k] += v * v;
+                     sab[k] += u * v;
+                  }
+               }
+            }
+            for (int k = 0; k < 3; k++)
+            {
+               double ma = sa[k] / n;
+               double mb = sb[k] / n;
+               double va = saa[k] / n - ma * ma;
+               double vb = sbb[k] / n - mb * mb;
+               double cov = sab[k] / n - ma * mb;
+               total += ((2 * ma * mb + c1) * (2 * cov + c2)) / ((ma * ma + mb * mb + c1) * (va + vb + c2));
+            }
+         }
+         totals[r] = total;
+      }
+   });
+
+   double total = 0.0;
+   for (int r = 0; r < rows; r++)
+   {
+      total += totals[r];
+   }
+   return total / (static_cast<double>(rows) * columns * 3);
+}
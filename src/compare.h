@@ -0,0 +1,33 @@
+//----------------------------------------
+// Image comparison
+// Author: Jiajie(Jason) Ma
+//----------------------------------------
+
+#pragma once
+#include <cstdint>
+#include "ppm_image.h"
+
+namespace agl
+{
+  // return true if a and b have the same size and the same pixels (rows are compared with memcmp and
+  // the comparison stops at the first difference)
+  bool identical(const ppm_image& a, const ppm_image& b);
+
+  // Return a 64-bit hash of the size and the pixels of image. Equal images have equal hashes on every
+  // platform and for any number of threads: the pixels are hashed in fixed blocks in parallel
+  // (xxHash64-style rounds over pairs of channel values), then the block hashes are combined in order
+  uint64_t content_hash(const ppm_image& image);
+
+  // Return the per-pixel difference |a - b| of two images of the same size, multiplied by gain
+  // (to make small differences visible) and capped at 255
+  ppm_image difference(const ppm_image& a, const ppm_image& b, int gain = 1);
+
+  // Return the peak signal-to-noise ratio of b against a in dB, over all channels (peak 255),
+  // or infinity if the images are identical
+  double psnr(const ppm_image& a, const ppm_image& b);
+
+  // Return the structural similarity of b against a in [-1, 1] (1 when identical): the mean SSIM of
+  // the 8x8 windows of every channel (windows are placed every 4 pixels; the usual constants
+  // (0.01 * 255)^2 and (0.03 * 255)^2). Rows of windows are computed in parallel
+  double ssim(const ppm_image& a, const ppm_image& b);
+}
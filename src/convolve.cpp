@@ -0,0 +1,392 @@
+#include "convolve.h"
+#include "buffer_pool.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+
+using namespace agl;
+using namespace std;
+
+// number of output rows computed by one task
+static const int kConvolveStrip = 32;
+
+conv_kernel::conv_kernel(int width, int height, const int* weights, int divisor) :
+   _w(width), _h(height), _integer(true), _separable(false), _divisor(divisor),
+   _iweights(weights, weights + width * height)
+{
+   assert((width % 2 == 1 && height % 2 == 1) && "The size of a kernel has to be odd!");
+   assert((divisor > 0) && "The divisor of a kernel has to be positive!");
+   factor();
+}
+
+conv_kernel::conv_kernel(int width, int height, const float* weights) :
+   _w(width), _h(height), _integer(false), _separable(false), _divisor(1),
+   _fweights(weights, weights + width * height)
+{
+   assert((width % 2 == 1 && height % 2 == 1) && "The size of a kernel has to be odd!");
+   factor();
+}
+
+conv_kernel conv_kernel::separable(const std::vector<int>& column, const std::vector<int>& row, int divisor)
+{
+   std::vector<int> weights(column.size() * row.size());
+   for (size_t i = 0; i < column.size(); i++)
+   {
+      for (size_t j = 0; j < row.size(); j++)
+      {
+         weights[i * row.size() + j] = column[i] * row[j];
+      }
+   }
+   return conv_kernel(static_cast<int>(row.size()), static_cast<int>(column.size()), weights.data(), divisor);
+}
+
+int conv_kernel::width() const
+{
+   return _w;
+}
+
+int conv_kernel::height() const
+{
+   return _h;
+}
+
+bool conv_kernel::is_integer() const
+{
+   return _integer;
+}
+
+bool conv_kernel::is_separable() const
+{
+   return _separable;
+}
+
+static int gcd(int a, int b)
+{
+   a = abs(a);
+   b = abs(b);
+   while (b != 0)
+   {
+      int t = a % b;
+      a = b;
+      b = t;
+   }
+   return a;
+}
+
+void conv_kernel::factor()
+{
+   // pivot on the largest weight; the kernel is rank-1 if every 2x2 minor through the pivot vanishes
+   int n = _w * _h;
+   int pivot = 0;
+   for (int x = 1; x < n; x++)
+   {
+      double a = _integer ? abs(_iweights[x]) : fabs(_fweights[x]);
+      double b = _integer ? abs(_iweights[pivot]) : fabs(_fweights[pivot]);
+      if (a > b)
+      {
+         pivot = x;
+      }
+   }
+   int pr = pivot / _w;
+   int pc = pivot % _w;
+
+   if (_integer)
+   {
+      if (_iweights[pivot] == 0)
+      {
+         return;
+      }
+      for (int i = 0; i < _h; i++)
+      {
+         for (int j = 0; j < _w; j++)
+         {
+            long long lhs = static_cast<long long>(_iweights[i * _w + j]) * _iweights[pivot];
+            long long rhs = static_cast<long long>(_iweights[i * _w + pc]) * _iweights[pr * _w + j];
+            if (lhs != rhs)
+            {
+               return;
+            }
+         }
+      }
+      // the pivot column divided by its gcd is primitive, so every column is an integer multiple of it
+      int g = 0;
+      for (int i = 0; i < _h; i++)
+      {
+         g = gcd(g, _iweights[i * _w + pc]);
+      }
+      _icolumn.resize(_h);
+      for (int i = 0; i < _h; i++)
+      {
+         _icolumn[i] = _iweights[i * _w + pc] / g;
+      }
+      _irow.resize(_w);
+      for (int j = 0; j < _w; j++)
+      {
+         _irow[j] = _iweights[pr * _w + j] / _icolumn[pr];
+      }
+   }
+   else
+   {
+      float p = _fweights[pivot];
+      if (p == 0.0f)
+      {
+         return;
+      }
+      for (int i = 0; i < _h; i++)
+      {
+         for (int j = 0; j < _w; j++)
+         {
+            double lhs = static_cast<double>(_fweights[i * _w + j]) * p;
+            double rhs = static_cast<double>(_fweights[i * _w + pc]) * _fweights[pr * _w + j];
+            if (fabs(lhs - rhs) > 1e-6 * static_cast<double>(p) * p)
+            {
+               return;
+            }
+         }
+      }
+      _fcolumn.resize(_h);
+      for (int i = 0; i < _h; i++)
+      {
+         _fcolumn[i] = _fweights[i * _w + pc];
+      }
+      _frow.resize(_w);
+      for (int j = 0; j < _w; j++)
+      {
+         _frow[j] = _fweights[pr * _w + j] / p;
+      }
+   }
+   _separable = true;
+}
+
+// return the index read for position i of n according to border, or -1 for a zero
+static int border_index(int i, int n, BorderMode border)
+{
+   if (i >= 0 && i < n)
+   {
+      return i;
+   }
+   if (border == BORDER_ZERO)
+   {
+      return -1;
+   }
+   if (border == BORDER_CLAMP || n == 1)
+   {
+      return (i < 0) ? 0 : n - 1;
+   }
+   if (border == BORDER_WRAP)
+   {
+      return ((i % n) + n) % n;
+   }
+   // reflect around the edge pixels, with a period of 2n - 2
+   int period = 2 * n - 2;
+   i = ((i % period) + period) % period;
+   return (i < n) ? i : period - i;
+}
+
+// Add the 1-D filter taps (N of them, or n if N is 0) across one row of w pixels: out[x] += sum of
+// taps[j] * src[x + (j - r) * 3] over j. The interior is a fixed-length loop over the interleaved
+// channels that the compiler can unroll and vectorize; only the r columns at each end look at border.
+template <class T, int N>
+static void filter_row(const int* src, int w, const T* taps, int n, BorderMode border, T* out)
+{
+   const int count = (N > 0) ? N : n;
+   int r = count / 2;
+   int left = min(w, r);
+   int right = max(left, w - r);
+   for (int x = left * 3; x < right * 3; x++)
+   {
+      const int* s = src + x - r * 3;
+      T sum = 0;
+      for (int j = 0; j < count; j++)
+      {
+         sum += taps[j] * s[j * 3];
+      }
+      out[x] += sum;
+   }
+   for (int col = 0; col < w; col++)
+   {
+      if (col == left)
+      {
+         col = right;
+         if (col >= w)
+         {
+            break;
+         }
+      }
+      for (int j = 0; j < count; j++)
+      {
+         int c = border_index(col + j - r, w, border);
+         if (c >= 0)
+         {
+            out[col * 3] += taps[j] * src[c * 3];
+            out[col * 3 + 1] += taps[j] * src[c * 3 + 1];
+            out[col * 3 + 2] += taps[j] * src[c * 3 + 2];
+         }
+      }
+   }
+}
+
+// out[x] = sum of taps[i] * rows[i][x] over the N (or n) rows
+template <class T, int N>
+static void filter_column(const T* const* rows, int n, const T* taps, int size, T* out)
+{
+   const int count = (N > 0) ? N : n;
+   for (int x = 0; x < size; x++)
+   {
+      T sum = 0;
+      for (int i = 0; i < count; i++)
+      {
+         sum += taps[i] * rows[i][x];
+      }
+      out[x] = sum;
+   }
+}
+
+template <class T>
+static void filter_row(const int* src, int w, const T* taps, int n, BorderMode border, T* out)
+{
+   switch (n)
+   {
+      case 3: filter_row<T, 3>(src, w, taps, n, border, out); break;
+      case 5: filter_row<T, 5>(src, w, taps, n, border, out); break;
+      case 7: filter_row<T, 7>(src, w, taps, n, border, out); break;
+      default: filter_row<T, 0>(src, w, taps, n, border, out); break;
+   }
+}
+
+template <class T>
+static void filter_column(const T* const* rows, int n, const T* taps, int size, T* out)
+{
+   switch (n)
+   {
+      case 3: filter_column<T, 3>(rows, n, taps, size, out); break;
+      case 5: filter_column<T, 5>(rows, n, taps, size, out); break;
+      case 7: filter_column<T, 7>(rows, n, taps, size, out); break;
+      default: filter_column<T, 0>(rows, n, taps, size, out); break;
+   }
+}
+
+// rounded down integer division by a positive d
+static int floor_div(int a, int d)
+{
+   int q = a / d;
+   return (a % d != 0 && a < 0) ? q - 1 : q;
+}
+
+static int to_channel(int sum, int divisor, bool raw)
+{
+   return raw ? sum : min(255, max(0, floor_div(sum, divisor)));
+}
+
+static int to_channel(float sum, int, bool)
+{
+   return min(255, max(0, static_cast<int>(floor(sum))));
+}
+
+// convolve_rows for weights of type T: the sums of each output row are accumulated in a row of T
+template <class T>
+static void convolve_typed(const int* pixels, int w, int h, int top, int bottom, int kw, int kh,
+   const T* weights, const T* column, const T* row, int divisor, BorderMode border, int first, int last, int* out, bool raw)
+{
+   size_t stride = static_cast<size_t>(w) * 3;
+   int rv = kh / 2;
+   pooled_array<T> sums(stride);
+
+   // return the given row of the image or 0 if it is a zero border row
+   auto source = [&](int y) -> const int* {
+      int i = border_index(y, h, border);
+      if (i < 0)
+      {
+         return 0;
+      }
+      assert((i >= top && i < bottom) && "The rows read by the kernel have to be given!");
+      return pixels + (i - top) * stride;
+   };
+
+   if (column != 0)
+   {
+      // horizontal pass over every row the strip reads, then a vertical pass per output row
+      int count = last - first + kh - 1;
+      pooled_array<T> passed(count * stride, 0);
+      for (int y = 0; y < count; y++)
+      {
+         const int* src = source(first - rv + y);
+         if (src != 0)
+         {
+            filter_row<T>(src, w, row, kw, border, &passed[y * stride]);
+         }
+      }
+      vector<const T*> rows(kh);
+      for (int y = first; y < last; y++)
+      {
+         for (int i = 0; i < kh; i++)
+         {
+            rows[i] = &passed[(y - first + i) * stride];
+         }
+         filter_column<T>(rows.data(), kh, column, static_cast<int>(stride), sums.data());
+         int* dst = out + (y - first) * stride;
+         for (size_t x = 0; x < stride; x++)
+         {
+            dst[x] = to_channel(sums[x], divisor, raw);
+         }
+      }
+   }
+   else
+   {
+      // one horizontal pass per kernel row, added up
+      for (int y = first; y < last; y++)
+      {
+         fill(sums.data(), sums.data() + stride, T(0));
+         for (int i = 0; i < kh; i++)
+         {
+            const int* src = source(y - rv + i);
+            if (src != 0)
+            {
+               filter_row<T>(src, w, weights + i * kw, kw, border, sums.data());
+            }
+         }
+         int* dst = out + (y - first) * stride;
+         for (size_t x = 0; x < stride; x++)
+         {
+            dst[x] = to_channel(sums[x], divisor, raw);
+         }
+      }
+   }
+}
+
+void agl::convolve_rows(const int* pixels, int w, int h, int top, int bottom, const conv_kernel& kernel,
+   BorderMode border, int first, int last, int* out, bool raw)
+{
+   if (kernel._integer)
+   {
+      convolve_typed<int>(pixels, w, h, top, bottom, kernel._w, kernel._h, kernel._iweights.data(),
+         kernel._separable ? kernel._icolumn.data() : 0, kernel._irow.data(), kernel._divisor, border, first, last, out, raw);
+   }
+   else
+   {
+      assert(!raw && "Raw sums are only available for integer kernels!");
+      convolve_typed<float>(pixels, w, h, top, bottom, kernel._w, kernel._h, kernel._fweights.data(),
+         kernel._separable ? kernel._fcolumn.data() : 0, kernel._frow.data(), 1, border, first, last, out, false);
+   }
+}
+
+ppm_image agl::convolve(const ppm_image& image, const conv_kernel& kernel, BorderMode border)
+{
+   int w = image.width();
+   int h = image.height();
+   ppm_image result(w, h);
+
+   const int* pixels = image.data();
+   int* out = result.data();
+   parallel_for(0, h, kConvolveStrip, [&](int first, int last) {
+      for (int y = first; y < last; y += kConvolveStrip)
+      {
+         int end = min(last, y + kConvolveStrip);
+         convolve_rows(pixels, w, h, 0, h, kernel, border, y, end, out + static_cast<size_t>(y) * w * 3);
+      }
+   });
+
+   return result;
+}
@@ -0,0 +1,69 @@
+//----------------------------------------
+// Image convolution
+// Author: Jiajie(Jason) Ma
+//----------------------------------------
+
+#pragma once
+#include <vector>
+#include "ppm_image.h"
+
+namespace agl
+{
+  // how pixels outside the image are read: as 0, as the nearest edge pixel, mirrored around the edge
+  // pixel (dcb|abcd|cba) or from the opposite side of the image
+  enum BorderMode {BORDER_ZERO, BORDER_CLAMP, BORDER_REFLECT, BORDER_WRAP};
+
+  // A width * height convolution kernel (odd sizes, centered) with integer or float weights.
+  // Rank-1 kernels are detected when the kernel is built and are applied as a horizontal and a
+  // vertical 1-D pass. Sizes 3, 5 and 7 have their own fixed-size inner loops; other sizes use a generic one.
+  // Integer kernels give the same sums either way; a float kernel is split by dividing by its largest
+  // weight, so its two passes can round differently from the 2-D sum unless that division is exact.
+  class conv_kernel
+  {
+  public:
+     // an integer kernel given row by row; the sums are divided by divisor (rounded down)
+     conv_kernel(int width, int height, const int* weights, int divisor = 1);
+
+     // a float kernel given row by row; the sums are rounded down
+     conv_kernel(int width, int height, const float* weights);
+
+     // the kernel column * row of two 1-D integer kernels
+     static conv_kernel separable(const std::vector<int>& column, const std::vector<int>& row, int divisor = 1);
+
+     // return the width/height of the kernel
+     int width() const;
+     int height() const;
+
+     // return true if the kernel has integer weights
+     bool is_integer() const;
+
+     // return true if the kernel is applied as two 1-D passes
+     bool is_separable() const;
+
+  private:
+     friend void convolve_rows(const int* pixels, int w, int h, int top, int bottom, const conv_kernel& kernel,
+        BorderMode border, int first, int last, int* out, bool raw);
+
+     // find out if the kernel is rank-1 and if so, split it into _column and _row
+     void factor();
+
+     int _w, _h;
+     bool _integer;
+     bool _separable;
+     int _divisor;
+     std::vector<int> _iweights, _icolumn, _irow;
+     std::vector<float> _fweights, _fcolumn, _frow;
+  };
+
+  // Return the convolution of image with kernel, rounded down and clamped to [0, 255].
+  // Like the filters of ppm_image the kernel is not flipped (i.e. this is a correlation), and rows
+  // are computed in parallel. Pixels outside the image are read according to border.
+  ppm_image convolve(const ppm_image& image, const conv_kernel& kernel, BorderMode border = BORDER_ZERO);
+
+  // Compute rows [first, last) of the convolution of a w * h image of which only rows [top, bottom) are
+  // given in pixels (3 ints per pixel, row top first); they have to contain every row the kernel reads.
+  // The results are stored in out (w * 3 ints per row). If raw, the integer sums are stored as they are
+  // (not divided and not clamped; integer kernels only).
+  void convolve_rows(const int* pixels, int w, int h, int top, int bottom, const conv_kernel& kernel,
+     BorderMode border, int first, int last, int* out, bool raw = false);
+}
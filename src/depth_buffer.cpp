@@ -0,0 +1,117 @@
+#include "depth_buffer.h"
+#include <algorithm>
+#include <cassert>
+#include <limits>
+
+using namespace agl;
+using namespace std;
+
+depth_buffer::depth_buffer(int width, int height, int tile_size) : _w(width), _h(height), _tile(tile_size)
+{
+   assert((width > 0 && height > 0) && "width and height of a depth buffer have to be positive!");
+   assert((tile_size > 0) && "The size of a tile has to be positive!");
+   _tiles_x = (width + tile_size - 1) / tile_size;
+   int tiles_y = (height + tile_size - 1) / tile_size;
+   _depths.resize(static_cast<size_t>(width) * height);
+   _nearest.resize(static_cast<size_t>(_tiles_x) * tiles_y);
+   _farthest.resize(_nearest.size());
+   clear();
+   reset_stats();
+}
+
+int depth_buffer::width() const
+{
+   return _w;
+}
+
+int depth_buffer::height() const
+{
+   return _h;
+}
+
+int depth_buffer::tile_size() const
+{
+   return _tile;
+}
+
+void depth_buffer::clear(float z)
+{
+   fill(_depths.begin(), _depths.end(), z);
+   fill(_nearest.begin(), _nearest.end(), z);
+   fill(_farthest.begin(), _farthest.end(), z);
+}
+
+void depth_buffer::clear()
+{
+   clear(numeric_limits<float>::infinity());
+}
+
+float depth_buffer::get(int row, int col) const
+{
+   return _depths[static_cast<size_t>(row) * _w + col];
+}
+
+bool depth_buffer::occluded(int tx, int ty, float nearest) const
+{
+   return nearest >= _farthest[static_cast<size_t>(ty) * _tiles_x + tx];
+}
+
+bool depth_buffer::in_front(int tx, int ty, float farthest) const
+{
+   return farthest < _nearest[static_cast<size_t>(ty) * _tiles_x + tx];
+}
+
+bool depth_buffer::test(int row, int col, float z)
+{
+   _stats.pixels_tested++;
+   float& depth = _depths[static_cast<size_t>(row) * _w + col];
+   if (z >= depth)
+   {
+      return false;
+   }
+   depth = z;
+   float& nearest = _nearest[static_cast<size_t>(row / _tile) * _tiles_x + col / _tile];
+   nearest = min(nearest, z);
+   _stats.pixels_passed++;
+   return true;
+}
+
+void depth_buffer::write(int row, int col, float z)
+{
+   _stats.pixels_tested++;
+   _depths[static_cast<size_t>(row) * _w + col] = z;
+   float& nearest = _nearest[static_cast<size_t>(row / _tile) * _tiles_x + col / _tile];
+   nearest = min(nearest, z);
+   _stats.pixels_passed++;
+}
+
+void depth_buffer::update_tile(int tx, int ty)
+{
+   float farthest = -numeric_limits<float>::infinity();
+   for (int i = ty * _tile; i < min(_h, ty * _tile + _tile); i++)
+   {
+      const float* row = &_depths[static_cast<size_t>(i) * _w];
+      for (int j = tx * _tile; j < min(_w, tx * _tile + _tile); j++)
+      {
+         farthest = max(farthest, row[j]);
+      }
+   }
+   _farthest[static_cast<size_t>(ty) * _tiles_x + tx] = farthest;
+}
+
+depth_stats& depth_buffer::stats()
+{
+   return _stats;
+}
+
+const depth_stats& depth_buffer::stats() const
+{
+   return _stats;
+}
+
+void depth_buffer::reset_stats()
+{
+   _stats.tiles_skipped = 0;
+   _stats.pixels_tested = 0;
+   _stats.pixels_passed = 0;
+}
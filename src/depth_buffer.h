@@ -0,0 +1,72 @@
+//----------------------------------------
+// Depth buffer
+// Author: Jiajie(Jason) Ma
+//----------------------------------------
+
+#pragma once
+#include <cstddef>
+#include <vector>
+
+namespace agl
+{
+  // counters of the depth test
+  struct depth_stats
+  {
+     size_t tiles_skipped; // tiles of primitives rejected at once because everything in them was nearer
+     size_t pixels_tested; // pixels of primitives compared with the buffer
+     size_t pixels_passed; // pixels that were nearer and got drawn
+  };
+
+  // A depth (or layer) per pixel, smaller is nearer, plus the nearest and farthest depth of every
+  // tile_size * tile_size tile. A primitive whose nearest depth is not nearer than the farthest depth
+  // of a tile is hidden in the whole tile, so it can skip the tile before any per-pixel work; one whose
+  // farthest depth is nearer than the nearest depth of a tile wins every pixel without comparing.
+  class depth_buffer
+  {
+  public:
+     // a width x height buffer whose pixels are all infinitely far
+     depth_buffer(int width, int height, int tile_size = 8);
+
+     // return the size of the buffer and of its tiles
+     int width() const;
+     int height() const;
+     int tile_size() const;
+
+     // make every pixel the given depth (infinitely far by default)
+     void clear(float z);
+     void clear();
+
+     // return the depth of pixel (row, col)
+     float get(int row, int col) const;
+
+     // return true if nothing nearer than (or as near as) nearest can be drawn in tile (tx, ty)
+     bool occluded(int tx, int ty, float nearest) const;
+
+     // return true if every pixel of tile (tx, ty) is farther than farthest
+     bool in_front(int tx, int ty, float farthest) const;
+
+     // Return true and store z at pixel (row, col) if z is nearer than its depth
+     bool test(int row, int col, float z);
+
+     // Store z at pixel (row, col) (whose depth is known to be farther)
+     void write(int row, int col, float z);
+
+     // recompute the farthest depth of tile (tx, ty) after its pixels were written
+     void update_tile(int tx, int ty);
+
+     // return the counters of the depth test (reset by reset_stats)
+     depth_stats& stats();
+     const depth_stats& stats() const;
+     void reset_stats();
+
+  private:
+     int _w;
+     int _h;
+     int _tile;
+     int _tiles_x;
+     std::vector<float> _depths;
+     std::vector<float> _nearest; // per tile
+     std::vector<float> _farthest; // per tile
+     depth_stats _stats;
+  };
+}
@@ -1,5 +1,14 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
 #include <iostream>
+#include <string>
+#include <vector>
+#include "batch.h"
 #include "canvas.h"
+#include "random.h"
 using namespace std;
 using namespace agl;
 
@@ -36,15 +45,15 @@ void SierpinskiTriangle(canvas& drawer, point p1, point p2, point p3, int n, boo
    }
 }
 
-// Draw fractal hexagon with n iterations
-void FractalHexagon(canvas& drawer, point c, point v, int n, bool filled)
+// Draw fractal hexagon with n iterations (the hexagons get random colors)
+void FractalHexagon(canvas& drawer, point c, point v, int n, bool filled, rng& random)
 {
    if(n == 1){
       // draw the filled polygon
       if(filled){
-         c.r = rand() % 255;
-         c.g = rand() % 255;
-         c.b = rand() % 255;
+         c.r = random.uniform(255);
+         c.g = random.uniform(255);
+         c.b = random.uniform(255);
          drawer.begin(POLYGONS);
          drawer.center(c);
          drawer.side(6);
@@ -53,9 +62,9 @@ void FractalHexagon(canvas& drawer, point c, point v, int n, bool filled)
          drawer.clear_polygon_vertices();
       }
       else{
-         c.r = rand() % 255;
-         c.g = rand() % 255;
-         c.b = rand() % 255;
+         c.r = random.uniform(255);
+         c.g = random.uniform(255);
+         c.b = random.uniform(255);
          drawer.begin(OUTLINED_POLYGONS);
          drawer.center(c);
          drawer.side(6);
@@ -80,35 +89,33 @@ void FractalHexagon(canvas& drawer, point c, point v, int n, bool filled)
 
       point new_c = drawer.mid_point(p1,p2);
       point new_v = drawer.directional_vector(new_c, p2);
-      FractalHexagon(drawer, new_c, new_v, n-1, filled);
+      FractalHexagon(drawer, new_c, new_v, n-1, filled, random);
 
       new_c = drawer.mid_point(p2,p3);
       new_v = drawer.directional_vector(new_c, p3);
-      FractalHexagon(drawer, new_c, new_v, n-1, filled);
+      FractalHexagon(drawer, new_c, new_v, n-1, filled, random);
 
       new_c = drawer.mid_point(p3,p4);
       new_v = drawer.directional_vector(new_c, p4);
-      FractalHexagon(drawer, new_c, new_v, n-1, filled);
+      FractalHexagon(drawer, new_c, new_v, n-1, filled, random);
 
       new_c = drawer.mid_point(p4,p5);
       new_v = drawer.directional_vector(new_c, p5);
-      FractalHexagon(drawer, new_c, new_v, n-1, filled);
+      FractalHexagon(drawer, new_c, new_v, n-1, filled, random);
 
       new_c = drawer.mid_point(p5,p6);
       new_v = drawer.directional_vector(new_c, p6);
-      FractalHexagon(drawer, new_c, new_v, n-1, filled);
+      FractalHexagon(drawer, new_c, new_v, n-1, filled, random);
 
       new_c = drawer.mid_point(p6,p1);
       new_v = drawer.directional_vector(new_c, p1);
-      FractalHexagon(drawer, new_c, new_v, n-1, filled);
+      FractalHexagon(drawer, new_c, new_v, n-1, filled, random);
    }
 }
 
-int main(int argc, char** argv)
+// Sierpinski triangle on an alpha blending background
+void SierpinskiScene(canvas& drawer)
 {
-   // Artwork results from canvas class
-   canvas drawer(640, 640);
-
    // Sierppinski Triangle
    // specify a fancy background (color palette: Japanese newspaper)
    ppm_pixel tl;
@@ -155,11 +162,13 @@ int main(int argc, char** argv)
    
    
    SierpinskiTriangle(drawer, p1, p2, p3, 6, true);
+}
 
-   drawer.save("Sierpinski triangle.png");
-
+// Wallpaper of outlined Sierpinski triangles
+void WallpaperScene(canvas& drawer)
+{
    // Sierppinski Triangle Wall paper
-   canvas drawer2(640, 320);
+   drawer.background(0, 0, 0);
 
    for (int i = 0; i < 10; i ++)
    {
@@ -194,14 +203,16 @@ int main(int argc, char** argv)
          p3.g = 255;
          p3.b = 255;
 
-         SierpinskiTriangle(drawer2, p1, p2, p3, 6, false);
+         SierpinskiTriangle(drawer, p1, p2, p3, 6, false);
       }
    }
+}
 
-   drawer2.save("Sierpinski triangle Wallpaper.png");
-
+// Wallpaper of color-interpolated triangles
+void IllusionScene(canvas& drawer)
+{
    // Illusion wallpaper
-   drawer2.background(0,0,0);
+   drawer.background(0,0,0);
 
    for (int i = 0; i < 10; i ++)
    {
@@ -236,16 +247,19 @@ int main(int argc, char** argv)
          p3.g = 255;
          p3.b = 255;
 
-         drawer2.begin(TRIANGLES);
-         drawer2.vertex(p1);
-         drawer2.vertex(p2);
-         drawer2.vertex(p3);
-         drawer2.end();
+         drawer.begin(TRIANGLES);
+         drawer.vertex(p1);
+         drawer.vertex(p2);
+         drawer.vertex(p3);
+         drawer.end();
       }
    }
+}
 
-   drawer2.save("Illusion.png");
-
+// Fractal tiling of filled hexagons
+void FilledHexagonScene(canvas& drawer)
+{
+   rng random(2022, 1);
 
    // Hexagon tiling wallpaper
    drawer.background(255, 255, 255); // set background to white
@@ -261,49 +275,67 @@ int main(int argc, char** argv)
    v.x = 320;
    v.y = 0;
 
-   FractalHexagon(drawer, c, v, 4, true);
+   FractalHexagon(drawer, c, v, 4, true, random);
+}
 
-   drawer.save("Filled Hexagon Tiling.png");
+// Fractal tiling of outlined hexagons
+void HexagonScene(canvas& drawer)
+{
+   rng random(2022, 2);
 
    // set background to black
    drawer.background(0, 0, 0);
 
    // draw the fractal 
+   point c;
+   c.x = 320;
+   c.y = 320;
+   c.r = 0;
+   c.g = 0;
+   c.b = 0;
+   point v;
+   v.x = 320;
+   v.y = 0;
 
-   FractalHexagon(drawer, c, v, 4, false);
-
-   drawer.save("Hexagon Tiling.png");
-
+   FractalHexagon(drawer, c, v, 4, false, random);
+}
 
+// Random squares of random colors
+void OrigamiScene(canvas& drawer)
+{
    // colorful origami paper
    drawer.background(255, 255, 255); // set background to white
 
-   // randomly select a point on canvas and check if we should color it (and its neighborhood)
+   // scatter 25,600 rectangles of random color, J x K pixels (3 to 7 each) from a random corner. Each
+   // rectangle is drawn as a row of square splats as wide as its shorter side (the last one overlaps)
+   std::vector<splat> confetti;
+   rng random(2022);
    for (int i = 0; i < 640*40; i++)
    {
-      point p;
-      p.x = rand()%640;
-      p.y = rand()%640;
-      p.r = rand()%255;
-      p.g = rand()%255;
-      p.b = rand()%255;
-      int J = rand()%5+3;
-      int K = rand()%5+3;
-      for (int j = 0; j < J; j++){
-         for (int k = 0; k < K; k++)
-         {
-            if (rand()%3 != -1 ){
-               drawer.begin(POINTS);
-               drawer.color(p.r, p.g, p.b);
-               drawer.vertex(p.x+j, p.y+k);
-               drawer.end();
-            }
-         }
+      splat s;
+      int x = random.uniform(640);
+      int y = random.uniform(640);
+      s.r = random.uniform(255);
+      s.g = random.uniform(255);
+      s.b = random.uniform(255);
+      int J = random.uniform(3, 7);
+      int K = random.uniform(3, 7);
+      s.size = std::min(J, K);
+      for (int along = 0; along < std::max(J, K); along += s.size)
+      {
+         int offset = std::min(along, std::max(J, K) - s.size);
+         s.x = x + (J > K ? offset : 0) + s.size / 2;
+         s.y = y + (J > K ? 0 : offset) + s.size / 2;
+         confetti.push_back(s);
       }
    }
-   
-   drawer.save("Colorful Origami Paper.png");
+   drawer.point_shape(SQUARE);
+   drawer.splats(confetti.data(), static_cast<int>(confetti.size()));
+}
 
+// Pokemon ball drawn with sectors, circles and lines
+void PokemonScene(canvas& drawer)
+{
    // Pokemon Ball
    drawer.background(21, 0, 255); // set the background to blue
 
@@ -394,8 +426,63 @@ int main(int argc, char** argv)
    drawer.vertex(320+210,318);
    drawer.vertex(320+60, 318);
    drawer.end();
+}
+
+// Render every scene as a batch job
+// usage: draw_art [-j threads] [--budget megabytes] [--samples n]
+int main(int argc, char** argv)
+{
+   int threads = 0;
+   size_t budget = 0;
+   int samples = 1;
+   for (int i = 1; i < argc; i++)
+   {
+      if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+      {
+         threads = atoi(argv[++i]);
+      }
+      else if (strcmp(argv[i], "--budget") == 0 && i + 1 < argc)
+      {
+         budget = static_cast<size_t>(atof(argv[++i]) * (1 << 20));
+      }
+      else if (strcmp(argv[i], "--samples") == 0 && i + 1 < argc)
+      {
+         samples = atoi(argv[++i]);
+      }
+      else
+      {
+         cout << "usage: " << argv[0] << " [-j threads] [--budget megabytes] [--samples 2|4|8|16]" << endl;
+         return 1;
+      }
+   }
 
-   drawer.save("Pokemon Ball.png");
+   vector<render_job> jobs;
+   jobs.push_back({"Sierpinski triangle.png", 640, 640, SierpinskiScene});
+   jobs.push_back({"Sierpinski triangle Wallpaper.png", 640, 320, WallpaperScene});
+   jobs.push_back({"Illusion.png", 640, 320, IllusionScene});
+   jobs.push_back({"Filled Hexagon Tiling.png", 640, 640, FilledHexagonScene});
+   jobs.push_back({"Hexagon Tiling.png", 640, 640, HexagonScene});
+   jobs.push_back({"Colorful Origami Paper.png", 640, 640, OrigamiScene});
+   jobs.push_back({"Pokemon Ball.png", 640, 640, PokemonScene});
+
+   // multisample every scene (the workers reuse their canvases, so each job sets it)
+   for (size_t j = 0; samples > 1 && j < jobs.size(); j++)
+   {
+      function<void(canvas&)> draw = jobs[j].draw;
+      jobs[j].draw = [draw, samples](canvas& drawer) {
+         drawer.multisample(samples);
+         draw(drawer);
+      };
+   }
 
+   batch_runner runner(threads, budget);
+   vector<job_timing> timings = runner.run(jobs);
+   double total = 0;
+   for (size_t j = 0; j < timings.size(); j++)
+   {
+      cout << timings[j].seconds << "s\t" << timings[j].output << " (worker " << timings[j].worker << ")" << endl;
+      total += timings[j].seconds;
+   }
+   cout << timings.size() << " jobs on " << runner.threads() << " workers, " << total << "s of work" << endl;
+   return 0;
 }
-
@@ -1,9 +1,98 @@
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
 #include <iostream>
+#include <stdexcept>
+#include <iterator>
+#include <string>
+#include <vector>
+#include "accumulation.h"
+#include "animation.h"
+#include "batch.h"
+#include "buffer_pool.h"
 #include "canvas.h"
+#include "lazy_image.h"
+#include "morphology.h"
+#include "parallel.h"
+#include "pixel_image.h"
+#include "pyramid.h"
+#include "color_lut.h"
+#include "compare.h"
+#include "image_writer.h"
+#include "convolve.h"
+#include "frame_arena.h"
+#include "image_stats.h"
+#include "integral_image.h"
+#include "random.h"
+#include "rank_filter.h"
+#include "resample.h"
+#include "scene.h"
+#include "spatial_index.h"
+#include "splat.h"
+#include "video_sink.h"
 
 using namespace agl;
 using namespace std;
 
+// content_hash of the expected image of each test; update it when a change of the output is intended
+struct golden_image
+{
+   const char* name;
+   uint64_t hash;
+};
+
+static const golden_image kGolden[] = {
+   {"horizontal-line.png", 0xe8d1cc074ea47072ULL},
+   {"vertical-line.png", 0x878c87f8292d2201ULL},
+   {"diagonal-line-1.png", 0xc8ec75f33ee1a49cULL},
+   {"h-lessthan-w-line-1.png", 0xf859557fc007d431ULL},
+   {"w-lessthan-h-line-1.png", 0x36482f64193596abULL},
+   {"diagonal-line-2.png", 0xc7dead12c57f221eULL},
+   {"h-lessthan-w-line-2.png", 0x2b99b433f30575f7ULL},
+   {"w-lessthan-h-line-2.png", 0x7e667ecb8aa73a88ULL},
+   {"line-color-interpolation.png", 0x5367117fdd355e1cULL},
+   {"triangle.png", 0x1885aaf6b4de1e41ULL},
+   {"quad.png", 0x83944e4652a3a254ULL}
+};
+
+static bool write_images = false;
+static int failures = 0;
+
+// compare the canvas with the golden hash of the test (and save it with --write)
+void check(canvas& drawer, const std::string& savename)
+{
+   uint64_t hash = content_hash(drawer.image());
+   bool found = false;
+   for (size_t i = 0; i < sizeof(kGolden) / sizeof(kGolden[0]); i++)
+   {
+      if (savename == kGolden[i].name)
+      {
+         found = (kGolden[i].hash == hash);
+      }
+   }
+   if (found)
+   {
+      cout << "ok     " << savename << endl;
+   }
+   else
+   {
+      cout << "FAILED " << savename << ": content hash is 0x" << hex << setw(16) << setfill('0') << hash << dec << endl;
+      failures++;
+   }
+
+   if (write_images)
+   {
+      drawer.save(savename);
+   }
+}
+
 void test_line(canvas& drawer, int ax, int ay, int bx, int by, const std::string& savename)
 {
    drawer.background(0, 0, 0);
@@ -11,11 +100,1899 @@ void test_line(canvas& drawer, int ax, int ay, int bx, int by, const std::string
    drawer.vertex(ax, ay);
    drawer.vertex(bx, by);
    drawer.end();
-   drawer.save(savename);
+   check(drawer, savename);
+}
+
+// print the outcome of a test that has no image
+void report(bool passed, const std::string& name, const std::string& problem)
+{
+   if (passed)
+   {
+      cout << "ok     " << name << endl;
+   }
+   else
+   {
+      cout << "FAILED " << name << ": " << problem << endl;
+      failures++;
+   }
+}
+
+// run f on the worker of a one-thread pool, where parallel_for runs inline: the result is what the
+// library computes with AGL_THREADS=1
+template <class F>
+void serially(F f)
+{
+   thread_pool single(1);
+   single.async(f).get();
+}
+
+// return a width x height image of random channels in [0, 255]
+ppm_image random_image(int width, int height, uint64_t seed)
+{
+   ppm_image image(width, height);
+   rng random(seed);
+   int* pixels = image.data();
+   for (size_t k = 0; k < static_cast<size_t>(width) * height * 3; k++)
+   {
+      pixels[k] = random.uniform(256);
+   }
+   return image;
+}
+
+// draw a bit of everything a scene can hold onto drawer, a canvas or a scene_writer
+template <class Drawer>
+void draw_scene_sample(Drawer& drawer)
+{
+   ppm_pixel tl = {10, 20, 30}, tr = {200, 0, 0}, bl = {0, 200, 0}, br = {0, 0, 200};
+   drawer.background(tl, tr, bl, br);
+   drawer.color(255, 255, 0);
+   drawer.begin(TRIANGLES);
+   drawer.vertex(5, 5);
+   drawer.color(0, 255, 255);
+   drawer.vertex(60, 12);
+   drawer.vertex(20, 70);
+   drawer.end();
+   drawer.begin(LINES);
+   drawer.vertex(0, 99);
+   drawer.vertex(99, 40);
+   drawer.end();
+   drawer.begin(CIRCLES);
+   drawer.center(70, 70);
+   drawer.radius(15);
+   drawer.end();
+   drawer.begin(POLYGONS);
+   drawer.center(30, 80);
+   drawer.orientation(10, 2);
+   drawer.side(5);
+   drawer.end();
+   drawer.begin(SECTORS);
+   drawer.center(80, 20);
+   drawer.orientation(15, -4);
+   drawer.angle(1.2f);
+   drawer.end();
+   drawer.point_size(5);
+   drawer.point_shape(DISC);
+   drawer.begin(POINTS);
+   drawer.vertex(50, 50);
+   drawer.vertex(90, 90);
+   drawer.end();
+   drawer.depth_test(true);
+   drawer.depth(0.5f);
+   drawer.begin(TRIANGLES);
+   drawer.vertex(40, 30);
+   drawer.vertex(95, 45);
+   drawer.vertex(55, 95);
+   drawer.end();
+   drawer.depth(0.8f);
+   drawer.begin(TRIANGLES);
+   drawer.vertex(35, 40);
+   drawer.vertex(90, 35);
+   drawer.vertex(60, 85);
+   drawer.end();
+   drawer.depth_test(false);
+   drawer.multisample(4);
+   drawer.color(255, 0, 128);
+   drawer.begin(TRIANGLES);
+   drawer.vertex(10, 40);
+   drawer.vertex(45, 55);
+   drawer.vertex(12, 95);
+   drawer.end();
+}
+
+// a scene played onto a canvas draws the same image as the calls it recorded
+void test_scene_round_trip()
+{
+   canvas direct(100, 100);
+   direct.color(0, 0, 0);
+   draw_scene_sample(direct);
+   scene_writer writer(100, 100);
+   writer.color(0, 0, 0);
+   draw_scene_sample(writer);
+
+   canvas played(100, 100);
+   string error;
+   bool ok = play_scene(writer.bytes().data(), writer.bytes().size(), played, &error);
+   report(ok && content_hash(played.image()) == content_hash(direct.image()), "scene-round-trip",
+      ok ? "the played image differs from the direct one" : error);
+}
+
+// truncated and corrupt scenes are rejected with an error instead of drawn or crashing
+void test_scene_rejects()
+{
+   scene_writer writer(64, 64);
+   writer.begin(TRIANGLES);
+   for (int k = 0; k < 20; k++)
+   {
+      writer.color(k * 12, 255 - k * 12, 7);
+      writer.vertex(3 * k, 2 * k);
+      writer.vertex(3 * k + 9, 60 - k);
+      writer.depth(0.25f);
+      writer.vertex(k, 63);
+   }
+   writer.end();
+   const vector<uint8_t>& bytes = writer.bytes();
+   size_t header = scene_writer(64, 64).bytes().size();
+
+   canvas drawer(64, 64);
+   string error;
+   int accepted = 0;
+   // every cut is inside the header or inside the one primitive of the scene
+   for (size_t size = 0; size < bytes.size(); size++)
+   {
+      error.clear();
+      if (size != header && (play_scene(bytes.data(), size, drawer, &error) || error.empty()))
+      {
+         accepted++;
+      }
+   }
+   report(accepted == 0, "scene-truncated", to_string(accepted) + " truncated scenes were not rejected");
+
+   vector<vector<uint8_t> > bad;
+   bad.push_back(bytes);
+   bad.back()[0] = 'X'; // not a scene
+   bad.push_back(bytes);
+   bad.back()[4] = SCENE_VERSION + 1; // a newer version
+   bad.push_back(bytes);
+   bad.back().push_back(0xff); // unknown command
+   bad.push_back(bytes);
+   bad.back().push_back(2); // end without begin
+   accepted = 0;
+   for (size_t k = 0; k < bad.size(); k++)
+   {
+      error.clear();
+      if (play_scene(bad[k].data(), bad[k].size(), drawer, &error) || error.empty())
+      {
+         accepted++;
+      }
+   }
+
+   // random damage may still leave a valid scene, but a rejected one always says why
+   rng random(38, 0);
+   for (int k = 0; k < 2000; k++)
+   {
+      vector<uint8_t> damaged = bytes;
+      for (int n = 0; n < 4; n++)
+      {
+         damaged[random.uniform(static_cast<int>(damaged.size()))] = static_cast<uint8_t>(random.uniform(256));
+      }
+      error.clear();
+      if (!play_scene(damaged.data(), damaged.size(), drawer, &error) && error.empty())
+      {
+         accepted++;
+      }
+   }
+   report(accepted == 0, "scene-corrupt", to_string(accepted) + " corrupt scenes were not rejected with an error");
+}
+
+// an outlined triangle draws its three edges once, so a large one is as cheap as three lines
+void test_scene_outline_cost()
+{
+   scene_writer writer(800, 800);
+   writer.background(0, 0, 0);
+   writer.color(255, 255, 255);
+   writer.begin(OUTLINED_TRIANGLES);
+   for (int k = 0; k < 20; k++)
+   {
+      writer.vertex(k, 5 * k);
+      writer.vertex(799 - k, 10 * k);
+      writer.vertex(400, 799 - k);
+   }
+   writer.end();
+
+   canvas lines(800, 800);
+   lines.background(0, 0, 0);
+   lines.color(255, 255, 255);
+   lines.begin(LINES);
+   for (int k = 0; k < 20; k++)
+   {
+      int x[3] = {k, 799 - k, 400};
+      int y[3] = {5 * k, 10 * k, 799 - k};
+      for (int e = 0; e < 3; e++)
+      {
+         lines.vertex(x[e], y[e]);
+         lines.vertex(x[(e + 1) % 3], y[(e + 1) % 3]);
+      }
+   }
+   lines.end();
+
+   canvas played(800, 800);
+   string error;
+   chrono::steady_clock::time_point start = chrono::steady_clock::now();
+   bool ok = play_scene(writer.bytes().data(), writer.bytes().size(), played, &error);
+   double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+   report(ok && content_hash(played.image()) == content_hash(lines.image()), "scene-outline",
+      ok ? "the outlines differ from their edges drawn as lines" : error);
+   // drawing the edges once per pixel of the box took minutes here
+   report(seconds < 1.0, "scene-outline-cost", "20 outlined triangles took " + to_string(seconds) + " s");
+}
+
+// the domain of a .cube file scales the input of the table, not its entries, and has to come first
+void test_cube_domain()
+{
+   const char* name = "draw_test-domain.cube";
+   string corners;
+   for (int k = 0; k < 8; k++)
+   {
+      corners += to_string(k & 1) + " " + to_string((k >> 1) & 1) + " " + to_string(k >> 2) + "\n";
+   }
+   ofstream(name) << "LUT_3D_SIZE 2\nDOMAIN_MIN 0 0 0\nDOMAIN_MAX 0.5 0.5 0.5\n" << corners;
+   cube_lut lut;
+   bool loaded = lut.load(name);
+   int wrong = 0;
+   for (int v = 0; loaded && v < 256; v++)
+   {
+      ppm_pixel c;
+      c.r = v;
+      c.g = v / 2;
+      c.b = 255 - v;
+      int in[3] = {c.r, c.g, c.b};
+      for (int interpolation = TRILINEAR; interpolation <= TETRAHEDRAL; interpolation++)
+      {
+         ppm_pixel out = lut.map(c, static_cast<LutInterpolation>(interpolation));
+         int got[3] = {out.r, out.g, out.b};
+         for (int k = 0; k < 3; k++)
+         {
+            // the grid spans inputs [0, 127.5], so the identity entries double the input up to white
+            int expected = min(255, static_cast<int>(in[k] * 2.0f + 0.5f));
+            if (abs(got[k] - expected) > 1)
+            {
+               wrong++;
+            }
+         }
+      }
+   }
+   report(loaded && wrong == 0, "cube-domain", loaded ? to_string(wrong) + " channels mapped wrongly" : "cannot load");
+
+   ofstream(name) << "LUT_3D_SIZE 2\n" << corners << "DOMAIN_MAX 0.5 0.5 0.5\n";
+   report(!lut.load(name), "cube-domain-after-data", "a domain after the table data was accepted");
+   remove(name);
+}
+
+// splats come out the same whatever the number of threads, and square and disc splats are drawn over
+// each other in submission order
+void test_splats()
+{
+   vector<splat> many(4000);
+   vector<splat> serial(many.size());
+   random_splats(many.data(), static_cast<int>(many.size()), 300, 200, 1, 15, 26);
+   serially([&]() { random_splats(serial.data(), static_cast<int>(serial.size()), 300, 200, 1, 15, 26); });
+   bool same = true;
+   for (size_t k = 0; k < many.size(); k++)
+   {
+      same = same && many[k].x == serial[k].x && many[k].y == serial[k].y && many[k].size == serial[k].size &&
+         many[k].r == serial[k].r && many[k].g == serial[k].g && many[k].b == serial[k].b;
+   }
+   report(same, "splats-random", "random_splats depends on the number of threads");
+
+   const char* names[] = {"splats-square", "splats-disc", "splats-gaussian"};
+   for (int shape = SQUARE; shape <= GAUSSIAN; shape++)
+   {
+      ppm_image parallel = random_image(300, 200, 1);
+      ppm_image single = parallel;
+      draw_splats(parallel, many.data(), static_cast<int>(many.size()), static_cast<SplatShape>(shape));
+      serially([&]() { draw_splats(single, many.data(), static_cast<int>(many.size()), static_cast<SplatShape>(shape)); });
+      bool matches = identical(parallel, single);
+      if (shape != GAUSSIAN)
+      {
+         ppm_image brute = random_image(300, 200, 1);
+         for (size_t k = 0; k < many.size(); k++)
+         {
+            const splat& s = many[k];
+            int before, after;
+            splat_extent(static_cast<SplatShape>(shape), s.size, before, after);
+            for (int i = max(0, s.y - before); i <= min(brute.height() - 1, s.y + after); i++)
+            {
+               for (int j = max(0, s.x - before); j <= min(brute.width() - 1, s.x + after); j++)
+               {
+                  if (splat_covers(static_cast<SplatShape>(shape), s.size, j - s.x, i - s.y))
+                  {
+                     ppm_pixel c = {s.r, s.g, s.b};
+                     brute.set(i, j, c);
+                  }
+               }
+            }
+         }
+         matches = matches && identical(parallel, brute);
+      }
+      report(matches, names[shape], "the splats differ from one thread or from drawing them one by one");
+   }
+}
+
+// resampling to the same size gives back the image with every filter, and resampling is the same
+// whatever the number of threads
+void test_resample()
+{
+   ppm_image image = random_image(157, 93, 27);
+   const char* names[] = {"nearest", "bilinear", "bicubic", "lanczos"};
+   for (int filter = NEAREST; filter <= LANCZOS; filter++)
+   {
+      ResampleFilter f = static_cast<ResampleFilter>(filter);
+      bool same = identical(resample(image, 157, 93, f), image);
+      ppm_image down, up;
+      serially([&]() {
+         down = resample(image, 61, 40, f);
+         up = resample(image, 400, 211, f);
+      });
+      bool threads = identical(resample(image, 61, 40, f), down) && identical(resample(image, 400, 211, f), up);
+      report(same && threads, string("resample-") + names[filter],
+         !same ? "resampling to the same size changed the image" : "the result depends on the number of threads");
+   }
+}
+
+// return the number of tiles of the deep zoom pyramid name that are missing, extra or differ from the
+// crops of levels (with their overlap), and remove the pyramid
+int deep_zoom_problems(const string& name, const vector<ppm_image>& levels, int tile, int overlap)
+{
+   int top = static_cast<int>(levels.size()) - 1;
+   vector<string> files;
+   int problems = 0;
+   for (int level = 0; level <= top + 1; level++)
+   {
+      int w = level <= top ? levels[level].width() : 0;
+      int h = level <= top ? levels[level].height() : 0;
+      int cols = (w + tile - 1) / tile;
+      int rows = (h + tile - 1) / tile;
+      // one tile past the last row and column must not exist either
+      for (int row = 0; row <= rows; row++)
+      {
+         for (int col = 0; col <= cols; col++)
+         {
+            string file = name + "_files/" + to_string(level) + "/" + to_string(col) + "_" + to_string(row) + ".ppm";
+            bool expected = row < rows && col < cols;
+            if (ifstream(file.c_str()).good() != expected)
+            {
+               problems++;
+               continue;
+            }
+            if (!expected)
+            {
+               continue;
+            }
+            files.push_back(file);
+            int x0 = max(0, col * tile - overlap), x1 = min(w, (col + 1) * tile + overlap);
+            int y0 = max(0, row * tile - overlap), y1 = min(h, (row + 1) * tile + overlap);
+            ppm_image loaded;
+            if (!loaded.load(file) || loaded.width() != x1 - x0 || loaded.height() != y1 - y0)
+            {
+               problems++;
+               continue;
+            }
+            bool same = true;
+            for (int i = y0; i < y1; i++)
+            {
+               for (int j = x0; j < x1; j++)
+               {
+                  ppm_pixel a = loaded.get(i - y0, j - x0), b = levels[level].get(i, j);
+                  same = same && a.r == b.r && a.g == b.g && a.b == b.b;
+               }
+            }
+            problems += same ? 0 : 1;
+         }
+      }
+   }
+
+   for (size_t k = 0; k < files.size(); k++)
+   {
+      remove(files[k].c_str());
+   }
+   for (int level = 0; level <= top; level++)
+   {
+      remove((name + "_files/" + to_string(level)).c_str());
+   }
+   remove((name + "_files").c_str());
+   remove((name + ".dzi").c_str());
+   return problems;
+}
+
+// a deep zoom pyramid has a level per halving down to 1x1, its full-size tiles are crops of the image
+// (with their overlap) and the tiles of the level below hold its 2x2 averages, also when every worker
+// of the global pool is saving a pyramid at once
+void test_deep_zoom()
+{
+   const string name = "draw_test-dzi";
+   const int tile = 32, overlap = 2, top = 7;
+   ppm_image image = random_image(100, 60, 28);
+   bool saved = save_deep_zoom(image, name, tile, overlap, "ppm");
+
+   // the image of each level, reduced the way the pyramid is documented
+   vector<ppm_image> levels(top + 1);
+   levels[top] = image;
+   for (int level = top - 1; level >= 0; level--)
+   {
+      const ppm_image& above = levels[level + 1];
+      levels[level] = ppm_image((above.width() + 1) / 2, (above.height() + 1) / 2);
+      for (int i = 0; i < levels[level].height(); i++)
+      {
+         for (int j = 0; j < levels[level].width(); j++)
+         {
+            int i2 = min(above.height() - 1, 2 * i + 1);
+            int j2 = min(above.width() - 1, 2 * j + 1);
+            ppm_pixel a = above.get(2 * i, 2 * j), b = above.get(2 * i, j2), c = above.get(i2, 2 * j), d = above.get(i2, j2);
+            ppm_pixel mean;
+            mean.r = (a.r + b.r + c.r + d.r + 2) >> 2;
+            mean.g = (a.g + b.g + c.g + d.g + 2) >> 2;
+            mean.b = (a.b + b.b + c.b + d.b + 2) >> 2;
+            levels[level].set(i, j, mean);
+         }
+      }
+   }
+   int problems = deep_zoom_problems(name, levels, tile, overlap);
+   report(saved && problems == 0, "deep-zoom", to_string(problems) + " tiles missing, extra or wrong");
+
+   // saving from inside the pool must not wait for tiles queued behind the savers themselves
+   int savers = thread_pool::global().size();
+   vector<future<bool> > saving;
+   for (int k = 0; k < savers; k++)
+   {
+      string worker_name = name + "-worker" + to_string(k);
+      saving.push_back(thread_pool::global().async([=, &image]() { return save_deep_zoom(image, worker_name, tile, overlap, "ppm"); }));
+   }
+   bool finished = true;
+   problems = 0;
+   for (int k = 0; k < savers; k++)
+   {
+      finished = finished && saving[k].wait_for(chrono::seconds(30)) == future_status::ready && saving[k].get();
+      problems += finished ? deep_zoom_problems(name + "-worker" + to_string(k), levels, tile, overlap) : 0;
+   }
+   report(finished && problems == 0, "deep-zoom-workers",
+      finished ? to_string(problems) + " tiles missing, extra or wrong" : "saving from the pool workers deadlocked");
+}
+
+// draw the primitives an out-of-core canvas supports, from random positions and colors
+void draw_tiled_sample(canvas& drawer)
+{
+   rng random(29);
+   ppm_pixel tl = {10, 20, 30}, tr = {200, 0, 0}, bl = {0, 200, 0}, br = {0, 0, 200};
+   drawer.background(tl, tr, bl, br);
+   PrimitiveType types[] = {LINES, TRIANGLES, OUTLINED_TRIANGLES, CIRCLES, OUTLINED_CIRCLES, POLYGONS, OUTLINED_POLYGONS, SECTORS};
+   for (int t = 0; t < 8; t++)
+   {
+      drawer.begin(types[t]);
+      for (int k = 0; k < 6; k++)
+      {
+         drawer.color(random.uniform(256), random.uniform(256), random.uniform(256));
+         if (types[t] == LINES || types[t] == TRIANGLES || types[t] == OUTLINED_TRIANGLES)
+         {
+            for (int v = 0; v < (types[t] == LINES ? 2 : 3); v++)
+            {
+               drawer.vertex(random.uniform(-20, 170), random.uniform(-20, 120));
+            }
+            continue;
+         }
+         drawer.center(random.uniform(0, 149), random.uniform(0, 99));
+         if (types[t] == CIRCLES || types[t] == OUTLINED_CIRCLES)
+         {
+            drawer.radius(random.uniform(2, 40));
+         }
+         else
+         {
+            drawer.orientation(random.uniform(-30, 30), random.uniform(-30, 30));
+            if (types[t] == SECTORS)
+            {
+               drawer.angle(random.uniform01() * 3.0f);
+            }
+            else
+            {
+               drawer.side(random.uniform(3, 9));
+            }
+         }
+      }
+      drawer.end();
+   }
+   vector<splat> splats(500);
+   random_splats(splats.data(), static_cast<int>(splats.size()), 150, 100, 1, 9, 29);
+   for (int shape = SQUARE; shape <= GAUSSIAN; shape++)
+   {
+      drawer.point_shape(static_cast<SplatShape>(shape));
+      drawer.splats(splats.data() + shape * 150, 150);
+   }
+}
+
+// an out-of-core canvas whose cache holds only 4 of its 70 tiles draws the same pixels as an in-memory one
+void test_tiled_canvas()
+{
+   canvas memory(150, 100);
+   canvas tiled(150, 100, 16, 4 * 16 * 16 * 3);
+   draw_tiled_sample(memory);
+   draw_tiled_sample(tiled);
+   // batches of points of every shape, so the tiles reuse their bins from one batch to the next
+   SplatShape shapes[] = {SQUARE, DISC, GAUSSIAN};
+   for (int batch = 0; batch < 6; batch++)
+   {
+      vector<splat> points(300);
+      random_splats(points.data(), 300, 150, 100, 1, 12, 80 + batch);
+      memory.point_shape(shapes[batch % 3]);
+      tiled.point_shape(shapes[batch % 3]);
+      memory.splats(points.data(), 300);
+      tiled.splats(points.data(), 300);
+   }
+   int wrong = 0;
+   for (int i = 0; i < 100; i++)
+   {
+      for (int j = 0; j < 150; j++)
+      {
+         ppm_pixel a = memory.pixel_color(i, j), b = tiled.pixel_color(i, j);
+         wrong += (a.r != b.r || a.g != b.g || a.b != b.b) ? 1 : 0;
+      }
+   }
+   report(wrong == 0, "tiled-canvas", to_string(wrong) + " pixels differ from the in-memory canvas");
+}
+
+// a color_grade applies its luts in one pass with the same result as applying them one after the other,
+// and the luts give the values of the ppm_image filters they stand for
+void test_color_grade()
+{
+   ppm_image image = random_image(120, 80, 31);
+   vector<pair<int, int> > points;
+   points.push_back(make_pair(0, 10));
+   points.push_back(make_pair(90, 70));
+   points.push_back(make_pair(200, 220));
+   points.push_back(make_pair(255, 240));
+   channel_lut luts[] = {channel_lut::gamma(2.2f), channel_lut::levels(20, 230, 0.8f, 10, 245),
+      channel_lut::curve(points), channel_lut::invert(0.9f)};
+   cube_lut cube(5);
+   for (int b = 0; b < 5; b++)
+   {
+      for (int g = 0; g < 5; g++)
+      {
+         for (int r = 0; r < 5; r++)
+         {
+            // a color twist, so that the interpolation has something to do
+            cube.set(r, g, b, g / 4.0f, (r + b) / 8.0f, 1.0f - r / 4.0f);
+         }
+      }
+   }
+
+   // two fused luts, the cube, the other two fused luts
+   color_grade grade;
+   grade.add(luts[0]).add(luts[1]).add(cube, TETRAHEDRAL).add(luts[2]).add(luts[3]);
+   ppm_image fused = image;
+   grade.apply(fused);
+   ppm_image sequential = image;
+   luts[0].apply(sequential);
+   luts[1].apply(sequential);
+   cube.apply(sequential, TETRAHEDRAL);
+   luts[2].apply(sequential);
+   luts[3].apply(sequential);
+   report(identical(fused, sequential), "color-grade-fused", "the fused chain differs from the luts one by one");
+
+   ppm_image gamma = image;
+   luts[0].apply(gamma);
+   ppm_image inverted = image;
+   luts[3].apply(inverted);
+   report(identical(gamma, image.gammaCorrect(2.2f)) && identical(inverted, image.invert(0.9f)), "color-lut-filters",
+      "the gamma or invert lut differs from the ppm_image filter");
+}
+
+// a lazy filter graph, evaluated in strips, gives the pixels of the same filters applied to whole images
+void test_lazy_image()
+{
+   ppm_image image = random_image(300, 500, 32);
+   ppm_image other = random_image(300, 500, 33);
+   int weights[] = {1, 2, -1, 0, 3, 0, -1, 2, 1};
+   conv_kernel kernel(3, 3, weights, 4);
+
+   lazy_image source(image);
+   lazy_image second(other);
+   ppm_image chain = source.gaussianblur().sharpen().gammaCorrect(2.2f).grayscale().eval();
+   report(identical(chain, image.gaussianblur().sharpen().gammaCorrect(2.2f).grayscale()), "lazy-chain",
+      "blur, sharpen, gamma and grayscale differ from the eager filters");
+
+   ppm_image edges = source.invert(0.8f).sobel(90, false).swirlcolor().eval();
+   report(identical(edges, image.invert(0.8f).sobel(90, false).swirlcolor()), "lazy-sobel",
+      "invert, sobel and swirl differ from the eager filters");
+
+   lazy_image blurred = source.gaussianblur();
+   ppm_image graph = blurred.alpha_blend(second.sharpen(), 0.3f).lightest(blurred.invert(1.0f))
+      .darkest(second.convolve(kernel)).color(channel_lut::levels(10, 240)).eval();
+   ppm_image eager = image.gaussianblur();
+   eager = eager.alpha_blend(other.sharpen(), 0.3f).lightest(eager.invert(1.0f)).darkest(convolve(other, kernel));
+   channel_lut::levels(10, 240).apply(eager);
+   report(identical(graph, eager), "lazy-graph", "a graph with shared and blended branches differs from the eager filters");
+}
+
+// return the index read for position i of n, or -1 for a zero, following the description of BorderMode
+int border_at(int i, int n, BorderMode border)
+{
+   if (i >= 0 && i < n)
+   {
+      return i;
+   }
+   switch (border)
+   {
+   case BORDER_ZERO:
+      return -1;
+   case BORDER_CLAMP:
+      return i < 0 ? 0 : n - 1;
+   case BORDER_WRAP:
+      return ((i % n) + n) % n;
+   default:
+      // mirror around the edge pixels until the position is inside
+      while (n > 1 && (i < 0 || i >= n))
+      {
+         i = i < 0 ? -i : 2 * (n - 1) - i;
+      }
+      return n > 1 ? i : 0;
+   }
+}
+
+// the convolution of image with a w x h kernel, one pixel and one weight at a time; integer kernels
+// are divided by divisor with the result rounded down, float kernels (divisor 0) only rounded down
+ppm_image naive_convolve(const ppm_image& image, int w, int h, const vector<double>& weights, int divisor, BorderMode border)
+{
+   ppm_image out(image.width(), image.height());
+   for (int i = 0; i < image.height(); i++)
+   {
+      for (int j = 0; j < image.width(); j++)
+      {
+         for (int k = 0; k < 3; k++)
+         {
+            double sum = 0;
+            for (int y = 0; y < h; y++)
+            {
+               for (int x = 0; x < w; x++)
+               {
+                  int row = border_at(i + y - h / 2, image.height(), border);
+                  int col = border_at(j + x - w / 2, image.width(), border);
+                  if (row >= 0 && col >= 0)
+                  {
+                     sum += weights[y * w + x] * image.data()[(static_cast<size_t>(row) * image.width() + col) * 3 + k];
+                  }
+               }
+            }
+            int value = static_cast<int>(floor(divisor > 0 ? sum / divisor : sum));
+            out.data()[(static_cast<size_t>(i) * image.width() + j) * 3 + k] = min(255, max(0, value));
+         }
+      }
+   }
+   return out;
+}
+
+// convolve matches a naive convolution for every border mode, with integer and float kernels, general
+// and separable, of the sizes with their own loops and of a generic size
+void test_convolve()
+{
+   rng random(33);
+   ppm_image images[] = {random_image(37, 23, 33), random_image(3, 2, 34)};
+   const char* borders[] = {"zero", "clamp", "reflect", "wrap"};
+   int wrong_kernels = 0;
+   string problem;
+   for (int shape = 0; shape < 6; shape++)
+   {
+      // kernel sizes: 3x3, 5x5 separable, 7x7 float, 9x1, 9x9 separable, 3x5 float separable
+      int sizes[6][2] = {{3, 3}, {5, 5}, {7, 7}, {9, 1}, {9, 9}, {3, 5}};
+      int w = sizes[shape][0], h = sizes[shape][1];
+      bool separable = shape == 1 || shape == 4 || shape == 5;
+      bool integer = shape != 2 && shape != 5;
+      vector<int> row(w), column(h);
+      vector<double> weights(w * h);
+      vector<int> iweights(w * h);
+      vector<float> fweights(w * h);
+      for (int x = 0; x < w; x++)
+      {
+         row[x] = random.uniform(-3, 6);
+      }
+      for (int y = 0; y < h; y++)
+      {
+         column[y] = random.uniform(-2, 5);
+      }
+      if (!integer && separable)
+      {
+         // a float kernel is split by dividing by its largest weight, which is only exact for powers of two
+         int powers_row[] = {1, 2, -1}, powers_column[] = {4, 1, -2, 2, 1};
+         row.assign(powers_row, powers_row + 3);
+         column.assign(powers_column, powers_column + 5);
+      }
+      for (int t = 0; t < w * h; t++)
+      {
+         // separable kernels are the product of their row and column; eighths keep float sums exact
+         iweights[t] = separable ? column[t / w] * row[t % w] : random.uniform(-4, 9);
+         weights[t] = integer ? iweights[t] : iweights[t] / 8.0;
+         fweights[t] = static_cast<float>(weights[t]);
+      }
+      int divisor = integer ? 7 : 0;
+      conv_kernel kernel = integer ? (separable ? conv_kernel::separable(column, row, divisor) : conv_kernel(w, h, iweights.data(), divisor))
+         : conv_kernel(w, h, fweights.data());
+      if (separable && !kernel.is_separable())
+      {
+         wrong_kernels++;
+         problem = "the kernel " + to_string(w) + "x" + to_string(h) + " was not recognized as separable";
+      }
+      for (int b = BORDER_ZERO; b <= BORDER_WRAP; b++)
+      {
+         for (int n = 0; n < 2; n++)
+         {
+            BorderMode border = static_cast<BorderMode>(b);
+            if (!identical(convolve(images[n], kernel, border), naive_convolve(images[n], w, h, weights, divisor, border)))
+            {
+               wrong_kernels++;
+               problem = "the kernel " + to_string(w) + "x" + to_string(h) + " differs with the " + borders[b] + " border";
+            }
+         }
+      }
+   }
+   report(wrong_kernels == 0, "convolve-naive", problem);
+}
+
+// the minimum (or maximum) of each channel under a width x height element anchored at its center
+// ((size - 1) / 2 before the pixel), ignoring the pixels outside the image
+ppm_image naive_morph(const ppm_image& image, int width, int height, bool maximum)
+{
+   ppm_image out(image.width(), image.height());
+   for (int i = 0; i < image.height(); i++)
+   {
+      for (int j = 0; j < image.width(); j++)
+      {
+         for (int k = 0; k < 3; k++)
+         {
+            int best = maximum ? -1 : 256;
+            for (int y = max(0, i - (height - 1) / 2); y <= min(image.height() - 1, i - (height - 1) / 2 + height - 1); y++)
+            {
+               for (int x = max(0, j - (width - 1) / 2); x <= min(image.width() - 1, j - (width - 1) / 2 + width - 1); x++)
+               {
+                  int v = image.data()[(static_cast<size_t>(y) * image.width() + x) * 3 + k];
+                  best = maximum ? max(best, v) : min(best, v);
+               }
+            }
+            out.data()[(static_cast<size_t>(i) * image.width() + j) * 3 + k] = best;
+         }
+      }
+   }
+   return out;
+}
+
+// erode and dilate match a brute-force minimum and maximum for odd, even, line and oversized elements,
+// and the compound filters are made of them as documented
+void test_morphology()
+{
+   ppm_image image = random_image(37, 23, 34);
+   structuring_element elements[] = {rect_element(1, 1), rect_element(3, 3), rect_element(4, 2), line_element(7),
+      line_element(5, true), rect_element(15, 11), rect_element(60, 60)};
+   string problem;
+   for (size_t e = 0; e < sizeof(elements) / sizeof(elements[0]); e++)
+   {
+      const structuring_element& element = elements[e];
+      string size = to_string(element.width) + "x" + to_string(element.height);
+      if (!identical(erode(image, element), naive_morph(image, element.width, element.height, false)))
+      {
+         problem += " erode " + size;
+      }
+      if (!identical(dilate(image, element), naive_morph(image, element.width, element.height, true)))
+      {
+         problem += " dilate " + size;
+      }
+   }
+   report(problem.empty(), "morphology-naive", "differs from brute force:" + problem);
+
+   structuring_element element = rect_element(5, 3);
+   ppm_image low = erode(image, element);
+   ppm_image high = dilate(image, element);
+   ppm_image gradient = high;
+   for (size_t k = 0; k < static_cast<size_t>(image.width()) * image.height() * 3; k++)
+   {
+      gradient.data()[k] -= low.data()[k];
+   }
+   report(identical(opening(image, element), dilate(low, element)) && identical(closing(image, element), erode(high, element)) &&
+      identical(morph_gradient(image, element), gradient), "morphology-compound",
+      "opening, closing or the gradient is not made of erode and dilate");
+}
+
+// the value of rank round(percent / 100 * (n - 1)) among the n clamped values of each channel in the
+// window of the given radius, cut at the borders of the image
+ppm_image naive_percentile(const ppm_image& image, int radius, float percent)
+{
+   ppm_image out(image.width(), image.height());
+   vector<int> values;
+   for (int i = 0; i < image.height(); i++)
+   {
+      for (int j = 0; j < image.width(); j++)
+      {
+         for (int k = 0; k < 3; k++)
+         {
+            values.clear();
+            for (int y = max(0, i - radius); y <= min(image.height() - 1, i + radius); y++)
+            {
+               for (int x = max(0, j - radius); x <= min(image.width() - 1, j + radius); x++)
+               {
+                  values.push_back(min(255, max(0, image.data()[(static_cast<size_t>(y) * image.width() + x) * 3 + k])));
+               }
+            }
+            sort(values.begin(), values.end());
+            int rank = static_cast<int>(floor(percent / 100.0 * (values.size() - 1) + 0.5));
+            out.data()[(static_cast<size_t>(i) * image.width() + j) * 3 + k] = values[rank];
+         }
+      }
+   }
+   return out;
+}
+
+// median (the 3x3 sorting network and the histograms) and percentile match sorting every window, also
+// across the column strips of the histograms and with channels outside [0, 255]
+void test_rank_filters()
+{
+   ppm_image image = random_image(300, 41, 35);
+   rng random(35);
+   for (int k = 0; k < 200; k++)
+   {
+      image.data()[random.uniform(300 * 41 * 3)] = random.uniform(2) ? -40 : 400;
+   }
+   string problem;
+   for (int radius = 1; radius <= 2; radius++)
+   {
+      if (!identical(median(image, radius), naive_percentile(image, radius, 50.0f)))
+      {
+         problem += " median r=" + to_string(radius);
+      }
+      float percents[] = {0.0f, 25.0f, 73.5f, 100.0f};
+      for (int p = 0; p < 4; p++)
+      {
+         if (!identical(percentile(image, radius, percents[p]), naive_percentile(image, radius, percents[p])))
+         {
+            problem += " percentile " + to_string(percents[p]) + " r=" + to_string(radius);
+         }
+      }
+   }
+   report(problem.empty(), "rank-filters-naive", "differs from sorting the windows:" + problem);
+}
+
+// the sums of a summed-area table and box_blur match adding up the pixels one by one
+void test_integral_image()
+{
+   ppm_image image = random_image(300, 200, 36);
+   integral_image32 table32(image);
+   integral_image64 table64(image);
+   rng random(36);
+   int wrong = 0;
+   for (int t = 0; t < 300; t++)
+   {
+      // a 32-bit table is exact for the squares of up to 257x257 pixels
+      int width = random.uniform(1, 100), height = random.uniform(1, 100);
+      int col = random.uniform(300 - width + 1), row = random.uniform(200 - height + 1);
+      for (int k = 0; k < 3; k++)
+      {
+         uint64_t sum = 0, squares = 0;
+         for (int i = row; i < row + height; i++)
+         {
+            for (int j = col; j < col + width; j++)
+            {
+               uint64_t v = image.data()[(static_cast<size_t>(i) * 300 + j) * 3 + k];
+               sum += v;
+               squares += v * v;
+            }
+         }
+         wrong += (table32.sum(row, col, width, height, k) != sum || table32.sum_squares(row, col, width, height, k) != squares ||
+            table64.sum(row, col, width, height, k) != sum || table64.sum_squares(row, col, width, height, k) != squares) ? 1 : 0;
+      }
+   }
+   report(wrong == 0, "integral-sums", to_string(wrong) + " rectangle sums differ from adding the pixels");
+
+   string problem;
+   ppm_image small = random_image(60, 40, 37);
+   int radii[] = {0, 1, 3, 25, 70};
+   for (int r = 0; r < 5; r++)
+   {
+      ppm_image brute(60, 40);
+      for (int i = 0; i < 40; i++)
+      {
+         for (int j = 0; j < 60; j++)
+         {
+            int top = max(0, i - radii[r]), bottom = min(39, i + radii[r]);
+            int left = max(0, j - radii[r]), right = min(59, j + radii[r]);
+            for (int k = 0; k < 3; k++)
+            {
+               int sum = 0;
+               for (int y = top; y <= bottom; y++)
+               {
+                  for (int x = left; x <= right; x++)
+                  {
+                     sum += small.data()[(static_cast<size_t>(y) * 60 + x) * 3 + k];
+                  }
+               }
+               brute.data()[(static_cast<size_t>(i) * 60 + j) * 3 + k] = sum / ((right - left + 1) * (bottom - top + 1));
+            }
+         }
+      }
+      if (!identical(box_blur(small, radii[r]), brute))
+      {
+         problem += " r=" + to_string(radii[r]);
+      }
+   }
+   report(problem.empty(), "box-blur", "differs from the window averages:" + problem);
+}
+
+// the parallel histogram and statistics match counting the pixels one by one, including the rows left
+// over by the split between threads and channels outside [0, 255]
+void test_statistics()
+{
+   ppm_image image = random_image(301, 77, 37);
+   rng random(37);
+   for (int k = 0; k < 50; k++)
+   {
+      image.data()[random.uniform(301 * 77 * 3)] = random.uniform(-100, 400);
+   }
+   uint64_t counts[3][256] = {{0}};
+   int low[3] = {INT_MAX, INT_MAX, INT_MAX}, high[3] = {INT_MIN, INT_MIN, INT_MIN};
+   long long sums[3] = {0, 0, 0};
+   vector<int> sorted[3];
+   for (size_t x = 0; x < static_cast<size_t>(301) * 77 * 3; x++)
+   {
+      int v = image.data()[x];
+      int k = x % 3;
+      counts[k][min(255, max(0, v))]++;
+      low[k] = min(low[k], v);
+      high[k] = max(high[k], v);
+      sums[k] += v;
+      sorted[k].push_back(min(255, max(0, v)));
+   }
+
+   image_histogram bins = histogram(image);
+   image_stats stats = statistics(image);
+   bool same_histogram = bins.total == 301u * 77u && memcmp(bins.counts, counts, sizeof(counts)) == 0;
+   bool same_stats = true, same_percentiles = true;
+   for (int k = 0; k < 3; k++)
+   {
+      double mean = static_cast<double>(sums[k]) / (301 * 77);
+      same_stats = same_stats && stats.min[k] == low[k] && stats.max[k] == high[k] && fabs(stats.mean[k] - mean) < 1e-9;
+      sort(sorted[k].begin(), sorted[k].end());
+      float percents[] = {0.0f, 10.0f, 50.0f, 99.5f, 100.0f};
+      for (int p = 0; p < 5; p++)
+      {
+         int rank = static_cast<int>(floor(percents[p] / 100.0 * (sorted[k].size() - 1) + 0.5));
+         same_percentiles = same_percentiles && bins.percentile(k, percents[p]) == sorted[k][rank];
+      }
+   }
+   report(same_histogram, "histogram-serial", "the histogram differs from counting the pixels one by one");
+   report(same_stats, "statistics-serial", "the minimum, maximum or mean differs from a serial pass");
+   report(same_percentiles, "histogram-percentile", "a percentile differs from the sorted values");
+}
+
+// an animation reports the rows that changed since the previous frame, in frame order
+void test_animation()
+{
+   // the rows with a line in each frame, -1 for none
+   const int lines[5][2] = {{3, -1}, {3, -1}, {10, -1}, {10, 25}, {-1, -1}};
+   // the changed rows [first, last) each frame should report: unchanged, one line moved, one added, all gone
+   const int expected[5][2] = {{0, 30}, {0, 0}, {3, 11}, {25, 26}, {10, 26}};
+   animation frames(40, 30);
+   auto draw = [&](int index, canvas& drawer) {
+      drawer.background(0, 0, 0);
+      drawer.color(255, 255, 255);
+      drawer.begin(LINES);
+      for (int k = 0; k < 2; k++)
+      {
+         if (lines[index][k] >= 0)
+         {
+            drawer.vertex(0, lines[index][k]);
+            drawer.vertex(39, lines[index][k]);
+         }
+      }
+      drawer.end();
+   };
+   string problem;
+   for (int detect = 1; detect >= 0; detect--)
+   {
+      frames.detect_changes(detect == 1);
+      int next = 0;
+      frames.render(5, draw, [&](const frame_info& info, const ppm_image& image) {
+         int first = detect ? expected[info.index][0] : 0;
+         int last = detect ? expected[info.index][1] : 30;
+         bool changed = first < last;
+         bool white = lines[info.index][0] < 0 || image.get(lines[info.index][0], 20).r == 255;
+         if (info.index != next++ || info.changed != changed || (changed && (info.first_row != first || info.last_row != last)) || !white)
+         {
+            problem += " frame " + to_string(info.index) + (detect ? "" : " (no detection)");
+         }
+      });
+      if (frames.unchanged_frames() != (detect ? 1 : 0))
+      {
+         problem += " unchanged count " + to_string(frames.unchanged_frames());
+      }
+   }
+   report(problem.empty(), "animation-rows", "wrong changed rows or frames:" + problem);
+
+   // an exception thrown by draw or encode stops the render and reaches the caller, and the
+   // animation can render again afterwards
+   animation failing(16, 8, 2);
+   for (int stage = 0; stage < 2; stage++)
+   {
+      string caught;
+      int encoded = 0;
+      try
+      {
+         failing.render(10, [&](int index, canvas& drawer) {
+            if (stage == 0 && index == 4)
+            {
+               throw runtime_error("draw failed");
+            }
+            drawer.background(index, 0, 0);
+         }, [&](const frame_info& info, const ppm_image&) {
+            if (stage == 1 && info.index == 3)
+            {
+               throw runtime_error("encode failed");
+            }
+            encoded++;
+         });
+      }
+      catch (const runtime_error& error)
+      {
+         caught = error.what();
+      }
+      int again = 0;
+      failing.render(5, [](int index, canvas& drawer) { drawer.background(index, 0, 0); },
+         [&](const frame_info&, const ppm_image&) { again++; });
+      bool stopped = stage == 0 ? (caught == "draw failed" && encoded <= 4) : (caught == "encode failed" && encoded == 3);
+      report(stopped && again == 5, stage == 0 ? "animation-draw-throws" : "animation-encode-throws",
+         caught.empty() ? "the exception did not reach the caller" : "the render did not stop, or cannot render again");
+   }
+}
+
+// return the bytes of a file
+vector<unsigned char> file_bytes(const string& name)
+{
+   ifstream file(name.c_str(), ios::binary);
+   return vector<unsigned char>(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+}
+
+// a Y4M stream of odd-sized frames has the documented header and frame sizes and the BT.601 values of
+// black and white, also for a frame written from its changed rows; a raw stream is the bytes of the frames
+void test_video_sink()
+{
+   const string name = "draw_test-video";
+   ppm_image black(41, 31), white(41, 31), half(41, 31);
+   for (int i = 0; i < 31; i++)
+   {
+      for (int j = 0; j < 41; j++)
+      {
+         ppm_pixel on = {255, 255, 255}, off = {0, 0, 0};
+         black.set(i, j, off);
+         white.set(i, j, on);
+         half.set(i, j, i < 15 ? on : off);
+      }
+   }
+   bool written;
+   {
+      video_sink sink(name + ".y4m", 41, 31, VIDEO_Y4M, 25);
+      frame_info info = {2, true, 15, 31};
+      written = sink.write(black) && sink.write(white) && sink.write(info, half) && sink.frames() == 3;
+   }
+   vector<unsigned char> y4m = file_bytes(name + ".y4m");
+   string header = "YUV4MPEG2 W41 H31 F25:1 Ip A1:1 C420jpeg\n";
+   size_t luma = 41 * 31, chroma = 21 * 16, frame = 6 + luma + 2 * chroma;
+   bool sized = y4m.size() == header.size() + 3 * frame && equal(header.begin(), header.end(), y4m.begin());
+   bool values = sized;
+   for (int f = 0; sized && f < 3; f++)
+   {
+      const unsigned char* at = &y4m[header.size() + f * frame];
+      values = values && memcmp(at, "FRAME\n", 6) == 0;
+      for (size_t i = 0; i < luma; i++)
+      {
+         bool lit = f == 1 || (f == 2 && i / 41 < 15);
+         values = values && at[6 + i] == (lit ? 235 : 16);
+      }
+      for (size_t i = 0; i < 2 * chroma; i++)
+      {
+         values = values && at[6 + luma + i] == 128;
+      }
+   }
+   report(written && sized && values, "video-y4m", !sized ? "wrong header or size" : "wrong Y, U or V values");
+
+   {
+      video_sink sink(name + ".rgb", 41, 31, VIDEO_RGB);
+      written = sink.write(half) && sink.write(white) && sink.bytes() == 2 * 41 * 31 * 3;
+   }
+   vector<unsigned char> rgb = file_bytes(name + ".rgb");
+   bool same = rgb.size() == 2 * 41 * 31 * 3;
+   for (size_t i = 0; same && i < 41 * 31 * 3; i++)
+   {
+      same = rgb[i] == half.data()[i] && rgb[41 * 31 * 3 + i] == 255;
+   }
+   report(written && same, "video-rgb", "the raw stream is not the bytes of the frames");
+   remove((name + ".y4m").c_str());
+   remove((name + ".rgb").c_str());
+}
+
+// save_async writes the pixels the canvas had when it was called, and an encoder that throws hands its
+// exception to the future without stopping the writer
+void test_save_async()
+{
+   const string name = "draw_test-async.ppm";
+   canvas drawer(64, 48);
+   draw_tiled_sample(drawer);
+   ppm_image saved = drawer.image();
+   shared_future<bool> done = drawer.save_async(name);
+   // drawing on goes to the canvas, not to the snapshot being written
+   drawer.background(255, 0, 0);
+   ppm_image loaded;
+   bool written = done.get() && loaded.load(name) && identical(loaded, saved);
+   report(written, "save-async", "the file is not the canvas at the time of the call");
+   remove(name.c_str());
+
+   image_writer writer(2);
+   shared_future<bool> failed = writer.submit(saved, [](const ppm_image&) -> bool { throw runtime_error("encoder failed"); });
+   bool passed_on = false;
+   try
+   {
+      failed.get();
+   }
+   catch (const runtime_error&)
+   {
+      passed_on = true;
+   }
+   int width = 0;
+   shared_future<bool> next = writer.submit(saved, [&](const ppm_image& snapshot) { width = snapshot.width(); return true; });
+   bool went_on = next.get() && width == 64;
+   writer.wait_all();
+   report(passed_on && went_on && writer.pending() == 0, "save-async-throw",
+      passed_on ? "the writer did not go on after an encoder threw" : "the exception did not reach the future");
+}
+
+// draw with the default color, point size and sample offset, so any state left over shows
+void draw_default_state(canvas& drawer)
+{
+   drawer.background(10, 20, 30);
+   drawer.begin(TRIANGLES);
+   drawer.vertex(2, 3);
+   drawer.vertex(29, 9);
+   drawer.vertex(7, 22);
+   drawer.end();
+   drawer.begin(POINTS);
+   drawer.vertex(25, 18);
+   drawer.end();
+}
+
+void test_batch()
+{
+   // the jobs run one after the other on the same canvas: the first two leave every kind of state
+   // behind, the last two must still draw what a new canvas does
+   vector<render_job> jobs(4);
+   for (int j = 0; j < 4; j++)
+   {
+      jobs[j].width = 32;
+      jobs[j].height = 24;
+   }
+   jobs[0].draw = [](canvas& drawer) {
+      drawer.multisample(4);
+      drawer.color(255, 0, 0);
+      drawer.point_size(5);
+      drawer.point_shape(DISC);
+      drawer.sample_offset(0.5f, 0.5f);
+      draw_default_state(drawer);
+   };
+   jobs[1].draw = [](canvas& drawer) {
+      drawer.depth_test(true);
+      drawer.picking(true);
+      drawer.primitive_id(7);
+      drawer.depth(-1);
+      draw_default_state(drawer);
+      drawer.depth(5);
+   };
+   jobs[2].output = "draw_test-batch-2.ppm";
+   jobs[2].draw = draw_default_state;
+   jobs[3].output = "draw_test-batch-3.ppm";
+   jobs[3].draw = draw_default_state;
+   batch_runner runner(1);
+   vector<job_timing> timings = runner.run(jobs);
+
+   canvas fresh(32, 24);
+   fresh.color(0, 0, 0);
+   draw_default_state(fresh);
+   bool same = timings.size() == 4;
+   for (int j = 2; j < 4; j++)
+   {
+      ppm_image loaded;
+      same = same && timings[j].output == jobs[j].output && timings[j].worker == 0 &&
+         loaded.load(jobs[j].output) && identical(loaded, fresh.image());
+      remove(jobs[j].output.c_str());
+   }
+   report(same, "batch-reused-canvas", "a job on a reused canvas differs from one on a new canvas");
+}
+
+void test_allocators()
+{
+   // a released block is handed out again to the next request of its size class, and trim or a
+   // full cache send the next request to the system
+   buffer_pool pool(8 << 10);
+   void* first = pool.acquire(1000);
+   pool.release(first, 1000);
+   allocator_stats released = pool.stats();
+   void* again = pool.acquire(1000);
+   allocator_stats reused = pool.stats();
+   void* other = pool.acquire(5000);
+   bool distinct = other != again;
+   pool.release(again, 1000);
+   pool.release(other, 5000);
+   pool.trim();
+   allocator_stats trimmed = pool.stats();
+   void* big = pool.acquire(16 << 10);
+   pool.release(big, 16 << 10);
+   allocator_stats overflowed = pool.stats();
+   report(released.misses == 1 && released.bytes == 0 && released.cached_bytes >= 1000 &&
+      again == first && reused.hits == 1 && reused.misses == 1 && reused.bytes >= 1000 && reused.cached_bytes == 0 &&
+      distinct && trimmed.misses == 2 && trimmed.bytes == 0 && trimmed.cached_bytes == 0 &&
+      overflowed.misses == 3 && overflowed.cached_bytes == 0, "buffer-pool-reuse",
+      "the hits, misses or cached bytes do not follow the acquires and releases");
+
+   // a frame that outgrew its chunk gets one chunk big enough for the whole frame after reset
+   frame_arena arena(1024);
+   char* small = static_cast<char*>(arena.allocate(3, 1));
+   char* aligned = static_cast<char*>(arena.allocate(8));
+   arena.allocate(2000);
+   allocator_stats grown = arena.stats();
+   arena.reset();
+   allocator_stats cleared = arena.stats();
+   char* start = static_cast<char*>(arena.allocate(3, 1));
+   char* next = static_cast<char*>(arena.allocate(8));
+   char* large = static_cast<char*>(arena.allocate(2000));
+   allocator_stats refilled = arena.stats();
+   report(reinterpret_cast<uintptr_t>(aligned) % 16 == 0 && aligned >= small + 3 && grown.misses == 2 &&
+      grown.bytes == 2011 && cleared.bytes == 0 && cleared.cached_bytes >= 3024 && next == start + 16 &&
+      large >= next + 8 && refilled.misses == 2 && refilled.hits == grown.hits + 3 && refilled.bytes == 2011,
+      "frame-arena-reset", "a reset arena does not serve the same frame from one chunk");
+}
+
+// return true if a and b hold the same stored values
+template <class F>
+bool same_values(const pixel_image<F>& a, const pixel_image<F>& b)
+{
+   return a.width() == b.width() && a.height() == b.height() && a.bytes() == b.bytes() &&
+      memcmp(a.data(), b.data(), a.bytes()) == 0;
+}
+
+void test_pixel_formats()
+{
+   const int width = 37, height = 23;
+   ppm_image image = random_image(width, height, 44);
+   size_t pixels = static_cast<size_t>(width) * height;
+
+   // the formats that hold 8 bits per channel give the image back unchanged; gray8 gives its grayscale
+   bool lossless = identical(to_ppm(convert<rgb8>(image)), image) && identical(to_ppm(convert<rgba8>(image)), image) &&
+      identical(to_ppm(convert<rgbf32>(image)), image) && identical(to_ppm(convert<gray8>(image)), image.grayscale());
+   report(lossless, "pixel-format-round-trip", "a format does not give back the pixels it was made from");
+
+   // rgb565 keeps the high bits of every channel and replicates them into the low bits
+   ppm_image expected(width, height);
+   for (int row = 0; row < height; row++)
+   {
+      for (int col = 0; col < width; col++)
+      {
+         ppm_pixel c = image.get(row, col);
+         ppm_pixel q;
+         q.r = static_cast<unsigned char>((c.r & 0xf8) | (c.r >> 5));
+         q.g = static_cast<unsigned char>((c.g & 0xfc) | (c.g >> 6));
+         q.b = static_cast<unsigned char>((c.b & 0xf8) | (c.b >> 5));
+         expected.set(row, col, q);
+      }
+   }
+   rgb565_image packed = convert<rgb565>(image);
+   report(identical(to_ppm(packed), expected) && same_values(convert<rgb565>(to_ppm(packed)), packed),
+      "pixel-format-rgb565", "rgb565 does not keep the high bits of the channels, or is not stable");
+
+   // converting between formats goes through 8-bit rgb, so an intermediate lossless format changes nothing
+   bool chained = same_values(convert<rgb565>(convert<rgbf32>(image)), packed) &&
+      same_values(convert<gray8>(convert<rgba8>(image)), convert<gray8>(image)) &&
+      same_values(convert<rgb8>(convert<rgba8>(convert<rgbf32>(image))), convert<rgb8>(image));
+   bool sized = convert<gray8>(image).bytes() == pixels && packed.bytes() == 2 * pixels &&
+      convert<rgba8>(image).bytes() == 4 * pixels && convert<rgbf32>(image).bytes() == 12 * pixels;
+   report(chained && sized, "pixel-format-convert", chained ? "a format takes the wrong number of bytes" :
+      "converting through another format changes the pixels");
+
+   // channels outside [0, 255] are clamped on the way in
+   ppm_image outside(2, 1);
+   outside.data()[0] = -5;
+   outside.data()[1] = 300;
+   outside.data()[2] = 128;
+   outside.data()[3] = 255;
+   outside.data()[4] = 0;
+   outside.data()[5] = 1000;
+   rgb8_image clamped = convert<rgb8>(outside);
+   const uint8_t want[6] = {0, 255, 128, 255, 0, 255};
+   report(memcmp(clamped.data(), want, 6) == 0, "pixel-format-clamp", "channels outside [0, 255] are not clamped");
+
+   // the gray8 filters give one channel of what the ppm_image filters give on the same gray image
+   ppm_image gray = image.grayscale();
+   gray8_image small = grayscale(image);
+   bool edges = identical(to_ppm(small), gray);
+   int thresholds[] = {0, 40, 200, 1200};
+   for (int t = 0; t < 4; t++)
+   {
+      for (int reverse = 0; reverse < 2; reverse++)
+      {
+         edges = edges && identical(to_ppm(sobel(small, thresholds[t], reverse == 1)), gray.sobel(thresholds[t], reverse == 1));
+      }
+   }
+   report(edges, "pixel-format-gray-filters", "grayscale or sobel on gray8 differs from ppm_image");
+}
+
+// return true if got is exact rounded to the nearest integer and clamped to [0, 255]; float sums may
+// round an exact tie either way
+bool rounds_to(double exact, int got)
+{
+   double clamped = min(255.0, max(0.0, exact));
+   double fraction = clamped - floor(clamped);
+   if (fabs(fraction - 0.5) < 1e-3)
+   {
+      return got == static_cast<int>(floor(clamped)) || got == static_cast<int>(floor(clamped)) + 1;
+   }
+   return got == static_cast<int>(floor(clamped + 0.5));
+}
+
+void test_accumulation()
+{
+   const int width = 41, height = 27;
+   size_t values = static_cast<size_t>(width) * height * 3;
+   vector<ppm_image> passes;
+   float weights[] = {1.0f, 3.0f, 0.5f, 2.0f};
+   for (int k = 0; k < 4; k++)
+   {
+      passes.push_back(random_image(width, height, 50 + k));
+   }
+
+   // the weighted average of the passes, rounded once, with and without exposure and tonemapping
+   accumulation_buffer buffer(width, height);
+   for (int k = 0; k < 4; k++)
+   {
+      buffer.add(passes[k], weights[k]);
+   }
+   ppm_image plain = buffer.resolve();
+   ppm_image exposed = buffer.resolve(1.8f);
+   ppm_image reinhard = buffer.resolve(2.0f, TONEMAP_REINHARD);
+   int wrong = 0;
+   for (size_t x = 0; x < values; x++)
+   {
+      double sum = 0;
+      for (int k = 0; k < 4; k++)
+      {
+         sum += weights[k] * passes[k].data()[x];
+      }
+      double average = sum / 6.5;
+      double tonemapped = average / 255.0 * 2.0;
+      wrong += !rounds_to(average, plain.data()[x]) + !rounds_to(average * 1.8, exposed.data()[x]) +
+         !rounds_to(tonemapped / (1.0 + tonemapped) * 255.0, reinhard.data()[x]);
+   }
+   report(wrong == 0 && buffer.passes() == 4 && buffer.weight() == 6.5f, "accumulation-resolve",
+      to_string(wrong) + " channels are not the rounded weighted average");
+
+   // one pass comes back unchanged; a blended layer is composited over the passes
+   buffer.clear();
+   buffer.add(passes[0]);
+   bool unchanged = identical(buffer.resolve(), passes[0]);
+   buffer.blend(passes[1], 0.25f);
+   ppm_image layered = buffer.resolve();
+   wrong = 0;
+   for (size_t x = 0; x < values; x++)
+   {
+      wrong += !rounds_to(passes[0].data()[x] * 0.75 + passes[1].data()[x] * 0.25, layered.data()[x]);
+   }
+   report(unchanged && wrong == 0 && buffer.passes() == 2, "accumulation-blend",
+      unchanged ? to_string(wrong) + " channels are not the composite" : "a single pass does not come back unchanged");
+
+   // supersample averages the passes drawn at the jitter offsets, and puts the sample offset back
+   auto draw = [](canvas& drawer) {
+      drawer.background(20, 40, 60);
+      drawer.begin(TRIANGLES);
+      drawer.color(250, 10, 10);
+      drawer.vertex(3, 2);
+      drawer.color(10, 250, 10);
+      drawer.vertex(38, 9);
+      drawer.color(10, 10, 250);
+      drawer.vertex(12, 25);
+      drawer.end();
+   };
+   canvas drawer(width, height);
+   drawer.color(0, 0, 0);
+   accumulation_buffer smooth(width, height);
+   smooth.supersample(drawer, 8, draw);
+   ppm_image resolved = smooth.resolve();
+   vector<double> sums(values, 0.0);
+   for (int pass = 0; pass < 8; pass++)
+   {
+      float dx, dy;
+      accumulation_buffer::jitter(pass, dx, dy);
+      canvas single(width, height);
+      single.color(0, 0, 0);
+      single.sample_offset(dx, dy);
+      draw(single);
+      for (size_t x = 0; x < values; x++)
+      {
+         sums[x] += single.image().data()[x];
+      }
+   }
+   wrong = 0;
+   for (size_t x = 0; x < values; x++)
+   {
+      wrong += !rounds_to(sums[x] / 8, resolved.data()[x]);
+   }
+   canvas fresh(width, height);
+   fresh.color(0, 0, 0);
+   draw(fresh);
+   draw(drawer);
+   report(wrong == 0 && identical(drawer.image(), fresh.image()), "accumulation-supersample",
+      wrong ? to_string(wrong) + " channels are not the average of the jittered passes" : "the sample offset was not put back");
+}
+
+// the corners and colors of flat triangles that overlap, so that edge pixels get samples of three colors
+static const int kFlatCorners[3][6] = {{2, 3, 45, 10, 9, 30}, {40, 1, 30, 33, 5, 18}, {12, 12, 47, 28, 20, 34}};
+static const unsigned char kFlatColors[4][3] = {{250, 30, 30}, {30, 250, 30}, {30, 30, 250}, {20, 40, 60}};
+
+// draw the flat triangles, triangle t with primitive id t
+void draw_flat_triangles(canvas& drawer)
+{
+   drawer.background(kFlatColors[3][0], kFlatColors[3][1], kFlatColors[3][2]);
+   for (int t = 0; t < 3; t++)
+   {
+      // the id is taken at end
+      drawer.primitive_id(t);
+      drawer.begin(TRIANGLES);
+      drawer.color(kFlatColors[t][0], kFlatColors[t][1], kFlatColors[t][2]);
+      for (int v = 0; v < 3; v++)
+      {
+         drawer.vertex(kFlatCorners[t][2 * v], kFlatCorners[t][2 * v + 1]);
+      }
+      drawer.end();
+   }
+}
+
+void test_multisample()
+{
+   // every sample of a multisampled pixel gets the color of the triangle that a single-sampled canvas
+   // offset to that sample draws on top there, and the pixel is the rounded average of its samples
+   const int width = 50, height = 36;
+   int counts[] = {4, 8, 16};
+   for (int c = 0; c < 3; c++)
+   {
+      int n = counts[c];
+      canvas drawer(width, height);
+      drawer.color(0, 0, 0);
+      drawer.multisample(n);
+      draw_flat_triangles(drawer);
+
+      // the triangle on top of every pixel at every sample (3 for the background)
+      vector<vector<int> > tops;
+      for (int k = 0; k < n; k++)
+      {
+         float dx, dy;
+         multisample_buffer::sample_position(n, k, dx, dy);
+         canvas single(width, height);
+         single.picking(true);
+         single.sample_offset(dx, dy);
+         draw_flat_triangles(single);
+         vector<int> top(static_cast<size_t>(width) * height);
+         for (int row = 0; row < height; row++)
+         {
+            for (int col = 0; col < width; col++)
+            {
+               int id = single.pick(row, col);
+               top[static_cast<size_t>(row) * width + col] = id < 0 ? 3 : id;
+            }
+         }
+         tops.push_back(top);
+      }
+      int wrong = 0;
+      int edges = 0;
+      for (int row = 0; row < height; row++)
+      {
+         for (int col = 0; col < width; col++)
+         {
+            size_t index = static_cast<size_t>(row) * width + col;
+            // the color of a triangle at a pixel is floored from interpolated floats, so it may be one less
+            int high[3] = {0, 0, 0};
+            int low[3] = {0, 0, 0};
+            bool uniform = true;
+            for (int k = 0; k < n; k++)
+            {
+               int top = tops[k][index];
+               for (int q = 0; q < 3; q++)
+               {
+                  high[q] += kFlatColors[top][q];
+                  low[q] += kFlatColors[top][q] - (top < 3 ? 1 : 0);
+               }
+               uniform = uniform && top == tops[0][index];
+            }
+            ppm_pixel pixel = drawer.image().get(row, col);
+            int got[3] = {pixel.r, pixel.g, pixel.b};
+            for (int q = 0; q < 3; q++)
+            {
+               wrong += got[q] < (low[q] + n / 2) / n || got[q] > (high[q] + n / 2) / n;
+            }
+            edges += !uniform;
+         }
+      }
+      report(wrong == 0 && edges > 0 && drawer.edge_pixels() == edges, "multisample-" + to_string(n),
+         to_string(wrong) + " channels are not the average of their samples, " + to_string(drawer.edge_pixels()) +
+         " edge pixels instead of " + to_string(edges));
+   }
+}
+
+// draw primitive k of a layered scene: every kind of primitive but gaussian points, each at its own depth
+void draw_layer(canvas& drawer, int k)
+{
+   rng random(60 + k);
+   drawer.depth(static_cast<float>(k) * 0.75f - 4.0f);
+   drawer.color(random.uniform(256), random.uniform(256), random.uniform(256));
+   PrimitiveType types[] = {TRIANGLES, CIRCLES, POLYGONS, SECTORS, LINES, OUTLINED_TRIANGLES, OUTLINED_CIRCLES, OUTLINED_POLYGONS, POINTS};
+   PrimitiveType type = types[k % 9];
+   drawer.point_size(random.uniform(3, 9));
+   drawer.point_shape(k % 2 ? SQUARE : DISC);
+   drawer.begin(type);
+   if (type == TRIANGLES || type == LINES || type == OUTLINED_TRIANGLES || type == POINTS)
+   {
+      int vertices = type == LINES ? 2 : (type == POINTS ? 6 : 3);
+      for (int v = 0; v < vertices; v++)
+      {
+         drawer.color(random.uniform(256), random.uniform(256), random.uniform(256));
+         drawer.vertex(random.uniform(-5, 70), random.uniform(-5, 55));
+      }
+   }
+   else
+   {
+      drawer.center(random.uniform(5, 60), random.uniform(5, 45));
+      if (type == CIRCLES || type == OUTLINED_CIRCLES)
+      {
+         drawer.radius(random.uniform(4, 20));
+      }
+      else
+      {
+         drawer.orientation(random.uniform(4, 20), random.uniform(-10, 10));
+         if (type == SECTORS)
+         {
+            drawer.angle(1.0f + random.uniform(100) / 50.0f);
+         }
+         else
+         {
+            drawer.side(random.uniform(3, 8));
+         }
+      }
+   }
+   drawer.end();
+}
+
+void test_depth_order()
+{
+   // with the depth test on, the layers give the same image in any order
+   const int width = 64, height = 50, layers = 27;
+   vector<vector<int> > orders(3);
+   for (int k = 0; k < layers; k++)
+   {
+      orders[0].push_back(k);
+      orders[1].push_back(layers - 1 - k);
+   }
+   orders[2] = orders[0];
+   rng random(61);
+   for (int k = layers - 1; k > 0; k--)
+   {
+      swap(orders[2][k], orders[2][random.uniform(k + 1)]);
+   }
+   vector<ppm_image> images;
+   for (size_t o = 0; o < orders.size(); o++)
+   {
+      canvas drawer(width, height);
+      drawer.depth_test(true);
+      drawer.background(10, 10, 10);
+      for (int k = 0; k < layers; k++)
+      {
+         draw_layer(drawer, orders[o][k]);
+      }
+      images.push_back(drawer.image());
+   }
+   canvas painted(width, height);
+   painted.background(10, 10, 10);
+   for (int k = 0; k < layers; k++)
+   {
+      draw_layer(painted, k);
+   }
+   report(identical(images[0], images[1]) && identical(images[0], images[2]) && !identical(images[0], painted.image()),
+      "depth-order", "the depth tested layers depend on the order they are drawn in");
+
+   // a gaussian point is blended where it is in front, and leaves what is nearer alone
+   for (int front = 0; front < 2; front++)
+   {
+      canvas drawer(width, height);
+      drawer.depth_test(true);
+      drawer.background(10, 10, 10);
+      drawer.depth(1);
+      drawer.color(200, 40, 40);
+      drawer.begin(TRIANGLES);
+      drawer.vertex(0, 0);
+      drawer.vertex(63, 0);
+      drawer.vertex(0, 49);
+      drawer.end();
+      ppm_image under = drawer.image();
+      drawer.depth(front ? 0.0f : 2.0f);
+      drawer.point_shape(GAUSSIAN);
+      drawer.point_size(8);
+      drawer.color(40, 40, 200);
+      drawer.begin(POINTS);
+      drawer.vertex(10, 10);
+      drawer.end();
+      ppm_pixel center = drawer.image().get(10, 10);
+      report(front ? (center.b > 150 && center.r < 100) : identical(drawer.image(), under),
+         front ? "depth-gaussian-front" : "depth-gaussian-behind", "a gaussian point ignores the depth test");
+   }
+}
+
+// a primitive recorded in a spatial_index, kept for the brute-force queries
+struct indexed_shape
+{
+   int id;
+   int type; // 0: triangle, 1: line, 2: box
+   point v[3];
+   bounds box;
+};
+
+// twice the signed area of p, q, (x, y)
+long long signed_area(const point& p, const point& q, int x, int y)
+{
+   return static_cast<long long>(q.x - p.x) * (y - p.y) - static_cast<long long>(q.y - p.y) * (x - p.x);
+}
+
+// return true if shape s holds pixel (x, y), by the rules spatial_index documents
+bool shape_holds(const indexed_shape& s, int x, int y)
+{
+   if (x < s.box.xmin || x > s.box.xmax || y < s.box.ymin || y > s.box.ymax)
+   {
+      return false;
+   }
+   if (s.type == 0)
+   {
+      long long d0 = signed_area(s.v[0], s.v[1], x, y);
+      long long d1 = signed_area(s.v[1], s.v[2], x, y);
+      long long d2 = signed_area(s.v[2], s.v[0], x, y);
+      return (d0 >= 0 && d1 >= 0 && d2 >= 0) || (d0 <= 0 && d1 <= 0 && d2 <= 0);
+   }
+   if (s.type == 1)
+   {
+      long long major = max(abs(s.v[1].x - s.v[0].x), abs(s.v[1].y - s.v[0].y));
+      return major == 0 || 2 * llabs(signed_area(s.v[0], s.v[1], x, y)) <= major;
+   }
+   return true;
 }
 
+// draw primitive k of a picking scene: every kind of primitive, some without an id
+void draw_pickable(canvas& drawer, int k, bool with_ids)
+{
+   rng random(70 + k);
+   drawer.primitive_id(with_ids && k % 5 != 4 ? 100 + k : -1);
+   PrimitiveType types[] = {TRIANGLES, CIRCLES, POLYGONS, SECTORS, LINES, OUTLINED_TRIANGLES, OUTLINED_CIRCLES, OUTLINED_POLYGONS, POINTS};
+   PrimitiveType type = types[k % 9];
+   SplatShape shapes[] = {SQUARE, DISC, GAUSSIAN};
+   drawer.point_size(random.uniform(1, 9));
+   drawer.point_shape(shapes[(k / 9) % 3]);
+   drawer.color(200, 200, 200);
+   drawer.begin(type);
+   if (type == TRIANGLES || type == LINES || type == OUTLINED_TRIANGLES || type == POINTS)
+   {
+      int vertices = type == LINES ? 2 : (type == POINTS ? 4 : 3);
+      for (int v = 0; v < vertices; v++)
+      {
+         drawer.vertex(random.uniform(-10, 90), random.uniform(-10, 70));
+      }
+   }
+   else
+   {
+      drawer.center(random.uniform(0, 80), random.uniform(0, 60));
+      if (type == CIRCLES || type == OUTLINED_CIRCLES)
+      {
+         drawer.radius(random.uniform(3, 25));
+      }
+      else
+      {
+         drawer.orientation(random.uniform(4, 25), random.uniform(-12, 12));
+         if (type == SECTORS)
+         {
+            drawer.angle(1.0f + random.uniform(100) / 50.0f);
+         }
+         else
+         {
+            drawer.side(random.uniform(3, 8));
+         }
+      }
+   }
+   drawer.end();
+}
+
+void test_picking()
+{
+   // the grid of the index finds what a scan of every recorded primitive finds
+   const int width = 80, height = 60;
+   rng random(71);
+   spatial_index index(width, height, 8);
+   vector<indexed_shape> shapes;
+   for (int k = 0; k < 120; k++)
+   {
+      indexed_shape s;
+      s.id = random.uniform(40);
+      s.type = k % 3;
+      for (int v = 0; v < 3; v++)
+      {
+         s.v[v].x = random.uniform(-20, width + 20);
+         s.v[v].y = random.uniform(-20, height + 20);
+         s.v[v].r = s.v[v].g = s.v[v].b = 0;
+      }
+      if (s.type == 1)
+      {
+         s.v[2] = s.v[1];
+      }
+      int corners = s.type == 1 ? 2 : 3;
+      s.box.xmin = s.box.xmax = s.v[0].x;
+      s.box.ymin = s.box.ymax = s.v[0].y;
+      for (int v = 1; v < corners; v++)
+      {
+         s.box.xmin = min(s.box.xmin, s.v[v].x);
+         s.box.xmax = max(s.box.xmax, s.v[v].x);
+         s.box.ymin = min(s.box.ymin, s.v[v].y);
+         s.box.ymax = max(s.box.ymax, s.v[v].y);
+      }
+      if (s.type == 0 && signed_area(s.v[0], s.v[1], s.v[2].x, s.v[2].y) == 0)
+      {
+         s.type = 2;
+      }
+      if (s.type == 0)
+      {
+         index.add_triangle(s.id, s.v[0], s.v[1], s.v[2]);
+      }
+      else if (s.type == 1)
+      {
+         index.add_line(s.id, s.v[0], s.v[1]);
+      }
+      else
+      {
+         index.add_box(s.id, s.box);
+      }
+      shapes.push_back(s);
+   }
+   vector<point> pixels;
+   int wrong = 0;
+   for (int y = -2; y < height + 2; y++)
+   {
+      for (int x = -2; x < width + 2; x++)
+      {
+         vector<int> expected;
+         for (size_t k = 0; k < shapes.size() && x >= 0 && x < width && y >= 0 && y < height; k++)
+         {
+            if (shape_holds(shapes[k], x, y))
+            {
+               expected.push_back(shapes[k].id);
+            }
+         }
+         sort(expected.begin(), expected.end());
+         expected.erase(unique(expected.begin(), expected.end()), expected.end());
+         wrong += index.at(x, y) != expected;
+         point p = {x, y, 0, 0, 0};
+         pixels.push_back(p);
+      }
+   }
+   vector<vector<int> > batched = index.at(pixels);
+   for (size_t k = 0; k < pixels.size(); k++)
+   {
+      wrong += batched[k] != index.at(pixels[k].x, pixels[k].y);
+   }
+   report(wrong == 0, "spatial-index-at", to_string(wrong) + " points differ from a scan of the primitives");
+
+   // a box query finds what an index of one cell finds, and at least the ids under its pixels
+   spatial_index scan(width, height, 1 << 20);
+   for (size_t k = 0; k < shapes.size(); k++)
+   {
+      if (shapes[k].type == 0)
+      {
+         scan.add_triangle(shapes[k].id, shapes[k].v[0], shapes[k].v[1], shapes[k].v[2]);
+      }
+      else if (shapes[k].type == 1)
+      {
+         scan.add_line(shapes[k].id, shapes[k].v[0], shapes[k].v[1]);
+      }
+      else
+      {
+         scan.add_box(shapes[k].id, shapes[k].box);
+      }
+   }
+   vector<bounds> boxes;
+   for (int k = 0; k < 200; k++)
+   {
+      int x = random.uniform(-10, width + 5);
+      int y = random.uniform(-10, height + 5);
+      bounds box = {x, y, x + random.uniform(0, 25), y + random.uniform(0, 25)};
+      boxes.push_back(box);
+   }
+   vector<vector<int> > found = index.intersecting(boxes);
+   wrong = 0;
+   for (size_t k = 0; k < boxes.size(); k++)
+   {
+      vector<int> under;
+      for (int y = max(0, boxes[k].ymin); y <= min(height - 1, boxes[k].ymax); y++)
+      {
+         for (int x = max(0, boxes[k].xmin); x <= min(width - 1, boxes[k].xmax); x++)
+         {
+            vector<int> ids = index.at(x, y);
+            under.insert(under.end(), ids.begin(), ids.end());
+         }
+      }
+      sort(under.begin(), under.end());
+      under.erase(unique(under.begin(), under.end()), under.end());
+      wrong += found[k] != scan.intersecting(boxes[k]) || found[k] != index.intersecting(boxes[k]) ||
+         !includes(found[k].begin(), found[k].end(), under.begin(), under.end());
+   }
+   report(wrong == 0, "spatial-index-intersecting", to_string(wrong) + " boxes differ from a scan of the primitives");
+
+   // the id on top of a pixel is the one of the last primitive that drew it, which is also under the point
+   const int count = 54;
+   canvas drawer(width, height);
+   drawer.picking(true);
+   drawer.background(0, 0, 0);
+   vector<int> top(static_cast<size_t>(width) * height, -1);
+   for (int k = 0; k < count; k++)
+   {
+      draw_pickable(drawer, k, true);
+      canvas alone(width, height);
+      alone.background(0, 0, 0);
+      draw_pickable(alone, k, false);
+      for (int y = 0; y < height; y++)
+      {
+         for (int x = 0; x < width; x++)
+         {
+            ppm_pixel c = alone.image().get(y, x);
+            if (c.r || c.g || c.b)
+            {
+               top[static_cast<size_t>(y) * width + x] = k % 5 != 4 ? 100 + k : -1;
+            }
+         }
+      }
+   }
+   wrong = 0;
+   int hidden = 0;
+   vector<point> queries;
+   for (int y = 0; y < height; y++)
+   {
+      for (int x = 0; x < width; x++)
+      {
+         int id = top[static_cast<size_t>(y) * width + x];
+         vector<int> under = drawer.primitives().at(x, y);
+         wrong += drawer.pick(y, x) != id || (id >= 0 && !binary_search(under.begin(), under.end(), id));
+         hidden += id < 0 && !under.empty();
+         point p = {x, y, 0, 0, 0};
+         queries.push_back(p);
+      }
+   }
+   vector<int> picked = drawer.pick(queries);
+   for (size_t k = 0; k < queries.size(); k++)
+   {
+      wrong += picked[k] != drawer.pick(queries[k].y, queries[k].x);
+   }
+   report(wrong == 0 && hidden > 0, "pick-top", to_string(wrong) + " pixels are not picked as the last primitive drawn there");
+}
+
+// Draw each test image and compare it with its golden hash, then check that scenes play back the same
+// image and that damaged scenes are rejected; the exit code is the number of failures.
+// With --write the images are also saved, to look at them or to check a new golden hash.
 int main(int argc, char** argv)
 {
+   for (int i = 1; i < argc; i++)
+   {
+      if (strcmp(argv[i], "--write") == 0)
+      {
+         write_images = true;
+      }
+   }
+
    canvas drawer(100, 100);
 
    drawer.color(255, 255, 255);
@@ -36,7 +2013,7 @@ int main(int argc, char** argv)
    drawer.color(0, 255, 255);
    drawer.vertex(100, 100);
    drawer.end();
-   drawer.save("line-color-interpolation.png");
+   check(drawer, "line-color-interpolation.png");
 
    // test triangle with interpolation
    drawer.background(0, 0, 0);
@@ -48,7 +2025,7 @@ int main(int argc, char** argv)
    drawer.color(255, 255, 0);
    drawer.vertex(10, 90);
    drawer.end();
-   drawer.save("triangle.png");
+   check(drawer, "triangle.png");
 
    // test triangle with interpolation
    drawer.background(0, 0, 0);
@@ -63,7 +2040,33 @@ int main(int argc, char** argv)
    drawer.vertex(90, 10);
    drawer.vertex(10, 10);
    drawer.end();
-   drawer.save("quad.png");
+   check(drawer, "quad.png");
+
+   test_scene_round_trip();
+   test_scene_rejects();
+   test_scene_outline_cost();
+   test_cube_domain();
+   test_color_grade();
+   test_lazy_image();
+   test_convolve();
+   test_morphology();
+   test_rank_filters();
+   test_integral_image();
+   test_statistics();
+   test_animation();
+   test_video_sink();
+   test_save_async();
+   test_splats();
+   test_resample();
+   test_deep_zoom();
+   test_tiled_canvas();
+   test_batch();
+   test_allocators();
+   test_pixel_formats();
+   test_accumulation();
+   test_multisample();
+   test_depth_order();
+   test_picking();
 
-   return 0;
+   return failures;
 }
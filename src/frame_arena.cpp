@@ -0,0 +1,90 @@
+#include "frame_arena.h"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+using namespace agl;
+using namespace std;
+
+frame_arena::frame_arena(size_t chunk_bytes) : _current(0), _offset(0), _chunk_bytes(chunk_bytes)
+{
+   memset(&_stats, 0, sizeof(_stats));
+}
+
+frame_arena::~frame_arena()
+{
+   for (size_t c = 0; c < _chunks.size(); c++)
+   {
+      buffer_pool::global().release(_chunks[c].data, _chunks[c].size);
+   }
+}
+
+void frame_arena::grow(size_t bytes)
+{
+   // chunks at least double, so a frame takes a logarithmic number of them
+   size_t size = max(bytes, _chunks.empty() ? _chunk_bytes : _chunks.back().size * 2);
+   chunk next;
+   next.data = static_cast<char*>(buffer_pool::global().acquire(size));
+   next.size = size;
+   _chunks.push_back(next);
+   _stats.cached_bytes += size;
+}
+
+void* frame_arena::allocate(size_t bytes, size_t align)
+{
+   assert((align > 0 && align <= 16 && (align & (align - 1)) == 0) && "The alignment has to be a power of two up to 16!");
+   bool missed = false;
+   for (;;)
+   {
+      if (_current < _chunks.size())
+      {
+         size_t start = (_offset + align - 1) & ~(align - 1);
+         if (start + bytes <= _chunks[_current].size)
+         {
+            _offset = start + bytes;
+            _stats.bytes += bytes;
+            _stats.peak_bytes = max(_stats.peak_bytes, _stats.bytes);
+            _stats.hits += missed ? 0 : 1;
+            return _chunks[_current].data + start;
+         }
+         if (_current + 1 < _chunks.size())
+         {
+            // move on to the next chunk kept from an earlier frame
+            _current++;
+            _offset = 0;
+            continue;
+         }
+      }
+      // chunks start 16-byte aligned, so a new chunk of bytes bytes always fits
+      missed = true;
+      _stats.misses++;
+      grow(bytes);
+      _current = _chunks.size() - 1;
+      _offset = 0;
+   }
+}
+
+void frame_arena::reset()
+{
+   if (_current > 0)
+   {
+      // the frame did not fit in one chunk: replace the chunks by one that holds them all
+      size_t total = 0;
+      for (size_t c = 0; c < _chunks.size(); c++)
+      {
+         total += _chunks[c].size;
+         buffer_pool::global().release(_chunks[c].data, _chunks[c].size);
+      }
+      _chunks.clear();
+      _stats.cached_bytes = 0;
+      grow(total);
+   }
+   _current = 0;
+   _offset = 0;
+   _stats.bytes = 0;
+}
+
+allocator_stats frame_arena::stats() const
+{
+   return _stats;
+}
@@ -0,0 +1,94 @@
+//----------------------------------------
+// Frame arena
+// Author: Jiajie(Jason) Ma
+//----------------------------------------
+
+#pragma once
+#include <cstddef>
+#include <vector>
+#include "buffer_pool.h"
+
+namespace agl
+{
+  // A bump allocator for data that only lives until the end of a frame, e.g. the commands between
+  // canvas::begin and canvas::end: allocate moves a pointer forward in the current chunk and reset
+  // frees everything at once. The chunks come from buffer_pool::global() and are kept across resets;
+  // if a frame needed several chunks, they are merged into one big enough for the next frame.
+  // Not thread safe.
+  class frame_arena
+  {
+  public:
+     explicit frame_arena(size_t chunk_bytes = 16 << 10);
+     virtual ~frame_arena();
+
+     // return bytes bytes aligned to align (a power of two up to 16)
+     void* allocate(size_t bytes, size_t align = 16);
+
+     // free everything allocated since the last reset
+     void reset();
+
+     // return the counters of the arena (bytes counts the current frame, cached_bytes the chunks)
+     allocator_stats stats() const;
+
+  private:
+     frame_arena(const frame_arena&);
+     frame_arena& operator=(const frame_arena&);
+
+     // append a chunk of at least bytes bytes
+     void grow(size_t bytes);
+
+     struct chunk
+     {
+        char* data;
+        size_t size;
+     };
+
+     std::vector<chunk> _chunks;
+     size_t _current; // chunk being filled
+     size_t _offset; // first free byte of the current chunk
+     size_t _chunk_bytes;
+     allocator_stats _stats;
+  };
+
+  // Standard allocator on top of a frame_arena: deallocate does nothing, the memory comes back
+  // when the arena is reset
+  template <class T>
+  class arena_allocator
+  {
+  public:
+     typedef T value_type;
+
+     explicit arena_allocator(frame_arena& arena) : _arena(&arena) {}
+
+     template <class U>
+     arena_allocator(const arena_allocator<U>& other) : _arena(other.arena()) {}
+
+     T* allocate(size_t n)
+     {
+        return static_cast<T*>(_arena->allocate(n * sizeof(T), alignof(T) < 16 ? alignof(T) : 16));
+     }
+
+     void deallocate(T*, size_t) {}
+
+     frame_arena* arena() const { return _arena; }
+
+  private:
+     frame_arena* _arena;
+  };
+
+  template <class T, class U>
+  bool operator==(const arena_allocator<T>& a, const arena_allocator<U>& b)
+  {
+     return a.arena() == b.arena();
+  }
+
+  template <class T, class U>
+  bool operator!=(const arena_allocator<T>& a, const arena_allocator<U>& b)
+  {
+     return a.arena() != b.arena();
+  }
+
+  // a vector whose storage lives in a frame_arena
+  template <class T>
+  using frame_vector = std::vector<T, arena_allocator<T> >;
+}
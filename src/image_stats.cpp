@@ -0,0 +1,182 @@
+#include "image_stats.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cassert>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+using namespace agl;
+using namespace std;
+
+// values per step of the min/max/sum loop: a multiple of 3 (channels) and of the vector width
+static const int kStatsLanes = 12;
+
+int image_histogram::percentile(int k, float percent) const
+{
+   assert((percent >= 0 && percent <= 100) && "The percentile has to be in [0, 100]!");
+   if (total == 0)
+   {
+      return 0;
+   }
+   uint64_t rank = static_cast<uint64_t>(floor(static_cast<double>(percent) / 100.0 * (total - 1) + 0.5));
+   uint64_t below = 0;
+   for (int v = 0; v < 256; v++)
+   {
+      below += counts[k][v];
+      if (below > rank)
+      {
+         return v;
+      }
+   }
+   return 255;
+}
+
+image_histogram agl::histogram(const ppm_image& image)
+{
+   int w = image.width();
+   int h = image.height();
+   int parts = max(1, min(h, worker_count()));
+
+   // four interleaved copies per part, so consecutive pixels of the same color do not wait on each other
+   vector<uint32_t> counts(static_cast<size_t>(parts) * 4 * 3 * 256, 0);
+   const int* pixels = image.data();
+   parallel_for(0, parts, 1, [&](int first, int last) {
+      for (int part = first; part < last; part++)
+      {
+         uint32_t* c = &counts[static_cast<size_t>(part) * 4 * 3 * 256];
+         size_t begin = static_cast<size_t>(h) * part / parts * w;
+         size_t end = static_cast<size_t>(h) * (part + 1) / parts * w;
+         for (size_t x = begin; x < end; x++)
+         {
+            const int* px = pixels + x * 3;
+            uint32_t* copy = c + (x & 3) * 3 * 256;
+            copy[min(255, max(0, px[0]))]++;
+            copy[256 + min(255, max(0, px[1]))]++;
+            copy[512 + min(255, max(0, px[2]))]++;
+         }
+      }
+   });
+
+   image_histogram result;
+   memset(&result, 0, sizeof(result));
+   result.total = static_cast<uint64_t>(w) * h;
+   for (size_t copy = 0; copy < static_cast<size_t>(parts) * 4; copy++)
+   {
+      const uint32_t* c = &counts[copy * 3 * 256];
+      for (int k = 0; k < 3; k++)
+      {
+         for (int v = 0; v < 256; v++)
+         {
+            result.counts[k][v] += c[k * 256 + v];
+         }
+      }
+   }
+   return result;
+}
+
+image_stats agl::statistics(const ppm_image& image)
+{
+   int w = image.width();
+   int h = image.height();
+   int parts = max(1, min(h, worker_count()));
+
+   // per part: kStatsLanes running minimums, maximums and sums (lane t holds channel t % 3)
+   vector<int> lows(static_cast<size_t>(parts) * kStatsLanes, INT_MAX);
+   vector<int> highs(static_cast<size_t>(parts) * kStatsLanes, INT_MIN);
+   vector<long long> sums(static_cast<size_t>(parts) * kStatsLanes, 0);
+   const int* pixels = image.data();
+   parallel_for(0, parts, 1, [&](int first, int last) {
+      for (int part = first; part < last; part++)
+      {
+         int lo[kStatsLanes], hi[kStatsLanes];
+         long long sum[kStatsLanes];
+         for (int t = 0; t < kStatsLanes; t++)
+         {
+            lo[t] = INT_MAX;
+            hi[t] = INT_MIN;
+            sum[t] = 0;
+         }
+         size_t begin = static_cast<size_t>(h) * part / parts * w * 3;
+         size_t end = static_cast<size_t>(h) * (part + 1) / parts * w * 3;
+         size_t x = begin;
+         for (; x + kStatsLanes <= end; x += kStatsLanes)
+         {
+            const int* v = pixels + x;
+            for (int t = 0; t < kStatsLanes; t++)
+            {
+               lo[t] = min(lo[t], v[t]);
+               hi[t] = max(hi[t], v[t]);
+               sum[t] += v[t];
+            }
+         }
+         // begin is a multiple of 3, so value x is channel (x - begin) % 3 = lane (x - begin) % 3
+         for (int t = 0; x < end; x++, t++)
+         {
+            lo[t] = min(lo[t], pixels[x]);
+            hi[t] = max(hi[t], pixels[x]);
+            sum[t] += pixels[x];
+         }
+         copy(lo, lo + kStatsLanes, &lows[static_cast<size_t>(part) * kStatsLanes]);
+         copy(hi, hi + kStatsLanes, &highs[static_cast<size_t>(part) * kStatsLanes]);
+         copy(sum, sum + kStatsLanes, &sums[static_cast<size_t>(part) * kStatsLanes]);
+      }
+   });
+
+   image_stats result;
+   long long total[3] = {0, 0, 0};
+   for (int k = 0; k < 3; k++)
+   {
+      result.min[k] = INT_MAX;
+      result.max[k] = INT_MIN;
+   }
+   for (size_t t = 0; t < lows.size(); t++)
+   {
+      int k = static_cast<int>(t % kStatsLanes) % 3;
+      result.min[k] = min(result.min[k], lows[t]);
+      result.max[k] = max(result.max[k], highs[t]);
+      total[k] += sums[t];
+   }
+   double n = static_cast<double>(w) * h;
+   for (int k = 0; k < 3; k++)
+   {
+      if (n == 0)
+      {
+         result.min[k] = 0;
+         result.max[k] = 0;
+      }
+      result.mean[k] = (n > 0) ? static_cast<double>(total[k]) / n : 0.0;
+   }
+   return result;
+}
+
+// the levels lut mapping [black, white] onto [0, 255], or the identity if the range is empty
+static channel_lut stretch(int black, int white)
+{
+   return (white > black) ? channel_lut::levels(black, white) : channel_lut();
+}
+
+channel_lut agl::auto_levels(const image_histogram& histogram, float clip)
+{
+   assert((clip >= 0 && clip < 50) && "The clipped percentage has to be in [0, 50)!");
+   channel_lut luts[3];
+   for (int k = 0; k < 3; k++)
+   {
+      luts[k] = stretch(histogram.percentile(k, clip), histogram.percentile(k, 100 - clip));
+   }
+   return channel_lut::channels(luts[0], luts[1], luts[2]);
+}
+
+channel_lut agl::auto_contrast(const image_histogram& histogram, float clip)
+{
+   assert((clip >= 0 && clip < 50) && "The clipped percentage has to be in [0, 50)!");
+   int black = 255;
+   int white = 0;
+   for (int k = 0; k < 3; k++)
+   {
+      black = min(black, histogram.percentile(k, clip));
+      white = max(white, histogram.percentile(k, 100 - clip));
+   }
+   return stretch(black, white);
+}
@@ -0,0 +1,46 @@
+//----------------------------------------
+// Image statistics and auto levels
+// Author: Jiajie(Jason) Ma
+//----------------------------------------
+
+#pragma once
+#include <cstdint>
+#include "color_lut.h"
+#include "ppm_image.h"
+
+namespace agl
+{
+  // The 256-bin histogram of each channel (values are clamped to [0, 255])
+  struct image_histogram
+  {
+     uint64_t counts[3][256];
+     uint64_t total; // number of pixels
+
+     // return the value of channel k at the given percentile in [0, 100]: the value of rank
+     // round(percent / 100 * (total - 1)) among the sorted values, as in agl::percentile
+     int percentile(int k, float percent) const;
+  };
+
+  // Per-channel minimum, maximum and mean of the pixels
+  struct image_stats
+  {
+     int min[3];
+     int max[3];
+     double mean[3];
+  };
+
+  // Return the histogram of image. Every thread counts a block of rows into its own histogram and the
+  // histograms are added up at the end
+  image_histogram histogram(const ppm_image& image);
+
+  // Return the minimum, maximum and mean of every channel in one parallel pass over the pixels
+  image_stats statistics(const ppm_image& image);
+
+  // Return a lut that stretches each channel on its own so that its clip% darkest values map to 0 and its
+  // clip% brightest to 255 (this also corrects a color cast). Channels with a single value are unchanged
+  channel_lut auto_levels(const image_histogram& histogram, float clip = 0.5f);
+
+  // Same as auto_levels, but with the same stretch for all the channels (taken over the darkest and
+  // brightest channel), so colors keep their hue
+  channel_lut auto_contrast(const image_histogram& histogram, float clip = 0.5f);
+}
@@ -0,0 +1,132 @@
+#include "image_writer.h"
+#include <cassert>
+#include <cstring>
+#include <exception>
+
+using namespace agl;
+using namespace std;
+
+image_writer::image_writer(int max_pending) : _max_pending(max_pending), _pending(0), _stopping(false)
+{
+   assert((max_pending > 0) && "The writer has to accept at least one pending image!");
+   _thread = thread([this]() { run(); });
+}
+
+image_writer::~image_writer()
+{
+   {
+      unique_lock<mutex> guard(_mutex);
+      _stopping = true;
+   }
+   _wake.notify_all();
+   _thread.join();
+}
+
+shared_future<bool> image_writer::submit(const ppm_image& image, const function<bool(const ppm_image&)>& encode)
+{
+   job next;
+   {
+      // back-pressure: wait for a free slot, and take a snapshot buffer of the right size if there is one
+      unique_lock<mutex> guard(_mutex);
+      _space.wait(guard, [this]() { return _pending < _max_pending; });
+      _pending++;
+      for (size_t s = 0; s < _spare.size(); s++)
+      {
+         if (_spare[s]->width() == image.width() && _spare[s]->height() == image.height())
+         {
+            next.image = move(_spare[s]);
+            _spare.erase(_spare.begin() + s);
+            break;
+         }
+      }
+   }
+
+   shared_future<bool> result;
+   try
+   {
+      if (next.image)
+      {
+         memcpy(next.image->data(), image.data(), static_cast<size_t>(image.width()) * image.height() * 3 * sizeof(int));
+      }
+      else
+      {
+         next.image.reset(new ppm_image(image));
+      }
+      next.encode = encode;
+      next.done = make_shared<promise<bool> >();
+      result = next.done->get_future().share();
+   }
+   catch (...)
+   {
+      // the slot taken above is given back, or wait_all would never return
+      {
+         unique_lock<mutex> guard(_mutex);
+         _pending--;
+      }
+      _space.notify_all();
+      throw;
+   }
+
+   {
+      unique_lock<mutex> guard(_mutex);
+      _jobs.push_back(move(next));
+   }
+   _wake.notify_one();
+   return result;
+}
+
+void image_writer::wait_all()
+{
+   unique_lock<mutex> guard(_mutex);
+   _space.wait(guard, [this]() { return _pending == 0; });
+}
+
+int image_writer::pending()
+{
+   unique_lock<mutex> guard(_mutex);
+   return _pending;
+}
+
+image_writer& image_writer::global()
+{
+   static image_writer writer;
+   return writer;
+}
+
+void image_writer::run()
+{
+   for (;;)
+   {
+      job current;
+      {
+         unique_lock<mutex> guard(_mutex);
+         _wake.wait(guard, [this]() { return _stopping || !_jobs.empty(); });
+         if (_jobs.empty())
+         {
+            return;
+         }
+         current = move(_jobs.front());
+         _jobs.pop_front();
+      }
+
+      // a throwing encoder fails its own image only; the writer carries on with the next one
+      try
+      {
+         current.done->set_value(current.encode(*current.image));
+      }
+      catch (...)
+      {
+         current.done->set_exception(current_exception());
+      }
+
+      {
+         unique_lock<mutex> guard(_mutex);
+         if (static_cast<int>(_spare.size()) < _max_pending)
+         {
+            _spare.push_back(move(current.image));
+         }
+         _pending--;
+      }
+      _space.notify_all();
+   }
+}
@@ -0,0 +1,65 @@
+//----------------------------------------
+// Background image writer
+// Author: Jiajie(Jason) Ma
+//----------------------------------------
+
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "ppm_image.h"
+
+namespace agl
+{
+  // Encodes and writes images on a background thread. submit copies the pixels into a snapshot
+  // (snapshot buffers are recycled, so a steady stream of same-sized images allocates nothing) and
+  // returns at once; it only blocks while max_pending snapshots are already waiting or being
+  // written, which bounds the memory the queue can take.
+  class image_writer
+  {
+  public:
+     explicit image_writer(int max_pending = 4);
+
+     // writes the queued images, then stops the thread
+     virtual ~image_writer();
+
+     // Queue encode(snapshot of image) on the writer thread. The future holds its result, or the
+     // exception it threw
+     std::shared_future<bool> submit(const ppm_image& image, const std::function<bool(const ppm_image&)>& encode);
+
+     // wait until every queued image has been written
+     void wait_all();
+
+     // return the number of images queued or being written
+     int pending();
+
+     // the writer used by canvas::save_async
+     static image_writer& global();
+
+  private:
+     // a snapshot waiting to be written
+     struct job
+     {
+        std::unique_ptr<ppm_image> image;
+        std::function<bool(const ppm_image&)> encode;
+        std::shared_ptr<std::promise<bool> > done;
+     };
+
+     void run();
+
+     int _max_pending;
+     int _pending; // queued or being written
+     std::deque<job> _jobs;
+     std::vector<std::unique_ptr<ppm_image> > _spare; // written snapshots, ready for reuse
+     std::mutex _mutex;
+     std::condition_variable _wake; // a job was queued, or the writer has to stop
+     std::condition_variable _space; // a job was written
+     bool _stopping;
+     std::thread _thread;
+  };
+}
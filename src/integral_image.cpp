@@ -0,0 +1,197 @@
+#include "integral_image.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cassert>
+
+using namespace agl;
+using namespace std;
+
+// number of table values per column strip of the vertical prefix sum
+static const int kPrefixStrip = 1024;
+
+// fill table with the summed-area table of f(v) over the channels of image
+template <class T, class F>
+static void prefix_sums(const ppm_image& image, std::vector<T>& table, F f)
+{
+   int w = image.width();
+   int h = image.height();
+   size_t stride = static_cast<size_t>(w + 1) * 3;
+   table.assign(stride * (h + 1), 0);
+   const int* pixels = image.data();
+   T* out = table.data();
+
+   // running sums along each row
+   parallel_for(0, h, 64, [&](int first, int last) {
+      for (int i = first; i < last; i++)
+      {
+         const int* src = pixels + static_cast<size_t>(i) * w * 3;
+         T* dst = out + (i + 1) * stride;
+         for (int x = 3; x < (w + 1) * 3; x++)
+         {
+            dst[x] = dst[x - 3] + f(static_cast<T>(src[x - 3]));
+         }
+      }
+   });
+
+   // then down each column: every strip adds each row to the next one, which is a plain vector add
+   int strips = static_cast<int>((stride + kPrefixStrip - 1) / kPrefixStrip);
+   parallel_for(0, strips, 1, [&](int first, int last) {
+      for (int s = first; s < last; s++)
+      {
+         size_t begin = static_cast<size_t>(s) * kPrefixStrip;
+         size_t end = min(stride, begin + kPrefixStrip);
+         for (int i = 2; i <= h; i++)
+         {
+            T* row = out + i * stride;
+            const T* above = row - stride;
+            for (size_t x = begin; x < end; x++)
+            {
+               row[x] += above[x];
+            }
+         }
+      }
+   });
+}
+
+template <class T>
+integral_image<T>::integral_image(const ppm_image& image, bool squares) : _w(image.width()), _h(image.height())
+{
+   prefix_sums(image, _sums, [](T v) { return v; });
+   if (squares)
+   {
+      prefix_sums(image, _squares, [](T v) { return v * v; });
+   }
+}
+
+template <class T>
+int integral_image<T>::width() const
+{
+   return _w;
+}
+
+template <class T>
+int integral_image<T>::height() const
+{
+   return _h;
+}
+
+template <class T>
+T integral_image<T>::box(const std::vector<T>& table, int row, int col, int width, int height, int k) const
+{
+   assert((row >= 0 && col >= 0 && width >= 0 && height >= 0 && row + height <= _h && col + width <= _w) && "The rectangle has to be inside the image!");
+   size_t stride = static_cast<size_t>(_w + 1) * 3;
+   size_t top = row * stride;
+   size_t bottom = (row + height) * stride;
+   size_t left = col * 3 + k;
+   size_t right = (col + width) * 3 + k;
+
+   // unsigned wrap-around cancels out: the result is exact whenever it fits in T
+   return table[bottom + right] - table[bottom + left] - table[top + right] + table[top + left];
+}
+
+template <class T>
+T integral_image<T>::sum(int row, int col, int width, int height, int k) const
+{
+   return box(_sums, row, col, width, height, k);
+}
+
+template <class T>
+T integral_image<T>::sum_squares(int row, int col, int width, int height, int k) const
+{
+   assert(!_squares.empty() && "The table has to be built with squares!");
+   return box(_squares, row, col, width, height, k);
+}
+
+template <class T>
+double integral_image<T>::mean(int row, int col, int width, int height, int k) const
+{
+   double n = static_cast<double>(width) * height;
+   return (n > 0) ? static_cast<double>(sum(row, col, width, height, k)) / n : 0.0;
+}
+
+template <class T>
+double integral_image<T>::variance(int row, int col, int width, int height, int k) const
+{
+   double n = static_cast<double>(width) * height;
+   if (n <= 0)
+   {
+      return 0.0;
+   }
+   double m = static_cast<double>(sum(row, col, width, height, k)) / n;
+   double v = static_cast<double>(sum_squares(row, col, width, height, k)) / n - m * m;
+   return max(0.0, v);
+}
+
+template class agl::integral_image<uint32_t>;
+template class agl::integral_image<uint64_t>;
+
+ppm_image agl::box_blur(const ppm_image& image, int radius)
+{
+   assert((radius >= 0) && "The radius of a box blur has to be nonnegative!");
+   int w = image.width();
+   int h = image.height();
+   ppm_image result(w, h);
+   integral_image32 table(image, false);
+
+   int* out = result.data();
+   parallel_for(0, h, 16, [&](int first, int last) {
+      for (int i = first; i < last; i++)
+      {
+         int top = max(0, i - radius);
+         int rows = min(h - 1, i + radius) - top + 1;
+         for (int j = 0; j < w; j++)
+         {
+            int left = max(0, j - radius);
+            int cols = min(w - 1, j + radius) - left + 1;
+            uint32_t n = static_cast<uint32_t>(rows) * cols;
+            int* px = out + (static_cast<size_t>(i) * w + j) * 3;
+            for (int k = 0; k < 3; k++)
+            {
+               px[k] = static_cast<int>(table.sum(top, left, cols, rows, k) / n);
+            }
+         }
+      }
+   });
+
+   return result;
+}
+
+ppm_image agl::adaptive_threshold(const ppm_image& image, int radius, int offset)
+{
+   assert((radius >= 0) && "The radius of a threshold window has to be nonnegative!");
+   int w = image.width();
+   int h = image.height();
+   ppm_image result(w, h);
+   integral_image32 table(image, false);
+
+   const int* pixels = image.data();
+   int* out = result.data();
+   parallel_for(0, h, 16, [&](int first, int last) {
+      for (int i = first; i < last; i++)
+      {
+         int top = max(0, i - radius);
+         int rows = min(h - 1, i + radius) - top + 1;
+         for (int j = 0; j < w; j++)
+         {
+            int left = max(0, j - radius);
+            int cols = min(w - 1, j + radius) - left + 1;
+            long long n = static_cast<long long>(rows) * cols;
+            long long window = 0;
+            for (int k = 0; k < 3; k++)
+            {
+               window += table.sum(top, left, cols, rows, k);
+            }
+
+            // (R+G+B)/3 > window/(3n) - offset, without divisions
+            size_t x = (static_cast<size_t>(i) * w + j) * 3;
+            long long gray = pixels[x] + pixels[x + 1] + pixels[x + 2];
+            int value = (gray * n > window - 3 * offset * n) ? 255 : 0;
+            out[x] = value;
+            out[x + 1] = value;
+            out[x + 2] = value;
+         }
+      }
+   });
+
+   return result;
+}
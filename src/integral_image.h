@@ -0,0 +1,60 @@
+//----------------------------------------
+// Summed-area tables and region statistics
+// Author: Jiajie(Jason) Ma
+//----------------------------------------
+
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "ppm_image.h"
+
+namespace agl
+{
+  // A summed-area table of an image: for every channel, the sum (and the sum of squares) of all the
+  // pixels above and to the left of each position. Any rectangle then costs 4 lookups, whatever its size.
+  // T is uint32_t or uint64_t. Sums are kept modulo 2^bits, so a rectangle is exact as long as its own
+  // sum fits in T: with 32 bits that is up to 16.8M pixels for sums and 66K pixels (257x257) for squares.
+  template <class T>
+  class integral_image
+  {
+  public:
+     // build the table(s) of image with parallel prefix sums (over rows, then over column strips)
+     explicit integral_image(const ppm_image& image, bool squares = true);
+
+     // return the width/height of the image
+     int width() const;
+     int height() const;
+
+     // sum of channel k over the width * height rectangle whose top left pixel is (row, col)
+     T sum(int row, int col, int width, int height, int k) const;
+
+     // sum of the squares of channel k over the rectangle (the table has to be built with squares)
+     T sum_squares(int row, int col, int width, int height, int k) const;
+
+     // mean of channel k over the rectangle
+     double mean(int row, int col, int width, int height, int k) const;
+
+     // variance of channel k over the rectangle (the table has to be built with squares)
+     double variance(int row, int col, int width, int height, int k) const;
+
+  private:
+     // sum of channel k of table over the rectangle
+     T box(const std::vector<T>& table, int row, int col, int width, int height, int k) const;
+
+     int _w, _h;
+     std::vector<T> _sums; // (h + 1) * (w + 1) * 3, with a zero first row and column
+     std::vector<T> _squares;
+  };
+
+  typedef integral_image<uint32_t> integral_image32;
+  typedef integral_image<uint64_t> integral_image64;
+
+  // Return a copy of image where each channel is the (rounded down) average of the (2*radius+1)^2 window
+  // around the pixel, cut at the borders of the image. The cost per pixel does not depend on the radius
+  ppm_image box_blur(const ppm_image& image, int radius);
+
+  // Return a black and white copy of image: white where the gray level (R+G+B)/3 of a pixel is above the mean
+  // gray level of the (2*radius+1)^2 window around it minus offset, black elsewhere (Bradley-Roth).
+  // Unlike a global threshold, this follows uneven lighting
+  ppm_image adaptive_threshold(const ppm_image& image, int radius, int offset);
+}
@@ -0,0 +1,351 @@
+#include "lazy_image.h"
+#include "buffer_pool.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+using namespace agl;
+using namespace std;
+
+// target size of the rows of one strip (plus halos), about the size of an L2 cache
+static const size_t kStripBytes = 256 << 10;
+
+namespace agl
+{
+  // a node of the graph computes any range of rows of its image on demand
+  class filter_node
+  {
+  public:
+     filter_node(int width, int height) : w(width), h(height) {}
+     virtual ~filter_node() {}
+
+     // compute rows [first, last) (inside the image) into out, which holds (last - first) * w * 3 values
+     virtual void rows(int first, int last, int* out) const = 0;
+
+     int w, h;
+  };
+}
+
+namespace
+{
+  // rows of the source image
+  class source_node : public filter_node
+  {
+  public:
+     source_node(const ppm_image& image) : filter_node(image.width(), image.height()), _image(image) {}
+
+     void rows(int first, int last, int* out) const
+     {
+        memcpy(out, _image.data() + static_cast<size_t>(first) * w * 3, sizeof(int) * (last - first) * w * 3);
+     }
+
+  private:
+     const ppm_image& _image;
+  };
+
+  // every channel mapped through its own table (inputs are clamped to [0, 255])
+  class table_node : public filter_node
+  {
+  public:
+     table_node(const shared_ptr<filter_node>& input, const channel_lut& lut) :
+        filter_node(input->w, input->h), input(input), lut(lut) {}
+
+     void rows(int first, int last, int* out) const
+     {
+        input->rows(first, last, out);
+        for (size_t x = 0; x < static_cast<size_t>(last - first) * w * 3; x += 3)
+        {
+           out[x] = lut.map(0, out[x]);
+           out[x + 1] = lut.map(1, out[x + 1]);
+           out[x + 2] = lut.map(2, out[x + 2]);
+        }
+     }
+
+     shared_ptr<filter_node> input;
+     channel_lut lut;
+  };
+
+  enum PixelOp {GRAYSCALE, SWIRL};
+
+  // per-pixel filters that mix the channels
+  class pixel_node : public filter_node
+  {
+  public:
+     pixel_node(const shared_ptr<filter_node>& input, PixelOp op) : filter_node(input->w, input->h), _input(input), _op(op) {}
+
+     void rows(int first, int last, int* out) const
+     {
+        _input->rows(first, last, out);
+        for (size_t x = 0; x < static_cast<size_t>(last - first) * w * 3; x += 3)
+        {
+           if (_op == GRAYSCALE)
+           {
+              int sum = out[x] + out[x + 1] + out[x + 2];
+              int average = (sum >= 0) ? sum / 3 : static_cast<int>(floor(static_cast<double>(sum) / 3.0));
+              out[x] = average;
+              out[x + 1] = average;
+              out[x + 2] = average;
+           }
+           else
+           {
+              int r = out[x];
+              out[x] = out[x + 1];
+              out[x + 1] = out[x + 2];
+              out[x + 2] = r;
+           }
+        }
+     }
+
+  private:
+     shared_ptr<filter_node> _input;
+     PixelOp _op;
+  };
+
+  // base of the filters that read a (2r+1) * (2r+1) neighbourhood with zero padding
+  class neighbourhood_node : public filter_node
+  {
+  public:
+     neighbourhood_node(const shared_ptr<filter_node>& input, int radius) : filter_node(input->w, input->h), _input(input), _r(radius) {}
+
+     void rows(int first, int last, int* out) const
+     {
+        // fetch the rows of the strip plus a halo of r rows on each side
+        int top = max(0, first - _r);
+        int bottom = min(h, last + _r);
+        pooled_array<int> in(static_cast<size_t>(bottom - top) * w * 3);
+        _input->rows(top, bottom, &in[0]);
+        filter(&in[0], top, bottom, first, last, out);
+     }
+
+  protected:
+     // compute rows [first, last) from the rows [top, bottom) of the input
+     virtual void filter(const int* in, int top, int bottom, int first, int last, int* out) const = 0;
+
+     shared_ptr<filter_node> _input;
+     int _r;
+  };
+
+  // a convolution, see convolve.h
+  class kernel_node : public neighbourhood_node
+  {
+  public:
+     kernel_node(const shared_ptr<filter_node>& input, const conv_kernel& kernel) :
+        neighbourhood_node(input, max(kernel.width(), kernel.height()) / 2), _kernel(kernel) {}
+
+  protected:
+     void filter(const int* in, int top, int bottom, int first, int last, int* out) const
+     {
+        convolve_rows(in, w, h, top, bottom, _kernel, BORDER_ZERO, first, last, out);
+     }
+
+  private:
+     conv_kernel _kernel;
+  };
+
+  // thresholded sobel magnitude, same as ppm_image::sobel
+  class sobel_node : public neighbourhood_node
+  {
+  public:
+     sobel_node(const shared_ptr<filter_node>& input, int threshold, bool reverse) :
+        neighbourhood_node(input, 1), _threshold(threshold), _reverse(reverse) {}
+
+  protected:
+     void filter(const int* in, int top, int bottom, int first, int last, int* out) const
+     {
+        static const int kx[9] = {1, 0, -1, 2, 0, -2, 1, 0, -1};
+        static const int ky[9] = {1, 2, 1, 0, 0, 0, -1, -2, -1};
+        static const conv_kernel gx(3, 3, kx);
+        static const conv_kernel gy(3, 3, ky);
+        size_t n = static_cast<size_t>(last - first) * w * 3;
+        vector<int> sy(n);
+        convolve_rows(in, w, h, top, bottom, gx, BORDER_ZERO, first, last, out, true);
+        convolve_rows(in, w, h, top, bottom, gy, BORDER_ZERO, first, last, &sy[0], true);
+
+        long long limit = (_threshold > 0) ? static_cast<long long>(_threshold) * _threshold : 0;
+        int below = _reverse ? 255 : 0;
+        int above = _reverse ? 0 : 255;
+        for (size_t x = 0; x < n; x++)
+        {
+           out[x] = (out[x] * out[x] + sy[x] * sy[x] < limit) ? below : above;
+        }
+     }
+
+  private:
+     int _threshold;
+     bool _reverse;
+  };
+
+  enum BlendOp {BLEND, LIGHTEST, DARKEST};
+
+  // filters that combine two images of the same size
+  class blend_node : public filter_node
+  {
+  public:
+     blend_node(const shared_ptr<filter_node>& a, const shared_ptr<filter_node>& b, BlendOp op, float alpha) :
+        filter_node(a->w, a->h), _a(a), _b(b), _op(op), _alpha(alpha) {}
+
+     void rows(int first, int last, int* out) const
+     {
+        size_t n = static_cast<size_t>(last - first) * w * 3;
+        vector<int> other(n);
+        _a->rows(first, last, out);
+        _b->rows(first, last, &other[0]);
+        for (size_t x = 0; x < n; x++)
+        {
+           if (_op == BLEND)
+           {
+              out[x] = min(255, static_cast<int>(floor(static_cast<double>(out[x]) * static_cast<double>(1 - _alpha) + static_cast<double>(other[x]) * static_cast<double>(_alpha))));
+           }
+           else if (_op == LIGHTEST)
+           {
+              out[x] = max(out[x], other[x]);
+           }
+           else
+           {
+              out[x] = min(out[x], other[x]);
+           }
+        }
+     }
+
+  private:
+     shared_ptr<filter_node> _a, _b;
+     BlendOp _op;
+     float _alpha;
+  };
+
+  // append a table to a node, fusing it with the node's own table if it has one
+  shared_ptr<filter_node> add_table(const shared_ptr<filter_node>& node, const channel_lut& lut)
+  {
+     const table_node* previous = dynamic_cast<const table_node*>(node.get());
+     if (previous == 0)
+     {
+        return shared_ptr<filter_node>(new table_node(node, lut));
+     }
+     return shared_ptr<filter_node>(new table_node(previous->input, previous->lut.then(lut)));
+  }
+}
+
+lazy_image::lazy_image(const ppm_image& source) : _node(new source_node(source))
+{
+}
+
+lazy_image::lazy_image(const std::shared_ptr<filter_node>& node) : _node(node)
+{
+}
+
+lazy_image lazy_image::gammaCorrect(float gamma) const
+{
+   return color(channel_lut::gamma(gamma));
+}
+
+lazy_image lazy_image::invert(float alpha) const
+{
+   // Return the original image if the inputs are not legal
+   if (alpha < 0)
+   {
+      cout << "WARNING: the given alpha for invert is supposed to be nonnegative!" << endl;
+      cout << alpha << " is given as for invert and the original image is returned." << endl << endl;
+      return *this;
+   }
+   return color(channel_lut::invert(alpha));
+}
+
+lazy_image lazy_image::color(const channel_lut& lut) const
+{
+   return lazy_image(add_table(_node, lut));
+}
+
+lazy_image lazy_image::grayscale() const
+{
+   return lazy_image(shared_ptr<filter_node>(new pixel_node(_node, GRAYSCALE)));
+}
+
+lazy_image lazy_image::swirlcolor() const
+{
+   return lazy_image(shared_ptr<filter_node>(new pixel_node(_node, SWIRL)));
+}
+
+lazy_image lazy_image::sobel(int threshold, bool reverse) const
+{
+   return lazy_image(shared_ptr<filter_node>(new sobel_node(_node, threshold, reverse)));
+}
+
+lazy_image lazy_image::gaussianblur() const
+{
+   static const conv_kernel kernel = conv_kernel::separable({1, 4, 6, 4, 1}, {1, 4, 6, 4, 1}, 256);
+   return convolve(kernel);
+}
+
+lazy_image lazy_image::sharpen() const
+{
+   static const int ker[9] = {
+      0, -1, 0,
+      -1, 5, -1,
+      0, -1, 0
+   };
+   static const conv_kernel kernel(3, 3, ker);
+   return convolve(kernel);
+}
+
+lazy_image lazy_image::convolve(const conv_kernel& kernel) const
+{
+   return lazy_image(shared_ptr<filter_node>(new kernel_node(_node, kernel)));
+}
+
+lazy_image lazy_image::alpha_blend(const lazy_image& other, float amount) const
+{
+   // Return the original image if the inputs are not legal
+   if (amount < 0 || amount > 1)
+   {
+      cout << "WARNING: the given alpha for blending is out of range!" << endl;
+      cout << amount << " is given as for blend and the original image is returned" << endl << endl;
+      return *this;
+   }
+   return lazy_image(shared_ptr<filter_node>(new blend_node(_node, other._node, BLEND, amount)));
+}
+
+lazy_image lazy_image::lightest(const lazy_image& other) const
+{
+   return lazy_image(shared_ptr<filter_node>(new blend_node(_node, other._node, LIGHTEST, 0.0f)));
+}
+
+lazy_image lazy_image::darkest(const lazy_image& other) const
+{
+   return lazy_image(shared_ptr<filter_node>(new blend_node(_node, other._node, DARKEST, 0.0f)));
+}
+
+int lazy_image::width() const
+{
+   return _node->w;
+}
+
+int lazy_image::height() const
+{
+   return _node->h;
+}
+
+ppm_image lazy_image::eval() const
+{
+   int w = _node->w;
+   int h = _node->h;
+   ppm_image result(w, h);
+
+   // each strip is computed straight into the result
+   int strip = max(8, static_cast<int>(kStripBytes / (static_cast<size_t>(w) * 3 * sizeof(int))));
+   int strips = (h + strip - 1) / strip;
+   int* out = result.data();
+   const filter_node* root = _node.get();
+   parallel_for(0, strips, 1, [&](int first, int last) {
+      for (int s = first; s < last; s++)
+      {
+         int top = s * strip;
+         int bottom = min(h, top + strip);
+         root->rows(top, bottom, out + static_cast<size_t>(top) * w * 3);
+      }
+   });
+
+   return result;
+}
@@ -0,0 +1,59 @@
+//----------------------------------------
+// Lazy image filter graph
+// Author: Jiajie(Jason) Ma
+//----------------------------------------
+
+#pragma once
+#include <memory>
+#include "color_lut.h"
+#include "convolve.h"
+#include "ppm_image.h"
+
+namespace agl
+{
+  class filter_node;
+
+  // A deferred chain (or DAG) of ppm_image filters. Each call only records the filter; eval() then
+  // computes the result in horizontal strips small enough to stay in L2, in parallel. Within a strip,
+  // per-pixel filters run on the rows the previous filter just produced, consecutive color tables are
+  // fused into one, and neighbourhood filters (blur, sharpen, sobel) recompute the few halo rows they
+  // need from their input. No full-size intermediate image is ever allocated.
+  //    ppm_image out = lazy_image(img).gaussianblur().sharpen().gammaCorrect(2.2).grayscale().eval();
+  // gives the same pixels as img.gaussianblur().sharpen().gammaCorrect(2.2).grayscale()
+  class lazy_image
+  {
+  public:
+     // start a graph from an image. The image is not copied and must outlive the evaluation
+     explicit lazy_image(const ppm_image& source);
+
+     // the filters of ppm_image, see ppm_image.h
+     lazy_image gammaCorrect(float gamma) const;
+     lazy_image grayscale() const;
+     lazy_image swirlcolor() const;
+     lazy_image invert(float alpha) const;
+     lazy_image sobel(int threshold, bool reverse) const;
+     lazy_image gaussianblur() const;
+     lazy_image sharpen() const;
+     lazy_image alpha_blend(const lazy_image& other, float amount) const;
+     lazy_image lightest(const lazy_image& other) const;
+     lazy_image darkest(const lazy_image& other) const;
+
+     // map every channel through a color table
+     lazy_image color(const channel_lut& lut) const;
+
+     // convolve with a kernel (zero padding), see convolve.h
+     lazy_image convolve(const conv_kernel& kernel) const;
+
+     // return the width/height of the result
+     int width() const;
+     int height() const;
+
+     // compute the result
+     ppm_image eval() const;
+
+  private:
+     explicit lazy_image(const std::shared_ptr<filter_node>& node);
+
+     std::shared_ptr<filter_node> _node;
+  };
+}
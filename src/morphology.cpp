@@ -0,0 +1,223 @@
+#include "morphology.h"
+#include "buffer_pool.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cassert>
+#include <climits>
+#include <vector>
+
+using namespace agl;
+using namespace std;
+
+// number of ints (about 85 pixels) per column strip of the vertical pass
+static const int kMorphStrip = 256;
+
+// the two operators, with the value that does not change the result (used outside the image)
+struct min_op
+{
+   static int apply(int a, int b) { return (a < b) ? a : b; }
+   static int identity() { return INT_MAX; }
+};
+
+struct max_op
+{
+   static int apply(int a, int b) { return (a > b) ? a : b; }
+   static int identity() { return INT_MIN; }
+};
+
+structuring_element agl::rect_element(int width, int height)
+{
+   assert((width > 0 && height > 0) && "The size of a structuring element has to be positive!");
+   structuring_element element;
+   element.width = width;
+   element.height = height;
+   return element;
+}
+
+structuring_element agl::line_element(int length, bool vertical)
+{
+   return vertical ? rect_element(1, length) : rect_element(length, 1);
+}
+
+// van Herk/Gil-Werman over a 1-D sequence. The input is padded with the identity so that it has
+// n = size + k - 1 values and every window covers exactly k of them, then cut into blocks of k.
+// g is the running op from the start of each block and h the running op to the end of each block:
+// a window [x, x + k - 1] spans the end of one block and the start of the next, so its result is
+// op(h[x], g[x + k - 1]).
+
+// horizontal pass over rows [first, last): windows of k pixels along each row
+template <class Op>
+static void morph_rows(const int* src, int* dst, int w, int k, int first, int last)
+{
+   int before = (k - 1) / 2;
+   int n = w + k - 1;
+   pooled_array<int> f(static_cast<size_t>(n) * 3, Op::identity());
+   pooled_array<int> g(static_cast<size_t>(n) * 3);
+   pooled_array<int> h(static_cast<size_t>(n) * 3);
+   for (int i = first; i < last; i++)
+   {
+      // f holds the row after before identity pixels
+      const int* row = src + static_cast<size_t>(i) * w * 3;
+      copy(row, row + w * 3, &f[before * 3]);
+      for (int block = 0; block < n; block += k)
+      {
+         int end = min(n, block + k);
+         for (int c = 0; c < 3; c++)
+         {
+            g[block * 3 + c] = f[block * 3 + c];
+            h[(end - 1) * 3 + c] = f[(end - 1) * 3 + c];
+         }
+         for (int x = (block + 1) * 3; x < end * 3; x++)
+         {
+            g[x] = Op::apply(g[x - 3], f[x]);
+         }
+         for (int x = (end - 1) * 3 - 1; x >= block * 3; x--)
+         {
+            h[x] = Op::apply(h[x + 3], f[x]);
+         }
+      }
+      int* out = dst + static_cast<size_t>(i) * w * 3;
+      for (int x = 0; x < w * 3; x++)
+      {
+         out[x] = Op::apply(h[x], g[x + (k - 1) * 3]);
+      }
+   }
+}
+
+// vertical pass over the values [first, last) of every row: windows of k rows. The recurrences run
+// a whole strip of a row at a time, so the inner loops are plain element-wise min/max over arrays
+template <class Op>
+static void morph_columns(const int* src, int* dst, int w, int height, int k, int first, int last)
+{
+   int before = (k - 1) / 2;
+   int n = height + k - 1;
+   int m = last - first;
+   size_t stride = static_cast<size_t>(w) * 3;
+   pooled_array<int> g(static_cast<size_t>(n) * m);
+   pooled_array<int> h(static_cast<size_t>(n) * m);
+   vector<int> identity(m, Op::identity());
+
+   // f(y) is the row y - before of the strip, or identity values outside of the image
+   auto f = [&](int y) { return (y >= before && y < before + height) ? src + (y - before) * stride + first : identity.data(); };
+   for (int y = 0; y < n; y++)
+   {
+      const int* in = f(y);
+      int* gy = &g[static_cast<size_t>(y) * m];
+      if (y % k == 0)
+      {
+         copy(in, in + m, gy);
+         continue;
+      }
+      const int* previous = gy - m;
+      for (int x = 0; x < m; x++)
+      {
+         gy[x] = Op::apply(previous[x], in[x]);
+      }
+   }
+   for (int y = n - 1; y >= 0; y--)
+   {
+      const int* in = f(y);
+      int* hy = &h[static_cast<size_t>(y) * m];
+      if (y % k == k - 1 || y == n - 1)
+      {
+         copy(in, in + m, hy);
+         continue;
+      }
+      const int* next = hy + m;
+      for (int x = 0; x < m; x++)
+      {
+         hy[x] = Op::apply(next[x], in[x]);
+      }
+   }
+   for (int y = 0; y < height; y++)
+   {
+      const int* hy = &h[static_cast<size_t>(y) * m];
+      const int* gy = &g[static_cast<size_t>(y + k - 1) * m];
+      int* out = dst + y * stride + first;
+      for (int x = 0; x < m; x++)
+      {
+         out[x] = Op::apply(hy[x], gy[x]);
+      }
+   }
+}
+
+template <class Op>
+static ppm_image morph(const ppm_image& image, const structuring_element& element)
+{
+   int w = image.width();
+   int h = image.height();
+   ppm_image result(w, h);
+   int* out = result.data();
+   const int* in = image.data();
+
+   // a rectangle is a horizontal line followed by a vertical line
+   ppm_image rows;
+   if (element.width > 1)
+   {
+      int* dst = out;
+      if (element.height > 1)
+      {
+         rows = ppm_image(w, h);
+         dst = rows.data();
+      }
+      parallel_for(0, h, 16, [&](int first, int last) {
+         morph_rows<Op>(in, dst, w, element.width, first, last);
+      });
+      in = dst;
+   }
+   if (element.height > 1)
+   {
+      int strips = (w * 3 + kMorphStrip - 1) / kMorphStrip;
+      parallel_for(0, strips, 1, [&](int first, int last) {
+         for (int s = first; s < last; s++)
+         {
+            morph_columns<Op>(in, out, w, h, element.height, s * kMorphStrip, min(w * 3, (s + 1) * kMorphStrip));
+         }
+      });
+   }
+   else if (element.width <= 1)
+   {
+      // 1x1 element
+      result = image;
+   }
+
+   return result;
+}
+
+ppm_image agl::erode(const ppm_image& image, const structuring_element& element)
+{
+   return morph<min_op>(image, element);
+}
+
+ppm_image agl::dilate(const ppm_image& image, const structuring_element& element)
+{
+   return morph<max_op>(image, element);
+}
+
+ppm_image agl::opening(const ppm_image& image, const structuring_element& element)
+{
+   return dilate(erode(image, element), element);
+}
+
+ppm_image agl::closing(const ppm_image& image, const structuring_element& element)
+{
+   return erode(dilate(image, element), element);
+}
+
+ppm_image agl::morph_gradient(const ppm_image& image, const structuring_element& element)
+{
+   ppm_image result = dilate(image, element);
+   ppm_image low = erode(image, element);
+
+   int* out = result.data();
+   const int* in = low.data();
+   size_t n = static_cast<size_t>(image.width()) * 3;
+   parallel_for(0, image.height(), 64, [&](int first, int last) {
+      for (size_t x = first * n; x < last * n; x++)
+      {
+         out[x] -= in[x];
+      }
+   });
+
+   return result;
+}
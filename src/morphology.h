@@ -0,0 +1,41 @@
+//----------------------------------------
+// Morphological filters
+// Author: Jiajie(Jason) Ma
+//----------------------------------------
+
+#pragma once
+#include "ppm_image.h"
+
+namespace agl
+{
+  // A flat structuring element: a width * height rectangle anchored at its center
+  // (at (width-1)/2, (height-1)/2 for even sizes). Lines are rectangles one pixel thick.
+  struct structuring_element
+  {
+     int width;
+     int height;
+  };
+
+  // return a width * height rectangle
+  structuring_element rect_element(int width, int height);
+
+  // return a horizontal (or vertical) line of the given length
+  structuring_element line_element(int length, bool vertical = false);
+
+  // Return a copy of image where each channel of each pixel is the minimum (erode) or maximum (dilate)
+  // of that channel under the element; pixels outside the image are ignored. Rectangles are applied as a
+  // horizontal and a vertical line, each with the van Herk/Gil-Werman algorithm: 3 min/max per pixel
+  // whatever the size. Rows (and then column strips) are processed in parallel.
+  // These are the neighbourhood versions of ppm_image::darkest and ppm_image::lightest.
+  ppm_image erode(const ppm_image& image, const structuring_element& element);
+  ppm_image dilate(const ppm_image& image, const structuring_element& element);
+
+  // erode then dilate: removes bright details smaller than the element
+  ppm_image opening(const ppm_image& image, const structuring_element& element);
+
+  // dilate then erode: fills dark details smaller than the element
+  ppm_image closing(const ppm_image& image, const structuring_element& element);
+
+  // dilate - erode: the outlines of the shapes (e.g. to thicken the edges found by ppm_image::sobel)
+  ppm_image morph_gradient(const ppm_image& image, const structuring_element& element);
+}
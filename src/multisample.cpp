@@ -0,0 +1,155 @@
+#include "multisample.h"
+#include <algorithm>
+#include <cassert>
+
+using namespace agl;
+using namespace std;
+
+// sample positions in 1/16 pixel, as x0, y0, x1, y1, ...
+static const int kPattern2[] = {4, 4, -4, -4};
+static const int kPattern4[] = {-2, -6, 6, -2, -6, 2, 2, 6};
+static const int kPattern8[] = {1, -3, -1, 3, 5, 1, -3, -5, -5, 5, -7, -1, 3, 7, 7, -7};
+static const int kPattern16[] = {1, 1, -1, -3, -3, 2, 4, -1, -5, -2, 2, 5, 5, 3, 3, -5,
+   -2, 6, 0, -7, -4, -6, -6, 4, -8, 0, 7, -4, 6, 7, -7, -8};
+
+multisample_buffer::multisample_buffer(int width, int height, int samples) :
+   _w(width), _h(height), _samples(samples), _slots(static_cast<size_t>(width) * height, -1)
+{
+   assert((samples == 2 || samples == 4 || samples == 8 || samples == 16) && "The number of samples has to be 2, 4, 8 or 16!");
+}
+
+int multisample_buffer::samples() const
+{
+   return _samples;
+}
+
+unsigned multisample_buffer::full_mask() const
+{
+   return (1u << _samples) - 1;
+}
+
+void multisample_buffer::sample_position(int samples, int k, float& dx, float& dy)
+{
+   const int* pattern = samples == 2 ? kPattern2 : (samples == 4 ? kPattern4 : (samples == 8 ? kPattern8 : kPattern16));
+   dx = pattern[2 * k] / 16.0f;
+   dy = pattern[2 * k + 1] / 16.0f;
+}
+
+void multisample_buffer::write(ppm_image& image, int row, int col, unsigned mask, const ppm_pixel& c)
+{
+   size_t index = static_cast<size_t>(row) * _w + col;
+   int slot = _slots[index];
+   if (mask == full_mask())
+   {
+      if (slot >= 0)
+      {
+         release(index);
+      }
+      image.set(row, col, c);
+      return;
+   }
+
+   if (slot < 0)
+   {
+      // a uniform pixel only needs samples if the primitive changes its color
+      ppm_pixel old = image.get(row, col);
+      if (old.r == c.r && old.g == c.g && old.b == c.b)
+      {
+         return;
+      }
+      if (_free.empty())
+      {
+         slot = static_cast<int>(_colors.size() / (3 * _samples));
+         _colors.resize(_colors.size() + 3 * _samples);
+      }
+      else
+      {
+         slot = _free.back();
+         _free.pop_back();
+      }
+      _slots[index] = slot;
+      unsigned char* s = &_colors[static_cast<size_t>(slot) * 3 * _samples];
+      for (int k = 0; k < _samples; k++)
+      {
+         s[3 * k] = old.r;
+         s[3 * k + 1] = old.g;
+         s[3 * k + 2] = old.b;
+      }
+   }
+
+   unsigned char* s = &_colors[static_cast<size_t>(slot) * 3 * _samples];
+   bool uniform = true;
+   for (int k = 0; k < _samples; k++)
+   {
+      if (mask & (1u << k))
+      {
+         s[3 * k] = c.r;
+         s[3 * k + 1] = c.g;
+         s[3 * k + 2] = c.b;
+      }
+      uniform = uniform && s[3 * k] == s[0] && s[3 * k + 1] == s[1] && s[3 * k + 2] == s[2];
+   }
+
+   if (uniform)
+   {
+      ppm_pixel first;
+      first.r = s[0];
+      first.g = s[1];
+      first.b = s[2];
+      release(index);
+      image.set(row, col, first);
+   }
+   else
+   {
+      image.set(row, col, resolve(slot));
+   }
+}
+
+void multisample_buffer::forget(int row, int col)
+{
+   size_t index = static_cast<size_t>(row) * _w + col;
+   if (_slots[index] >= 0)
+   {
+      release(index);
+   }
+}
+
+void multisample_buffer::clear()
+{
+   fill(_slots.begin(), _slots.end(), -1);
+   _colors.clear();
+   _free.clear();
+}
+
+int multisample_buffer::edge_pixels() const
+{
+   return static_cast<int>(_colors.size() / (3 * _samples) - _free.size());
+}
+
+size_t multisample_buffer::bytes() const
+{
+   return _slots.size() * sizeof(int) + _colors.capacity() + _free.capacity() * sizeof(int);
+}
+
+ppm_pixel multisample_buffer::resolve(int slot) const
+{
+   const unsigned char* s = &_colors[static_cast<size_t>(slot) * 3 * _samples];
+   int sum[3] = {0, 0, 0};
+   for (int k = 0; k < _samples; k++)
+   {
+      sum[0] += s[3 * k];
+      sum[1] += s[3 * k + 1];
+      sum[2] += s[3 * k + 2];
+   }
+   ppm_pixel c;
+   c.r = static_cast<unsigned char>((sum[0] + _samples / 2) / _samples);
+   c.g = static_cast<unsigned char>((sum[1] + _samples / 2) / _samples);
+   c.b = static_cast<unsigned char>((sum[2] + _samples / 2) / _samples);
+   return c;
+}
+
+void multisample_buffer::release(size_t index)
+{
+   _free.push_back(_slots[index]);
+   _slots[index] = -1;
+}
@@ -0,0 +1,65 @@
+//----------------------------------------
+// Multisample storage
+// Author: Jiajie(Jason) Ma
+//----------------------------------------
+
+#pragma once
+#include <cstddef>
+#include <vector>
+#include "ppm_image.h"
+
+namespace agl
+{
+  // The samples of a multisampled canvas. The color of a pixel lives in the canvas image as usual;
+  // only the pixels on an edge, whose samples got different colors, get a slot of samples here
+  // (the others are stored compressed, as their one color). The image always holds the resolved color
+  // (the average of the samples) of an edge pixel, so saving needs no extra pass.
+  class multisample_buffer
+  {
+  public:
+     // samples per pixel: 2, 4, 8 or 16
+     multisample_buffer(int width, int height, int samples);
+
+     // return the number of samples per pixel
+     int samples() const;
+
+     // return the coverage mask of a pixel whose samples are all covered
+     unsigned full_mask() const;
+
+     // the position of sample k of the given count relative to the sampled point of the pixel, in
+     // pixels (the standard D3D patterns, all within 0.75 of the center)
+     static void sample_position(int samples, int k, float& dx, float& dy);
+
+     // Write color c to the samples of pixel (row, col) whose bit is set in mask, and the resolved color
+     // to image. A fully covered pixel becomes uniform again; an edge pixel whose samples end up with
+     // the same color is compressed again
+     void write(ppm_image& image, int row, int col, unsigned mask, const ppm_pixel& c);
+
+     // Forget the samples of pixel (row, col), whose color in the image was overwritten by something that
+     // does not go through write (e.g. points), so the pixel is uniform with its new color
+     void forget(int row, int col);
+
+     // make every pixel uniform (e.g. after the background is filled)
+     void clear();
+
+     // return the number of pixels that hold samples
+     int edge_pixels() const;
+
+     // return the number of bytes used by the samples and the slot table
+     size_t bytes() const;
+
+  private:
+     // return the average of the samples of a slot
+     ppm_pixel resolve(int slot) const;
+
+     // give the slot of pixel index back
+     void release(size_t index);
+
+     int _w;
+     int _h;
+     int _samples;
+     std::vector<int> _slots; // per pixel: the slot of its samples, or -1 if it is uniform
+     std::vector<unsigned char> _colors; // rgb of the samples of every slot
+     std::vector<int> _free; // released slots
+  };
+}
@@ -0,0 +1,160 @@
+#include "parallel.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+
+using namespace agl;
+using namespace std;
+
+// set on the threads owned by a pool so that nested parallel loops run inline
+static thread_local bool t_in_worker = false;
+
+thread_pool::thread_pool(int n) : _stopping(false)
+{
+   if (n < 1)
+   {
+      n = 1;
+   }
+   for (int i = 0; i < n; i++)
+   {
+      _workers.push_back(std::thread(&thread_pool::run, this));
+   }
+}
+
+thread_pool::~thread_pool()
+{
+   {
+      lock_guard<mutex> lock(_mutex);
+      _stopping = true;
+   }
+   _wake.notify_all();
+   for (size_t i = 0; i < _workers.size(); i++)
+   {
+      _workers[i].join();
+   }
+}
+
+void thread_pool::submit(const std::function<void()>& task)
+{
+   {
+      lock_guard<mutex> lock(_mutex);
+      _tasks.push_back(task);
+   }
+   _wake.notify_one();
+}
+
+int thread_pool::size() const
+{
+   return static_cast<int>(_workers.size());
+}
+
+bool thread_pool::in_worker()
+{
+   return t_in_worker;
+}
+
+thread_pool& thread_pool::global()
+{
+   // created on first use and kept alive for the rest of the process
+   static thread_pool* pool = 0;
+   static once_flag created;
+   call_once(created, []() {
+      int n = static_cast<int>(std::thread::hardware_concurrency());
+      const char* env = getenv("AGL_THREADS");
+      if (env != 0 && atoi(env) > 0)
+      {
+         n = atoi(env);
+      }
+      pool = new thread_pool(max(1, n));
+   });
+   return *pool;
+}
+
+void thread_pool::run()
+{
+   t_in_worker = true;
+   for (;;)
+   {
+      std::function<void()> task;
+      {
+         unique_lock<mutex> lock(_mutex);
+         _wake.wait(lock, [this]() { return _stopping || !_tasks.empty(); });
+         if (_tasks.empty())
+         {
+            return;
+         }
+         task = _tasks.front();
+         _tasks.pop_front();
+      }
+      task();
+   }
+}
+
+int agl::worker_count()
+{
+   return thread_pool::global().size();
+}
+
+void agl::parallel_for(int first, int last, int grain, const std::function<void(int, int)>& body)
+{
+   if (last <= first)
+   {
+      return;
+   }
+   if (grain < 1)
+   {
+      grain = 1;
+   }
+
+   int n = last - first;
+   int workers = worker_count();
+   if (workers == 1 || n <= grain || thread_pool::in_worker())
+   {
+      body(first, last);
+      return;
+   }
+
+   // aim for a few chunks per worker so that uneven chunks still balance out
+   int chunks = min(workers * 4, (n + grain - 1) / grain);
+   int size = (n + chunks - 1) / chunks;
+   chunks = (n + size - 1) / size;
+
+   struct loop_state
+   {
+      atomic<int> next;
+      int finished;
+      mutex lock;
+      condition_variable done;
+   };
+   shared_ptr<loop_state> state(new loop_state());
+   state->next = 0;
+   state->finished = 0;
+
+   // helpers that start after the last chunk was taken return without touching body
+   std::function<void()> work = [state, chunks, size, first, last, &body]() {
+      for (;;)
+      {
+         int c = state->next++;
+         if (c >= chunks)
+         {
+            return;
+         }
+         body(first + c * size, min(last, first + (c + 1) * size));
+         lock_guard<mutex> lock(state->lock);
+         if (++state->finished == chunks)
+         {
+            state->done.notify_all();
+         }
+      }
+   };
+
+   int helpers = min(workers, chunks) - 1;
+   for (int i = 0; i < helpers; i++)
+   {
+      thread_pool::global().submit(work);
+   }
+   work();
+
+   unique_lock<mutex> lock(state->lock);
+   state->done.wait(lock, [state, chunks]() { return state->finished == chunks; });
+}
@@ -0,0 +1,68 @@
+//----------------------------------------
+// Thread pool and parallel loops
+// Author: Jiajie(Jason) Ma
+//----------------------------------------
+
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace agl
+{
+  // A fixed set of worker threads that run submitted tasks in FIFO order
+  class thread_pool
+  {
+  public:
+     // start n workers (at least one)
+     explicit thread_pool(int n);
+
+     // finish the queued tasks and join the workers
+     virtual ~thread_pool();
+
+     // queue a task; it runs on one of the workers
+     void submit(const std::function<void()>& task);
+
+     // queue a callable and return a future for its result
+     template <class F>
+     std::future<typename std::result_of<F()>::type> async(F f)
+     {
+        typedef typename std::result_of<F()>::type result_type;
+        std::shared_ptr<std::packaged_task<result_type()> > task(new std::packaged_task<result_type()>(f));
+        std::future<result_type> result = task->get_future();
+        submit([task]() { (*task)(); });
+        return result;
+     }
+
+     // return the number of workers
+     int size() const;
+
+     // return true if the calling thread is one of the workers of any pool
+     static bool in_worker();
+
+     // the process-wide pool used by parallel_for. Its size is the number of hardware threads,
+     // or the value of the AGL_THREADS environment variable if it is set
+     static thread_pool& global();
+
+  private:
+     void run();
+
+     std::vector<std::thread> _workers;
+     std::deque<std::function<void()> > _tasks;
+     std::mutex _mutex;
+     std::condition_variable _wake;
+     bool _stopping;
+  };
+
+  // return the number of threads parallel_for may use
+  int worker_count();
+
+  // Split [first, last) into chunks of at least grain items and call body(begin, end) for each chunk
+  // on the global pool. The calling thread takes part; nested calls from a worker run inline.
+  void parallel_for(int first, int last, int grain, const std::function<void(int, int)>& body);
+}
@@ -0,0 +1,200 @@
+//----------------------------------------
+// Pixel formats
+// Author: Jiajie(Jason) Ma
+//----------------------------------------
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+namespace agl
+{
+  // Every pixel format describes how a pixel is stored (value_type, values per pixel) and provides
+  // the conversion from and to 8-bit rgb plus the kernels of pixel_image over a run of n pixels.
+  // The kernels are plain loops over the stored values, written once per format, so that gray8 is
+  // a loop over bytes and rgb565 never goes through rgb unless it has to.
+
+  // 8-bit luminance, the average (R+G+B)/3 as in ppm_image::grayscale
+  struct gray8
+  {
+     typedef uint8_t value_type;
+     enum { values = 1 };
+
+     static void from_rgb(int r, int g, int b, value_type* px)
+     {
+        px[0] = static_cast<value_type>((r + g + b) / 3);
+     }
+
+     static void to_rgb(const value_type* px, int* rgb)
+     {
+        rgb[0] = rgb[1] = rgb[2] = px[0];
+     }
+
+     static void invert(const value_type* in, value_type* out, size_t n)
+     {
+        for (size_t x = 0; x < n; x++)
+        {
+           out[x] = static_cast<value_type>(255 - in[x]);
+        }
+     }
+
+     // out = a * (1 - alpha) + b * alpha, in 8.8 fixed point
+     static void blend(const value_type* a, const value_type* b, float alpha, value_type* out, size_t n)
+     {
+        int weight = static_cast<int>(alpha * 256.0f + 0.5f);
+        for (size_t x = 0; x < n; x++)
+        {
+           out[x] = static_cast<value_type>((a[x] * (256 - weight) + b[x] * weight + 128) >> 8);
+        }
+     }
+  };
+
+  // 8-bit red, green and blue
+  struct rgb8
+  {
+     typedef uint8_t value_type;
+     enum { values = 3 };
+
+     static void from_rgb(int r, int g, int b, value_type* px)
+     {
+        px[0] = static_cast<value_type>(r);
+        px[1] = static_cast<value_type>(g);
+        px[2] = static_cast<value_type>(b);
+     }
+
+     static void to_rgb(const value_type* px, int* rgb)
+     {
+        rgb[0] = px[0];
+        rgb[1] = px[1];
+        rgb[2] = px[2];
+     }
+
+     static void invert(const value_type* in, value_type* out, size_t n)
+     {
+        gray8::invert(in, out, n * 3);
+     }
+
+     static void blend(const value_type* a, const value_type* b, float alpha, value_type* out, size_t n)
+     {
+        gray8::blend(a, b, alpha, out, n * 3);
+     }
+  };
+
+  // 8-bit red, green, blue and alpha (opaque when converted from rgb; invert keeps the alpha)
+  struct rgba8
+  {
+     typedef uint8_t value_type;
+     enum { values = 4 };
+
+     static void from_rgb(int r, int g, int b, value_type* px)
+     {
+        rgb8::from_rgb(r, g, b, px);
+        px[3] = 255;
+     }
+
+     static void to_rgb(const value_type* px, int* rgb)
+     {
+        rgb8::to_rgb(px, rgb);
+     }
+
+     static void invert(const value_type* in, value_type* out, size_t n)
+     {
+        for (size_t x = 0; x < n * 4; x += 4)
+        {
+           out[x] = static_cast<value_type>(255 - in[x]);
+           out[x + 1] = static_cast<value_type>(255 - in[x + 1]);
+           out[x + 2] = static_cast<value_type>(255 - in[x + 2]);
+           out[x + 3] = in[x + 3];
+        }
+     }
+
+     static void blend(const value_type* a, const value_type* b, float alpha, value_type* out, size_t n)
+     {
+        gray8::blend(a, b, alpha, out, n * 4);
+     }
+  };
+
+  // 16-bit packed rgb: 5 bits of red (high bits), 6 of green and 5 of blue
+  struct rgb565
+  {
+     typedef uint16_t value_type;
+     enum { values = 1 };
+
+     static void from_rgb(int r, int g, int b, value_type* px)
+     {
+        px[0] = static_cast<value_type>(((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3));
+     }
+
+     // the bits are replicated into the low bits, so 0 and 255 map back to 0 and 255
+     static void to_rgb(const value_type* px, int* rgb)
+     {
+        int r = px[0] >> 11;
+        int g = (px[0] >> 5) & 63;
+        int b = px[0] & 31;
+        rgb[0] = (r << 3) | (r >> 2);
+        rgb[1] = (g << 2) | (g >> 4);
+        rgb[2] = (b << 3) | (b >> 2);
+     }
+
+     // inverting every field is inverting every bit
+     static void invert(const value_type* in, value_type* out, size_t n)
+     {
+        for (size_t x = 0; x < n; x++)
+        {
+           out[x] = static_cast<value_type>(~in[x]);
+        }
+     }
+
+     // blend the three fields in place, without unpacking to 8 bits
+     static void blend(const value_type* a, const value_type* b, float alpha, value_type* out, size_t n)
+     {
+        int weight = static_cast<int>(alpha * 256.0f + 0.5f);
+        for (size_t x = 0; x < n; x++)
+        {
+           int r = ((a[x] >> 11) * (256 - weight) + (b[x] >> 11) * weight + 128) >> 8;
+           int g = (((a[x] >> 5) & 63) * (256 - weight) + ((b[x] >> 5) & 63) * weight + 128) >> 8;
+           int bl = ((a[x] & 31) * (256 - weight) + (b[x] & 31) * weight + 128) >> 8;
+           out[x] = static_cast<value_type>((r << 11) | (g << 5) | bl);
+        }
+     }
+  };
+
+  // 32-bit float red, green and blue, 1 for 255 (values outside [0, 1] are kept until converted back)
+  struct rgbf32
+  {
+     typedef float value_type;
+     enum { values = 3 };
+
+     static void from_rgb(int r, int g, int b, value_type* px)
+     {
+        px[0] = r * (1.0f / 255.0f);
+        px[1] = g * (1.0f / 255.0f);
+        px[2] = b * (1.0f / 255.0f);
+     }
+
+     static void to_rgb(const value_type* px, int* rgb)
+     {
+        for (int k = 0; k < 3; k++)
+        {
+           float v = px[k] * 255.0f + 0.5f;
+           rgb[k] = v <= 0.0f ? 0 : (v >= 255.0f ? 255 : static_cast<int>(v));
+        }
+     }
+
+     static void invert(const value_type* in, value_type* out, size_t n)
+     {
+        for (size_t x = 0; x < n * 3; x++)
+        {
+           out[x] = 1.0f - in[x];
+        }
+     }
+
+     static void blend(const value_type* a, const value_type* b, float alpha, value_type* out, size_t n)
+     {
+        for (size_t x = 0; x < n * 3; x++)
+        {
+           out[x] = a[x] + (b[x] - a[x]) * alpha;
+        }
+     }
+  };
+}
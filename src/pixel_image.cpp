@@ -0,0 +1,264 @@
+#include "pixel_image.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <iostream>
+#include "stb/stb_image_write.h"
+
+using namespace agl;
+using namespace std;
+
+// rows per task of the parallel loops
+static const int kRowGrain = 64;
+
+template <class F>
+pixel_image<F>::pixel_image(int width, int height) : _w(width), _h(height)
+{
+   assert((width > 0 && height > 0) && "width and height of an image have to be positive!");
+   _values.assign(static_cast<size_t>(width) * height * F::values, value_type());
+}
+
+template <class F>
+pixel_image<F>::pixel_image(int width, int height, const value_type* values) : _w(width), _h(height)
+{
+   assert((width > 0 && height > 0) && "width and height of an image have to be positive!");
+   _values.assign(values, values + static_cast<size_t>(width) * height * F::values);
+}
+
+template <class F>
+int pixel_image<F>::width() const
+{
+   return _w;
+}
+
+template <class F>
+int pixel_image<F>::height() const
+{
+   return _h;
+}
+
+template <class F>
+typename F::value_type* pixel_image<F>::data()
+{
+   return _values.data();
+}
+
+template <class F>
+const typename F::value_type* pixel_image<F>::data() const
+{
+   return _values.data();
+}
+
+template <class F>
+size_t pixel_image<F>::bytes() const
+{
+   return _values.size() * sizeof(value_type);
+}
+
+template <class F>
+ppm_pixel pixel_image<F>::get(int row, int col) const
+{
+   assert((row >= 0 && row < _h && col >= 0 && col < _w) && "The pixel has to be inside the image!");
+   int rgb[3];
+   F::to_rgb(&_values[(static_cast<size_t>(row) * _w + col) * F::values], rgb);
+   ppm_pixel c;
+   c.r = static_cast<unsigned char>(rgb[0]);
+   c.g = static_cast<unsigned char>(rgb[1]);
+   c.b = static_cast<unsigned char>(rgb[2]);
+   return c;
+}
+
+template <class F>
+void pixel_image<F>::set(int row, int col, const ppm_pixel& c)
+{
+   assert((row >= 0 && row < _h && col >= 0 && col < _w) && "The pixel has to be inside the image!");
+   F::from_rgb(c.r, c.g, c.b, &_values[(static_cast<size_t>(row) * _w + col) * F::values]);
+}
+
+template <class F>
+void pixel_image<F>::fill(const ppm_pixel& c)
+{
+   // convert the color once, then copy the pixel
+   value_type px[F::values];
+   F::from_rgb(c.r, c.g, c.b, px);
+   for (size_t x = 0; x < _values.size(); x += F::values)
+   {
+      for (int k = 0; k < F::values; k++)
+      {
+         _values[x + k] = px[k];
+      }
+   }
+}
+
+// the png writer takes 8-bit values with 1 to 4 channels
+template <class F>
+static bool write_png(const string& filename, const pixel_image<F>& image)
+{
+   rgb8_image rgb = convert<rgb8>(image);
+   return stbi_write_png(filename.c_str(), rgb.width(), rgb.height(), 3, rgb.data(), rgb.width() * 3) == 1;
+}
+
+template <>
+bool write_png(const string& filename, const gray8_image& image)
+{
+   return stbi_write_png(filename.c_str(), image.width(), image.height(), 1, image.data(), image.width()) == 1;
+}
+
+template <>
+bool write_png(const string& filename, const rgb8_image& image)
+{
+   return stbi_write_png(filename.c_str(), image.width(), image.height(), 3, image.data(), image.width() * 3) == 1;
+}
+
+template <>
+bool write_png(const string& filename, const rgba8_image& image)
+{
+   return stbi_write_png(filename.c_str(), image.width(), image.height(), 4, image.data(), image.width() * 4) == 1;
+}
+
+template <class F>
+bool pixel_image<F>::save(const std::string& filename) const
+{
+   return write_png(filename, *this);
+}
+
+template <class F>
+pixel_image<F> agl::convert(const ppm_image& image)
+{
+   int w = image.width();
+   pixel_image<F> result(w, image.height());
+   const int* src = image.data();
+   typename F::value_type* dst = result.data();
+   parallel_for(0, image.height(), kRowGrain, [&](int first, int last) {
+      for (size_t x = static_cast<size_t>(first) * w; x < static_cast<size_t>(last) * w; x++)
+      {
+         const int* px = src + x * 3;
+         F::from_rgb(min(255, max(0, px[0])), min(255, max(0, px[1])), min(255, max(0, px[2])), dst + x * F::values);
+      }
+   });
+   return result;
+}
+
+template <class To, class From>
+pixel_image<To> agl::convert(const pixel_image<From>& image)
+{
+   int w = image.width();
+   pixel_image<To> result(w, image.height());
+   const typename From::value_type* src = image.data();
+   typename To::value_type* dst = result.data();
+   parallel_for(0, image.height(), kRowGrain, [&](int first, int last) {
+      for (size_t x = static_cast<size_t>(first) * w; x < static_cast<size_t>(last) * w; x++)
+      {
+         int rgb[3];
+         From::to_rgb(src + x * From::values, rgb);
+         To::from_rgb(rgb[0], rgb[1], rgb[2], dst + x * To::values);
+      }
+   });
+   return result;
+}
+
+template <class F>
+ppm_image agl::to_ppm(const pixel_image<F>& image)
+{
+   int w = image.width();
+   ppm_image result(w, image.height());
+   const typename F::value_type* src = image.data();
+   int* dst = result.data();
+   parallel_for(0, image.height(), kRowGrain, [&](int first, int last) {
+      for (size_t x = static_cast<size_t>(first) * w; x < static_cast<size_t>(last) * w; x++)
+      {
+         F::to_rgb(src + x * F::values, dst + x * 3);
+      }
+   });
+   return result;
+}
+
+template <class F>
+pixel_image<F> agl::invert(const pixel_image<F>& image)
+{
+   size_t w = image.width();
+   pixel_image<F> result(image.width(), image.height());
+   const typename F::value_type* src = image.data();
+   typename F::value_type* dst = result.data();
+   parallel_for(0, image.height(), kRowGrain, [&](int first, int last) {
+      F::invert(src + first * w * F::values, dst + first * w * F::values, (last - first) * w);
+   });
+   return result;
+}
+
+template <class F>
+pixel_image<F> agl::alpha_blend(const pixel_image<F>& a, const pixel_image<F>& b, float alpha)
+{
+   assert((a.width() == b.width() && a.height() == b.height()) && "The images have to be the same size!");
+   assert((alpha >= 0 && alpha <= 1) && "alpha has to be in [0, 1]!");
+   size_t w = a.width();
+   pixel_image<F> result(a.width(), a.height());
+   const typename F::value_type* pa = a.data();
+   const typename F::value_type* pb = b.data();
+   typename F::value_type* dst = result.data();
+   parallel_for(0, a.height(), kRowGrain, [&](int first, int last) {
+      size_t offset = first * w * F::values;
+      F::blend(pa + offset, pb + offset, alpha, dst + offset, (last - first) * w);
+   });
+   return result;
+}
+
+gray8_image agl::grayscale(const ppm_image& image)
+{
+   return convert<gray8>(image);
+}
+
+gray8_image agl::sobel(const gray8_image& image, int threshold, bool reverse)
+{
+   int w = image.width();
+   int h = image.height();
+   gray8_image result(w, h);
+
+   // compare the squared magnitude, as ppm_image::sobel does
+   long long limit = (threshold > 0) ? static_cast<long long>(threshold) * threshold : 0;
+   uint8_t below = reverse ? 255 : 0;
+   uint8_t above = reverse ? 0 : 255;
+   const uint8_t* src = image.data();
+   uint8_t* dst = result.data();
+   parallel_for(0, h, kRowGrain, [&](int first, int last) {
+      for (int i = first; i < last; i++)
+      {
+         for (int j = 0; j < w; j++)
+         {
+            // the 3x3 neighbourhood of (i, j), zero outside the image
+            int n[3][3];
+            for (int di = 0; di < 3; di++)
+            {
+               for (int dj = 0; dj < 3; dj++)
+               {
+                  int row = i + di - 1;
+                  int col = j + dj - 1;
+                  n[di][dj] = (row < 0 || row >= h || col < 0 || col >= w) ? 0 : src[static_cast<size_t>(row) * w + col];
+               }
+            }
+            long long gx = (n[0][0] + 2 * n[1][0] + n[2][0]) - (n[0][2] + 2 * n[1][2] + n[2][2]);
+            long long gy = (n[0][0] + 2 * n[0][1] + n[0][2]) - (n[2][0] + 2 * n[2][1] + n[2][2]);
+            dst[static_cast<size_t>(i) * w + j] = (gx * gx + gy * gy < limit) ? below : above;
+         }
+      }
+   });
+   return result;
+}
+
+#define AGL_CONVERT(To, From) \
+   template pixel_image<To> agl::convert<To, From>(const pixel_image<From>&);
+
+#define AGL_PIXEL_FORMAT(F) \
+   template class agl::pixel_image<F>; \
+   template pixel_image<F> agl::convert<F>(const ppm_image&); \
+   template ppm_image agl::to_ppm<F>(const pixel_image<F>&); \
+   template pixel_image<F> agl::invert<F>(const pixel_image<F>&); \
+   template pixel_image<F> agl::alpha_blend<F>(const pixel_image<F>&, const pixel_image<F>&, float); \
+   AGL_CONVERT(F, gray8) AGL_CONVERT(F, rgb8) AGL_CONVERT(F, rgba8) AGL_CONVERT(F, rgb565) AGL_CONVERT(F, rgbf32)
+
+AGL_PIXEL_FORMAT(gray8)
+AGL_PIXEL_FORMAT(rgb8)
+AGL_PIXEL_FORMAT(rgba8)
+AGL_PIXEL_FORMAT(rgb565)
+AGL_PIXEL_FORMAT(rgbf32)
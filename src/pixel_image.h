@@ -0,0 +1,95 @@
+//----------------------------------------
+// Images of a given pixel format
+// Author: Jiajie(Jason) Ma
+//----------------------------------------
+
+#pragma once
+#include <string>
+#include <vector>
+#include "pixel_format.h"
+#include "ppm_image.h"
+
+namespace agl
+{
+  // An image whose pixels are stored in the format F (gray8, rgb8, rgba8, rgb565 or rgbf32, see
+  // pixel_format.h): F::values values of type F::value_type per pixel, row after row. A gray8
+  // mask takes 1 byte per pixel where a ppm_image takes 12. Instantiated for the five formats.
+  template <class F>
+  class pixel_image
+  {
+  public:
+     typedef typename F::value_type value_type;
+
+     // a width x height image of zero values
+     pixel_image(int width, int height);
+
+     // a width x height image holding the given width * height * F::values values
+     pixel_image(int width, int height, const value_type* values);
+
+     // return the width of this image
+     int width() const;
+
+     // return the height of the image
+     int height() const;
+
+     // return the values of the pixels (contiguous, row-major)
+     value_type* data();
+     const value_type* data() const;
+
+     // return the number of bytes of the pixels
+     size_t bytes() const;
+
+     // Get the pixel at index (row, col) as 8-bit rgb
+     ppm_pixel get(int row, int col) const;
+
+     // Set the pixel at index (row, col) from 8-bit rgb
+     void set(int row, int col, const ppm_pixel& c);
+
+     // Set every pixel to the given color
+     void fill(const ppm_pixel& c);
+
+     // Save in png file format. gray8, rgb8 and rgba8 are written as they are (1, 3 or 4 channels);
+     // the other formats are converted to rgb8 first.
+     // returns true if the save is successful; false otherwise
+     bool save(const std::string& filename) const;
+
+  private:
+     int _w;
+     int _h;
+     std::vector<value_type> _values;
+  };
+
+  // Return image converted to the format F (channels are clamped to [0, 255] first)
+  template <class F>
+  pixel_image<F> convert(const ppm_image& image);
+
+  // Return image converted to the format To, through 8-bit rgb
+  template <class To, class From>
+  pixel_image<To> convert(const pixel_image<From>& image);
+
+  // Return image as a ppm_image
+  template <class F>
+  ppm_image to_ppm(const pixel_image<F>& image);
+
+  // Return a copy of image whose colors are inverted (the alpha of rgba8 is kept)
+  template <class F>
+  pixel_image<F> invert(const pixel_image<F>& image);
+
+  // Return a * (1 - alpha) + b * alpha for two images of the same size and alpha in [0, 1]
+  template <class F>
+  pixel_image<F> alpha_blend(const pixel_image<F>& a, const pixel_image<F>& b, float alpha);
+
+  typedef pixel_image<gray8> gray8_image;
+  typedef pixel_image<rgb8> rgb8_image;
+  typedef pixel_image<rgba8> rgba8_image;
+  typedef pixel_image<rgb565> rgb565_image;
+  typedef pixel_image<rgbf32> rgbf32_image;
+
+  // Return the grayscale of image in 1 byte per pixel: the values of image.grayscale() (channels are
+  // clamped to [0, 255] first)
+  gray8_image grayscale(const ppm_image& image);
+
+  // Return the edges of a gray image in 1 byte per pixel: the values of every channel of
+  // ppm_image::sobel on the same gray image (255 for an edge, 0 if reversed)
+  gray8_image sobel(const gray8_image& image, int threshold, bool reverse);
+}
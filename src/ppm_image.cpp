@@ -1,9 +1,15 @@
 #include "ppm_image.h"
+#include "buffer_pool.h"
+#include "convolve.h"
+#include "parallel.h"
 #include <string>
 #include <iostream>
 #include <fstream>
 #include <cmath>
 #include <cassert>
+#include <algorithm>
+#include <cstring>
+#include <vector>
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "stb/stb_image_write.h"
 
@@ -32,22 +38,8 @@ ppm_image::ppm_image()
 {
    // default constructor
    format = "P3";
-   w = 1;
-   h = 1;
    m = 255;
-   p = new int** [h];
-   for (int i = 0; i < h; i++)
-   {
-      p[i] = new int* [w];
-      for (int j = 0; j < w; j++)
-      {
-         p[i][j] = new int [3];
-         for (int k = 0; k < 3; k++)
-         {
-            p[i][j][k] = 0;
-         }
-      }
-   }
+   allocate(1, 1);
 }
 
 ppm_image::ppm_image(int width, int height) 
@@ -62,43 +54,16 @@ ppm_image::ppm_image(int width, int height)
    }
    // set all member variables except w and h by default
    format = "P3";
-   w = width;
-   h = height;
    m = 255;
-   p = new int** [h];
-   for (int i = 0; i < h; i++)
-   {
-      p[i] = new int* [w];
-      for (int j = 0; j < w; j++)
-      {
-         p[i][j] = new int [3];
-         for (int k = 0; k < 3; k++)
-         {
-            p[i][j][k] = 0;
-         }
-      }
-   }
+   allocate(width, height);
 }
 
 ppm_image::ppm_image(const ppm_image& orig)
 {
    format = orig.format;
-   w = orig.w;
-   h = orig.h;
    m = orig.m;
-   p = new int** [h];
-   for (int i = 0; i < h; i++)
-   {
-      p[i] = new int* [w];
-      for (int j = 0; j < w; j++)
-      {
-         p[i][j] = new int [3];
-         for (int k = 0; k < 3; k++)
-         {
-            p[i][j][k] = orig.p[i][j][k];
-         }
-      }
-   }
+   allocate(orig.w, orig.h);
+   memcpy(data(), orig.data(), sizeof(int) * w * h * 3);
 }
 
 ppm_image& ppm_image::operator=(const ppm_image& orig)
@@ -110,22 +75,9 @@ ppm_image& ppm_image::operator=(const ppm_image& orig)
 
    cleanup();
    format = orig.format;
-   w = orig.w;
-   h = orig.h;
    m = orig.m;
-   p = new int** [h];
-   for (int i = 0; i < h; i++)
-   {
-      p[i] = new int* [w];
-      for (int j = 0; j < w; j++)
-      {
-         p[i][j] = new int [3];
-         for (int k = 0; k < 3; k++)
-         {
-            p[i][j][k] = orig.p[i][j][k];
-         }
-      }
-   }
+   allocate(orig.w, orig.h);
+   memcpy(data(), orig.data(), sizeof(int) * w * h * 3);
 
    return *this;   
 }
@@ -147,19 +99,18 @@ bool ppm_image::load(const std::string& filename)
    
    cleanup();
    // read the format, width, height, and maximum color value of the image
+   int width, height;
    file >> format;
-   file >> w;
-   file >> h;
+   file >> width;
+   file >> height;
    file >> m;
-   
-   p = new int** [h];
+   allocate(width, height);
+
    // read the pixels of the image
    for (int i = 0; i < h; i++)
    {
-      p[i] = new int* [w];
       for (int j = 0; j < w; j++)
       {
-         p[i][j] = new int [3];
          for (int k = 0; k < 3; k++)
          {
             file >> p[i][j][k];
@@ -256,8 +207,15 @@ bool ppm_image::save(const std::string& filename) const
 
     ppm_image result(width, height);
 
+    // find the source column of every new column once instead of once per row
+    std::vector<int> columns(width, 0);
+    for (int j = 0; j < width && width > 1; j++)
+    {
+       columns[j] = floor((static_cast<double>(j)/static_cast<double>(width - 1)) * static_cast<double>(w - 1));
+    }
+
     // for each pixel in the new image, find its corresponding pixel in the original image
-    int u, v;
+    int u;
     for (int i = 0; i < height; i++)
     {
        if (height == 1)
@@ -270,17 +228,9 @@ bool ppm_image::save(const std::string& filename) const
 
        for (int j = 0; j < width; j++)
        {
-          if (width == 1)
-          {
-             v = 0;
-          }
-          else{
-             v = floor((static_cast<double>(j)/static_cast<double>(width - 1)) * static_cast<double>(w - 1));
-          }
-
           for (int k = 0; k < 3; k++)
           {
-             result.p[i][j][k] = this->p[u][v][k];
+             result.p[i][j][k] = this->p[u][columns[j]][k];
           }
        }
     }
@@ -455,37 +405,40 @@ ppm_image ppm_image::lightest(const ppm_image& other) const
    return result;
 }
 
+// Map every channel of image through table into result, clamping the values to the table first
+static void map_channels(const ppm_image& image, ppm_image& result, const std::vector<int>& table)
+{
+   int n = image.width() * 3;
+   int top = static_cast<int>(table.size()) - 1;
+   const int* src = image.data();
+   int* dst = result.data();
+   const int* t = table.data();
+   parallel_for(0, image.height(), 64, [=](int first, int last) {
+      for (size_t x = static_cast<size_t>(first) * n; x < static_cast<size_t>(last) * n; x++)
+      {
+         dst[x] = t[int_min(top, int_max(0, src[x]))];
+      }
+   });
+}
+
 ppm_image ppm_image::gammaCorrect(float gamma) const
 {
    ppm_image result(w, h);
 
-   // Return a image of maximum color if gamma is 0
-   if (gamma == 0){
-      for (int i = 0; i < h; i++)
-      {
-         for (int j = 0; j < w; j++)
-         {
-            for (int k = 0; k < 3; k++)
-            {
-               result.p[i][j][k] = m;
-            }
-         }
+   // there are only m+1 possible inputs, so raise each of them to the power of 1/gamma once (with a cap of m)
+   std::vector<int> table(m + 1);
+   for (int v = 0; v <= m; v++)
+   {
+      // Return a image of maximum color if gamma is 0
+      if (gamma == 0){
+         table[v] = m;
       }
-   }
-   else{
-      // otherwise, for each pixel, raise its RGB value to the power of 1/gamma (with a cap of m)
-      for (int i = 0; i < h; i++)
-      {
-         for (int j = 0; j < w; j++)
-         {
-            for (int k = 0; k < 3; k++)
-            {
-               result.p[i][j][k] = int_min(m, floor(static_cast<double>(m) * pow(static_cast<double>(this->p[i][j][k])/static_cast<double>(m), static_cast<double>(1)/static_cast<double>(gamma))));
-            }
-         }
+      else{
+         table[v] = int_min(m, floor(static_cast<double>(m) * pow(static_cast<double>(v)/static_cast<double>(m), static_cast<double>(1)/static_cast<double>(gamma))));
       }
    }
-   
+   map_channels(*this, result, table);
+
    return result;
 }
 
@@ -494,18 +447,19 @@ ppm_image ppm_image::grayscale() const
    ppm_image result(w, h);
 
    // set each pixel to the average (R+G+B)/3
-   int average;
-   for (int i = 0; i < h; i++)
-   {
-      for (int j = 0; j < w; j++)
+   const int* src = data();
+   int* dst = result.data();
+   int width = w;
+   parallel_for(0, h, 64, [=](int first, int last) {
+      for (size_t x = static_cast<size_t>(first) * width * 3; x < static_cast<size_t>(last) * width * 3; x += 3)
       {
-         average = floor(static_cast<double>(this->p[i][j][0] + this->p[i][j][1] + this->p[i][j][2])/static_cast<double>(3));
-         for (int k = 0; k < 3; k++)
-         {
-            result.p[i][j][k] = average;
-         }
+         int sum = src[x] + src[x + 1] + src[x + 2];
+         int average = (sum >= 0) ? sum / 3 : floor(static_cast<double>(sum)/static_cast<double>(3));
+         dst[x] = average;
+         dst[x + 1] = average;
+         dst[x + 2] = average;
       }
-   }
+   });
 
    return result;
 }
@@ -515,21 +469,17 @@ ppm_image ppm_image::swirlcolor() const
    ppm_image result(w, h);
 
    // rotate the colors of your image such that the red channel becomes the green channel, the green becomes blue, and the blue becomes red
-   for (int i = 0; i < h; i++)
-   {
-      for (int j = 0; j < w; j++)
+   const int* src = data();
+   int* dst = result.data();
+   int width = w;
+   parallel_for(0, h, 64, [=](int first, int last) {
+      for (size_t x = static_cast<size_t>(first) * width * 3; x < static_cast<size_t>(last) * width * 3; x += 3)
       {
-         for (int k = 0; k < 3; k++)
-         {
-            if (k == 2){
-               result.p[i][j][k] = this->p[i][j][0];
-            }
-            else{
-               result.p[i][j][k] = this->p[i][j][k+1];
-            }
-         }
+         dst[x] = src[x + 1];
+         dst[x + 1] = src[x + 2];
+         dst[x + 2] = src[x];
       }
-   }
+   });
 
    return result;
 }
@@ -549,257 +499,156 @@ ppm_image ppm_image::invert(float alpha) const
 
    ppm_image result(w, h);
 
-   // subtract the rgb value of each pixel * alpha from the maximum color value
-   for (int i = 0; i < h; i++)
+   // subtract the rgb value of each pixel * alpha from the maximum color value (once per possible value)
+   std::vector<int> table(m + 1);
+   for (int v = 0; v <= m; v++)
    {
-      for (int j = 0; j < w; j++)
-      {
-         for (int k = 0; k < 3; k++)
-         {
-            result.p[i][j][k] = int_max(0, floor(m - static_cast<double>(this->p[i][j][k]) * alpha));
-         }
-      }
+      table[v] = int_max(0, floor(m - static_cast<double>(v) * alpha));
    }
+   map_channels(*this, result, table);
 
    return result;
 }
 
-ppm_image ppm_image::sobel(int threshold, bool reverse) const
+// Sobel kernel shared by sobel, sobel_mask and sobel_magnitude.
+// For each row of [first, last) it computes the squared gradient magnitude gx^2 + gy^2 of every
+// channel (zero padding outside the image) and calls emit(row, col, squared) where squared points
+// to the three channels of the pixel. Both kernels are rank-1, so the convolution engine applies
+// them as two 1-D passes over a few rows at a time.
+template <class Emit>
+static void sobel_rows(const int* pixels, int w, int h, int first, int last, Emit emit)
 {
-   ppm_image result(w, h);
-
-   // define the kernels for the sobel operator
-   float gx[3][3] = {
-      {1, 0, -1},
-      {2, 0, -2},
-      {1, 0, -1}
-   };
-
-   float gy[3][3] = {
-      {1, 2, 1},
-      {0, 0, 0},
-      {-1, -2, -1}
-   };
-
-   // Add zero padder to the original image
-   int*** pz = new int**[h+2];
-   for (int i = 0; i < h+2; i++){
-
-      pz[i] = new int*[w+2];
-
-      for (int j = 0; j < w+2; j++){
-
-         pz[i][j] = new int[3];
-
-         for (int k = 0; k < 3; k++){
-            if (i == 0 || j == 0 || i == h+1 || j == w+1){
-               pz[i][j][k] = 0;
-            }
-            else{
-               pz[i][j][k] = p[i-1][j-1][k];
-            }
+   static const int kx[9] = {1, 0, -1, 2, 0, -2, 1, 0, -1};
+   static const int ky[9] = {1, 2, 1, 0, 0, 0, -1, -2, -1};
+   static const conv_kernel gx(3, 3, kx);
+   static const conv_kernel gy(3, 3, ky);
+   const int rows = 16;
+   size_t n = static_cast<size_t>(w) * 3;
+   pooled_array<int> sx(rows * n);
+   pooled_array<int> sy(rows * n);
+   pooled_array<int> squared(n);
+   for (int top = first; top < last; top += rows)
+   {
+      int bottom = int_min(last, top + rows);
+      convolve_rows(pixels, w, h, 0, h, gx, BORDER_ZERO, top, bottom, sx.data(), true);
+      convolve_rows(pixels, w, h, 0, h, gy, BORDER_ZERO, top, bottom, sy.data(), true);
+      for (int i = top; i < bottom; i++)
+      {
+         const int* x = &sx[(i - top) * n];
+         const int* y = &sy[(i - top) * n];
+         int* sq = &squared[0];
+         for (size_t k = 0; k < n; k++)
+         {
+            sq[k] = x[k] * x[k] + y[k] * y[k];
          }
-      }
-   }
-
-   // apply the x-direction kernel and y-direction kernel to the image
-   float*** px = new float**[h];
-   for (int i = 0; i < h; i++){
-
-      px[i] = new float*[w];
-
-      for (int j = 0; j < w; j++){
-
-         px[i][j] = new float[3];
-
-         for (int k = 0; k < 3; k++){
-
-            px[i][j][k] = 0.0f;
-
-            for (int u = -1; u < 2; u++){
-
-               for (int v = -1; v < 2; v++){
-
-                  px[i][j][k] = px[i][j][k] + static_cast<double>(gx[u+1][v+1]) * static_cast<double>(pz[i + u + 1][j + v + 1][k]);
-
-               }
-            }
+         for (int j = 0; j < w; j++)
+         {
+            emit(i, j, sq + j * 3);
          }
       }
    }
+}
 
-   // apply the y-direction kernel and y-direction kernel to the image
-   float*** py = new float**[h];
-   for (int i = 0; i < h; i++){
-
-      py[i] = new float*[w];
-
-      for (int j = 0; j < w; j++){
-
-         py[i][j] = new float[3];
-
-         for (int k = 0; k < 3; k++){
-
-            py[i][j][k] = 0.0f;
-
-            for (int u = -1; u < 2; u++){
-
-               for (int v = -1; v < 2; v++){
-
-                  py[i][j][k] = py[i][j][k] + static_cast<double>(gy[u+1][v+1]) * static_cast<double>(pz[i + u + 1][j + v + 1][k]);
-
-               }
-            }
-         }
-      }
+// return floor(sqrt(s)) for a nonnegative integer s
+static int int_sqrt(int s)
+{
+   int r = static_cast<int>(sqrtf(static_cast<float>(s)));
+   while (r * r > s)
+   {
+      r--;
    }
-
-   // output the image
-   for (int i = 0; i < h; i++){
-
-      for (int j = 0; j < w; j++){
-
-         for (int k = 0; k < 3; k++){
-            int mag = floor(pow(static_cast<double>(pow(static_cast<double>(px[i][j][k]), 2) + pow(static_cast<double>(py[i][j][k]), 2)), 0.5f));
-            if(reverse == false){
-               if(mag < threshold){
-                  result.p[i][j][k] = 0;
-               }
-               else{
-                  result.p[i][j][k] = m;
-               }
-            }
-            else{
-               if(mag < threshold){
-                  result.p[i][j][k] = m;
-               }
-               else{
-                  result.p[i][j][k] = 0;
-                  }
-            }
-         }
-      }
+   while ((r + 1) * (r + 1) <= s)
+   {
+      r++;
    }
-
-   return result;
+   return r;
 }
 
-ppm_image ppm_image::sharpen() const
+ppm_image ppm_image::sobel(int threshold, bool reverse) const
 {
    ppm_image result(w, h);
 
-   // define the kernel for the sharpen operator
-   float ker[3][3] = {
-      {0, -1, 0},
-      {-1, 5, -1},
-      {0, -1, 0}
-   };
-
-   // Add zero padder to the original image
-   int*** pz = new int**[h+2];
-   for (int i = 0; i < h+2; i++){
-
-      pz[i] = new int*[w+2];
-
-      for (int j = 0; j < w+2; j++){
-
-         pz[i][j] = new int[3];
-
-         for (int k = 0; k < 3; k++){
-            if (i == 0 || j == 0 || i == h+1 || j == w+1){
-               pz[i][j][k] = 0;
-            }
-            else{
-               pz[i][j][k] = p[i-1][j-1][k];
-            }
+   // floor(sqrt(s)) < threshold exactly when s < threshold^2, so no square root is taken
+   long long limit = (threshold > 0) ? static_cast<long long>(threshold) * threshold : 0;
+   int below = reverse ? m : 0;
+   int above = reverse ? 0 : m;
+   const int* pixels = data();
+   int* out = result.data();
+   int width = w;
+   int height = h;
+   parallel_for(0, h, 16, [&](int first, int last) {
+      sobel_rows(pixels, width, height, first, last, [&](int i, int j, const int* squared) {
+         int* px = out + (static_cast<size_t>(i) * width + j) * 3;
+         for (int k = 0; k < 3; k++)
+         {
+            px[k] = (squared[k] < limit) ? below : above;
          }
-      }
-   }
-
-   // apply the kernel to the image
-   for (int i = 0; i < h; i++){
-
-      for (int j = 0; j < w; j++){
+      });
+   });
 
-         for (int k = 0; k < 3; k++){
-
-            float c = 0.0f;
-
-            for (int u = -1; u < 2; u++){
-
-               for (int v = -1; v < 2; v++){
+   return result;
+}
 
-                  c = c + static_cast<double>(ker[u+1][v+1]) * static_cast<double>(pz[i + u + 1][j + v + 1][k]);
+std::vector<unsigned char> ppm_image::sobel_mask(int threshold, bool reverse) const
+{
+   std::vector<unsigned char> result(static_cast<size_t>(w) * h);
+
+   long long limit = (threshold > 0) ? static_cast<long long>(threshold) * threshold : 0;
+   unsigned char below = reverse ? 255 : 0;
+   unsigned char above = reverse ? 0 : 255;
+   const int* pixels = data();
+   unsigned char* out = result.data();
+   int width = w;
+   int height = h;
+   parallel_for(0, h, 16, [&](int first, int last) {
+      sobel_rows(pixels, width, height, first, last, [&](int i, int j, const int* squared) {
+         int s = max(squared[0], max(squared[1], squared[2]));
+         out[static_cast<size_t>(i) * width + j] = (s < limit) ? below : above;
+      });
+   });
 
-               }
-            }
+   return result;
+}
 
-            result.p[i][j][k] = int_min(m, floor(c));
-         }
-      }
-   }
+std::vector<unsigned char> ppm_image::sobel_magnitude() const
+{
+   std::vector<unsigned char> result(static_cast<size_t>(w) * h);
+
+   const int* pixels = data();
+   unsigned char* out = result.data();
+   int width = w;
+   int height = h;
+   parallel_for(0, h, 16, [&](int first, int last) {
+      sobel_rows(pixels, width, height, first, last, [&](int i, int j, const int* squared) {
+         int s = max(squared[0], max(squared[1], squared[2]));
+         out[static_cast<size_t>(i) * width + j] = (s >= 255 * 255) ? 255 : int_sqrt(s);
+      });
+   });
 
    return result;
 }
 
-ppm_image ppm_image::gaussianblur() const
+ppm_image ppm_image::sharpen() const
 {
-   ppm_image result(w, h);
-
-   // define the kernel for the gaussian blur operator
-   float ker[5][5] = {
-      {1.0f/256.0f, 4.0f/256.0f, 6.0f/256.0f, 4.0f/256.0f, 1.0f/256.0f},
-      {4.0f/256.0f, 16.0f/256.0f, 24.0f/256.0f, 16.0f/256.0f, 4.0f/256.0f},
-      {6.0f/256.0f, 24.0f/256.0f, 36.0f/256.0f, 24.0f/256.0f, 6.0f/256.0f},
-      {4.0f/256.0f, 16.0f/256.0f, 24.0f/256.0f, 16.0f/256.0f, 4.0f/256.0f},
-      {1.0f/256.0f, 4.0f/256.0f, 6.0f/256.0f, 4.0f/256.0f, 1.0f/256.0f}
+   // define the kernel for the sharpen operator
+   static const int ker[9] = {
+      0, -1, 0,
+      -1, 5, -1,
+      0, -1, 0
    };
+   static const conv_kernel kernel(3, 3, ker);
 
-   // Add zero padders to the original image
-   int*** pz = new int**[h+4];
-   for (int i = 0; i < h+4; i++){
-
-      pz[i] = new int*[w+4];
-
-      for (int j = 0; j < w+4; j++){
-
-         pz[i][j] = new int[3];
-
-         for (int k = 0; k < 3; k++){
-            if (i == 0 || j == 0 || i == 1 || j == 1 || i == h+2 || j == w+2 || i == h+3 || j == w+3){
-               pz[i][j][k] = 0;
-            }
-            else{
-               pz[i][j][k] = p[i-2][j-2][k];
-            }
-         }
-      }
-   }
-
-   // apply the kernel to the image
-   for (int i = 0; i < h; i++){
-
-      for (int j = 0; j < w; j++){
-
-         for (int k = 0; k < 3; k++){
-
-            float c = 0.0f;
-
-            for (int u = -2; u < 3; u++){
-
-               for (int v = -2; v < 3; v++){
-
-                  c = c + static_cast<double>(ker[u+2][v+2]) * static_cast<double>(pz[i + u + 2][j + v + 2][k]);
-
-               }
-            }
+   // pixels outside the image are 0 (zero padding)
+   return convolve(*this, kernel, BORDER_ZERO);
+}
 
-            result.p[i][j][k] = int_min(m, floor(c));
-         }
-      }
-   }
+ppm_image ppm_image::gaussianblur() const
+{
+   // define the kernel for the gaussian blur operator: the outer product of [1 4 6 4 1] with itself, over 256
+   static const conv_kernel kernel = conv_kernel::separable({1, 4, 6, 4, 1}, {1, 4, 6, 4, 1}, 256);
 
-   return result;
+   // pixels outside the image are 0 (zero padding)
+   return convolve(*this, kernel, BORDER_ZERO);
 }
 
 
@@ -847,16 +696,49 @@ int ppm_image::width() const
    return w;
 }
 
+int* ppm_image::data()
+{
+   return p[0][0];
+}
+
+const int* ppm_image::data() const
+{
+   return p[0][0];
+}
+
 void ppm_image::cleanup()
 {
    // clean up the memory
+   if (p == 0)
+   {
+      return;
+   }
+   size_t cells = static_cast<size_t>(w) * static_cast<size_t>(h);
+   buffer_pool& pool = buffer_pool::global();
+   pool.release(p[0][0], cells * 3 * sizeof(int));
+   pool.release(p[0], cells * sizeof(int*));
+   pool.release(p, h * sizeof(int**));
+   p = 0;
+}
+
+void ppm_image::allocate(int width, int height)
+{
+   // the pixels live in one contiguous h * w * 3 block (zero initialized); p only indexes into it.
+   // The blocks come from the buffer pool, so the temporaries of the filters reuse each other's memory
+   w = width;
+   h = height;
+   size_t cells = static_cast<size_t>(w) * static_cast<size_t>(h);
+   buffer_pool& pool = buffer_pool::global();
+   int* block = static_cast<int*>(pool.acquire(cells * 3 * sizeof(int)));
+   memset(block, 0, cells * 3 * sizeof(int));
+   int** columns = static_cast<int**>(pool.acquire(cells * sizeof(int*)));
+   p = static_cast<int***>(pool.acquire(h * sizeof(int**)));
    for (int i = 0; i < h; i++)
    {
+      p[i] = columns + static_cast<size_t>(i) * w;
       for (int j = 0; j < w; j++)
       {
-         delete[] p[i][j];
+         p[i][j] = block + (static_cast<size_t>(i) * w + j) * 3;
       }
-      delete[] p[i];
    }
-   delete[] p;
 }
\ No newline at end of file
@@ -5,6 +5,7 @@
 
 #pragma once
 #include <string>
+#include <vector>
 
 namespace agl
 {
@@ -37,7 +38,8 @@ namespace agl
      // returns true if the save is successful; false otherwise
      bool save(const std::string& filename) const;
 
-     // Returns a copy of this image resized to the given width and height
+     // Returns a copy of this image resized to the given width and height (nearest neighbour).
+     // See resample.h for filtered resizing
      ppm_image resize(int width, int height) const;
 
      // Return a copy of this image flipped around the horizontal midline
@@ -79,10 +81,17 @@ namespace agl
      // Given a threshold, return a copy of this image that detects the edges (with a specified color of edge (dark/bright))
      ppm_image sobel(int threshold, bool reverse) const;
 
+     // Same as sobel but return a single-channel w * h mask: 255 for an edge (0 if reversed), where a pixel
+     // is an edge if the gradient magnitude of any of its channels reaches the threshold
+     std::vector<unsigned char> sobel_mask(int threshold, bool reverse) const;
+
+     // Return the single-channel w * h gradient magnitude: floor(sqrt(gx^2 + gy^2)) of the strongest channel, capped at 255
+     std::vector<unsigned char> sobel_magnitude() const;
+
      // Return a copy of this image that is applied with 5*5 Gaussian smoothing
      ppm_image gaussianblur() const;
 
-     // Return a copy of this image that is sharpened
+     // Return a copy of this image that is sharpened (clamped to [0, 255])
      ppm_image sharpen() const;
 
      // Get the pixel at index (row, col)
@@ -97,13 +106,20 @@ namespace agl
      // return the height of the image
      int height() const;
 
+     // return the pixels as one contiguous row-major block of h * w * 3 channel values
+     int* data();
+     const int* data() const;
+
      // clean up the memory occupied by the object
      void cleanup();
 
    protected:
+      // allocate a zero-filled width * height image
+      void allocate(int width, int height);
+
       std::string format; // image format, e.g. "P3" by default
       int w, h; // width and height of the image
       int m; // maximum color value, e.g. "255" by default
-      int*** p; // 3D array that stores the pixels of the image. The dimension is h * w * 3 and he default value for a pixel is (0,0,0).
+      int*** p; // 3D array that stores the pixels of the image. The dimension is h * w * 3 and he default value for a pixel is (0,0,0). p[i][j] points into a single contiguous block, see data().
   };
 }
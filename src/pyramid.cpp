@@ -0,0 +1,243 @@
+#include "pyramid.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cerrno>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include "stb/stb_image_write.h"
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+using namespace agl;
+using namespace std;
+
+// a reduced level of the pyramid, stored as packed rgb bytes
+struct pyramid_level
+{
+   int w;
+   int h;
+   vector<unsigned char> rgb;
+};
+
+// read access to one level of the pyramid: either the source image or a reduced level
+class level_view
+{
+public:
+   level_view(const ppm_image& image) : _image(&image), _level(0) {}
+   level_view(const pyramid_level& level) : _image(0), _level(&level) {}
+
+   int width() const
+   {
+      return _image ? _image->width() : _level->w;
+   }
+
+   int height() const
+   {
+      return _image ? _image->height() : _level->h;
+   }
+
+   // copy the columns [x0, x1) of row i as rgb bytes
+   void copy_row(int i, int x0, int x1, unsigned char* out) const
+   {
+      if (_image)
+      {
+         const int* in = _image->data() + (static_cast<size_t>(i) * _image->width() + x0) * 3;
+         for (int k = 0; k < (x1 - x0) * 3; k++)
+         {
+            out[k] = static_cast<unsigned char>(min(255, max(0, in[k])));
+         }
+      }
+      else
+      {
+         const unsigned char* in = &_level->rgb[(static_cast<size_t>(i) * _level->w + x0) * 3];
+         copy(in, in + (x1 - x0) * 3, out);
+      }
+   }
+
+private:
+   const ppm_image* _image;
+   const pyramid_level* _level;
+};
+
+static bool make_directory(const string& path)
+{
+#ifdef _WIN32
+   int result = _mkdir(path.c_str());
+#else
+   int result = mkdir(path.c_str(), 0755);
+#endif
+   if (result != 0 && errno != EEXIST)
+   {
+      cout << "ERROR: Cannot create directory: " << path << endl << std::endl;
+      return false;
+   }
+   return true;
+}
+
+// write the rectangle [x0, x1) * [y0, y1) of a level as a png or (plain text) ppm file
+static bool write_tile(const level_view& view, int x0, int y0, int x1, int y1, const string& filename, const string& format)
+{
+   int tw = x1 - x0;
+   int th = y1 - y0;
+   vector<unsigned char> buffer(static_cast<size_t>(tw) * th * 3);
+   for (int i = 0; i < th; i++)
+   {
+      view.copy_row(y0 + i, x0, x1, &buffer[static_cast<size_t>(i) * tw * 3]);
+   }
+
+   if (format == "ppm")
+   {
+      ofstream file(filename.c_str());
+      if (!file)
+      {
+         return false;
+      }
+      file << "P3" << std::endl << tw << " " << th << std::endl << 255 << std::endl;
+      for (int i = 0; i < th; i++)
+      {
+         for (int k = 0; k < tw * 3; k++)
+         {
+            file << static_cast<int>(buffer[static_cast<size_t>(i) * tw * 3 + k]) << ((k == tw * 3 - 1) ? "\n" : " ");
+         }
+      }
+      return static_cast<bool>(file);
+   }
+   return stbi_write_png(filename.c_str(), tw, th, 3, &buffer[0], tw * 3) == 1;
+}
+
+// reduce a level by 2 in each direction with a 2x2 box filter (the last row/column is repeated
+// when the size is odd)
+static void reduce_level(const level_view& view, pyramid_level& out)
+{
+   int w = view.width();
+   int h = view.height();
+   out.w = (w + 1) / 2;
+   out.h = (h + 1) / 2;
+   out.rgb.resize(static_cast<size_t>(out.w) * out.h * 3);
+
+   parallel_for(0, out.h, 8, [&](int first, int last) {
+      vector<unsigned char> top(static_cast<size_t>(w) * 3);
+      vector<unsigned char> bottom(static_cast<size_t>(w) * 3);
+      for (int i = first; i < last; i++)
+      {
+         view.copy_row(2 * i, 0, w, &top[0]);
+         view.copy_row(min(h - 1, 2 * i + 1), 0, w, &bottom[0]);
+         unsigned char* dst = &out.rgb[static_cast<size_t>(i) * out.w * 3];
+         for (int j = 0; j < out.w; j++)
+         {
+            int left = 2 * j * 3;
+            int right = min(w - 1, 2 * j + 1) * 3;
+            for (int k = 0; k < 3; k++)
+            {
+               dst[j * 3 + k] = (top[left + k] + top[right + k] + bottom[left + k] + bottom[right + k] + 2) >> 2;
+            }
+         }
+      }
+   });
+}
+
+bool agl::save_deep_zoom(const ppm_image& image, const std::string& name, int tile_size, int overlap, const std::string& format)
+{
+   if (tile_size <= 0 || overlap < 0)
+   {
+      cout << "ERROR: The tile size has to be positive and the overlap nonnegative." << endl << std::endl;
+      return false;
+   }
+
+   // write the descriptor
+   ofstream dzi((name + ".dzi").c_str());
+   if (!dzi)
+   {
+      cout << "ERROR: Cannot write file: " << name << ".dzi" << endl << std::endl;
+      return false;
+   }
+   dzi << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>" << std::endl;
+   dzi << "<Image xmlns=\"http://schemas.microsoft.com/deepzoom/2008\" Format=\"" << format
+       << "\" Overlap=\"" << overlap << "\" TileSize=\"" << tile_size << "\">" << std::endl;
+   dzi << "  <Size Width=\"" << image.width() << "\" Height=\"" << image.height() << "\"/>" << std::endl;
+   dzi << "</Image>" << std::endl;
+   dzi.close();
+
+   string root = name + "_files";
+   if (!make_directory(root))
+   {
+      return false;
+   }
+
+   // the top level is ceil(log2(max(w, h)))
+   int top = 0;
+   while ((1 << top) < max(image.width(), image.height()))
+   {
+      top++;
+   }
+
+   bool ok = true;
+   pyramid_level current;
+   for (int level = top; level >= 0; level--)
+   {
+      level_view view = (level == top) ? level_view(image) : level_view(current);
+      ostringstream dir;
+      dir << root << "/" << level;
+      if (!make_directory(dir.str()))
+      {
+         return false;
+      }
+
+      // encode the tiles of this level in the background; on a pool worker the tasks could queue behind
+      // the caller itself, so they are encoded here instead
+      bool in_pool = thread_pool::in_worker();
+      vector<future<bool> > tiles;
+      int w = view.width();
+      int h = view.height();
+      for (int row = 0; row * tile_size < h; row++)
+      {
+         for (int col = 0; col * tile_size < w; col++)
+         {
+            int x0 = max(0, col * tile_size - overlap);
+            int y0 = max(0, row * tile_size - overlap);
+            int x1 = min(w, (col + 1) * tile_size + overlap);
+            int y1 = min(h, (row + 1) * tile_size + overlap);
+            ostringstream filename;
+            filename << dir.str() << "/" << col << "_" << row << "." << format;
+            string path = filename.str();
+            if (in_pool)
+            {
+               ok = write_tile(view, x0, y0, x1, y1, path, format) && ok;
+               continue;
+            }
+            tiles.push_back(thread_pool::global().async([=]() {
+               return write_tile(view, x0, y0, x1, y1, path, format);
+            }));
+         }
+      }
+
+      // meanwhile reduce the next level, then drop this one once its tiles are written
+      pyramid_level next;
+      if (level > 0)
+      {
+         reduce_level(view, next);
+      }
+      for (size_t t = 0; t < tiles.size(); t++)
+      {
+         if (!tiles[t].get())
+         {
+            ok = false;
+         }
+      }
+      current.rgb.swap(next.rgb);
+      current.w = next.w;
+      current.h = next.h;
+   }
+
+   if (!ok)
+   {
+      cout << "ERROR: Failed to write some tiles of " << name << endl << std::endl;
+   }
+   return ok;
+}
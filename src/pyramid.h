@@ -0,0 +1,23 @@
+//----------------------------------------
+// Image pyramid and Deep Zoom export
+// Author: Jiajie(Jason) Ma
+//----------------------------------------
+
+#pragma once
+#include <string>
+#include "ppm_image.h"
+
+namespace agl
+{
+  // Save image as a Deep Zoom (DZI) pyramid:
+  //    name.dzi                          the descriptor
+  //    name_files/<level>/<col>_<row>.png   the tiles (or .ppm if format is "ppm")
+  // Level max = ceil(log2(max(w, h))) is the full image and every level below is a 2x box-filtered
+  // reduction of the one above, down to 1x1. Tiles are tile_size pixels wide plus overlap pixels
+  // shared with each neighbour.
+  // Levels are produced one at a time: while the tiles of a level are encoded in parallel, the next
+  // level is reduced from it, so at most the image plus two levels are in memory.
+  // Called from a worker of any thread_pool, the tiles are encoded on the calling thread instead.
+  // returns true if every file was written; false otherwise
+  bool save_deep_zoom(const ppm_image& image, const std::string& name, int tile_size = 256, int overlap = 0, const std::string& format = "png");
+}
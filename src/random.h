@@ -0,0 +1,71 @@
+//----------------------------------------
+// Seedable pseudo-random number generator
+// Author: Jiajie(Jason) Ma
+//----------------------------------------
+
+#pragma once
+#include <stdint.h>
+
+namespace agl
+{
+  // xoshiro256** generator. It is small enough to keep one per thread, and two generators built
+  // from the same (seed, stream) pair always produce the same sequence, unlike rand()
+  class rng
+  {
+  public:
+     rng(uint64_t seed = 0, uint64_t stream = 0)
+     {
+        // expand the seed with splitmix64 so that nearby seeds/streams give unrelated states
+        uint64_t x = seed ^ (stream * 0xD1B54A32D192ED03ULL);
+        for (int i = 0; i < 4; i++)
+        {
+           x += 0x9E3779B97F4A7C15ULL;
+           uint64_t z = x;
+           z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+           z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+           s[i] = z ^ (z >> 31);
+        }
+     }
+
+     // return the next 64 random bits
+     uint64_t next()
+     {
+        uint64_t result = rotl(s[1] * 5, 7) * 9;
+        uint64_t t = s[1] << 17;
+        s[2] ^= s[0];
+        s[3] ^= s[1];
+        s[1] ^= s[2];
+        s[0] ^= s[3];
+        s[2] ^= t;
+        s[3] = rotl(s[3], 45);
+        return result;
+     }
+
+     // return an integer uniformly distributed in [0, n)
+     int uniform(int n)
+     {
+        // multiply-shift instead of %: no division and no modulo bias worth noticing
+        return static_cast<int>(((next() >> 32) * static_cast<uint64_t>(n)) >> 32);
+     }
+
+     // return an integer uniformly distributed in [lo, hi]
+     int uniform(int lo, int hi)
+     {
+        return lo + uniform(hi - lo + 1);
+     }
+
+     // return a float uniformly distributed in [0, 1)
+     float uniform01()
+     {
+        return static_cast<float>(next() >> 40) * (1.0f / 16777216.0f);
+     }
+
+  private:
+     static uint64_t rotl(uint64_t x, int k)
+     {
+        return (x << k) | (x >> (64 - k));
+     }
+
+     uint64_t s[4];
+  };
+}
@@ -0,0 +1,411 @@
+#include "rank_filter.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cassert>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+using namespace agl;
+using namespace std;
+
+// number of values sorted side by side by the sorting networks
+static const int kNetworkLanes = 256;
+
+// minimum number of pixels per column strip of the sliding histogram
+static const int kHistogramStrip = 128;
+
+// a compare-exchange: min goes to wire a, max to wire b
+struct comparator
+{
+   int a, b;
+};
+
+static int clamp_channel(int v)
+{
+   return min(255, max(0, v));
+}
+
+// rank of the given percentile among n values
+static int percentile_rank(float percent, int n)
+{
+   return static_cast<int>(floor(static_cast<double>(percent) / 100.0 * (n - 1) + 0.5));
+}
+
+// Batcher's odd-even merge of wires [lo, hi] (inclusive) whose two halves are sorted
+static void odd_even_merge(int lo, int hi, int r, vector<comparator>& out)
+{
+   int step = r * 2;
+   if (step < hi - lo)
+   {
+      odd_even_merge(lo, hi, step, out);
+      odd_even_merge(lo + r, hi, step, out);
+      for (int i = lo + r; i < hi - r; i += step)
+      {
+         out.push_back(comparator{i, i + r});
+      }
+   }
+   else
+   {
+      out.push_back(comparator{lo, lo + r});
+   }
+}
+
+static void odd_even_sort(int lo, int hi, vector<comparator>& out)
+{
+   if (hi - lo >= 1)
+   {
+      int mid = lo + (hi - lo) / 2;
+      odd_even_sort(lo, mid, out);
+      odd_even_sort(mid + 1, hi, out);
+      odd_even_merge(lo, hi, 1, out);
+   }
+}
+
+// Return a network that moves the value of rank k of n inputs to wire k. It is Batcher's sorting
+// network over the next power of two (the extra wires hold INT_MAX), without the comparators that
+// cannot change anything (both wires at INT_MAX, or only the max one) or do not lead to wire k.
+static vector<comparator> selection_network(int n, int k)
+{
+   int size = 1;
+   while (size < n)
+   {
+      size *= 2;
+   }
+   vector<comparator> sort;
+   odd_even_sort(0, size - 1, sort);
+
+   vector<comparator> useful;
+   vector<bool> padding(size, false);
+   for (int i = n; i < size; i++)
+   {
+      padding[i] = true;
+   }
+   for (size_t i = 0; i < sort.size(); i++)
+   {
+      comparator c = sort[i];
+      if (padding[c.b])
+      {
+         continue;
+      }
+      useful.push_back(c);
+      if (padding[c.a])
+      {
+         padding[c.a] = false;
+         padding[c.b] = true;
+      }
+   }
+
+   vector<comparator> network;
+   vector<bool> needed(size, false);
+   needed[k] = true;
+   for (size_t i = useful.size(); i-- > 0;)
+   {
+      comparator c = useful[i];
+      if (needed[c.a] || needed[c.b])
+      {
+         network.push_back(c);
+         needed[c.a] = true;
+         needed[c.b] = true;
+      }
+   }
+   reverse(network.begin(), network.end());
+   return network;
+}
+
+// value of the given rank over the window of (i, j), cut at the borders of the image
+static int window_rank(const int* pixels, int w, int h, int radius, float percent, int i, int j, int k, vector<int>& values)
+{
+   values.clear();
+   for (int y = max(0, i - radius); y <= min(h - 1, i + radius); y++)
+   {
+      for (int x = max(0, j - radius); x <= min(w - 1, j + radius); x++)
+      {
+         values.push_back(clamp_channel(pixels[(static_cast<size_t>(y) * w + x) * 3 + k]));
+      }
+   }
+   int rank = percentile_rank(percent, static_cast<int>(values.size()));
+   nth_element(values.begin(), values.begin() + rank, values.end());
+   return values[rank];
+}
+
+// median of a 3x3 window: the sorting network runs over kNetworkLanes values of a row at a time
+static void median_network(const int* pixels, int* out, int w, int h, int first, int last)
+{
+   const int radius = 1;
+   const int side = 3;
+   const int n = 9;
+   static const vector<comparator> network = selection_network(n, n / 2);
+
+   size_t stride = static_cast<size_t>(w) * 3;
+   // channels are clamped to [0, 255], so the wires are 16-bit: twice the lanes per vector register
+   vector<int16_t> wires(static_cast<size_t>(n) * kNetworkLanes);
+   vector<int> values;
+   for (int i = first; i < last; i++)
+   {
+      int* dst = out + i * stride;
+      bool inside = (i >= radius && i < h - radius);
+      int left = inside ? min(w, radius) : w;
+      int right = inside ? max(left, w - radius) : w;
+
+      // every channel of the pixels whose window is inside the image
+      for (int x0 = left * 3; x0 < right * 3; x0 += kNetworkLanes)
+      {
+         int lanes = min(kNetworkLanes, right * 3 - x0);
+         for (int u = 0; u < side; u++)
+         {
+            const int* row = pixels + (i + u - radius) * stride + x0;
+            for (int v = 0; v < side; v++)
+            {
+               const int* src = row + (v - radius) * 3;
+               int16_t* wire = &wires[static_cast<size_t>(u * side + v) * kNetworkLanes];
+               for (int l = 0; l < lanes; l++)
+               {
+                  wire[l] = static_cast<int16_t>(clamp_channel(src[l]));
+               }
+               fill(wire + lanes, wire + kNetworkLanes, static_cast<int16_t>(0));
+            }
+         }
+         // always run all the lanes in blocks of 16, loading both wires before storing, so the
+         // compiler can keep a block in vector registers (a and b never overlap)
+         for (size_t c = 0; c < network.size(); c++)
+         {
+            int16_t* a = &wires[static_cast<size_t>(network[c].a) * kNetworkLanes];
+            int16_t* b = &wires[static_cast<size_t>(network[c].b) * kNetworkLanes];
+            for (int l = 0; l < kNetworkLanes; l += 16)
+            {
+               int16_t lo[16], hi[16];
+               for (int t = 0; t < 16; t++)
+               {
+                  lo[t] = min(a[l + t], b[l + t]);
+                  hi[t] = max(a[l + t], b[l + t]);
+               }
+               for (int t = 0; t < 16; t++)
+               {
+                  a[l + t] = lo[t];
+                  b[l + t] = hi[t];
+               }
+            }
+         }
+         const int16_t* result = &wires[static_cast<size_t>(n / 2) * kNetworkLanes];
+         copy(result, result + lanes, dst + x0);
+      }
+
+      // pixels whose window is cut by the borders
+      for (int j = 0; j < w; j++)
+      {
+         if (j == left)
+         {
+            j = right;
+            if (j >= w)
+            {
+               break;
+            }
+         }
+         for (int k = 0; k < 3; k++)
+         {
+            dst[j * 3 + k] = window_rank(pixels, w, h, radius, 50.0f, i, j, k, values);
+         }
+      }
+   }
+}
+
+// Perreault-Hebert sliding histogram over the pixel columns [x0, x1), for every row.
+// Each image column keeps a 256-bin histogram of the window rows (plus a 16-bin coarse one), updated
+// by one insertion and one removal per row. Along a row, the coarse window histogram is the sum of
+// the 2r+1 column coarse histograms, updated by one addition and one subtraction per pixel; the fine
+// bins of a coarse bin are only brought up to date when the rank falls in it.
+static void rank_histogram(const int* pixels, int* out, int w, int h, int radius, float percent, int x0, int x1)
+{
+   int c0 = max(0, x0 - radius);
+   int c1 = min(w, x1 + radius);
+   int columns = c1 - c0;
+   size_t stride = static_cast<size_t>(w) * 3;
+
+   // [column][channel][bin]
+   vector<uint16_t> fine(static_cast<size_t>(columns) * 3 * 256, 0);
+   vector<uint16_t> coarse(static_cast<size_t>(columns) * 3 * 16, 0);
+   auto column_fine = [&](int x, int k) { return &fine[(static_cast<size_t>(x - c0) * 3 + k) * 256]; };
+   auto column_coarse = [&](int x, int k) { return &coarse[(static_cast<size_t>(x - c0) * 3 + k) * 16]; };
+   auto update = [&](int y, int delta) {
+      const int* row = pixels + y * stride;
+      for (int x = c0; x < c1; x++)
+      {
+         for (int k = 0; k < 3; k++)
+         {
+            int v = clamp_channel(row[x * 3 + k]);
+            column_fine(x, k)[v] += delta;
+            column_coarse(x, k)[v >> 4] += delta;
+         }
+      }
+   };
+   for (int y = 0; y < min(h, radius); y++)
+   {
+      update(y, 1);
+   }
+
+   int window_coarse[3][16];
+   int window_fine[3][16][16];
+   int updated[3][16]; // column for which window_fine[k][s] is valid
+   for (int i = 0; i < h; i++)
+   {
+      if (i + radius < h)
+      {
+         update(i + radius, 1);
+      }
+      if (i - radius - 1 >= 0)
+      {
+         update(i - radius - 1, -1);
+      }
+      int rows = min(h - 1, i + radius) - max(0, i - radius) + 1;
+
+      memset(window_coarse, 0, sizeof(window_coarse));
+      for (int x = max(0, x0 - radius); x <= min(w - 1, x0 + radius); x++)
+      {
+         for (int k = 0; k < 3; k++)
+         {
+            const uint16_t* c = column_coarse(x, k);
+            for (int s = 0; s < 16; s++)
+            {
+               window_coarse[k][s] += c[s];
+            }
+         }
+      }
+      for (int k = 0; k < 3; k++)
+      {
+         for (int s = 0; s < 16; s++)
+         {
+            updated[k][s] = INT_MIN;
+         }
+      }
+
+      int* dst = out + i * stride;
+      for (int j = x0; j < x1; j++)
+      {
+         int add = j + radius;
+         int remove = j - radius - 1;
+         if (j > x0)
+         {
+            for (int k = 0; k < 3; k++)
+            {
+               if (add < w)
+               {
+                  const uint16_t* c = column_coarse(add, k);
+                  for (int s = 0; s < 16; s++)
+                  {
+                     window_coarse[k][s] += c[s];
+                  }
+               }
+               if (remove >= 0)
+               {
+                  const uint16_t* c = column_coarse(remove, k);
+                  for (int s = 0; s < 16; s++)
+                  {
+                     window_coarse[k][s] -= c[s];
+                  }
+               }
+            }
+         }
+         int cols = min(w - 1, j + radius) - max(0, j - radius) + 1;
+         int rank = percentile_rank(percent, rows * cols);
+
+         for (int k = 0; k < 3; k++)
+         {
+            // coarse bin holding the rank
+            int s = 0;
+            int below = 0;
+            while (below + window_coarse[k][s] <= rank)
+            {
+               below += window_coarse[k][s];
+               s++;
+            }
+
+            // bring its fine bins to column j: slide them from the last update, or sum the window again
+            int* bins = window_fine[k][s];
+            if (updated[k][s] != INT_MIN && j - updated[k][s] <= radius)
+            {
+               for (int x = updated[k][s] + 1; x <= j; x++)
+               {
+                  if (x + radius < w)
+                  {
+                     const uint16_t* f = column_fine(x + radius, k) + s * 16;
+                     for (int b = 0; b < 16; b++)
+                     {
+                        bins[b] += f[b];
+                     }
+                  }
+                  if (x - radius - 1 >= 0)
+                  {
+                     const uint16_t* f = column_fine(x - radius - 1, k) + s * 16;
+                     for (int b = 0; b < 16; b++)
+                     {
+                        bins[b] -= f[b];
+                     }
+                  }
+               }
+            }
+            else
+            {
+               memset(bins, 0, sizeof(int) * 16);
+               for (int x = max(0, j - radius); x <= min(w - 1, j + radius); x++)
+               {
+                  const uint16_t* f = column_fine(x, k) + s * 16;
+                  for (int b = 0; b < 16; b++)
+                  {
+                     bins[b] += f[b];
+                  }
+               }
+            }
+            updated[k][s] = j;
+
+            int b = 0;
+            while (below + bins[b] <= rank)
+            {
+               below += bins[b];
+               b++;
+            }
+            dst[j * 3 + k] = s * 16 + b;
+         }
+      }
+   }
+}
+
+ppm_image agl::percentile(const ppm_image& image, int radius, float percent)
+{
+   assert((radius >= 0) && "The radius of a rank filter has to be nonnegative!");
+   assert((percent >= 0 && percent <= 100) && "The percentile has to be in [0, 100]!");
+
+   int w = image.width();
+   int h = image.height();
+   ppm_image result(w, h);
+   const int* pixels = image.data();
+   int* out = result.data();
+
+   if (percent == 50.0f && radius == 1)
+   {
+      parallel_for(0, h, 8, [&](int first, int last) {
+         median_network(pixels, out, w, h, first, last);
+      });
+   }
+   else
+   {
+      // column strips are independent: each one keeps the histograms of its own columns
+      int strip = max(kHistogramStrip, 4 * radius);
+      int strips = (w + strip - 1) / strip;
+      parallel_for(0, strips, 1, [&](int first, int last) {
+         for (int s = first; s < last; s++)
+         {
+            rank_histogram(pixels, out, w, h, radius, percent, s * strip, min(w, (s + 1) * strip));
+         }
+      });
+   }
+
+   return result;
+}
+
+ppm_image agl::median(const ppm_image& image, int radius)
+{
+   return percentile(image, radius, 50.0f);
+}
@@ -0,0 +1,21 @@
+//----------------------------------------
+// Median and rank filters
+// Author: Jiajie(Jason) Ma
+//----------------------------------------
+
+#pragma once
+#include "ppm_image.h"
+
+namespace agl
+{
+  // Return a copy of image where each channel of each pixel is replaced by the median of that channel
+  // over the (2*radius+1)^2 window around the pixel; pixels outside the image are ignored (the window is
+  // cut at the borders). Channels are clamped to [0, 255].
+  // The 3x3 median uses a sorting network run over whole rows at once; other windows use a sliding
+  // histogram (Perreault-Hebert), whose cost per pixel does not depend on the radius.
+  ppm_image median(const ppm_image& image, int radius);
+
+  // Same as median for the given percentile in [0, 100] (0 is the minimum, 100 the maximum):
+  // the value of rank round(percent / 100 * (n - 1)) among the n sorted values of the window
+  ppm_image percentile(const ppm_image& image, int radius, float percent);
+}
@@ -0,0 +1,105 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "render_server.h"
+#include "scene.h"
+
+using namespace agl;
+using namespace std;
+
+typedef chrono::steady_clock timer;
+
+static double seconds_since(timer::time_point start)
+{
+   return chrono::duration<double>(timer::now() - start).count();
+}
+
+// print the median, 90th percentile and maximum of times
+static void print_times(const string& name, vector<double> times)
+{
+   sort(times.begin(), times.end());
+   cout << name << ": p50 " << times[times.size() / 2] * 1e3 << "ms, p90 " << times[times.size() * 9 / 10] * 1e3
+      << "ms, max " << times.back() * 1e3 << "ms" << endl;
+}
+
+// Send a scene file to a render_daemon and write the image it returns
+// usage: render_client socket scene output [--format png|ppm|rgb] [-n repeat]
+int main(int argc, char** argv)
+{
+   if (argc < 4)
+   {
+      cout << "usage: " << argv[0] << " socket scene output [--format png|ppm|rgb] [-n repeat]" << endl;
+      return 1;
+   }
+   ImageFormat format = IMAGE_PNG;
+   int repeat = 1;
+   for (int i = 4; i < argc; i++)
+   {
+      bool valued = i + 1 < argc;
+      if (strcmp(argv[i], "--format") == 0 && valued)
+      {
+         string name = argv[++i];
+         format = name == "ppm" ? IMAGE_PPM : (name == "rgb" ? IMAGE_RGB : IMAGE_PNG);
+      }
+      else if (strcmp(argv[i], "-n") == 0 && valued)
+      {
+         repeat = max(1, atoi(argv[++i]));
+      }
+      else
+      {
+         cout << "ERROR: Unknown option: " << argv[i] << endl << endl;
+         return 1;
+      }
+   }
+
+   mapped_file scene(argv[2]);
+   if (!scene.good())
+   {
+      cout << "ERROR: Cannot read scene file: " << argv[2] << endl << endl;
+      return 1;
+   }
+   render_connection connection(argv[1]);
+   if (!connection.good())
+   {
+      cout << "ERROR: Cannot connect to " << argv[1] << endl << endl;
+      return 1;
+   }
+
+   render_reply reply;
+   vector<double> round_trip, render;
+   for (int k = 0; k < repeat; k++)
+   {
+      timer::time_point start = timer::now();
+      if (!connection.render(scene.data(), scene.size(), format, reply))
+      {
+         cout << "ERROR: The connection to " << argv[1] << " failed" << endl << endl;
+         return 1;
+      }
+      if (reply.status != RENDER_OK)
+      {
+         cout << "ERROR: Render failed (status " << reply.status << "): "
+            << string(reply.payload.begin(), reply.payload.end()) << endl << endl;
+         return 1;
+      }
+      round_trip.push_back(seconds_since(start));
+      render.push_back(reply.render_seconds);
+   }
+
+   ofstream out(argv[3], ios::binary);
+   out.write(reinterpret_cast<const char*>(reply.payload.data()), reply.payload.size());
+   if (!out)
+   {
+      cout << "ERROR: Cannot write image: " << argv[3] << endl << endl;
+      return 1;
+   }
+   cout << reply.width << "x" << reply.height << " image of " << reply.payload.size() << " bytes, "
+      << repeat << " requests" << endl;
+   print_times("round trip", round_trip);
+   print_times("server render", render);
+   return 0;
+}
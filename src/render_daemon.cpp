@@ -0,0 +1,84 @@
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include "render_server.h"
+
+using namespace agl;
+using namespace std;
+
+static render_server* running = 0;
+
+static void on_signal(int)
+{
+   if (running)
+   {
+      running->stop();
+   }
+}
+
+// Serve scene renders on a Unix domain socket until interrupted (see render_server.h)
+// usage: render_daemon socket [-j renderers] [--queue n] [--connections n] [--cache-mb n] [--deadline s] [--idle s] [--verbose]
+int main(int argc, char** argv)
+{
+   if (argc < 2)
+   {
+      cout << "usage: " << argv[0] << " socket [-j renderers] [--queue n] [--connections n] [--cache-mb n] [--deadline s] [--idle s] [--verbose]" << endl;
+      return 1;
+   }
+   server_options options = default_server_options(argv[1]);
+   for (int i = 2; i < argc; i++)
+   {
+      bool valued = i + 1 < argc;
+      if (strcmp(argv[i], "-j") == 0 && valued)
+      {
+         options.renderers = atoi(argv[++i]);
+      }
+      else if (strcmp(argv[i], "--queue") == 0 && valued)
+      {
+         options.max_waiting = atoi(argv[++i]);
+      }
+      else if (strcmp(argv[i], "--connections") == 0 && valued)
+      {
+         options.max_connections = atoi(argv[++i]);
+      }
+      else if (strcmp(argv[i], "--cache-mb") == 0 && valued)
+      {
+         options.max_cached_bytes = static_cast<size_t>(atoi(argv[++i])) << 20;
+      }
+      else if (strcmp(argv[i], "--deadline") == 0 && valued)
+      {
+         options.max_render_seconds = atof(argv[++i]);
+      }
+      else if (strcmp(argv[i], "--idle") == 0 && valued)
+      {
+         options.idle_seconds = atof(argv[++i]);
+      }
+      else if (strcmp(argv[i], "--verbose") == 0)
+      {
+         options.verbose = true;
+      }
+      else
+      {
+         cout << "ERROR: Unknown option: " << argv[i] << endl << endl;
+         return 1;
+      }
+   }
+
+   render_server server(options);
+   if (!server.good())
+   {
+      return 1;
+   }
+   running = &server;
+   signal(SIGINT, on_signal);
+   signal(SIGTERM, on_signal);
+
+   cout << "listening on " << options.socket_path << endl;
+   server.run();
+   running = 0;
+   cout << "served " << server.served() << " requests, rejected " << server.rejected() << " as busy, "
+      << server.failed() << " failed" << endl;
+   return 0;
+}
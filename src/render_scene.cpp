@@ -0,0 +1,66 @@
+#include <chrono>
+#include <iostream>
+#include <string>
+#include "canvas.h"
+#include "scene.h"
+
+using namespace agl;
+using namespace std;
+
+typedef chrono::steady_clock timer;
+
+static double seconds_since(timer::time_point start)
+{
+   return chrono::duration<double>(timer::now() - start).count();
+}
+
+// return true if name ends with suffix
+static bool ends_with(const string& name, const string& suffix)
+{
+   return name.size() >= suffix.size() && name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// Render a scene file (see scene.h) to an image: ppm if the output ends in .ppm, png otherwise
+// usage: render_scene scene output
+int main(int argc, char** argv)
+{
+   if (argc != 3)
+   {
+      cout << "usage: " << argv[0] << " scene output" << endl;
+      return 1;
+   }
+   string output = argv[2];
+
+   timer::time_point start = timer::now();
+   mapped_file scene(argv[1]);
+   int width, height;
+   if (!scene.good() || !scene_size(scene.data(), scene.size(), width, height))
+   {
+      cout << "ERROR: Cannot read scene file: " << argv[1] << endl << endl;
+      return 1;
+   }
+   double load = seconds_since(start);
+
+   start = timer::now();
+   canvas drawer(width, height);
+   string error;
+   if (!play_scene(scene.data(), scene.size(), drawer, &error))
+   {
+      cout << "ERROR: Bad scene file: " << argv[1] << ": " << error << endl << endl;
+      return 1;
+   }
+   double render = seconds_since(start);
+
+   start = timer::now();
+   bool saved = ends_with(output, ".ppm") ? drawer.image().save_ppm(output) : drawer.image().save(output);
+   if (!saved)
+   {
+      cout << "ERROR: Cannot write image: " << output << endl << endl;
+      return 1;
+   }
+   double save = seconds_since(start);
+
+   cout << width << "x" << height << " scene of " << scene.size() << " bytes: loaded in " << load << "s, rendered in "
+      << render << "s, saved in " << save << "s" << endl;
+   return 0;
+}
@@ -0,0 +1,664 @@
+#include "render_server.h"
+#include "scene.h"
+#include <cassert>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <exception>
+#include <future>
+#include <iostream>
+#include <iterator>
+#include <list>
+#include <thread>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace agl;
+using namespace std;
+
+// defined with the rest of stb_image_write (see ppm_image.cpp), whose header of this version does not
+// declare it: encode a png into memory allocated with malloc
+unsigned char* stbi_write_png_to_mem(unsigned char* pixels, int stride_bytes, int x, int y, int n, int* out_len);
+
+typedef chrono::steady_clock timer;
+
+// the first bytes of every request and reply, and the version of the protocol
+static const char kMagic[4] = {'A', 'G', 'L', 'R'};
+static const int kProtocolVersion = 1;
+
+// bytes of the fixed part of a request and of a reply
+static const int kRequestHeader = 12;
+static const int kReplyHeader = 32;
+
+// pending connections the kernel holds before run accepts them
+static const int kBacklog = 64;
+
+// a peer that hung up makes send fail with EPIPE instead of raising SIGPIPE (see no_sigpipe for the
+// systems without MSG_NOSIGNAL)
+#ifdef MSG_NOSIGNAL
+static const int kSendFlags = MSG_NOSIGNAL;
+#else
+static const int kSendFlags = 0;
+#endif
+
+static double seconds_since(timer::time_point start)
+{
+   return chrono::duration<double>(timer::now() - start).count();
+}
+
+// bytes held by the pixels of a width x height canvas (one int per channel)
+static size_t canvas_bytes(int width, int height)
+{
+   return static_cast<size_t>(width) * height * 3 * sizeof(int);
+}
+
+static void put_u32(uint8_t* out, uint32_t v)
+{
+   out[0] = v & 0xff;
+   out[1] = (v >> 8) & 0xff;
+   out[2] = (v >> 16) & 0xff;
+   out[3] = (v >> 24) & 0xff;
+}
+
+static uint32_t get_u32(const uint8_t* in)
+{
+   return in[0] | (in[1] << 8) | (in[2] << 16) | (static_cast<uint32_t>(in[3]) << 24);
+}
+
+// a time in whole microseconds, saturated to fit the reply
+static uint32_t microseconds(double seconds)
+{
+   double us = seconds * 1e6 + 0.5;
+   return us >= 4294967295.0 ? 0xffffffffu : static_cast<uint32_t>(us);
+}
+
+// read or write exactly size bytes, retrying after signals and short transfers
+// returns true if all the bytes were transferred; false if the connection failed or closed
+static bool read_full(int fd, void* data, size_t size)
+{
+   uint8_t* at = static_cast<uint8_t*>(data);
+   while (size > 0)
+   {
+      ssize_t n = read(fd, at, size);
+      if (n < 0 && errno == EINTR)
+      {
+         continue;
+      }
+      if (n <= 0)
+      {
+         return false;
+      }
+      at += n;
+      size -= n;
+   }
+   return true;
+}
+
+static bool write_full(int fd, const void* data, size_t size)
+{
+   const uint8_t* at = static_cast<const uint8_t*>(data);
+   while (size > 0)
+   {
+      ssize_t n = send(fd, at, size, kSendFlags);
+      if (n < 0 && errno == EINTR)
+      {
+         continue;
+      }
+      if (n <= 0)
+      {
+         return false;
+      }
+      at += n;
+      size -= n;
+   }
+   return true;
+}
+
+// keep a send to a peer that hung up from raising SIGPIPE where send has no flag for it
+static void no_sigpipe(int fd)
+{
+#ifdef SO_NOSIGPIPE
+   int on = 1;
+   setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#else
+   (void) fd;
+#endif
+}
+
+// make a read or send on fd that makes no progress for the given time fail, instead of blocking forever
+// (no limit if it is not positive)
+static void transfer_timeout(int fd, double seconds)
+{
+   if (seconds <= 0)
+   {
+      return;
+   }
+   timeval limit;
+   limit.tv_sec = static_cast<time_t>(seconds);
+   limit.tv_usec = static_cast<suseconds_t>((seconds - limit.tv_sec) * 1e6);
+   setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &limit, sizeof(limit));
+   setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &limit, sizeof(limit));
+}
+
+// wait until fd has something to read (a request, or the end of the connection), at most the given
+// time (no limit if it is not positive)
+// returns true if it does; false if nothing came in time
+static bool wait_readable(int fd, double seconds)
+{
+   timer::time_point start = timer::now();
+   while (true)
+   {
+      pollfd entry;
+      entry.fd = fd;
+      entry.events = POLLIN;
+      int left = seconds > 0 ? max(static_cast<int>((seconds - seconds_since(start)) * 1e3), 0) : -1;
+      int ready = poll(&entry, 1, left);
+      if (ready < 0 && errno == EINTR)
+      {
+         continue;
+      }
+      return ready != 0;
+   }
+}
+
+// fill the address of the socket at path
+// returns true if path fits in the address; false otherwise
+static bool socket_address(const string& path, sockaddr_un& address)
+{
+   memset(&address, 0, sizeof(address));
+   address.sun_family = AF_UNIX;
+   if (path.empty() || path.size() >= sizeof(address.sun_path))
+   {
+      return false;
+   }
+   memcpy(address.sun_path, path.c_str(), path.size());
+   return true;
+}
+
+// return true if nothing is at path, or a socket no server listens on (left behind by a server that did
+// not stop cleanly); false if path is another kind of file or the socket of a running server
+static bool stale_socket(const string& path, const sockaddr_un& address)
+{
+   struct stat status;
+   if (lstat(path.c_str(), &status) != 0)
+   {
+      return errno == ENOENT;
+   }
+   if (!S_ISSOCK(status.st_mode))
+   {
+      return false;
+   }
+   int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+   if (probe < 0)
+   {
+      return false;
+   }
+   bool refused = connect(probe, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 &&
+      errno == ECONNREFUSED;
+   close(probe);
+   return refused;
+}
+
+static bool send_reply(int fd, const render_reply& reply)
+{
+   uint8_t header[kReplyHeader];
+   memcpy(header, kMagic, 4);
+   header[4] = kProtocolVersion;
+   header[5] = static_cast<uint8_t>(reply.status);
+   header[6] = header[7] = 0;
+   put_u32(header + 8, reply.width);
+   put_u32(header + 12, reply.height);
+   put_u32(header + 16, microseconds(reply.queue_seconds));
+   put_u32(header + 20, microseconds(reply.render_seconds));
+   put_u32(header + 24, microseconds(reply.encode_seconds));
+   put_u32(header + 28, static_cast<uint32_t>(reply.payload.size()));
+   return write_full(fd, header, kReplyHeader) &&
+      (reply.payload.empty() || write_full(fd, reply.payload.data(), reply.payload.size()));
+}
+
+// set reply to an error with the given message
+static void fail(render_reply& reply, RenderStatus status, const string& message)
+{
+   reply.status = status;
+   reply.payload.assign(message.begin(), message.end());
+}
+
+// encode image into out in the given format; ppm is the binary (P6) form
+static bool encode(const ppm_image& image, ImageFormat format, vector<uint8_t>& out)
+{
+   int w = image.width();
+   int h = image.height();
+   size_t count = static_cast<size_t>(w) * h * 3;
+   out.clear();
+   if (format == IMAGE_PPM)
+   {
+      string header = "P6\n" + to_string(w) + " " + to_string(h) + "\n255\n";
+      out.assign(header.begin(), header.end());
+   }
+   size_t start = out.size();
+   out.resize(start + count);
+   const int* pixels = image.data();
+   for (size_t k = 0; k < count; k++)
+   {
+      out[start + k] = static_cast<uint8_t>(pixels[k]);
+   }
+   if (format != IMAGE_PNG)
+   {
+      return true;
+   }
+   int length = 0;
+   unsigned char* png = stbi_write_png_to_mem(out.data(), w * 3, w, h, 3, &length);
+   if (!png)
+   {
+      return false;
+   }
+   out.assign(png, png + length);
+   free(png);
+   return true;
+}
+
+server_options agl::default_server_options(const string& socket_path)
+{
+   server_options options;
+   options.socket_path = socket_path;
+   options.renderers = 0;
+   options.max_waiting = 64;
+   options.max_connections = 64;
+   options.max_request_bytes = 64u << 20;
+   options.max_pixels = 4096u * 4096u;
+   options.max_cached_bytes = 256u << 20;
+   options.max_render_seconds = 10;
+   options.idle_seconds = 60;
+   options.transfer_seconds = 10;
+   options.verbose = false;
+   return options;
+}
+
+render_server::render_server(const server_options& options) :
+   _options(options), _listen(-1), _pending(0), _idle_bytes(0), _served(0), _rejected(0), _failed(0)
+{
+   _wake[0] = _wake[1] = -1;
+   int renderers = options.renderers > 0 ? options.renderers : worker_count();
+   _renderers.reset(new thread_pool(renderers));
+
+   sockaddr_un address;
+   if (!socket_address(options.socket_path, address))
+   {
+      cout << "ERROR: Bad socket path: " << options.socket_path << endl << endl;
+      return;
+   }
+   if (!stale_socket(options.socket_path, address))
+   {
+      cout << "ERROR: Cannot listen on " << options.socket_path << ": the path is in use" << endl << endl;
+      return;
+   }
+   // a socket left behind by a server that did not stop cleanly would make bind fail
+   unlink(options.socket_path.c_str());
+   _listen = socket(AF_UNIX, SOCK_STREAM, 0);
+   if (_listen < 0 || bind(_listen, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+      listen(_listen, kBacklog) != 0 || pipe(_wake) != 0)
+   {
+      cout << "ERROR: Cannot listen on " << options.socket_path << ": " << strerror(errno) << endl << endl;
+      if (_listen >= 0)
+      {
+         close(_listen);
+         _listen = -1;
+      }
+      return;
+   }
+   fcntl(_wake[1], F_SETFL, O_NONBLOCK);
+}
+
+render_server::~render_server()
+{
+   if (_listen >= 0)
+   {
+      close(_listen);
+      unlink(_options.socket_path.c_str());
+   }
+   for (int k = 0; k < 2; k++)
+   {
+      if (_wake[k] >= 0)
+      {
+         close(_wake[k]);
+      }
+   }
+}
+
+bool render_server::good() const
+{
+   return _listen >= 0;
+}
+
+void render_server::run()
+{
+   assert(good() && "The server is not listening!");
+   while (true)
+   {
+      pollfd fds[2];
+      fds[0].fd = _listen;
+      fds[0].events = POLLIN;
+      fds[1].fd = _wake[0];
+      fds[1].events = POLLIN;
+      int ready = poll(fds, 2, -1);
+      if (ready < 0 && errno == EINTR)
+      {
+         continue;
+      }
+      if (ready < 0 || fds[1].revents)
+      {
+         break;
+      }
+      if (!(fds[0].revents & POLLIN))
+      {
+         continue;
+      }
+      int fd = accept(_listen, 0, 0);
+      if (fd < 0)
+      {
+         continue;
+      }
+      no_sigpipe(fd);
+      transfer_timeout(fd, _options.transfer_seconds);
+
+      unique_lock<mutex> lock(_mutex);
+      if (static_cast<int>(_connections.size()) >= _options.max_connections)
+      {
+         lock.unlock();
+         render_reply reply = {RENDER_BUSY, 0, 0, 0, 0, 0, vector<uint8_t>()};
+         fail(reply, RENDER_BUSY, "too many connections");
+         send_reply(fd, reply);
+         close(fd);
+         _rejected++;
+         continue;
+      }
+      _connections.insert(fd);
+      lock.unlock();
+      thread(&render_server::serve, this, fd).detach();
+   }
+
+   // wake the connections blocked on their clients, and wait until they are all closed
+   unique_lock<mutex> lock(_mutex);
+   for (set<int>::iterator it = _connections.begin(); it != _connections.end(); ++it)
+   {
+      shutdown(*it, SHUT_RDWR);
+   }
+   _closed.wait(lock, [this]() { return _connections.empty(); });
+}
+
+void render_server::stop()
+{
+   char byte = 0;
+   ssize_t written = write(_wake[1], &byte, 1);
+   (void) written;
+}
+
+size_t render_server::served() const
+{
+   return _served;
+}
+
+size_t render_server::rejected() const
+{
+   return _rejected;
+}
+
+size_t render_server::failed() const
+{
+   return _failed;
+}
+
+void render_server::serve(int fd)
+{
+   vector<uint8_t> scene;
+   render_reply reply;
+   uint8_t header[kRequestHeader];
+   // a client that sends nothing for idle_seconds is hung up on; one that stalls inside a request, or
+   // stops reading its reply, for transfer_seconds too (see transfer_timeout)
+   while (wait_readable(fd, _options.idle_seconds) && read_full(fd, header, kRequestHeader))
+   {
+      timer::time_point start = timer::now();
+      reply.status = RENDER_OK;
+      reply.width = reply.height = 0;
+      reply.queue_seconds = reply.render_seconds = reply.encode_seconds = 0;
+      reply.payload.clear();
+
+      ImageFormat format = static_cast<ImageFormat>(header[5]);
+      size_t size = get_u32(header + 8);
+      if (memcmp(header, kMagic, 4) != 0 || header[4] != kProtocolVersion || header[5] > IMAGE_RGB)
+      {
+         // the rest of the request cannot be found, so the connection ends here
+         fail(reply, RENDER_BAD_REQUEST, "not a render request of a supported version");
+         _failed++;
+         send_reply(fd, reply);
+         break;
+      }
+      if (size > _options.max_request_bytes)
+      {
+         fail(reply, RENDER_BAD_REQUEST, "scene of " + to_string(size) + " bytes is too large");
+         _failed++;
+         send_reply(fd, reply);
+         break;
+      }
+      scene.resize(size);
+      if (size > 0 && !read_full(fd, scene.data(), size))
+      {
+         break;
+      }
+
+      unique_lock<mutex> lock(_mutex);
+      bool busy = _pending >= _renderers->size() + _options.max_waiting;
+      if (!busy)
+      {
+         _pending++;
+      }
+      lock.unlock();
+
+      if (busy)
+      {
+         fail(reply, RENDER_BUSY, "all renderers are busy");
+         _rejected++;
+      }
+      else
+      {
+         timer::time_point queued = timer::now();
+         future<void> done = _renderers->async([&]() {
+            reply.queue_seconds = seconds_since(queued);
+            render(scene, format, reply);
+         });
+         done.get();
+         lock.lock();
+         _pending--;
+         lock.unlock();
+         if (reply.status == RENDER_OK)
+         {
+            _served++;
+         }
+         else
+         {
+            _failed++;
+         }
+      }
+
+      if (_options.verbose)
+      {
+         lock.lock();
+         cout << "request of " << size << " bytes: status " << reply.status << ", " << reply.width << "x"
+            << reply.height << ", queued " << reply.queue_seconds << "s, rendered " << reply.render_seconds
+            << "s, encoded " << reply.encode_seconds << "s, total " << seconds_since(start) << "s" << endl;
+         lock.unlock();
+      }
+      if (!send_reply(fd, reply))
+      {
+         break;
+      }
+   }
+
+   lock_guard<mutex> lock(_mutex);
+   _connections.erase(fd);
+   close(fd);
+   _closed.notify_all();
+}
+
+void render_server::render(const vector<uint8_t>& scene, ImageFormat format, render_reply& reply)
+{
+   try
+   {
+      timer::time_point start = timer::now();
+      int width, height;
+      if (!scene_size(scene.data(), scene.size(), width, height))
+      {
+         fail(reply, RENDER_BAD_REQUEST, "not a scene of a supported version");
+         return;
+      }
+      if (static_cast<size_t>(width) * height > _options.max_pixels)
+      {
+         fail(reply, RENDER_BAD_REQUEST, "canvas of " + to_string(width) + "x" + to_string(height) + " is too large");
+         return;
+      }
+      unique_ptr<canvas> drawer = acquire_canvas(width, height);
+      string error;
+      if (!play_scene(scene.data(), scene.size(), *drawer, &error, _options.max_render_seconds))
+      {
+         release_canvas(move(drawer));
+         if (_options.max_render_seconds > 0 && seconds_since(start) > _options.max_render_seconds)
+         {
+            fail(reply, RENDER_FAILED, "the scene took longer than " + to_string(_options.max_render_seconds) + " s");
+         }
+         else
+         {
+            fail(reply, RENDER_BAD_REQUEST, "bad scene: " + error);
+         }
+         return;
+      }
+      reply.width = width;
+      reply.height = height;
+      reply.render_seconds = seconds_since(start);
+
+      start = timer::now();
+      bool encoded = encode(drawer->image(), format, reply.payload);
+      release_canvas(move(drawer));
+      if (!encoded)
+      {
+         fail(reply, RENDER_FAILED, "cannot encode the image");
+         return;
+      }
+      reply.encode_seconds = seconds_since(start);
+   }
+   catch (const exception& e)
+   {
+      // most likely out of memory; the server carries on with the next request
+      fail(reply, RENDER_FAILED, string("render failed: ") + e.what());
+   }
+}
+
+unique_ptr<canvas> render_server::acquire_canvas(int width, int height)
+{
+   unique_ptr<canvas> drawer;
+   {
+      lock_guard<mutex> lock(_mutex);
+      for (list<unique_ptr<canvas> >::iterator it = _idle.begin(); it != _idle.end(); ++it)
+      {
+         if ((*it)->width() == width && (*it)->height() == height)
+         {
+            drawer = move(*it);
+            _idle.erase(it);
+            _idle_bytes -= canvas_bytes(width, height);
+            break;
+         }
+      }
+   }
+   if (!drawer)
+   {
+      return unique_ptr<canvas>(new canvas(width, height));
+   }
+   // a new canvas is black; a reused one is made so, after the lock is released so that clearing a
+   // large canvas does not hold up the other connections
+   drawer->background(0, 0, 0);
+   return drawer;
+}
+
+void render_server::release_canvas(unique_ptr<canvas> drawer)
+{
+   // the evicted canvases are freed after the lock is released
+   list<unique_ptr<canvas> > evicted;
+   lock_guard<mutex> lock(_mutex);
+   _idle.push_front(move(drawer));
+   _idle_bytes += canvas_bytes(_idle.front()->width(), _idle.front()->height());
+   while (!_idle.empty() && _idle_bytes > _options.max_cached_bytes)
+   {
+      _idle_bytes -= canvas_bytes(_idle.back()->width(), _idle.back()->height());
+      evicted.splice(evicted.end(), _idle, prev(_idle.end()));
+   }
+}
+
+render_connection::render_connection(const string& socket_path) : _fd(-1)
+{
+   sockaddr_un address;
+   if (!socket_address(socket_path, address))
+   {
+      return;
+   }
+   _fd = socket(AF_UNIX, SOCK_STREAM, 0);
+   if (_fd >= 0 && connect(_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)
+   {
+      close(_fd);
+      _fd = -1;
+   }
+   if (_fd >= 0)
+   {
+      no_sigpipe(_fd);
+   }
+}
+
+render_connection::~render_connection()
+{
+   if (_fd >= 0)
+   {
+      close(_fd);
+   }
+}
+
+bool render_connection::good() const
+{
+   return _fd >= 0;
+}
+
+bool render_connection::render(const uint8_t* scene, size_t size, ImageFormat format, render_reply& reply)
+{
+   if (_fd < 0 || size > 0xffffffffu)
+   {
+      return false;
+   }
+   uint8_t header[kRequestHeader];
+   memcpy(header, kMagic, 4);
+   header[4] = kProtocolVersion;
+   header[5] = static_cast<uint8_t>(format);
+   header[6] = header[7] = 0;
+   put_u32(header + 8, static_cast<uint32_t>(size));
+   if (!write_full(_fd, header, kRequestHeader) || (size > 0 && !write_full(_fd, scene, size)))
+   {
+      return false;
+   }
+
+   uint8_t answer[kReplyHeader];
+   if (!read_full(_fd, answer, kReplyHeader) || memcmp(answer, kMagic, 4) != 0 || answer[4] != kProtocolVersion)
+   {
+      return false;
+   }
+   reply.status = static_cast<RenderStatus>(answer[5]);
+   reply.width = get_u32(answer + 8);
+   reply.height = get_u32(answer + 12);
+   reply.queue_seconds = get_u32(answer + 16) * 1e-6;
+   reply.render_seconds = get_u32(answer + 20) * 1e-6;
+   reply.encode_seconds = get_u32(answer + 24) * 1e-6;
+   reply.payload.resize(get_u32(answer + 28));
+   return reply.payload.empty() || read_full(_fd, reply.payload.data(), reply.payload.size());
+}
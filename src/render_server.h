@@ -0,0 +1,144 @@
+//----------------------------------------
+// Render server over a Unix domain socket
+// Author: Jiajie(Jason) Ma
+//----------------------------------------
+
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <condition_variable>
+#include <mutex>
+#include <set>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "canvas.h"
+#include "parallel.h"
+
+namespace agl
+{
+  // encoding of a rendered image
+  enum ImageFormat {IMAGE_PNG, IMAGE_PPM, IMAGE_RGB};
+
+  // outcome of a request
+  enum RenderStatus {RENDER_OK, RENDER_BAD_REQUEST, RENDER_BUSY, RENDER_FAILED};
+
+  // The answer to a render request. The times are measured by the server: waiting for a free
+  // renderer, playing the scene, and encoding the image
+  struct render_reply
+  {
+     RenderStatus status;
+     int width;
+     int height;
+     double queue_seconds;
+     double render_seconds;
+     double encode_seconds;
+     std::vector<uint8_t> payload; // the encoded image, or the error message
+  };
+
+  struct server_options
+  {
+     std::string socket_path;
+     int renderers; // scenes rendered at once (0: one per hardware thread)
+     int max_waiting; // requests that may wait for a busy renderer; more are answered RENDER_BUSY
+     int max_connections; // clients connected at once; more are answered RENDER_BUSY and closed
+     size_t max_request_bytes; // largest scene accepted
+     size_t max_pixels; // largest canvas accepted
+     size_t max_cached_bytes; // pixels of the idle canvases kept for reuse; the least recently used go first
+     double max_render_seconds; // time a scene may take to play; a longer one is answered RENDER_FAILED (0: no limit)
+     double idle_seconds; // time a connection may wait for its next request before it is closed (0: no limit)
+     double transfer_seconds; // time a request or reply may stall before the connection is closed (0: no limit)
+     bool verbose; // print one line per request
+  };
+
+  // return the default options for a server listening on socket_path
+  server_options default_server_options(const std::string& socket_path);
+
+  // A long-lived renderer that answers requests on a Unix domain socket. The render threads and the
+  // canvases (reused between requests of the same size, up to max_cached_bytes) stay warm, so a request
+  // costs only playing the scene and encoding the image. Every connection is served by its own thread
+  // and may send any number of requests, each answered in order:
+  //    request: "AGLR", version (1 byte), format (1 byte), 2 zero bytes, scene size (4 bytes), scene
+  //    reply:   "AGLR", version, status (1 byte), 2 zero bytes, width, height, queue, render and
+  //             encode time in microseconds, payload size (4 bytes each), payload
+  // with every number little-endian. A scene that plays longer than max_render_seconds is answered
+  // RENDER_FAILED, and a client that goes quiet (see idle_seconds and transfer_seconds) is hung up on, so
+  // neither can hold a renderer or a connection forever. Sends never raise SIGPIPE. Not available on Windows.
+  class render_server
+  {
+  public:
+     // Listen on options.socket_path. A socket left there by a server that is gone is replaced; anything
+     // else at the path (a file, or the socket of a running server) is left alone and the server is not good
+     explicit render_server(const server_options& options);
+
+     // stop listening and remove the socket
+     virtual ~render_server();
+
+     // return true if the server is listening
+     bool good() const;
+
+     // Accept and serve connections until stop is called; returns once every connection is closed
+     void run();
+
+     // Make run return. Only writes to a pipe, so it may be called from a signal handler
+     void stop();
+
+     // return the number of requests answered, rejected as busy and failed (bad request or render)
+     size_t served() const;
+     size_t rejected() const;
+     size_t failed() const;
+
+  private:
+     render_server(const render_server&);
+     render_server& operator=(const render_server&);
+
+     // serve the requests of one connection until it closes
+     void serve(int fd);
+
+     // render scene and encode it in the given format
+     void render(const std::vector<uint8_t>& scene, ImageFormat format, render_reply& reply);
+
+     // take a canvas of the given size from the pool (or make one), and give it back
+     std::unique_ptr<canvas> acquire_canvas(int width, int height);
+     void release_canvas(std::unique_ptr<canvas> drawer);
+
+     server_options _options;
+     int _listen;
+     int _wake[2]; // stop writes to _wake[1]; run polls _wake[0]
+     std::unique_ptr<thread_pool> _renderers;
+
+     std::mutex _mutex;
+     std::condition_variable _closed;
+     std::set<int> _connections; // open client sockets
+     int _pending; // requests queued for or being rendered
+     std::list<std::unique_ptr<canvas> > _idle; // canvases kept for reuse, most recently used first
+     size_t _idle_bytes; // bytes of the pixels of _idle
+
+     std::atomic<size_t> _served;
+     std::atomic<size_t> _rejected;
+     std::atomic<size_t> _failed;
+  };
+
+  // A client connection to a render_server
+  class render_connection
+  {
+  public:
+     explicit render_connection(const std::string& socket_path);
+     virtual ~render_connection();
+
+     // return true if the connection is open
+     bool good() const;
+
+     // Send a scene and wait for the reply
+     // returns true if a reply was received (check reply.status); false if the connection failed
+     bool render(const uint8_t* scene, size_t size, ImageFormat format, render_reply& reply);
+
+  private:
+     render_connection(const render_connection&);
+     render_connection& operator=(const render_connection&);
+
+     int _fd;
+  };
+}
@@ -0,0 +1,211 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "canvas.h"
+#include "render_server.h"
+#include "scene.h"
+
+using namespace agl;
+using namespace std;
+
+static int failures = 0;
+
+// print the outcome of a test
+void report(bool passed, const std::string& name, const std::string& problem)
+{
+   if (passed)
+   {
+      cout << "ok     " << name << endl;
+   }
+   else
+   {
+      cout << "FAILED " << name << ": " << problem << endl;
+      failures++;
+   }
+}
+
+// draw a small scene onto drawer, a canvas or a scene_writer
+template <class Drawer>
+void draw_sample(Drawer& drawer)
+{
+   drawer.background(30, 60, 90);
+   drawer.color(255, 200, 0);
+   drawer.begin(TRIANGLES);
+   drawer.vertex(3, 4);
+   drawer.color(0, 100, 255);
+   drawer.vertex(60, 20);
+   drawer.vertex(15, 45);
+   drawer.end();
+   drawer.begin(CIRCLES);
+   drawer.center(40, 30);
+   drawer.radius(9);
+   drawer.end();
+}
+
+// return a raw socket connected to the server at path, to send it what render_connection would not
+int raw_connection(const string& path)
+{
+   sockaddr_un address;
+   memset(&address, 0, sizeof(address));
+   address.sun_family = AF_UNIX;
+   memcpy(address.sun_path, path.c_str(), path.size());
+   int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+   if (fd >= 0 && connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)
+   {
+      close(fd);
+      fd = -1;
+   }
+   return fd;
+}
+
+// return the reply payload as text, for the error messages
+string text(const render_reply& reply)
+{
+   return string(reply.payload.begin(), reply.payload.end());
+}
+
+// Start a render_server on a socket in /tmp, send it requests with render_connection and check the
+// replies against a direct render; the exit code is the number of failures.
+int main()
+{
+   string path = "/tmp/agl-render-test-" + to_string(getpid()) + ".sock";
+   server_options options = default_server_options(path);
+   options.renderers = 2;
+   options.max_render_seconds = 0.5;
+   options.idle_seconds = 1;
+   options.transfer_seconds = 1;
+   render_server server(options);
+   report(server.good(), "server-listens", "cannot listen on " + path);
+   if (!server.good())
+   {
+      return failures;
+   }
+   thread running(&render_server::run, &server);
+
+   canvas direct(64, 48);
+   direct.color(0, 0, 0);
+   draw_sample(direct);
+   scene_writer writer(64, 48);
+   writer.color(0, 0, 0);
+   draw_sample(writer);
+   const ppm_image& expected = direct.image();
+   vector<uint8_t> rgb(expected.data(), expected.data() + 64 * 48 * 3);
+
+   render_connection connection(path);
+   report(connection.good(), "client-connects", "cannot connect to " + path);
+   render_reply reply;
+   // the second request reuses the canvas of the first, which has to start black again
+   for (int k = 0; k < 2 && connection.good(); k++)
+   {
+      bool answered = connection.render(writer.bytes().data(), writer.bytes().size(), IMAGE_RGB, reply);
+      report(answered && reply.status == RENDER_OK && reply.width == 64 && reply.height == 48 && reply.payload == rgb,
+         k == 0 ? "render-rgb" : "render-rgb-reused", answered ? "the image differs: " + text(reply) : "no reply");
+   }
+
+   bool answered = connection.render(writer.bytes().data(), writer.bytes().size(), IMAGE_PPM, reply);
+   string header = "P6\n64 48\n255\n";
+   report(answered && reply.status == RENDER_OK && reply.payload.size() == header.size() + rgb.size() &&
+      equal(header.begin(), header.end(), reply.payload.begin()) &&
+      equal(rgb.begin(), rgb.end(), reply.payload.begin() + header.size()), "render-ppm", "bad ppm reply");
+
+   answered = connection.render(writer.bytes().data(), writer.bytes().size(), IMAGE_PNG, reply);
+   const uint8_t signature[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+   report(answered && reply.status == RENDER_OK && reply.payload.size() > 8 &&
+      memcmp(reply.payload.data(), signature, 8) == 0, "render-png", "bad png reply");
+
+   // a damaged scene is answered with an error, and the connection stays usable
+   vector<uint8_t> truncated(writer.bytes().begin(), writer.bytes().end() - 1);
+   answered = connection.render(truncated.data(), truncated.size(), IMAGE_RGB, reply);
+   report(answered && reply.status == RENDER_BAD_REQUEST && !reply.payload.empty(), "render-bad-scene",
+      answered ? "status " + to_string(reply.status) : "no reply");
+   answered = connection.render(writer.bytes().data(), writer.bytes().size(), IMAGE_RGB, reply);
+   report(answered && reply.status == RENDER_OK && reply.payload == rgb, "render-after-error", "no good reply");
+
+   // a second server may neither take over the socket of a running one nor remove other files
+   {
+      render_server second(options);
+      report(!second.good(), "socket-in-use", "a second server took over " + path);
+   }
+   string file = "/tmp/agl-render-test-" + to_string(getpid()) + ".txt";
+   ofstream(file.c_str()) << "keep" << endl;
+   {
+      render_server on_file(default_server_options(file));
+      report(!on_file.good() && ifstream(file.c_str()).good(), "socket-on-file", "a server replaced " + file);
+   }
+   remove(file.c_str());
+
+   // a scene that plays past the deadline is answered with a failure instead of holding its renderer
+   scene_writer heavy(1024, 1024);
+   heavy.begin(TRIANGLES);
+   for (int k = 0; k < 5000; k++)
+   {
+      heavy.color(k % 256, 0, 0);
+      heavy.vertex(0, 0);
+      heavy.vertex(1023, 0);
+      heavy.vertex(0, 1023);
+   }
+   heavy.end();
+   render_connection slow(path);
+   chrono::steady_clock::time_point start = chrono::steady_clock::now();
+   answered = slow.render(heavy.bytes().data(), heavy.bytes().size(), IMAGE_RGB, reply);
+   double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+   report(answered && reply.status == RENDER_FAILED && seconds < 3, "render-deadline",
+      answered ? "status " + to_string(reply.status) + " after " + to_string(seconds) + " s" : "no reply");
+
+   // a client that hangs up before its reply is sent must not take the server down with SIGPIPE
+   int hangup = raw_connection(path);
+   scene_writer large(512, 512);
+   uint8_t request[12] = {'A', 'G', 'L', 'R', 1, IMAGE_RGB, 0, 0};
+   uint32_t size = static_cast<uint32_t>(large.bytes().size());
+   for (int k = 0; k < 4; k++)
+   {
+      request[8 + k] = (size >> (8 * k)) & 0xff;
+   }
+   bool sent = hangup >= 0 && write(hangup, request, 12) == 12 &&
+      write(hangup, large.bytes().data(), size) == static_cast<ssize_t>(size);
+   if (hangup >= 0)
+   {
+      close(hangup);
+   }
+   render_connection after(path);
+   answered = after.render(writer.bytes().data(), writer.bytes().size(), IMAGE_RGB, reply);
+   report(sent && answered && reply.status == RENDER_OK && reply.payload == rgb, "render-after-hangup",
+      "no good reply after a client hung up");
+
+   // a client that stays quiet, or stops in the middle of a request, is hung up on
+   render_connection idle(path);
+   this_thread::sleep_for(chrono::milliseconds(1500));
+   answered = idle.render(writer.bytes().data(), writer.bytes().size(), IMAGE_RGB, reply);
+   report(!answered, "idle-closed", "an idle connection was still served");
+   int stalled = raw_connection(path);
+   bool closed = false;
+   if (stalled >= 0 && write(stalled, request, 4) == 4)
+   {
+      pollfd entry;
+      entry.fd = stalled;
+      entry.events = POLLIN;
+      char byte;
+      closed = poll(&entry, 1, 5000) == 1 && read(stalled, &byte, 1) == 0;
+   }
+   if (stalled >= 0)
+   {
+      close(stalled);
+   }
+   report(closed, "stalled-closed", "a connection stalled inside a request was not closed");
+
+   server.stop();
+   running.join();
+   report(server.served() == 7 && server.failed() == 2, "server-counts",
+      "served " + to_string(server.served()) + ", failed " + to_string(server.failed()));
+   return failures;
+}
@@ -0,0 +1,210 @@
+#include "resample.h"
+#include "buffer_pool.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+using namespace agl;
+using namespace std;
+
+// filter weights are fixed point with 14 fractional bits
+static const int kWeightBits = 14;
+
+// the horizontal pass keeps 7 extra fractional bits for the vertical pass
+static const int kExtraBits = 7;
+
+// weights of one direction of the resampling: output index i reads the source indices
+// index[i*taps .. i*taps+taps) (already clamped to the image) with the matching weights
+struct filter_table
+{
+   int taps;
+   vector<int> index;
+   vector<int> weight;
+};
+
+static double sinc(double x)
+{
+   if (x == 0.0)
+   {
+      return 1.0;
+   }
+   x *= M_PI;
+   return sin(x) / x;
+}
+
+// return the radius of the filter (in source pixels at scale 1)
+static double filter_support(ResampleFilter filter)
+{
+   if (filter == NEAREST)
+   {
+      return 0.5;
+   }
+   else if (filter == BILINEAR)
+   {
+      return 1.0;
+   }
+   else if (filter == BICUBIC)
+   {
+      return 2.0;
+   }
+   return 3.0;
+}
+
+static double filter_value(ResampleFilter filter, double x)
+{
+   x = fabs(x);
+   if (filter == NEAREST)
+   {
+      return (x <= 0.5) ? 1.0 : 0.0;
+   }
+   else if (filter == BILINEAR)
+   {
+      return (x < 1.0) ? 1.0 - x : 0.0;
+   }
+   else if (filter == BICUBIC)
+   {
+      // Catmull-Rom (a = -0.5)
+      if (x < 1.0)
+      {
+         return (1.5 * x - 2.5) * x * x + 1.0;
+      }
+      if (x < 2.0)
+      {
+         return ((-0.5 * x + 2.5) * x - 4.0) * x + 2.0;
+      }
+      return 0.0;
+   }
+   return (x < 3.0) ? sinc(x) * sinc(x / 3.0) : 0.0;
+}
+
+// build the weights that map in_size source pixels onto out_size output pixels
+static filter_table build_table(int in_size, int out_size, ResampleFilter filter)
+{
+   double scale = static_cast<double>(in_size) / static_cast<double>(out_size);
+   double stretch = max(1.0, scale);
+   double support = filter_support(filter) * stretch;
+
+   filter_table table;
+   table.taps = (filter == NEAREST) ? 1 : static_cast<int>(ceil(support)) * 2 + 1;
+   table.index.resize(static_cast<size_t>(out_size) * table.taps);
+   table.weight.resize(static_cast<size_t>(out_size) * table.taps);
+
+   vector<double> raw(table.taps);
+   for (int i = 0; i < out_size; i++)
+   {
+      double center = (static_cast<double>(i) + 0.5) * scale - 0.5;
+      int first = (filter == NEAREST) ? static_cast<int>(floor(center + 0.5)) : static_cast<int>(floor(center - support)) + 1;
+
+      double total = 0.0;
+      for (int t = 0; t < table.taps; t++)
+      {
+         raw[t] = (filter == NEAREST) ? 1.0 : filter_value(filter, (static_cast<double>(first + t) - center) / stretch);
+         total += raw[t];
+      }
+
+      // quantize so that the weights add up to exactly 1.0 in fixed point
+      int sum = 0;
+      int largest = 0;
+      int* index = &table.index[static_cast<size_t>(i) * table.taps];
+      int* weight = &table.weight[static_cast<size_t>(i) * table.taps];
+      for (int t = 0; t < table.taps; t++)
+      {
+         index[t] = min(in_size - 1, max(0, first + t));
+         weight[t] = static_cast<int>(floor(raw[t] / total * (1 << kWeightBits) + 0.5));
+         sum += weight[t];
+         if (weight[t] > weight[largest])
+         {
+            largest = t;
+         }
+      }
+      weight[largest] += (1 << kWeightBits) - sum;
+   }
+   return table;
+}
+
+ppm_image agl::resample(const ppm_image& image, int width, int height, ResampleFilter filter)
+{
+   // Return the original image if the inputs are not legal
+   if (width <= 0 || height <= 0)
+   {
+      std::cout << "WARNING: width and height a image is supposed to be positive!" << std::endl;
+      std::cout << width << ", " << height << " are given to resample a image and the original image is returned." << std::endl << std::endl;
+      return image;
+   }
+
+   int w = image.width();
+   int h = image.height();
+   filter_table columns = build_table(w, width, filter);
+   filter_table rows = build_table(h, height, filter);
+
+   // horizontal pass: every source row becomes a row of the new width (with extra precision)
+   pooled_array<int> middle(static_cast<size_t>(h) * width * 3);
+   const int* src = image.data();
+   parallel_for(0, h, 16, [&](int first, int last) {
+      for (int i = first; i < last; i++)
+      {
+         const int* in = src + static_cast<size_t>(i) * w * 3;
+         int* out = &middle[static_cast<size_t>(i) * width * 3];
+         for (int j = 0; j < width; j++)
+         {
+            const int* index = &columns.index[static_cast<size_t>(j) * columns.taps];
+            const int* weight = &columns.weight[static_cast<size_t>(j) * columns.taps];
+            int r = 0;
+            int g = 0;
+            int b = 0;
+            for (int t = 0; t < columns.taps; t++)
+            {
+               const int* px = in + index[t] * 3;
+               r += weight[t] * px[0];
+               g += weight[t] * px[1];
+               b += weight[t] * px[2];
+            }
+            const int round = 1 << (kWeightBits - kExtraBits - 1);
+            out[j * 3] = (r + round) >> (kWeightBits - kExtraBits);
+            out[j * 3 + 1] = (g + round) >> (kWeightBits - kExtraBits);
+            out[j * 3 + 2] = (b + round) >> (kWeightBits - kExtraBits);
+         }
+      }
+   });
+
+   // vertical pass: a weighted sum of whole rows, which the compiler turns into vector code
+   ppm_image result(width, height);
+   int* dst = result.data();
+   int n = width * 3;
+   parallel_for(0, height, 16, [&](int first, int last) {
+      vector<int> acc(n);
+      for (int i = first; i < last; i++)
+      {
+         const int* index = &rows.index[static_cast<size_t>(i) * rows.taps];
+         const int* weight = &rows.weight[static_cast<size_t>(i) * rows.taps];
+         const int round = 1 << (kWeightBits + kExtraBits - 1);
+         int* a = &acc[0];
+         for (int x = 0; x < n; x++)
+         {
+            a[x] = round;
+         }
+         for (int t = 0; t < rows.taps; t++)
+         {
+            const int* in = &middle[static_cast<size_t>(index[t]) * n];
+            int wt = weight[t];
+            if (wt == 0)
+            {
+               continue;
+            }
+            for (int x = 0; x < n; x++)
+            {
+               a[x] += wt * in[x];
+            }
+         }
+         int* out = dst + static_cast<size_t>(i) * n;
+         for (int x = 0; x < n; x++)
+         {
+            out[x] = min(255, max(0, a[x] >> (kWeightBits + kExtraBits)));
+         }
+      }
+   });
+
+   return result;
+}
@@ -0,0 +1,21 @@
+//----------------------------------------
+// Filtered image resampling
+// Author: Jiajie(Jason) Ma
+//----------------------------------------
+
+#pragma once
+#include "ppm_image.h"
+
+namespace agl
+{
+  // reconstruction filter used by resample. BILINEAR is a triangle filter, BICUBIC is Catmull-Rom
+  // and LANCZOS is the 3-lobe Lanczos window. When shrinking, the filters are widened by the scale
+  // factor so that every source pixel contributes (no aliasing from skipped pixels).
+  enum ResampleFilter {NEAREST, BILINEAR, BICUBIC, LANCZOS};
+
+  // Return a copy of image resized to (width, height) with the given filter.
+  // Pixel centers are aligned, i.e. output pixel j samples source position (j + 0.5) * w / width - 0.5.
+  // The filter weights are computed once per column and once per row, then the image is filtered
+  // with a horizontal and a vertical fixed-point pass that run in parallel over rows.
+  ppm_image resample(const ppm_image& image, int width, int height, ResampleFilter filter);
+}
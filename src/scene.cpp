@@ -0,0 +1,694 @@
+#include "scene.h"
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#ifdef _WIN32
+#include <iterator>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace agl;
+using namespace std;
+
+// the opcodes of the commands
+enum SceneOp {OP_BEGIN = 1, OP_END, OP_VERTEX, OP_CENTER, OP_ORIENTATION, OP_SIDE, OP_RADIUS, OP_ANGLE,
+   OP_POINT_SIZE, OP_POINT_SHAPE, OP_COLOR, OP_BACKGROUND, OP_BACKGROUND_CORNERS, OP_DEPTH_TEST, OP_DEPTH,
+   OP_MULTISAMPLE};
+
+static const char kMagic[] = {'A', 'G', 'L', 'S'};
+
+// limits of a playable scene, so that a bad scene cannot ask for unbounded work or memory
+static const int kMaxSide = 1 << 15;
+static const int kMaxCoordinate = 1 << 20;
+static const int kMaxRadius = 1 << 16;
+static const int kMaxSides = 1 << 16;
+static const int kMaxPointSize = 1 << 12;
+
+// canvas::end draws its primitives one at a time from the front of its lists, which is quadratic in
+// their number, so a long primitive is ended and begun again every this many vertices and centers
+static const size_t kFlush = 3 * 1024;
+
+// commands played between two looks at the clock, when playing has a time limit; the commands that draw
+// (end, background) look at it every time, and a long primitive is ended and begun again this often
+// instead of every kFlush vertices, so that the time limit is not overrun by a whole flush of drawing
+static const int kClockEvery = 64;
+
+// the vertices, centers and parameters a canvas has recorded since the last end
+struct recorded
+{
+   size_t vertices;
+   size_t centers;
+   size_t orientations;
+   size_t sides;
+   size_t radii;
+   size_t angles;
+};
+
+// return true if end can draw what is recorded for a primitive of the given type; if exact is true,
+// also that nothing is left over for the next primitive
+static bool complete(PrimitiveType type, const recorded& r, bool exact)
+{
+   if (type == LINES)
+   {
+      return r.vertices % 2 == 0;
+   }
+   if (type == TRIANGLES || type == OUTLINED_TRIANGLES)
+   {
+      return r.vertices % 3 == 0;
+   }
+   if (type == POLYGONS || type == OUTLINED_POLYGONS)
+   {
+      return exact ? (r.orientations == r.centers && r.sides == r.centers) :
+         (r.orientations >= r.centers && r.sides >= r.centers);
+   }
+   if (type == CIRCLES || type == OUTLINED_CIRCLES)
+   {
+      return exact ? r.radii == r.centers : r.radii >= r.centers;
+   }
+   if (type == SECTORS)
+   {
+      return exact ? (r.orientations == r.centers && r.angles == r.centers) :
+         (r.orientations >= r.centers && r.angles >= r.centers);
+   }
+   return true;
+}
+
+// Decodes the operands of the commands, with bounds checks
+class scene_reader
+{
+public:
+   scene_reader(const uint8_t* data, size_t size) : _p(data), _end(data + size), _bad(false)
+   {
+   }
+
+   bool bad() const
+   {
+      return _bad;
+   }
+
+   bool done() const
+   {
+      return _p == _end;
+   }
+
+   size_t offset(const uint8_t* data) const
+   {
+      return _p - data;
+   }
+
+   uint8_t byte()
+   {
+      if (_p == _end)
+      {
+         _bad = true;
+         return 0;
+      }
+      return *_p++;
+   }
+
+   uint32_t uvarint()
+   {
+      uint32_t v = 0;
+      for (int shift = 0; shift < 35; shift += 7)
+      {
+         uint8_t b = byte();
+         v |= static_cast<uint32_t>(b & 0x7f) << shift;
+         if (!(b & 0x80))
+         {
+            return v;
+         }
+      }
+      // more than 5 bytes cannot be a 32-bit value
+      _bad = true;
+      return 0;
+   }
+
+   int32_t svarint()
+   {
+      uint32_t v = uvarint();
+      return static_cast<int32_t>((v >> 1) ^ (0u - (v & 1)));
+   }
+
+   float real()
+   {
+      uint32_t bits = 0;
+      for (int k = 0; k < 4; k++)
+      {
+         bits |= static_cast<uint32_t>(byte()) << (8 * k);
+      }
+      float v;
+      memcpy(&v, &bits, sizeof(v));
+      return v;
+   }
+
+   // read the header; returns false if it is not one of a playable scene
+   bool header(int& width, int& height)
+   {
+      for (int k = 0; k < 4; k++)
+      {
+         if (byte() != static_cast<uint8_t>(kMagic[k]))
+         {
+            return false;
+         }
+      }
+      uint32_t version = uvarint();
+      uint32_t w = uvarint();
+      uint32_t h = uvarint();
+      if (_bad || version < 1 || version > static_cast<uint32_t>(SCENE_VERSION) ||
+         w < 1 || w > static_cast<uint32_t>(kMaxSide) || h < 1 || h > static_cast<uint32_t>(kMaxSide))
+      {
+         return false;
+      }
+      width = static_cast<int>(w);
+      height = static_cast<int>(h);
+      return true;
+   }
+
+private:
+   const uint8_t* _p;
+   const uint8_t* _end;
+   bool _bad;
+};
+
+scene_writer::scene_writer(int width, int height) : _x(0), _y(0)
+{
+   assert((width > 0 && width <= kMaxSide && height > 0 && height <= kMaxSide) && "The size of a scene is out of range!");
+   for (int k = 0; k < 4; k++)
+   {
+      _bytes.push_back(static_cast<uint8_t>(kMagic[k]));
+   }
+   uvarint(SCENE_VERSION);
+   uvarint(width);
+   uvarint(height);
+}
+
+void scene_writer::begin(PrimitiveType type)
+{
+   op(OP_BEGIN);
+   _bytes.push_back(static_cast<uint8_t>(type));
+}
+
+void scene_writer::end()
+{
+   op(OP_END);
+}
+
+void scene_writer::vertex(int x, int y)
+{
+   op(OP_VERTEX);
+   svarint(x - _x);
+   svarint(y - _y);
+   _x = x;
+   _y = y;
+}
+
+void scene_writer::center(int x, int y)
+{
+   op(OP_CENTER);
+   svarint(x - _x);
+   svarint(y - _y);
+   _x = x;
+   _y = y;
+}
+
+void scene_writer::orientation(int x, int y)
+{
+   op(OP_ORIENTATION);
+   svarint(x);
+   svarint(y);
+}
+
+void scene_writer::side(int n)
+{
+   op(OP_SIDE);
+   uvarint(n);
+}
+
+void scene_writer::radius(int r)
+{
+   op(OP_RADIUS);
+   uvarint(r);
+}
+
+void scene_writer::angle(float theta)
+{
+   op(OP_ANGLE);
+   real(theta);
+}
+
+void scene_writer::point_size(int size)
+{
+   op(OP_POINT_SIZE);
+   uvarint(size);
+}
+
+void scene_writer::point_shape(SplatShape shape)
+{
+   op(OP_POINT_SHAPE);
+   _bytes.push_back(static_cast<uint8_t>(shape));
+}
+
+void scene_writer::color(unsigned char r, unsigned char g, unsigned char b)
+{
+   op(OP_COLOR);
+   _bytes.push_back(r);
+   _bytes.push_back(g);
+   _bytes.push_back(b);
+}
+
+void scene_writer::background(unsigned char r, unsigned char g, unsigned char b)
+{
+   op(OP_BACKGROUND);
+   _bytes.push_back(r);
+   _bytes.push_back(g);
+   _bytes.push_back(b);
+}
+
+void scene_writer::background(ppm_pixel tl, ppm_pixel tr, ppm_pixel bl, ppm_pixel br)
+{
+   op(OP_BACKGROUND_CORNERS);
+   ppm_pixel corners[4] = {tl, tr, bl, br};
+   for (int k = 0; k < 4; k++)
+   {
+      _bytes.push_back(corners[k].r);
+      _bytes.push_back(corners[k].g);
+      _bytes.push_back(corners[k].b);
+   }
+}
+
+void scene_writer::depth_test(bool enabled)
+{
+   op(OP_DEPTH_TEST);
+   _bytes.push_back(enabled ? 1 : 0);
+}
+
+void scene_writer::depth(float z)
+{
+   op(OP_DEPTH);
+   real(z);
+}
+
+void scene_writer::multisample(int samples)
+{
+   op(OP_MULTISAMPLE);
+   uvarint(samples);
+}
+
+const std::vector<uint8_t>& scene_writer::bytes() const
+{
+   return _bytes;
+}
+
+bool scene_writer::save(const std::string& filename) const
+{
+   ofstream file(filename.c_str(), ios::binary);
+   if (!file)
+   {
+      cout << "ERROR: Cannot write scene file: " << filename << endl << endl;
+      return false;
+   }
+   file.write(reinterpret_cast<const char*>(_bytes.data()), _bytes.size());
+   return static_cast<bool>(file);
+}
+
+void scene_writer::op(int code)
+{
+   _bytes.push_back(static_cast<uint8_t>(code));
+}
+
+void scene_writer::uvarint(uint32_t v)
+{
+   while (v >= 0x80)
+   {
+      _bytes.push_back(static_cast<uint8_t>(v | 0x80));
+      v >>= 7;
+   }
+   _bytes.push_back(static_cast<uint8_t>(v));
+}
+
+void scene_writer::svarint(int32_t v)
+{
+   uvarint((static_cast<uint32_t>(v) << 1) ^ static_cast<uint32_t>(v >> 31));
+}
+
+void scene_writer::real(float v)
+{
+   uint32_t bits;
+   memcpy(&bits, &v, sizeof(bits));
+   for (int k = 0; k < 4; k++)
+   {
+      _bytes.push_back(static_cast<uint8_t>(bits >> (8 * k)));
+   }
+}
+
+bool agl::scene_size(const uint8_t* data, size_t size, int& width, int& height)
+{
+   scene_reader in(data, size);
+   return in.header(width, height);
+}
+
+bool agl::play_scene(const uint8_t* data, size_t size, canvas& drawer, std::string* error, double max_seconds)
+{
+   chrono::steady_clock::time_point start = chrono::steady_clock::now();
+   scene_reader in(data, size);
+   int width, height;
+   if (!in.header(width, height))
+   {
+      if (error)
+      {
+         *error = "not a scene of a supported version";
+      }
+      return false;
+   }
+
+   // every scene starts from the default state of a canvas
+   drawer.reset();
+
+   // what the canvas has recorded since the last end, to check that end will find what it needs
+   PrimitiveType type = UNDEFINED;
+   recorded counts = {0, 0, 0, 0, 0, 0};
+   bool depth_tested = false;
+   int samples = 1;
+   int x = 0, y = 0;
+
+   const char* problem = 0;
+   int commands = 0;
+   size_t flush = max_seconds > 0 ? kClockEvery : kFlush;
+   while (!problem && !in.done())
+   {
+      size_t at = in.offset(data);
+      uint8_t code = in.byte();
+      switch (code)
+      {
+      case OP_BEGIN:
+      {
+         uint8_t t = in.byte();
+         if (t <= UNDEFINED || t > OUTLINED_CIRCLES)
+         {
+            problem = "unknown primitive type";
+            break;
+         }
+         type = static_cast<PrimitiveType>(t);
+         drawer.begin(type);
+         break;
+      }
+      case OP_END:
+      {
+         if (type == UNDEFINED)
+         {
+            problem = "end without begin";
+            break;
+         }
+         if (!complete(type, counts, false))
+         {
+            problem = "the primitive is missing vertices or parameters";
+            break;
+         }
+         drawer.end();
+         type = UNDEFINED;
+         counts = recorded();
+         break;
+      }
+      case OP_VERTEX:
+      case OP_CENTER:
+      {
+         int64_t nx = static_cast<int64_t>(x) + in.svarint();
+         int64_t ny = static_cast<int64_t>(y) + in.svarint();
+         if (nx < -kMaxCoordinate || nx > kMaxCoordinate || ny < -kMaxCoordinate || ny > kMaxCoordinate)
+         {
+            problem = "position out of range";
+            break;
+         }
+         x = static_cast<int>(nx);
+         y = static_cast<int>(ny);
+         if (code == OP_VERTEX)
+         {
+            drawer.vertex(x, y);
+            counts.vertices++;
+         }
+         else
+         {
+            drawer.center(x, y);
+            counts.centers++;
+         }
+         break;
+      }
+      case OP_ORIENTATION:
+      {
+         int32_t ox = in.svarint();
+         int32_t oy = in.svarint();
+         if (ox < -kMaxRadius || ox > kMaxRadius || oy < -kMaxRadius || oy > kMaxRadius)
+         {
+            problem = "orientation out of range";
+            break;
+         }
+         drawer.orientation(ox, oy);
+         counts.orientations++;
+         break;
+      }
+      case OP_SIDE:
+      {
+         uint32_t n = in.uvarint();
+         if (n < 1 || n > static_cast<uint32_t>(kMaxSides))
+         {
+            problem = "number of sides out of range";
+            break;
+         }
+         drawer.side(static_cast<int>(n));
+         counts.sides++;
+         break;
+      }
+      case OP_RADIUS:
+      {
+         uint32_t r = in.uvarint();
+         if (r < 1 || r > static_cast<uint32_t>(kMaxRadius))
+         {
+            problem = "radius out of range";
+            break;
+         }
+         drawer.radius(static_cast<int>(r));
+         counts.radii++;
+         break;
+      }
+      case OP_ANGLE:
+      {
+         float theta = in.real();
+         if (!(theta > 0 && theta <= 2 * M_PI))
+         {
+            problem = "angle out of range";
+            break;
+         }
+         drawer.angle(theta);
+         counts.angles++;
+         break;
+      }
+      case OP_POINT_SIZE:
+      {
+         uint32_t s = in.uvarint();
+         if (s < 1 || s > static_cast<uint32_t>(kMaxPointSize))
+         {
+            problem = "point size out of range";
+            break;
+         }
+         drawer.point_size(static_cast<int>(s));
+         break;
+      }
+      case OP_POINT_SHAPE:
+      {
+         uint8_t shape = in.byte();
+         if (shape > GAUSSIAN)
+         {
+            problem = "unknown point shape";
+            break;
+         }
+         drawer.point_shape(static_cast<SplatShape>(shape));
+         break;
+      }
+      case OP_COLOR:
+      case OP_BACKGROUND:
+      {
+         uint8_t r = in.byte();
+         uint8_t g = in.byte();
+         uint8_t b = in.byte();
+         if (in.bad())
+         {
+            break;
+         }
+         if (code == OP_COLOR)
+         {
+            drawer.color(r, g, b);
+         }
+         else
+         {
+            drawer.background(r, g, b);
+         }
+         break;
+      }
+      case OP_BACKGROUND_CORNERS:
+      {
+         ppm_pixel corners[4];
+         for (int k = 0; k < 4; k++)
+         {
+            corners[k].r = in.byte();
+            corners[k].g = in.byte();
+            corners[k].b = in.byte();
+         }
+         if (!in.bad())
+         {
+            drawer.background(corners[0], corners[1], corners[2], corners[3]);
+         }
+         break;
+      }
+      case OP_DEPTH_TEST:
+      {
+         bool enabled = in.byte() != 0;
+         if (enabled && samples > 1)
+         {
+            problem = "a multisampled scene cannot be depth tested";
+            break;
+         }
+         drawer.depth_test(enabled);
+         depth_tested = enabled;
+         break;
+      }
+      case OP_DEPTH:
+      {
+         float z = in.real();
+         if (!(z == z))
+         {
+            problem = "depth is not a number";
+            break;
+         }
+         drawer.depth(z);
+         break;
+      }
+      case OP_MULTISAMPLE:
+      {
+         uint32_t n = in.uvarint();
+         if (n != 1 && n != 2 && n != 4 && n != 8 && n != 16)
+         {
+            problem = "the number of samples has to be 1, 2, 4, 8 or 16";
+            break;
+         }
+         if (n > 1 && depth_tested)
+         {
+            problem = "a depth tested scene cannot be multisampled";
+            break;
+         }
+         drawer.multisample(static_cast<int>(n));
+         samples = static_cast<int>(n);
+         break;
+      }
+      default:
+         problem = "unknown command";
+         break;
+      }
+      if (!problem && in.bad())
+      {
+         problem = "truncated command";
+      }
+      bool drawn = code == OP_END || code == OP_BACKGROUND || code == OP_BACKGROUND_CORNERS;
+      if (!problem && type != UNDEFINED && counts.vertices + counts.centers >= flush && complete(type, counts, true))
+      {
+         drawer.end();
+         drawer.begin(type);
+         counts = recorded();
+         drawn = true;
+      }
+      if (!problem && max_seconds > 0 && (drawn || ++commands % kClockEvery == 0) &&
+         chrono::duration<double>(chrono::steady_clock::now() - start).count() > max_seconds)
+      {
+         problem = "the scene takes longer than its time limit";
+      }
+      if (problem && error)
+      {
+         *error = string(problem) + " at byte " + to_string(at);
+      }
+   }
+
+   if (!problem && type != UNDEFINED)
+   {
+      problem = "the scene ends inside a primitive";
+      if (error)
+      {
+         *error = problem;
+      }
+   }
+   // leave the canvas ready for the next scene
+   drawer.cancel();
+   return !problem;
+}
+
+mapped_file::mapped_file(const std::string& filename) : _good(false), _data(0), _size(0)
+{
+#ifdef _WIN32
+   ifstream file(filename.c_str(), ios::binary);
+   if (!file)
+   {
+      return;
+   }
+   _copy.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+   _data = _copy.data();
+   _size = _copy.size();
+   _good = true;
+#else
+   int fd = open(filename.c_str(), O_RDONLY);
+   if (fd < 0)
+   {
+      return;
+   }
+   struct stat info;
+   if (fstat(fd, &info) == 0)
+   {
+      _size = static_cast<size_t>(info.st_size);
+      if (_size == 0)
+      {
+         _good = true;
+      }
+      else
+      {
+         void* p = mmap(0, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+         if (p != MAP_FAILED)
+         {
+            // the scene is read front to back once
+            madvise(p, _size, MADV_SEQUENTIAL);
+            _data = static_cast<const uint8_t*>(p);
+            _good = true;
+         }
+      }
+   }
+   close(fd);
+#endif
+}
+
+mapped_file::~mapped_file()
+{
+#ifndef _WIN32
+   if (_data && _size > 0)
+   {
+      munmap(const_cast<uint8_t*>(_data), _size);
+   }
+#endif
+}
+
+bool mapped_file::good() const
+{
+   return _good;
+}
+
+const uint8_t* mapped_file::data() const
+{
+   return _data;
+}
+
+size_t mapped_file::size() const
+{
+   return _size;
+}
@@ -0,0 +1,106 @@
+//----------------------------------------
+// Binary scene files
+// Author: Jiajie(Jason) Ma
+//----------------------------------------
+
+#pragma once
+#include <cstddef>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "canvas.h"
+
+namespace agl
+{
+  // A scene is the sequence of canvas calls that draws an image, stored as bytes:
+  //    "AGLS", version, width, height, then one command after another
+  // where every command is a one-byte opcode followed by its operands. Sizes, counts and radii are
+  // unsigned LEB128 varints; the positions of vertex and center are zigzag varints relative to the
+  // previous vertex or center, so neighbouring points take a byte or two each; colors are raw bytes
+  // and angles and depths are little-endian 32-bit floats. The version is raised whenever the meaning
+  // of a command changes; a reader plays every version up to its own.
+  const int SCENE_VERSION = 1;
+
+  // Records canvas calls into a scene
+  class scene_writer
+  {
+  public:
+     // a scene drawn on a width x height canvas
+     scene_writer(int width, int height);
+
+     // the canvas calls of the same names (see canvas.h)
+     void begin(PrimitiveType type);
+     void end();
+     void vertex(int x, int y);
+     void center(int x, int y);
+     void orientation(int x, int y);
+     void side(int n);
+     void radius(int r);
+     void angle(float theta);
+     void point_size(int size);
+     void point_shape(SplatShape shape);
+     void color(unsigned char r, unsigned char g, unsigned char b);
+     void background(unsigned char r, unsigned char g, unsigned char b);
+     void background(ppm_pixel tl, ppm_pixel tr, ppm_pixel bl, ppm_pixel br);
+     void depth_test(bool enabled);
+     void depth(float z);
+     void multisample(int samples);
+
+     // return the scene recorded so far
+     const std::vector<uint8_t>& bytes() const;
+
+     // save the scene to the given file
+     // returns true if the save is successful; false otherwise
+     bool save(const std::string& filename) const;
+
+  private:
+     // append an opcode, an unsigned varint, a zigzag varint or a float
+     void op(int code);
+     void uvarint(uint32_t v);
+     void svarint(int32_t v);
+     void real(float v);
+
+     std::vector<uint8_t> _bytes;
+     int _x; // previous vertex or center
+     int _y;
+  };
+
+  // Read the size of the canvas of the scene in data[0..size)
+  // returns true if data starts with a scene header of a version this reader can play; false otherwise
+  bool scene_size(const uint8_t* data, size_t size, int& width, int& height);
+
+  // Play the scene in data[0..size) onto drawer (which should be the size of the scene), decoding each
+  // command straight into the canvas call. The scene starts with multisampling and the depth test off
+  // and the default color, depth and point size, whatever drawer was used for before. The commands are
+  // checked before they are played, so a truncated or malformed scene never trips an assertion of the
+  // canvas: playing stops at the first bad command, and error (if given) says what is wrong with it.
+  // With a positive max_seconds playing also stops once it has taken longer than that; the clock is read
+  // between commands and every few primitives, so a single primitive is never cut short.
+  // returns true if the whole scene was played; false otherwise
+  bool play_scene(const uint8_t* data, size_t size, canvas& drawer, std::string* error = 0, double max_seconds = 0);
+
+  // A file mapped read-only into memory (read into memory where mapping is not available), so a scene
+  // can be played without being copied first
+  class mapped_file
+  {
+  public:
+     explicit mapped_file(const std::string& filename);
+     ~mapped_file();
+
+     // return true if the file could be opened
+     bool good() const;
+
+     // return the contents and the size of the file
+     const uint8_t* data() const;
+     size_t size() const;
+
+  private:
+     mapped_file(const mapped_file&);
+     mapped_file& operator=(const mapped_file&);
+
+     bool _good;
+     const uint8_t* _data;
+     size_t _size;
+     std::vector<uint8_t> _copy; // the contents, if the file is not mapped
+  };
+}
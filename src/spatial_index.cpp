@@ -0,0 +1,243 @@
+#include "spatial_index.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+
+using namespace agl;
+using namespace std;
+
+// queries per task of the bulk queries
+static const int kQueryGrain = 256;
+
+// twice the signed area of the triangle p, q, (x, y), in 64 bits so that large coordinates cannot overflow
+static long long cross(const point& p, const point& q, int x, int y)
+{
+   return static_cast<long long>(q.x - p.x) * (y - p.y) - static_cast<long long>(q.y - p.y) * (x - p.x);
+}
+
+// sort ids and drop the repeated ones
+static void unique_ids(vector<int>& ids)
+{
+   sort(ids.begin(), ids.end());
+   ids.erase(unique(ids.begin(), ids.end()), ids.end());
+}
+
+spatial_index::spatial_index(int width, int height, int cell_size) : _w(width), _h(height), _cell(cell_size)
+{
+   assert((width > 0 && height > 0) && "width and height of an index have to be positive!");
+   assert((cell_size > 0) && "The size of a cell has to be positive!");
+   _cells_x = (width + cell_size - 1) / cell_size;
+   _cells_y = (height + cell_size - 1) / cell_size;
+   _cells.resize(static_cast<size_t>(_cells_x) * _cells_y);
+}
+
+void spatial_index::clear()
+{
+   _entries.clear();
+   for (size_t c = 0; c < _cells.size(); c++)
+   {
+      _cells[c].clear();
+   }
+}
+
+void spatial_index::add_triangle(int id, point a, point b, point c)
+{
+   entry e;
+   e.id = id;
+   e.type = ENTRY_TRIANGLE;
+   e.v[0] = a;
+   e.v[1] = b;
+   e.v[2] = c;
+   e.box.xmin = min(a.x, min(b.x, c.x));
+   e.box.ymin = min(a.y, min(b.y, c.y));
+   e.box.xmax = max(a.x, max(b.x, c.x));
+   e.box.ymax = max(a.y, max(b.y, c.y));
+   // three collinear points are drawn as a line, and picked by their box
+   if (cross(a, b, c.x, c.y) == 0)
+   {
+      e.type = ENTRY_BOX;
+   }
+   add(e);
+}
+
+void spatial_index::add_line(int id, point a, point b)
+{
+   entry e;
+   e.id = id;
+   e.type = ENTRY_LINE;
+   e.v[0] = a;
+   e.v[1] = b;
+   e.v[2] = b;
+   e.box.xmin = min(a.x, b.x);
+   e.box.ymin = min(a.y, b.y);
+   e.box.xmax = max(a.x, b.x);
+   e.box.ymax = max(a.y, b.y);
+   add(e);
+}
+
+void spatial_index::add_box(int id, const bounds& box)
+{
+   entry e;
+   e.id = id;
+   e.type = ENTRY_BOX;
+   e.box = box;
+   add(e);
+}
+
+size_t spatial_index::size() const
+{
+   return _entries.size();
+}
+
+vector<int> spatial_index::at(int x, int y) const
+{
+   vector<int> ids;
+   if (x < 0 || x >= _w || y < 0 || y >= _h)
+   {
+      return ids;
+   }
+   const vector<int>& cell = _cells[static_cast<size_t>(y / _cell) * _cells_x + x / _cell];
+   for (size_t k = 0; k < cell.size(); k++)
+   {
+      if (contains(_entries[cell[k]], x, y))
+      {
+         ids.push_back(_entries[cell[k]].id);
+      }
+   }
+   unique_ids(ids);
+   return ids;
+}
+
+vector<vector<int> > spatial_index::at(const vector<point>& points) const
+{
+   vector<vector<int> > hits(points.size());
+   parallel_for(0, static_cast<int>(points.size()), kQueryGrain, [&](int first, int last) {
+      for (int k = first; k < last; k++)
+      {
+         hits[k] = at(points[k].x, points[k].y);
+      }
+   });
+   return hits;
+}
+
+vector<int> spatial_index::intersecting(const bounds& box) const
+{
+   vector<int> ids;
+   // only the part of box on the canvas can be picked, as at does off the canvas
+   bounds clipped = {max(0, box.xmin), max(0, box.ymin), min(_w - 1, box.xmax), min(_h - 1, box.ymax)};
+   for (int cy = clipped.ymin / _cell; clipped.ymin <= clipped.ymax && cy <= clipped.ymax / _cell; cy++)
+   {
+      for (int cx = clipped.xmin / _cell; clipped.xmin <= clipped.xmax && cx <= clipped.xmax / _cell; cx++)
+      {
+         const vector<int>& cell = _cells[static_cast<size_t>(cy) * _cells_x + cx];
+         for (size_t k = 0; k < cell.size(); k++)
+         {
+            if (overlaps(_entries[cell[k]], clipped))
+            {
+               ids.push_back(_entries[cell[k]].id);
+            }
+         }
+      }
+   }
+   unique_ids(ids);
+   return ids;
+}
+
+vector<vector<int> > spatial_index::intersecting(const vector<bounds>& boxes) const
+{
+   vector<vector<int> > hits(boxes.size());
+   parallel_for(0, static_cast<int>(boxes.size()), kQueryGrain, [&](int first, int last) {
+      for (int k = first; k < last; k++)
+      {
+         hits[k] = intersecting(boxes[k]);
+      }
+   });
+   return hits;
+}
+
+void spatial_index::add(const entry& e)
+{
+   // primitives off the canvas cannot be picked
+   int cx0 = max(0, e.box.xmin);
+   int cy0 = max(0, e.box.ymin);
+   int cx1 = min(_w - 1, e.box.xmax);
+   int cy1 = min(_h - 1, e.box.ymax);
+   if (cx0 > cx1 || cy0 > cy1)
+   {
+      return;
+   }
+   int index = static_cast<int>(_entries.size());
+   _entries.push_back(e);
+   for (int cy = cy0 / _cell; cy <= cy1 / _cell; cy++)
+   {
+      for (int cx = cx0 / _cell; cx <= cx1 / _cell; cx++)
+      {
+         _cells[static_cast<size_t>(cy) * _cells_x + cx].push_back(index);
+      }
+   }
+}
+
+bool spatial_index::contains(const entry& e, int x, int y)
+{
+   if (x < e.box.xmin || x > e.box.xmax || y < e.box.ymin || y > e.box.ymax)
+   {
+      return false;
+   }
+   if (e.type == ENTRY_TRIANGLE)
+   {
+      // inside (or on an edge) if (x, y) is on the same side of the three edges
+      long long d0 = cross(e.v[0], e.v[1], x, y);
+      long long d1 = cross(e.v[1], e.v[2], x, y);
+      long long d2 = cross(e.v[2], e.v[0], x, y);
+      return (d0 >= 0 && d1 >= 0 && d2 >= 0) || (d0 <= 0 && d1 <= 0 && d2 <= 0);
+   }
+   if (e.type == ENTRY_LINE)
+   {
+      // within a pixel of the line, measured across its major axis as the rasterizer steps it
+      long long d = cross(e.v[0], e.v[1], x, y);
+      long long major = max(abs(e.v[1].x - e.v[0].x), abs(e.v[1].y - e.v[0].y));
+      return major == 0 || 2 * abs(d) <= major;
+   }
+   return true;
+}
+
+bool spatial_index::overlaps(const entry& e, const bounds& box)
+{
+   if (box.xmax < e.box.xmin || box.xmin > e.box.xmax || box.ymax < e.box.ymin || box.ymin > e.box.ymax)
+   {
+      return false;
+   }
+   if (e.type == ENTRY_BOX)
+   {
+      return true;
+   }
+   // the boxes overlap, so the shapes are apart only if an edge of the triangle (or the line) separates
+   // them: every corner of box is strictly outside the same edge, or for a line farther than the half
+   // pixel contains allows on the same side
+   int corners[4][2] = {{box.xmin, box.ymin}, {box.xmax, box.ymin}, {box.xmin, box.ymax}, {box.xmax, box.ymax}};
+   long long orientation = cross(e.v[0], e.v[1], e.v[2].x, e.v[2].y);
+   long long major = max(abs(e.v[1].x - e.v[0].x), abs(e.v[1].y - e.v[0].y));
+   int edges = (e.type == ENTRY_TRIANGLE) ? 3 : 1;
+   for (int k = 0; k < edges; k++)
+   {
+      const point& p = e.v[k];
+      const point& q = e.v[(k + 1) % 3];
+      bool separated = true;
+      bool outside_left = true;
+      bool outside_right = true;
+      for (int c = 0; c < 4; c++)
+      {
+         long long d = cross(p, q, corners[c][0], corners[c][1]);
+         separated = separated && (orientation > 0 ? d < 0 : d > 0);
+         outside_left = outside_left && 2 * d > major;
+         outside_right = outside_right && 2 * d < -major;
+      }
+      // a line is apart from box if all the corners are on one side of it
+      if ((e.type == ENTRY_TRIANGLE && separated) || (e.type == ENTRY_LINE && (outside_left || outside_right)))
+      {
+         return false;
+      }
+   }
+   return true;
+}
@@ -0,0 +1,84 @@
+//----------------------------------------
+// Spatial index of drawn primitives
+// Author: Jiajie(Jason) Ma
+//----------------------------------------
+
+#pragma once
+#include <cstddef>
+#include <vector>
+#include "canvas.h"
+
+namespace agl
+{
+  // an axis-aligned rectangle of pixels, [xmin, xmax] * [ymin, ymax]
+  struct bounds
+  {
+     int xmin;
+     int ymin;
+     int xmax;
+     int ymax;
+  };
+
+  // The primitives drawn on a canvas with picking on (see canvas::picking), binned in a uniform grid of
+  // cell_size * cell_size cells by their bounding boxes. A query only tests the primitives of the cells
+  // it touches, so its cost depends on how crowded the queried area is, not on how many primitives
+  // were drawn. Polygons, circles and sectors are kept as the triangles they are drawn with, outlines as
+  // their edges.
+  class spatial_index
+  {
+  public:
+     spatial_index(int width, int height, int cell_size = 32);
+
+     // forget all the primitives
+     void clear();
+
+     // record a triangle, a line or a box of pixels drawn for the primitive id
+     void add_triangle(int id, point a, point b, point c);
+     void add_line(int id, point a, point b);
+     void add_box(int id, const bounds& box);
+
+     // return the number of recorded primitives (triangles, lines and boxes)
+     size_t size() const;
+
+     // Return the ids of the primitives that contain (x, y), sorted, each once
+     std::vector<int> at(int x, int y) const;
+
+     // Answer at for every point; the points are split between threads
+     std::vector<std::vector<int> > at(const std::vector<point>& points) const;
+
+     // Return the ids of the primitives that intersect the part of box on the canvas, sorted, each once
+     std::vector<int> intersecting(const bounds& box) const;
+
+     // Answer intersecting for every box; the boxes are split between threads
+     std::vector<std::vector<int> > intersecting(const std::vector<bounds>& boxes) const;
+
+  private:
+     enum EntryType {ENTRY_TRIANGLE, ENTRY_LINE, ENTRY_BOX};
+
+     // a recorded primitive
+     struct entry
+     {
+        int id;
+        EntryType type;
+        bounds box;
+        point v[3];
+     };
+
+     // add e to every cell its box touches
+     void add(const entry& e);
+
+     // return true if (x, y) is in e
+     static bool contains(const entry& e, int x, int y);
+
+     // return true if e intersects box
+     static bool overlaps(const entry& e, const bounds& box);
+
+     int _w;
+     int _h;
+     int _cell;
+     int _cells_x;
+     int _cells_y;
+     std::vector<entry> _entries;
+     std::vector<std::vector<int> > _cells; // indices of the entries whose box touches each cell
+  };
+}
@@ -0,0 +1,239 @@
+#include "splat.h"
+#include "parallel.h"
+#include "random.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+using namespace agl;
+using namespace std;
+
+// number of splats generated from one random stream
+static const int kSplatChunk = 4096;
+
+// number of image rows drawn by one task
+static const int kSplatBand = 32;
+
+// gaussian weights (fixed point, 256 = opaque) for d^2 / sigma^2 in [0, 9]
+static const int kGaussianSteps = 1024;
+
+void agl::splat_extent(SplatShape shape, int size, int& before, int& after)
+{
+   if (shape == SQUARE)
+   {
+      before = size / 2;
+      after = size - 1 - before;
+   }
+   else if (shape == DISC)
+   {
+      before = size / 2;
+      after = before;
+   }
+   else
+   {
+      // cut the gaussian at 3 sigma
+      before = (3 * size) / 4;
+      after = before;
+   }
+}
+
+bool agl::splat_covers(SplatShape shape, int size, int dx, int dy)
+{
+   int before, after;
+   splat_extent(shape, size, before, after);
+   if (dx < -before || dx > after || dy < -before || dy > after)
+   {
+      return false;
+   }
+   if (shape == DISC)
+   {
+      return 4 * (dx * dx + dy * dy) <= size * size;
+   }
+   if (shape == GAUSSIAN)
+   {
+      // every step of the table has a positive weight, so the gaussian draws up to its last step
+      float sigma = max(0.25f, static_cast<float>(size) / 4.0f);
+      float scale = static_cast<float>(kGaussianSteps) / (9.0f * sigma * sigma);
+      return static_cast<int>(static_cast<float>(dx * dx + dy * dy) * scale) <= kGaussianSteps;
+   }
+   return true;
+}
+
+// return the gaussian weight (256 = opaque) of step i of d^2 / sigma^2 in [0, 9]
+static int gaussian_weight(int i)
+{
+   double q = 9.0 * static_cast<double>(i) / static_cast<double>(kGaussianSteps);
+   return static_cast<int>(floor(256.0 * exp(-0.5 * q) + 0.5));
+}
+
+int agl::splat_weight(SplatShape shape, int size, int dx, int dy)
+{
+   if (!splat_covers(shape, size, dx, dy))
+   {
+      return 0;
+   }
+   if (shape != GAUSSIAN)
+   {
+      return 256;
+   }
+   float sigma = max(0.25f, static_cast<float>(size) / 4.0f);
+   float scale = static_cast<float>(kGaussianSteps) / (9.0f * sigma * sigma);
+   return gaussian_weight(static_cast<int>(static_cast<float>(dx * dx + dy * dy) * scale));
+}
+
+void agl::random_splats(splat* out, int n, int width, int height, int min_size, int max_size, uint64_t seed)
+{
+   int chunks = (n + kSplatChunk - 1) / kSplatChunk;
+   parallel_for(0, chunks, 1, [=](int first, int last) {
+      for (int c = first; c < last; c++)
+      {
+         // every chunk owns a stream, so the output does not depend on how chunks are scheduled
+         rng random(seed, c);
+         int end = min(n, (c + 1) * kSplatChunk);
+         for (int i = c * kSplatChunk; i < end; i++)
+         {
+            splat s;
+            s.x = random.uniform(width);
+            s.y = random.uniform(height);
+            s.size = random.uniform(min_size, max_size);
+            s.r = random.uniform(255);
+            s.g = random.uniform(255);
+            s.b = random.uniform(255);
+            out[i] = s;
+         }
+      }
+   });
+}
+
+void agl::draw_splats(ppm_image& image, const splat* splats, int n, SplatShape shape)
+{
+   int w = image.width();
+   int h = image.height();
+   int bands = (h + kSplatBand - 1) / kSplatBand;
+   if (n <= 0 || bands == 0)
+   {
+      return;
+   }
+
+   // bucket the splats by the row bands they touch (counting sort keeps submission order)
+   vector<int> offsets(bands + 1, 0);
+   for (int i = 0; i < n; i++)
+   {
+      int before, after;
+      splat_extent(shape, splats[i].size, before, after);
+      int top = max(0, splats[i].y - before);
+      int bottom = min(h - 1, splats[i].y + after);
+      for (int b = top / kSplatBand; top <= bottom && b <= bottom / kSplatBand; b++)
+      {
+         offsets[b + 1]++;
+      }
+   }
+   for (int b = 0; b < bands; b++)
+   {
+      offsets[b + 1] += offsets[b];
+   }
+   vector<int> order(offsets[bands]);
+   vector<int> fill(offsets.begin(), offsets.end() - 1);
+   for (int i = 0; i < n; i++)
+   {
+      int before, after;
+      splat_extent(shape, splats[i].size, before, after);
+      int top = max(0, splats[i].y - before);
+      int bottom = min(h - 1, splats[i].y + after);
+      for (int b = top / kSplatBand; top <= bottom && b <= bottom / kSplatBand; b++)
+      {
+         order[fill[b]++] = i;
+      }
+   }
+
+   vector<int> gaussian;
+   if (shape == GAUSSIAN)
+   {
+      gaussian.resize(kGaussianSteps + 1);
+      for (int i = 0; i <= kGaussianSteps; i++)
+      {
+         gaussian[i] = gaussian_weight(i);
+      }
+   }
+
+   int* pixels = image.data();
+   parallel_for(0, bands, 1, [&](int first, int last) {
+      for (int b = first; b < last; b++)
+      {
+         int band_top = b * kSplatBand;
+         int band_bottom = min(h, band_top + kSplatBand) - 1;
+         for (int k = offsets[b]; k < offsets[b + 1]; k++)
+         {
+            const splat& s = splats[order[k]];
+            int before, after;
+            splat_extent(shape, s.size, before, after);
+            int top = max(band_top, s.y - before);
+            int bottom = min(band_bottom, s.y + after);
+            int left = max(0, s.x - before);
+            int right = min(w - 1, s.x + after);
+            if (left > right)
+            {
+               continue;
+            }
+
+            if (shape == SQUARE)
+            {
+               for (int i = top; i <= bottom; i++)
+               {
+                  int* px = pixels + (static_cast<size_t>(i) * w + left) * 3;
+                  for (int j = left; j <= right; j++, px += 3)
+                  {
+                     px[0] = s.r;
+                     px[1] = s.g;
+                     px[2] = s.b;
+                  }
+               }
+            }
+            else if (shape == DISC)
+            {
+               // (dx, dy) is inside if it is within size/2 of the center
+               int r2 = s.size * s.size;
+               for (int i = top; i <= bottom; i++)
+               {
+                  int dy = i - s.y;
+                  int* px = pixels + (static_cast<size_t>(i) * w + left) * 3;
+                  for (int j = left; j <= right; j++, px += 3)
+                  {
+                     int dx = j - s.x;
+                     if (4 * (dx * dx + dy * dy) <= r2)
+                     {
+                        px[0] = s.r;
+                        px[1] = s.g;
+                        px[2] = s.b;
+                     }
+                  }
+               }
+            }
+            else
+            {
+               // weight = exp(-d^2 / (2 sigma^2)) with sigma = size/4, looked up by d^2 / sigma^2
+               float sigma = max(0.25f, static_cast<float>(s.size) / 4.0f);
+               float scale = static_cast<float>(kGaussianSteps) / (9.0f * sigma * sigma);
+               for (int i = top; i <= bottom; i++)
+               {
+                  int dy = i - s.y;
+                  int* px = pixels + (static_cast<size_t>(i) * w + left) * 3;
+                  for (int j = left; j <= right; j++, px += 3)
+                  {
+                     int dx = j - s.x;
+                     int step = static_cast<int>(static_cast<float>(dx * dx + dy * dy) * scale);
+                     if (step > kGaussianSteps)
+                     {
+                        continue;
+                     }
+                     int a = gaussian[step];
+                     px[0] += ((s.r - px[0]) * a) >> 8;
+                     px[1] += ((s.g - px[1]) * a) >> 8;
+                     px[2] += ((s.b - px[2]) * a) >> 8;
+                  }
+               }
+            }
+         }
+      }
+   });
+}
@@ -0,0 +1,47 @@
+//----------------------------------------
+// Point splats
+// Author: Jiajie(Jason) Ma
+//----------------------------------------
+
+#pragma once
+#include <stdint.h>
+#include "ppm_image.h"
+
+namespace agl
+{
+  // footprint of a splat: a size * size square, a disc of diameter size, or a gaussian
+  // blob (sigma = size/4) that is blended into the image instead of overwriting it
+  enum SplatShape {SQUARE, DISC, GAUSSIAN};
+
+  // a point with a footprint, centered at column x and row y
+  struct splat
+  {
+     int x;
+     int y;
+     int size;
+     unsigned char r;
+     unsigned char g;
+     unsigned char b;
+  };
+
+  // return the number of rows/columns a splat of the given size and shape covers before and after its center
+  void splat_extent(SplatShape shape, int size, int& before, int& after);
+
+  // return true if a splat of the given shape and size draws the pixel (dx, dy) away from its center
+  // (the test draw_splats applies; the pixels of the extent a disc or gaussian leaves alone are false)
+  bool splat_covers(SplatShape shape, int size, int dx, int dy);
+
+  // Return the weight (out of 256) with which a splat of the given shape and size draws the pixel (dx, dy)
+  // away from its center: 256 where a square or disc covers it, the falloff of a gaussian, 0 where it
+  // leaves the pixel alone. draw_splats turns a channel p into p + (((c - p) * weight) >> 8)
+  int splat_weight(SplatShape shape, int size, int dx, int dy);
+
+  // Fill out[0..n) with splats whose centers are uniform over a width * height image, whose sizes are
+  // uniform in [min_size, max_size] and whose colors are uniform in [0, 254].
+  // The result only depends on seed, not on the number of threads used to generate it.
+  void random_splats(splat* out, int n, int width, int height, int min_size, int max_size, uint64_t seed);
+
+  // Draw n splats onto image in submission order. Rows are split into bands that are drawn in
+  // parallel, so overlapping splats still end up in the same order as a serial loop.
+  void draw_splats(ppm_image& image, const splat* splats, int n, SplatShape shape);
+}
@@ -0,0 +1,319 @@
+#include "tiled_image.h"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+using namespace agl;
+using namespace std;
+
+// move the position of f to a (possibly > 2GB) byte offset
+static bool seek_to(FILE* f, unsigned long long offset)
+{
+#ifdef _WIN32
+   return _fseeki64(f, static_cast<__int64>(offset), SEEK_SET) == 0;
+#else
+   return fseeko(f, static_cast<off_t>(offset), SEEK_SET) == 0;
+#endif
+}
+
+// append the decimal digits of v (0..255) to out
+static char* append_channel(char* out, int v)
+{
+   if (v >= 100)
+   {
+      *out++ = '0' + v / 100;
+   }
+   if (v >= 10)
+   {
+      *out++ = '0' + (v / 10) % 10;
+   }
+   *out++ = '0' + v % 10;
+   return out;
+}
+
+tiled_image::tiled_image(int width, int height, int tile_size, size_t cache_bytes, const std::string& scratch)
+{
+   assert(width > 0 && height > 0 && "width and height of a tiled image have to be positive!");
+   assert(tile_size > 0 && "The size of a tile has to be positive!");
+
+   _w = width;
+   _h = height;
+   _tile = tile_size;
+   _tx = (width + tile_size - 1) / tile_size;
+   _ty = (height + tile_size - 1) / tile_size;
+   _tile_bytes = static_cast<size_t>(tile_size) * tile_size * 3;
+   _capacity = max(static_cast<size_t>(2), cache_bytes / _tile_bytes);
+   _last = -1;
+   _background.r = 0;
+   _background.g = 0;
+   _background.b = 0;
+   _page_ins = 0;
+   _page_outs = 0;
+   _page_errors = 0;
+
+   tile_state state;
+   state.slot = -1;
+   state.on_disk = false;
+   state.dirty = false;
+   _tiles.assign(static_cast<size_t>(_tx) * _ty, state);
+
+   _scratch_path = scratch;
+   _scratch = scratch.empty() ? tmpfile() : fopen(scratch.c_str(), "w+b");
+   if (_scratch == 0)
+   {
+      cout << "ERROR: Cannot create the scratch file for a tiled image: " << scratch << endl << std::endl;
+   }
+}
+
+tiled_image::~tiled_image()
+{
+   if (_scratch != 0)
+   {
+      fclose(_scratch);
+      if (!_scratch_path.empty())
+      {
+         remove(_scratch_path.c_str());
+      }
+   }
+}
+
+int tiled_image::width() const
+{
+   return _w;
+}
+
+int tiled_image::height() const
+{
+   return _h;
+}
+
+int tiled_image::tile_size() const
+{
+   return _tile;
+}
+
+int tiled_image::tiles_x() const
+{
+   return _tx;
+}
+
+int tiled_image::tiles_y() const
+{
+   return _ty;
+}
+
+long tiled_image::page_ins() const
+{
+   return _page_ins;
+}
+
+long tiled_image::page_outs() const
+{
+   return _page_outs;
+}
+
+long tiled_image::page_errors() const
+{
+   return _page_errors;
+}
+
+ppm_pixel tiled_image::get(int row, int col)
+{
+   // test the legality of the inputs
+   assert(row >= 0 && row < _h);
+   assert(col >= 0 && col < _w);
+
+   const unsigned char* px = tile((row / _tile) * _tx + col / _tile, false) + ((row % _tile) * _tile + col % _tile) * 3;
+   ppm_pixel pixel;
+   pixel.r = px[0];
+   pixel.g = px[1];
+   pixel.b = px[2];
+   return pixel;
+}
+
+void tiled_image::set(int row, int col, const ppm_pixel& c)
+{
+   // test the legality of the inputs
+   assert(row >= 0 && row < _h);
+   assert(col >= 0 && col < _w);
+
+   unsigned char* px = tile((row / _tile) * _tx + col / _tile, true) + ((row % _tile) * _tile + col % _tile) * 3;
+   px[0] = c.r;
+   px[1] = c.g;
+   px[2] = c.b;
+}
+
+void tiled_image::fill(const ppm_pixel& c)
+{
+   // forget everything that was paged out: every tile is the background again
+   _background = c;
+   for (size_t t = 0; t < _tiles.size(); t++)
+   {
+      _tiles[t].on_disk = false;
+      if (_tiles[t].slot >= 0)
+      {
+         unsigned char* px = &_slots[_tiles[t].slot][0];
+         for (size_t k = 0; k < _tile_bytes; k += 3)
+         {
+            px[k] = c.r;
+            px[k + 1] = c.g;
+            px[k + 2] = c.b;
+         }
+         _tiles[t].dirty = false;
+      }
+   }
+}
+
+void tiled_image::read_tile(int tx, int ty, ppm_image& image)
+{
+   assert(image.width() == _tile && image.height() == _tile);
+   const unsigned char* px = tile(ty * _tx + tx, false);
+   int* out = image.data();
+   for (size_t k = 0; k < _tile_bytes; k++)
+   {
+      out[k] = px[k];
+   }
+}
+
+void tiled_image::write_tile(int tx, int ty, const ppm_image& image)
+{
+   assert(image.width() == _tile && image.height() == _tile);
+   unsigned char* px = tile(ty * _tx + tx, true);
+   const int* in = image.data();
+   for (size_t k = 0; k < _tile_bytes; k++)
+   {
+      px[k] = static_cast<unsigned char>(min(255, max(0, in[k])));
+   }
+}
+
+bool tiled_image::save_ppm(const std::string& filename)
+{
+   ofstream file(filename.c_str(), ios::binary);
+   if (!file)
+   {
+      cout << "ERROR: Cannot save file: " << filename << endl << std::endl;
+      return false;
+   }
+
+   // write the format, width, height, and maximum color value of the image
+   file << "P3" << std::endl;
+   file << _w << " ";
+   file << _h << std::endl;
+   file << 255 << std::endl;
+
+   // gather one row of tiles at a time (each tile is paged in once), then print its rows
+   vector<unsigned char> band(static_cast<size_t>(_w) * _tile * 3);
+   vector<char> line(static_cast<size_t>(_w) * 3 * 4);
+   for (int ty = 0; ty < _ty; ty++)
+   {
+      int rows = min(_tile, _h - ty * _tile);
+      for (int tx = 0; tx < _tx; tx++)
+      {
+         int cols = min(_tile, _w - tx * _tile);
+         const unsigned char* px = tile(ty * _tx + tx, false);
+         for (int i = 0; i < rows; i++)
+         {
+            memcpy(&band[(static_cast<size_t>(i) * _w + tx * _tile) * 3], px + static_cast<size_t>(i) * _tile * 3, cols * 3);
+         }
+      }
+      for (int i = 0; i < rows; i++)
+      {
+         const unsigned char* px = &band[static_cast<size_t>(i) * _w * 3];
+         char* out = &line[0];
+         for (int k = 0; k < _w * 3; k++)
+         {
+            out = append_channel(out, px[k]);
+            *out++ = (k == _w * 3 - 1) ? '\n' : ' ';
+         }
+         file.write(&line[0], out - &line[0]);
+      }
+   }
+   return static_cast<bool>(file);
+}
+
+unsigned char* tiled_image::tile(int t, bool dirty)
+{
+   tile_state& state = _tiles[t];
+   if (state.slot < 0)
+   {
+      int slot;
+      if (_slots.size() < _capacity)
+      {
+         _slots.push_back(vector<unsigned char>(_tile_bytes));
+         slot = static_cast<int>(_slots.size()) - 1;
+      }
+      else
+      {
+         slot = evict();
+      }
+
+      unsigned char* px = &_slots[slot][0];
+      bool read = state.on_disk && _scratch != 0 && seek_to(_scratch, static_cast<unsigned long long>(t) * _tile_bytes)
+          && fread(px, 1, _tile_bytes, _scratch) == _tile_bytes;
+      if (read)
+      {
+         _page_ins++;
+      }
+      else
+      {
+         if (state.on_disk)
+         {
+            cout << "ERROR: Cannot read a tile from the scratch file; it is refilled with the background." << endl << std::endl;
+            state.on_disk = false;
+            _page_errors++;
+         }
+         for (size_t k = 0; k < _tile_bytes; k += 3)
+         {
+            px[k] = _background.r;
+            px[k + 1] = _background.g;
+            px[k + 2] = _background.b;
+         }
+      }
+      state.slot = slot;
+      state.dirty = false;
+      _lru.push_front(t);
+      state.lru = _lru.begin();
+   }
+   else if (t != _last)
+   {
+      _lru.splice(_lru.begin(), _lru, state.lru);
+   }
+
+   _last = t;
+   if (dirty)
+   {
+      state.dirty = true;
+   }
+   return &_slots[state.slot][0];
+}
+
+int tiled_image::evict()
+{
+   int t = _lru.back();
+   _lru.pop_back();
+   tile_state& state = _tiles[t];
+   if (state.dirty)
+   {
+      if (_scratch != 0 && seek_to(_scratch, static_cast<unsigned long long>(t) * _tile_bytes)
+          && fwrite(&_slots[state.slot][0], 1, _tile_bytes, _scratch) == _tile_bytes)
+      {
+         state.on_disk = true;
+         _page_outs++;
+      }
+      else
+      {
+         cout << "ERROR: Cannot write a tile to the scratch file; its contents are lost." << endl << std::endl;
+         _page_errors++;
+      }
+   }
+   int slot = state.slot;
+   state.slot = -1;
+   state.dirty = false;
+   if (_last == t)
+   {
+      _last = -1;
+   }
+   return slot;
+}
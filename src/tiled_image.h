@@ -0,0 +1,97 @@
+//----------------------------------------
+// Out-of-core tiled image
+// Author: Jiajie(Jason) Ma
+//----------------------------------------
+
+#pragma once
+#include <cstdio>
+#include <list>
+#include <string>
+#include <vector>
+#include "ppm_image.h"
+
+namespace agl
+{
+  // An RGB image split into tile_size * tile_size tiles. Only the most recently used tiles are kept
+  // in memory (up to cache_bytes); cold tiles are written to a scratch file and read back when they
+  // are accessed again. Tiles that were never drawn on take no space at all: they are recorded as
+  // the current background color. Not thread safe.
+  class tiled_image
+  {
+  public:
+     // the scratch file is a temporary file unless a path is given (it is removed in the destructor)
+     tiled_image(int width, int height, int tile_size = 256, size_t cache_bytes = 256 << 20, const std::string& scratch = "");
+     virtual ~tiled_image();
+
+     // return the width of this image
+     int width() const;
+
+     // return the height of the image
+     int height() const;
+
+     // return the size of a tile
+     int tile_size() const;
+
+     // return the number of tiles in a row/column
+     int tiles_x() const;
+     int tiles_y() const;
+
+     // Get the pixel at index (row, col)
+     ppm_pixel get(int row, int col);
+
+     // Set the pixel at index (row, col)
+     void set(int row, int col, const ppm_pixel& c);
+
+     // Fill the whole image with the given color. Nothing is written to the scratch file
+     void fill(const ppm_pixel& c);
+
+     // Copy tile (tx, ty) into image, which must be tile_size * tile_size
+     void read_tile(int tx, int ty, ppm_image& image);
+
+     // Copy image (tile_size * tile_size) back into tile (tx, ty)
+     void write_tile(int tx, int ty, const ppm_image& image);
+
+     // save the given filename in ppm file format, streaming one row of tiles at a time
+     // (the output is the same as ppm_image::save_ppm). returns true if the save is successful
+     bool save_ppm(const std::string& filename);
+
+     // number of tiles read from / written to the scratch file so far
+     long page_ins() const;
+     long page_outs() const;
+
+     // number of tiles that could not be read from or written to the scratch file (their contents
+     // were lost; each failure is also reported on cout)
+     long page_errors() const;
+
+  private:
+     tiled_image(const tiled_image&) = delete;
+     tiled_image& operator=(const tiled_image&) = delete;
+
+     // return the rgb bytes of tile t, paging it in if needed. dirty marks it as modified
+     unsigned char* tile(int t, bool dirty);
+
+     // write the least recently used tile to the scratch file (if modified) and return its free slot
+     int evict();
+
+     struct tile_state
+     {
+        int slot; // index of the cache slot holding the tile, or -1
+        bool on_disk; // true if the scratch file holds the latest contents of a non-resident tile
+        bool dirty; // true if the resident copy differs from the scratch file
+        std::list<int>::iterator lru; // position in _lru while resident
+     };
+
+     int _w, _h, _tile;
+     int _tx, _ty;
+     size_t _tile_bytes;
+     std::vector<tile_state> _tiles;
+     std::vector<std::vector<unsigned char> > _slots; // cached tiles
+     size_t _capacity; // maximum number of cached tiles
+     std::list<int> _lru; // resident tiles, most recently used first
+     int _last; // most recently used tile, to skip the list update for consecutive accesses
+     ppm_pixel _background; // contents of tiles that were never drawn on
+     std::string _scratch_path;
+     FILE* _scratch;
+     long _page_ins, _page_outs, _page_errors;
+  };
+}
@@ -0,0 +1,299 @@
+#include "video_sink.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <iostream>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+using namespace agl;
+using namespace std;
+
+static const char kFrameTag[] = "FRAME\n";
+
+// a piece of a frame to write
+struct chunk
+{
+   const void* data;
+   size_t size;
+};
+
+// write the n chunks in order, retrying after short writes and interruptions
+static bool write_chunks(int fd, chunk* chunks, int n)
+{
+#ifdef _WIN32
+   for (int c = 0; c < n; c++)
+   {
+      const char* p = static_cast<const char*>(chunks[c].data);
+      size_t left = chunks[c].size;
+      while (left > 0)
+      {
+         int written = _write(fd, p, static_cast<unsigned int>(min(left, static_cast<size_t>(1 << 30))));
+         if (written <= 0)
+         {
+            return false;
+         }
+         p += written;
+         left -= written;
+      }
+   }
+   return true;
+#else
+   iovec iov[4];
+   assert(n <= 4);
+   for (int c = 0; c < n; c++)
+   {
+      iov[c].iov_base = const_cast<void*>(chunks[c].data);
+      iov[c].iov_len = chunks[c].size;
+   }
+   iovec* next = iov;
+   while (n > 0)
+   {
+      ssize_t written = writev(fd, next, n);
+      if (written < 0)
+      {
+         if (errno == EINTR)
+         {
+            continue;
+         }
+         return false;
+      }
+      // skip the chunks that were written completely, then the written part of the next one
+      size_t done = static_cast<size_t>(written);
+      while (n > 0 && done >= next->iov_len)
+      {
+         done -= next->iov_len;
+         next++;
+         n--;
+      }
+      if (n > 0)
+      {
+         next->iov_base = static_cast<char*>(next->iov_base) + done;
+         next->iov_len -= done;
+      }
+   }
+   return true;
+#endif
+}
+
+static inline int clamp_channel(int v)
+{
+   return min(255, max(0, v));
+}
+
+// BT.601 limited range: Y in [16, 235], computed in 8.8 fixed point
+static void luma_row(const int* rgb, int w, unsigned char* y)
+{
+   for (int j = 0; j < w; j++)
+   {
+      int r = clamp_channel(rgb[j * 3]);
+      int g = clamp_channel(rgb[j * 3 + 1]);
+      int b = clamp_channel(rgb[j * 3 + 2]);
+      y[j] = static_cast<unsigned char>(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+   }
+}
+
+// U and V in [16, 240] of the 2x2 blocks of rows a and b (the last column is repeated if w is odd)
+static void chroma_row(const int* a, const int* b, int w, unsigned char* u, unsigned char* v)
+{
+   // the bias keeps the sums positive, so the shift rounds the same way for every value
+   const int bias = (128 << 10) + 512;
+   int pairs = w / 2;
+   for (int j = 0; j < pairs; j++)
+   {
+      const int* pa = a + j * 6;
+      const int* pb = b + j * 6;
+      int r = clamp_channel(pa[0]) + clamp_channel(pa[3]) + clamp_channel(pb[0]) + clamp_channel(pb[3]);
+      int g = clamp_channel(pa[1]) + clamp_channel(pa[4]) + clamp_channel(pb[1]) + clamp_channel(pb[4]);
+      int bl = clamp_channel(pa[2]) + clamp_channel(pa[5]) + clamp_channel(pb[2]) + clamp_channel(pb[5]);
+      u[j] = static_cast<unsigned char>((-38 * r - 74 * g + 112 * bl + bias) >> 10);
+      v[j] = static_cast<unsigned char>((112 * r - 94 * g - 18 * bl + bias) >> 10);
+   }
+   if (w % 2 == 1)
+   {
+      const int* pa = a + pairs * 6;
+      const int* pb = b + pairs * 6;
+      int r = 2 * (clamp_channel(pa[0]) + clamp_channel(pb[0]));
+      int g = 2 * (clamp_channel(pa[1]) + clamp_channel(pb[1]));
+      int bl = 2 * (clamp_channel(pa[2]) + clamp_channel(pb[2]));
+      u[pairs] = static_cast<unsigned char>((-38 * r - 74 * g + 112 * bl + bias) >> 10);
+      v[pairs] = static_cast<unsigned char>((112 * r - 94 * g - 18 * bl + bias) >> 10);
+   }
+}
+
+video_sink::video_sink(int fd, int width, int height, VideoFormat format, int fps) : _fd(fd), _owned(false)
+{
+   open(width, height, format, fps);
+}
+
+video_sink::video_sink(const std::string& filename, int width, int height, VideoFormat format, int fps) : _owned(true)
+{
+#ifdef _WIN32
+   _fd = _open(filename.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, 0644);
+#else
+   _fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+#endif
+   if (_fd < 0)
+   {
+      cout << "ERROR: Cannot open video output: " << filename << endl << endl;
+   }
+   open(width, height, format, fps);
+}
+
+video_sink::~video_sink()
+{
+   if (_owned && _fd >= 0)
+   {
+#ifdef _WIN32
+      _close(_fd);
+#else
+      close(_fd);
+#endif
+   }
+}
+
+void video_sink::open(int width, int height, VideoFormat format, int fps)
+{
+   assert((width > 0 && height > 0) && "The size of a video has to be positive!");
+   assert((fps > 0) && "The frame rate has to be positive!");
+   _good = (_fd >= 0);
+   _w = width;
+   _h = height;
+   _format = format;
+   _converted = false;
+   _frames = 0;
+   _bytes = 0;
+
+   size_t pixels = static_cast<size_t>(width) * height;
+   if (format == VIDEO_Y4M)
+   {
+      char header[128];
+      snprintf(header, sizeof(header), "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", width, height, fps);
+      _header = header;
+      size_t chroma = static_cast<size_t>((width + 1) / 2) * ((height + 1) / 2);
+      _buffer.resize(pixels + 2 * chroma);
+   }
+   else
+   {
+      _buffer.resize(pixels * 3);
+   }
+}
+
+bool video_sink::good() const
+{
+   return _good;
+}
+
+void video_sink::convert(const ppm_image& image, int first, int last)
+{
+   int w = _w;
+   int h = _h;
+   const int* pixels = image.data();
+   unsigned char* out = _buffer.data();
+   if (_format == VIDEO_RGB)
+   {
+      parallel_for(first, last, 16, [&](int begin, int end) {
+         size_t x0 = static_cast<size_t>(begin) * w * 3;
+         size_t x1 = static_cast<size_t>(end) * w * 3;
+         for (size_t x = x0; x < x1; x++)
+         {
+            out[x] = static_cast<unsigned char>(clamp_channel(pixels[x]));
+         }
+      });
+      return;
+   }
+
+   // luma of the rows, then the chroma of every pair of rows that contains one of them
+   parallel_for(first, last, 16, [&](int begin, int end) {
+      for (int i = begin; i < end; i++)
+      {
+         luma_row(pixels + static_cast<size_t>(i) * w * 3, w, out + static_cast<size_t>(i) * w);
+      }
+   });
+   int cw = (w + 1) / 2;
+   size_t chroma = static_cast<size_t>(cw) * ((h + 1) / 2);
+   unsigned char* u = out + static_cast<size_t>(w) * h;
+   unsigned char* v = u + chroma;
+   parallel_for(first / 2, (last + 1) / 2, 8, [&](int begin, int end) {
+      for (int c = begin; c < end; c++)
+      {
+         const int* a = pixels + static_cast<size_t>(2 * c) * w * 3;
+         const int* b = pixels + static_cast<size_t>(min(h - 1, 2 * c + 1)) * w * 3;
+         chroma_row(a, b, w, u + static_cast<size_t>(c) * cw, v + static_cast<size_t>(c) * cw);
+      }
+   });
+}
+
+bool video_sink::flush()
+{
+   if (!_good)
+   {
+      return false;
+   }
+   chunk chunks[3];
+   int n = 0;
+   if (_frames == 0 && !_header.empty())
+   {
+      chunks[n].data = _header.data();
+      chunks[n++].size = _header.size();
+   }
+   if (_format == VIDEO_Y4M)
+   {
+      chunks[n].data = kFrameTag;
+      chunks[n++].size = sizeof(kFrameTag) - 1;
+   }
+   chunks[n].data = _buffer.data();
+   chunks[n++].size = _buffer.size();
+
+   if (!write_chunks(_fd, chunks, n))
+   {
+      cout << "ERROR: Cannot write video frame " << _frames << endl << endl;
+      _good = false;
+      return false;
+   }
+   for (int c = 0; c < n; c++)
+   {
+      _bytes += chunks[c].size;
+   }
+   _frames++;
+   return true;
+}
+
+bool video_sink::write(const ppm_image& image)
+{
+   frame_info info = {_frames, true, 0, _h};
+   _converted = false;
+   return write(info, image);
+}
+
+bool video_sink::write(const frame_info& info, const ppm_image& image)
+{
+   assert((image.width() == _w && image.height() == _h) && "The frame has to be the size of the video!");
+   if (!_converted)
+   {
+      convert(image, 0, _h);
+   }
+   else if (info.changed)
+   {
+      convert(image, max(0, info.first_row), min(_h, info.last_row));
+   }
+   _converted = true;
+   return flush();
+}
+
+int video_sink::frames() const
+{
+   return _frames;
+}
+
+long long video_sink::bytes() const
+{
+   return _bytes;
+}
@@ -0,0 +1,68 @@
+//----------------------------------------
+// Raw video output
+// Author: Jiajie(Jason) Ma
+//----------------------------------------
+
+#pragma once
+#include <string>
+#include <vector>
+#include "animation.h"
+#include "ppm_image.h"
+
+namespace agl
+{
+  // VIDEO_RGB: packed 8-bit rgb frames with no header (ffmpeg -f rawvideo -pix_fmt rgb24)
+  // VIDEO_Y4M: a YUV4MPEG2 stream of BT.601 limited-range 4:2:0 frames (ffmpeg -i -)
+  enum VideoFormat {VIDEO_RGB, VIDEO_Y4M};
+
+  // Streams frames of a fixed size to a file, a named pipe or a file descriptor without compressing
+  // them. Every frame is converted into a buffer allocated once and written with a single writev.
+  // Not thread safe.
+  class video_sink
+  {
+  public:
+     // write to an open file descriptor (e.g. 1 for stdout); it is not closed by the sink
+     video_sink(int fd, int width, int height, VideoFormat format = VIDEO_Y4M, int fps = 30);
+
+     // write to the given file or named pipe (opening a pipe waits for its reader)
+     video_sink(const std::string& filename, int width, int height, VideoFormat format = VIDEO_Y4M, int fps = 30);
+
+     // closes the output if the sink opened it
+     virtual ~video_sink();
+
+     // return true if the output is open and every write so far succeeded
+     bool good() const;
+
+     // Append a frame (same size as the sink). returns true if the write is successful
+     bool write(const ppm_image& image);
+
+     // Append a frame of an animation: only the rows info reports as changed since the previous
+     // frame written to this sink are converted again. Can be used directly as animation encoder
+     bool write(const frame_info& info, const ppm_image& image);
+
+     // return the number of frames and bytes written so far
+     int frames() const;
+     long long bytes() const;
+
+  private:
+     void open(int width, int height, VideoFormat format, int fps);
+
+     // convert the rows [first, last) of image into _buffer
+     void convert(const ppm_image& image, int first, int last);
+
+     // write the header (once) and the frame in _buffer
+     bool flush();
+
+     int _fd;
+     bool _owned; // the sink opened _fd
+     bool _good;
+     int _w;
+     int _h;
+     VideoFormat _format;
+     std::string _header; // stream header, written before the first frame
+     std::vector<unsigned char> _buffer; // the converted frame (rgb, or the Y, U and V planes)
+     bool _converted; // _buffer holds the previous frame
+     int _frames;
+     long long _bytes;
+  };
+}